@@ -0,0 +1,270 @@
+/******************************************************************************
+ * @file bench_kernels.h
+ * @brief Hot-path kernels shared by the host and on-target benchmarks
+ *
+ * @details Each kernel is one iteration of a hot-path operation of the firmware.
+ *          The kernel bodies are static inline so that every benchmark driver
+ *          can instantiate its own copy of the loop around them: the host
+ *          benchmark (host/bench) builds one copy, the on-target benchmark
+ *          builds one placed in IRAM and one placed in flash.
+ *
+ *          Adding a kernel:
+ *          1. Add whatever state it needs to bench_state_t and prepare it in
+ *             bench_state_init()
+ *          2. Write bench_kernel_<name>() below; it must return a value that
+ *             depends on the work done so the compiler cannot drop it
+ *          3. Add X(<name>) to BENCH_KERNELS
+ *          4. Refresh the stored baseline (see README)
+ *
+ ******************************************************************************/
+
+#ifndef BENCH_KERNELS_H
+#define BENCH_KERNELS_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "load_gen_core.h"
+#include "deferred_log_ring.h"
+#include "deferred_log_fmt.h"
+#include "flight_recorder_ring.h"
+#include "esp_now_peer_table.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Number of peers used by the multi-peer kernels (matches ESP_NOW_COMM_MAX_PEERS) */
+#define BENCH_NUM_PEERS 20
+
+/* Length of the sender sequences replayed by the peer lookup kernels; must be a power of two */
+#define BENCH_PEER_SENDERS 64
+
+/* List of all kernels, in report order */
+#define BENCH_KERNELS(X)        \
+    X(mac_format)               \
+    X(hist_record)              \
+    X(hist_percentile)          \
+    X(sched_next_20_peers)      \
+    X(dlog_ring_put)            \
+    X(fr_ring_record)           \
+    X(peer_find_1)              \
+    X(peer_find_20)             \
+    X(peer_find_miss_20)        \
+    X(peer_find_mostly_miss_20) \
+    X(peer_scan_20)             \
+    X(peer_scan_miss_20)        \
+    X(peer_lru_64)
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Peer slot of the linear scan the peer table replaced, kept as the reference of peer_scan_*
+ */
+typedef struct
+{
+    uint8_t       mac_addr[6];
+    _Atomic bool  in_use;
+} bench_peer_slot_t;
+
+/**
+ * @brief State shared by all kernels
+ */
+typedef struct
+{
+    uint8_t    mac[6];          /* MAC address formatted by mac_format */
+    char       text[32];        /* Output buffer of mac_format */
+    lg_hist_t  hist;            /* Histogram written by hist_record */
+    lg_hist_t  hist_full;       /* Pre-filled histogram read by hist_percentile */
+    lg_config_t sched_cfg;      /* Traffic shape of sched_next_20_peers */
+    lg_sched_t sched;           /* Scheduler driven by sched_next_20_peers */
+    uint64_t   sched_now_us;    /* Simulated clock of sched_next_20_peers */
+    dlog_ring_t dlog_ring;      /* Ring written by dlog_ring_put */
+    fr_ring_t  fr_ring;         /* Ring written by fr_ring_record */
+    peer_table_t peers_1;       /* Table holding one peer (peer_find_1) */
+    peer_table_t peers_20;      /* Table holding BENCH_NUM_PEERS peers (peer_find_*_20) */
+    bench_peer_slot_t peer_slots[BENCH_NUM_PEERS];              /* Same peers for peer_scan_* */
+    uint8_t    senders_hit[BENCH_PEER_SENDERS][6];              /* Round robin over the 20 peers */
+    uint8_t    senders_miss[BENCH_PEER_SENDERS][6];             /* Unknown senders only */
+    uint8_t    senders_mostly_miss[BENCH_PEER_SENDERS][6];      /* One peer in 8 frames, unknown senders otherwise */
+    peer_table_t peers_lru;     /* BENCH_PEER_SENDERS logical peers, BENCH_NUM_PEERS of them registered (peer_lru_64) */
+} bench_state_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Prepare the state used by all kernels
+ *
+ * @param[out] st State to initialize
+ */
+void bench_state_init(bench_state_t *st);
+
+/**
+ * @brief Format a MAC address the way the ESP-NOW callbacks log it
+ */
+static inline uint32_t bench_kernel_mac_format(bench_state_t *st, uint32_t i)
+{
+    st->mac[5] = (uint8_t)i;
+    int n = snprintf(st->text, sizeof(st->text), "%02x:%02x:%02x:%02x:%02x:%02x",
+                     st->mac[0], st->mac[1], st->mac[2], st->mac[3], st->mac[4], st->mac[5]);
+    return (uint32_t)n + (uint8_t)st->text[16];
+}
+
+/**
+ * @brief Record one latency sample (values spread over 0..65535 us)
+ */
+static inline uint32_t bench_kernel_hist_record(bench_state_t *st, uint32_t i)
+{
+    lg_hist_record(&st->hist, (i * 2654435761u) >> 16);
+    return st->hist.count;
+}
+
+/**
+ * @brief Compute the p99 of a histogram holding 10000 samples
+ */
+static inline uint32_t bench_kernel_hist_percentile(bench_state_t *st, uint32_t i)
+{
+    (void)i;
+    return lg_hist_percentile(&st->hist_full, 99);
+}
+
+/**
+ * @brief Advance a 20-peer / 50 Hz schedule by 1 ms and drain the due frames
+ */
+static inline uint32_t bench_kernel_sched_next_20_peers(bench_state_t *st, uint32_t i)
+{
+    (void)i;
+    lg_frame_t frame;
+    uint32_t frames = 0;
+
+    st->sched_now_us += 1000u;
+    while (lg_sched_next(&st->sched, st->sched_now_us, &frame))
+    {
+        frames += frame.len;
+    }
+    if (lg_sched_done(&st->sched, st->sched_now_us))
+    {
+        /* Restart the (long) schedule so the kernel never runs out of work */
+        st->sched_now_us = 0;
+        lg_sched_init(&st->sched, &st->sched_cfg, 0);
+    }
+    return frames;
+}
+
+/**
+ * @brief Store the ESP-NOW receive message (7 args) in a deferred log ring,
+ *        the hot-path replacement of mac_format + printing; drained every 16 records
+ */
+static inline uint32_t bench_kernel_dlog_ring_put(bench_state_t *st, uint32_t i)
+{
+    const uint32_t args[7] = { i, st->mac[0], st->mac[1], st->mac[2], st->mac[3], st->mac[4], st->mac[5] };
+    uint32_t ok = dlog_ring_put(&st->dlog_ring, i, DLOG_ESPNOW_RECV, args, 7) ? 1u : 0u;
+    if ((i & 15u) == 15u)
+    {
+        /* Stand-in for the consumer task: release the slots without formatting */
+        atomic_store_explicit(&st->dlog_ring.tail,
+                              atomic_load_explicit(&st->dlog_ring.head, memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+    return ok + st->dlog_ring.records[i & (DEFERRED_LOG_RING_SIZE - 1u)].nargs;
+}
+
+/**
+ * @brief Append one control-tick record to the flight recorder ring
+ */
+static inline uint32_t bench_kernel_fr_ring_record(bench_state_t *st, uint32_t i)
+{
+    fr_ring_record(&st->fr_ring, i, FR_REC_CONTROL, 1, i * 3u, i ^ 0x5A5Au);
+    return st->fr_ring.records[i & (FLIGHT_RECORDER_RECORDS - 1u)].seq;
+}
+
+/**
+ * @brief Linear scan for a MAC, the lookup of the receive callback before the peer table
+ */
+static inline bench_peer_slot_t *bench_peer_scan(bench_state_t *st, const uint8_t *mac)
+{
+    for (int i = 0; i < BENCH_NUM_PEERS; i++)
+    {
+        bench_peer_slot_t *slot = &st->peer_slots[i];
+        if (atomic_load_explicit(&slot->in_use, memory_order_acquire) && memcmp(slot->mac_addr, mac, 6) == 0)
+        {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Receive callback lookup with a single registered peer (the controller)
+ */
+static inline uint32_t bench_kernel_peer_find_1(bench_state_t *st, uint32_t i)
+{
+    (void)i;
+    peer_entry_t *e = peer_table_find(&st->peers_1, st->senders_hit[0]);
+    return (e != NULL) ? e->mac_addr[5] : 0u;
+}
+
+/**
+ * @brief Receive callback lookup, 20 peers, every frame from one of them
+ */
+static inline uint32_t bench_kernel_peer_find_20(bench_state_t *st, uint32_t i)
+{
+    peer_entry_t *e = peer_table_find(&st->peers_20, st->senders_hit[i & (BENCH_PEER_SENDERS - 1u)]);
+    return (e != NULL) ? e->mac_addr[5] : 0u;
+}
+
+/**
+ * @brief Receive callback lookup, 20 peers, every frame from an unknown sender
+ */
+static inline uint32_t bench_kernel_peer_find_miss_20(bench_state_t *st, uint32_t i)
+{
+    peer_entry_t *e = peer_table_find(&st->peers_20, st->senders_miss[i & (BENCH_PEER_SENDERS - 1u)]);
+    return (e != NULL) ? e->mac_addr[5] : 1u;
+}
+
+/**
+ * @brief Receive callback lookup, 20 peers, 7 frames in 8 from unknown senders
+ */
+static inline uint32_t bench_kernel_peer_find_mostly_miss_20(bench_state_t *st, uint32_t i)
+{
+    peer_entry_t *e = peer_table_find(&st->peers_20, st->senders_mostly_miss[i & (BENCH_PEER_SENDERS - 1u)]);
+    return (e != NULL) ? e->mac_addr[5] : 1u;
+}
+
+/**
+ * @brief Reference: linear scan, 20 peers, every frame from one of them
+ */
+static inline uint32_t bench_kernel_peer_scan_20(bench_state_t *st, uint32_t i)
+{
+    bench_peer_slot_t *slot = bench_peer_scan(st, st->senders_hit[i & (BENCH_PEER_SENDERS - 1u)]);
+    return (slot != NULL) ? slot->mac_addr[5] : 0u;
+}
+
+/**
+ * @brief Reference: linear scan, 20 peers, every frame from an unknown sender
+ */
+static inline uint32_t bench_kernel_peer_scan_miss_20(bench_state_t *st, uint32_t i)
+{
+    bench_peer_slot_t *slot = bench_peer_scan(st, st->senders_miss[i & (BENCH_PEER_SENDERS - 1u)]);
+    return (slot != NULL) ? slot->mac_addr[5] : 1u;
+}
+
+/**
+ * @brief Eviction choice when a 64th-peer send finds the driver full: pick the least
+ *        recently active of the 20 registered peers and mark it active again (re-added)
+ */
+static inline uint32_t bench_kernel_peer_lru_64(bench_state_t *st, uint32_t i)
+{
+    peer_entry_t *e = peer_table_lru(&st->peers_lru, i);
+    peer_table_touch(e, i);
+    return e->mac_addr[5];
+}
+
+#endif /* BENCH_KERNELS_H */
@@ -0,0 +1,56 @@
+/******************************************************************************
+ * @file bench_target.h
+ * @brief On-target benchmark of the shared hot-path kernels
+ *
+ ******************************************************************************/
+
+#ifndef BENCH_TARGET_H
+#define BENCH_TARGET_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include "esp_err.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch for the benchmark application (see [env:seeed_xiao_esp32c6_bench]
+ * in platformio.ini). When 1, app_main runs the benchmark instead of the driver. */
+#ifndef BENCH_APP
+#define BENCH_APP 0
+#endif
+
+/* Iterations per timed run. Kept small so a run with interrupts disabled stays
+ * well below the interrupt watchdog timeout even for the slowest kernel. */
+#define BENCH_TARGET_ITERATIONS 1000
+
+/* Timed runs per kernel and placement; the median is reported */
+#define BENCH_TARGET_REPEATS 7
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Run every kernel from bench_kernels.h and print a parseable report
+ *
+ * @details Each kernel is compiled twice, once placed in IRAM and once in flash,
+ *          and timed with esp_cpu_get_cycle_count() with interrupts disabled.
+ *          For every placement the report holds the cycles of the very first
+ *          call (cold: flash cache and branch predictor not yet warmed up) and
+ *          the median cycles per iteration of BENCH_TARGET_REPEATS warm runs.
+ *          Code that the kernels call out of line (newlib, non-inline component
+ *          functions) stays in its normal place for both variants.
+ *
+ *          Report format, one record per line, parsed by tools/bench_target_compare.py:
+ *              BENCH_BEGIN,cpu_mhz=<MHz>,iterations=<n>,repeats=<n>
+ *              BENCH,<kernel>,<iram|flash>,<cycles per op>,<cold cycles>
+ *              BENCH_END
+ *
+ * @return ESP_OK (the report is the actual output)
+ */
+esp_err_t bench_target_run(void);
+
+#endif /* BENCH_TARGET_H */
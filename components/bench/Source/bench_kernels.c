@@ -0,0 +1,101 @@
+/******************************************************************************
+ * @file bench_kernels.c
+ * @brief State preparation for the shared benchmark kernels
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include "bench_kernels.h"
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+void bench_state_init(bench_state_t *st)
+{
+    memset(st, 0, sizeof(*st));
+
+    /* #01 - mac_format: a fixed sample MAC (controllers are paired at runtime now, see esp_now_comm_pairing.h) */
+    const uint8_t mac[6] = {0xD8, 0x13, 0x2A, 0x2F, 0x3C, 0xE4};
+    memcpy(st->mac, mac, sizeof(mac));
+
+    /* #02 - hist_percentile: 10000 samples with a long tail */
+    lg_hist_reset(&st->hist_full);
+    for (uint32_t i = 0; i < 10000u; i++)
+    {
+        uint32_t value = 50u + (i % 100u) * 3u;
+        if ((i % 97u) == 0)
+        {
+            value *= 40u;
+        }
+        lg_hist_record(&st->hist_full, value);
+    }
+
+    /* #03 - sched_next_20_peers: the default load generator shape */
+    st->sched_cfg.num_peers = BENCH_NUM_PEERS;
+    st->sched_cfg.rate_hz = 50;
+    st->sched_cfg.large_frame_pct = 10;
+    st->sched_cfg.small_len = 16;
+    st->sched_cfg.large_len = 200;
+    st->sched_cfg.duration_ms = 3600u * 1000u;
+    st->sched_cfg.seed = 1;
+    lg_sched_init(&st->sched, &st->sched_cfg, 0);
+
+    /* #04 - peer_*: the controller plus 19 devices with the same OUI, and unknown senders
+     * that share the OUI or use locally administered addresses (broadcasting phones, other rovers) */
+    uint8_t peers[BENCH_NUM_PEERS][6];
+    uint8_t unknown[BENCH_PEER_SENDERS][6];
+    uint32_t rng = 0x2545F491u;
+    for (uint32_t p = 0; p < BENCH_NUM_PEERS; p++)
+    {
+        memcpy(peers[p], mac, sizeof(mac));
+        if (p != 0)
+        {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            peers[p][3] = (uint8_t)rng;
+            peers[p][4] = (uint8_t)(rng >> 8);
+            peers[p][5] = (uint8_t)(rng >> 16) & 0xFEu;
+        }
+    }
+    for (uint32_t u = 0; u < BENCH_PEER_SENDERS; u++)
+    {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        memcpy(unknown[u], mac, sizeof(mac));
+        if ((u & 1u) != 0)
+        {
+            unknown[u][0] = 0x02;
+            unknown[u][1] = (uint8_t)(rng >> 24);
+            unknown[u][2] = (uint8_t)(rng >> 5);
+        }
+        unknown[u][3] = (uint8_t)rng;
+        unknown[u][4] = (uint8_t)(rng >> 8);
+        unknown[u][5] = (uint8_t)(rng >> 16) | 0x01u;   /* Odd, peers are even: never a peer */
+    }
+    peer_table_init(&st->peers_1);
+    peer_table_init(&st->peers_20);
+    (void)peer_table_insert(&st->peers_1, peers[0]);
+    for (uint32_t p = 0; p < BENCH_NUM_PEERS; p++)
+    {
+        (void)peer_table_insert(&st->peers_20, peers[p]);
+        memcpy(st->peer_slots[p].mac_addr, peers[p], 6);
+        atomic_store_explicit(&st->peer_slots[p].in_use, true, memory_order_relaxed);
+    }
+    for (uint32_t s = 0; s < BENCH_PEER_SENDERS; s++)
+    {
+        memcpy(st->senders_hit[s], peers[s % BENCH_NUM_PEERS], 6);
+        memcpy(st->senders_miss[s], unknown[s], 6);
+        memcpy(st->senders_mostly_miss[s], ((s & 7u) == 0) ? peers[(s / 8u) % BENCH_NUM_PEERS] : unknown[s], 6);
+    }
+
+    /* #05 - peer_lru_64: the unknown senders as logical peers, every third one registered, all active at different times */
+    peer_table_init(&st->peers_lru);
+    for (uint32_t u = 0; u < BENCH_PEER_SENDERS; u++)
+    {
+        peer_entry_t *e = peer_table_insert(&st->peers_lru, unknown[u]);
+        atomic_store_explicit(&e->registered, (u % 3u) == 0 && u / 3u < BENCH_NUM_PEERS, memory_order_relaxed);
+        peer_table_touch(e, u * 7u);
+    }
+}
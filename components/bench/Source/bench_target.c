@@ -0,0 +1,175 @@
+/******************************************************************************
+ * @file bench_target.c
+ * @brief On-target benchmark of the shared hot-path kernels
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "bench_kernels.h"
+#include "bench_target.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "BENCH"
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Loop around one kernel: runs it n times and returns the folded results
+ */
+typedef uint32_t (*bench_loop_fn_t)(bench_state_t *st, uint32_t n);
+
+/**
+ * @brief One kernel with its IRAM and flash placed loops
+ */
+typedef struct
+{
+    const char      *name;
+    bench_loop_fn_t loop_iram;
+    bench_loop_fn_t loop_flash;
+} bench_case_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Time one kernel in one placement and print its report line
+ *
+ * @param[in] name Kernel name
+ * @param[in] placement "iram" or "flash"
+ * @param[in] loop Loop function of that placement
+ */
+static void bench_target_run_case(const char *name, const char *placement, bench_loop_fn_t loop);
+
+/**
+ * @brief qsort comparator for uint32_t
+ */
+static int bench_cmp_u32(const void *a, const void *b);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static bench_state_t s_state;
+
+/* Results are folded into this so the compiler has to keep every kernel */
+static volatile uint32_t s_sink;
+
+/* Interrupts are disabled around every timed run */
+static portMUX_TYPE s_bench_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Two copies of every loop: one in IRAM, one in flash. noinline keeps the
+ * copies from being merged into their caller, which lives in flash. */
+#define BENCH_DEFINE_LOOPS(name)                                                                \
+    static IRAM_ATTR __attribute__((noinline)) uint32_t bench_loop_##name##_iram(bench_state_t *st, uint32_t n) \
+    {                                                                                           \
+        uint32_t acc = 0;                                                                       \
+        for (uint32_t i = 0; i < n; i++)                                                        \
+        {                                                                                       \
+            acc += bench_kernel_##name(st, i);                                                  \
+        }                                                                                       \
+        return acc;                                                                             \
+    }                                                                                           \
+    static __attribute__((noinline)) uint32_t bench_loop_##name##_flash(bench_state_t *st, uint32_t n) \
+    {                                                                                           \
+        uint32_t acc = 0;                                                                       \
+        for (uint32_t i = 0; i < n; i++)                                                        \
+        {                                                                                       \
+            acc += bench_kernel_##name(st, i);                                                  \
+        }                                                                                       \
+        return acc;                                                                             \
+    }
+BENCH_KERNELS(BENCH_DEFINE_LOOPS)
+#undef BENCH_DEFINE_LOOPS
+
+#define BENCH_CASE_ENTRY(name) { #name, bench_loop_##name##_iram, bench_loop_##name##_flash },
+static const bench_case_t s_cases[] =
+{
+    BENCH_KERNELS(BENCH_CASE_ENTRY)
+};
+#undef BENCH_CASE_ENTRY
+
+#define BENCH_NUM_CASES (sizeof(s_cases) / sizeof(s_cases[0]))
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+esp_err_t bench_target_run(void)
+{
+    ESP_LOGI(TAG, "Running %u kernels, IRAM and flash placement...", (unsigned)BENCH_NUM_CASES);
+
+    /* The report goes straight to stdout so it is not interleaved with log prefixes */
+    printf("BENCH_BEGIN,cpu_mhz=%d,iterations=%d,repeats=%d\n",
+           CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, BENCH_TARGET_ITERATIONS, BENCH_TARGET_REPEATS);
+    for (size_t i = 0; i < BENCH_NUM_CASES; i++)
+    {
+        /* Flash first: its cold number should see a cache that the IRAM run did not warm up */
+        bench_target_run_case(s_cases[i].name, "flash", s_cases[i].loop_flash);
+        bench_target_run_case(s_cases[i].name, "iram", s_cases[i].loop_iram);
+
+        /* Let the idle task run so the task watchdog stays quiet */
+        vTaskDelay(1);
+    }
+    printf("BENCH_END\n");
+
+    ESP_LOGI(TAG, "Done");
+    return ESP_OK;
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void bench_target_run_case(const char *name, const char *placement, bench_loop_fn_t loop)
+{
+    uint32_t samples[BENCH_TARGET_REPEATS];
+
+    /* #01 - Fresh state, then one single call: the cold cost */
+    bench_state_init(&s_state);
+
+    portENTER_CRITICAL(&s_bench_mux);
+    esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+    s_sink += loop(&s_state, 1);
+    uint32_t cold = (uint32_t)(esp_cpu_get_cycle_count() - start);
+    portEXIT_CRITICAL(&s_bench_mux);
+
+    /* #02 - Warm runs */
+    for (int rep = 0; rep < BENCH_TARGET_REPEATS; rep++)
+    {
+        portENTER_CRITICAL(&s_bench_mux);
+        start = esp_cpu_get_cycle_count();
+        s_sink += loop(&s_state, BENCH_TARGET_ITERATIONS);
+        uint32_t elapsed = (uint32_t)(esp_cpu_get_cycle_count() - start);
+        portEXIT_CRITICAL(&s_bench_mux);
+
+        samples[rep] = elapsed;
+    }
+
+    qsort(samples, BENCH_TARGET_REPEATS, sizeof(samples[0]), bench_cmp_u32);
+    uint32_t median = samples[BENCH_TARGET_REPEATS / 2];
+
+    /* Cycles per op with two decimals, without pulling in float printf */
+    uint32_t centi = (uint32_t)(((uint64_t)median * 100u) / BENCH_TARGET_ITERATIONS);
+    printf("BENCH,%s,%s,%lu.%02lu,%lu\n", name, placement,
+           (unsigned long)(centi / 100u), (unsigned long)(centi % 100u), (unsigned long)cold);
+}
+
+static int bench_cmp_u32(const void *a, const void *b)
+{
+    uint32_t ua = *(const uint32_t *)a;
+    uint32_t ub = *(const uint32_t *)b;
+    return (ua > ub) - (ua < ub);
+}
@@ -0,0 +1,167 @@
+/******************************************************************************
+ * @file deferred_log.h
+ * @brief Deferred binary logger for the radio and control hot paths
+ *
+ * @details Hot paths call DLOG(id, args...) instead of ESP_LOGx. That only
+ *          copies the format ID, a timestamp and up to DEFERRED_LOG_MAX_ARGS raw
+ *          32-bit arguments into a lock-free ring owned by the calling task.
+ *          A low priority task later formats and prints the records on the
+ *          console and/or ships them raw to a sink (e.g. an ESP-NOW peer) for
+ *          decoding on the host with tools/dlog_decode.py.
+ *
+ *          Every task that logs gets its own single-producer ring, claimed on
+ *          its first DLOG() call, up to DEFERRED_LOG_MAX_PRODUCERS tasks at a
+ *          time; the ring of a deleted task goes back to the pool.
+ *          When a ring is full (or no ring is left) the record is dropped and
+ *          counted, the caller never blocks. Not for use from ISRs.
+ *
+ ******************************************************************************/
+
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "deferred_log_ring.h"
+#include "deferred_log_fmt.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Number of tasks that can own a ring */
+#define DEFERRED_LOG_MAX_PRODUCERS 4
+
+/* Consumer task: priority just above idle, wakes up every DEFERRED_LOG_FLUSH_MS */
+#define DEFERRED_LOG_TASK_PRIORITY  1
+#define DEFERRED_LOG_TASK_STACK     3072
+#define DEFERRED_LOG_FLUSH_MS       100
+
+/* Raw records are shipped to the sink when a frame is full or after this long,
+ * whichever comes first. Shipping causes send callbacks, which log themselves,
+ * so this interval also bounds the logger's self-generated traffic. */
+#define DEFERRED_LOG_SHIP_INTERVAL_MS 1000
+
+/* Ship records to the ESP-NOW peers in addition to printing them (set from build_flags) */
+#ifndef DEFERRED_LOG_SHIP
+#define DEFERRED_LOG_SHIP 0
+#endif
+
+/* Log a message: DLOG(DLOG_xxx, arg0, arg1, ...). Arguments are converted to uint32_t. */
+#define DLOG(fmt_id, ...)                                                       \
+    deferred_log_write((fmt_id), (const uint32_t[]){ __VA_ARGS__ },             \
+                       sizeof((const uint32_t[]){ __VA_ARGS__ }) / sizeof(uint32_t))
+
+/* Output selection for deferred_log_set_output() */
+#define DEFERRED_LOG_OUTPUT_CONSOLE (1u << 0)   /* Format and print on the console */
+#define DEFERRED_LOG_OUTPUT_SINK    (1u << 1)   /* Ship raw records to the sink */
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Sink receiving raw record frames
+ *
+ * @details Frame layout (little endian, decoded by tools/dlog_decode.py):
+ *          u8 count, then count records of
+ *          u32 timestamp_us, u16 fmt_id, u8 producer, u8 nargs, u32 args[nargs].
+ *          The sink adds its own transport header (e.g. the ESP-NOW message ID).
+ *
+ * @param[in] frame Frame to transmit
+ * @param[in] len Frame length in bytes (at most DEFERRED_LOG_SINK_MTU)
+ *
+ * @return ESP_OK if the frame was accepted
+ */
+typedef esp_err_t (*deferred_log_sink_t)(const uint8_t *frame, size_t len);
+
+/* Largest frame handed to the sink (ESP-NOW v1.0 payload limit minus a message ID byte) */
+#define DEFERRED_LOG_SINK_MTU 249
+
+/**
+ * @brief Logger statistics
+ */
+typedef struct
+{
+    uint32_t written;                   /* Records stored in a ring */
+    uint32_t dropped;                   /* Records lost because a ring was full */
+    uint32_t dropped_no_ring;           /* Records lost because no ring was left for the task */
+    uint32_t printed;                   /* Records formatted on the console */
+    uint32_t shipped;                   /* Records handed to the sink */
+    uint32_t sink_errors;               /* Sink frames that were rejected */
+    uint32_t producers;                 /* Rings in use */
+    uint32_t ring_hwm[DEFERRED_LOG_MAX_PRODUCERS]; /* Highest fill level per ring */
+} deferred_log_stats_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Start the consumer task
+ *
+ * @details DLOG() may be called before this; records simply wait in the rings.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if already started
+ *      - ESP_FAIL if the task could not be created
+ */
+esp_err_t deferred_log_init(void);
+
+/**
+ * @brief Write one record into the calling task's ring (use the DLOG macro)
+ *
+ * @param[in] fmt_id Format ID from deferred_log_fmt.h
+ * @param[in] args Raw arguments
+ * @param[in] nargs Number of arguments
+ */
+void deferred_log_write(uint16_t fmt_id, const uint32_t *args, size_t nargs);
+
+/**
+ * @brief Select where records go
+ *
+ * @param[in] outputs Bitmask of DEFERRED_LOG_OUTPUT_* (default: console only)
+ */
+void deferred_log_set_output(uint32_t outputs);
+
+/**
+ * @brief Set the sink used with DEFERRED_LOG_OUTPUT_SINK
+ *
+ * @param[in] sink Frame transmit function, NULL to disable shipping
+ */
+void deferred_log_set_sink(deferred_log_sink_t sink);
+
+/**
+ * @brief Get the logger statistics
+ *
+ * @param[out] stats Filled with the current counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t deferred_log_get_stats(deferred_log_stats_t *stats);
+
+/**
+ * @brief Print the logger statistics on the console
+ */
+void deferred_log_print_stats(void);
+
+/**
+ * @brief Measure the cost of one DLOG() call against one ESP_LOGI() call
+ *
+ * @details Logs the same MAC/length message iterations times each way, timing
+ *          with the CPU cycle counter, and prints cycles per call. The DLOG
+ *          records written here are discarded. Prints iterations lines through
+ *          ESP_LOGI, so run it from a benchmark build, not in the field.
+ *
+ * @param[in] iterations Calls per variant
+ */
+void deferred_log_measure_cost(uint32_t iterations);
+
+#endif /* DEFERRED_LOG_H */
@@ -0,0 +1,46 @@
+/******************************************************************************
+ * @file deferred_log_fmt.h
+ * @brief Format registry of the deferred logger
+ *
+ * @details Every deferred log message is declared here once, with the tag and
+ *          printf format used when it is finally printed. Records only carry the
+ *          numeric ID, so IDs must stay stable: append new entries at the end and
+ *          never reorder. tools/dlog_decode.py parses this file to decode records
+ *          shipped over ESP-NOW, so keep one X(...) entry per line.
+ *
+ *          Formats receive every argument as unsigned int; use %u, %d, %x, %c
+ *          (with width/flags as needed). %s is not supported.
+ *
+ ******************************************************************************/
+
+#ifndef DEFERRED_LOG_FMT_H
+#define DEFERRED_LOG_FMT_H
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* X(id, tag, format) */
+#define DEFERRED_LOG_FORMATS(X) \
+    X(DLOG_ESPNOW_SEND_OK,    "ESP_NOW_COMM_CALLBACK", "Send to %02x:%02x:%02x:%02x:%02x:%02x: SUCCESS") \
+    X(DLOG_ESPNOW_SEND_FAIL,  "ESP_NOW_COMM_CALLBACK", "Send to %02x:%02x:%02x:%02x:%02x:%02x: FAIL") \
+    X(DLOG_ESPNOW_RECV,       "ESP_NOW_COMM_CALLBACK", "Received %u bytes from %02x:%02x:%02x:%02x:%02x:%02x") \
+    X(DLOG_LATENCY_REPORT_FAIL, "ESP_NOW_DIAG", "Latency report for stage %u failed: 0x%x") \
+    X(DLOG_ESPNOW_CHANNEL_OUTAGE, "ESP_NOW_COMM", "Link back after channel change, outage %u ms")
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Format IDs
+ */
+typedef enum
+{
+#define DEFERRED_LOG_FMT_ENUM(id, tag, fmt) id,
+    DEFERRED_LOG_FORMATS(DEFERRED_LOG_FMT_ENUM)
+#undef DEFERRED_LOG_FMT_ENUM
+    DLOG_FMT_COUNT
+} dlog_fmt_id_t;
+
+#endif /* DEFERRED_LOG_FMT_H */
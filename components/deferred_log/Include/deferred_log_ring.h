@@ -0,0 +1,137 @@
+/******************************************************************************
+ * @file deferred_log_ring.h
+ * @brief Single-producer/single-consumer record ring of the deferred logger
+ *
+ * @details Plain C11 with no ESP-IDF dependencies, so the host benchmarks can
+ *          measure exactly the code that runs on the hot paths. The producer
+ *          only writes head, the consumer only writes tail; a record is
+ *          published by the release store of head.
+ *
+ ******************************************************************************/
+
+#ifndef DEFERRED_LOG_RING_H
+#define DEFERRED_LOG_RING_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Maximum number of raw 32-bit arguments stored with one record */
+#define DEFERRED_LOG_MAX_ARGS 8
+
+/* Records per ring; must be a power of two */
+#ifndef DEFERRED_LOG_RING_SIZE
+#define DEFERRED_LOG_RING_SIZE 32
+#endif
+
+_Static_assert((DEFERRED_LOG_RING_SIZE & (DEFERRED_LOG_RING_SIZE - 1)) == 0,
+               "DEFERRED_LOG_RING_SIZE must be a power of two");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief One log record: format ID, timestamp and raw arguments, formatted later
+ */
+typedef struct
+{
+    uint32_t timestamp_us;                  /* Low 32 bits of esp_timer time when the record was written */
+    uint16_t fmt_id;                        /* Index into DEFERRED_LOG_FORMATS */
+    uint8_t  nargs;                         /* Valid entries in args */
+    uint8_t  producer;                      /* Ring (producer) index, filled in by the consumer */
+    uint32_t args[DEFERRED_LOG_MAX_ARGS];   /* Raw arguments */
+} dlog_record_t;
+
+/**
+ * @brief Record ring of one producer
+ */
+typedef struct
+{
+    _Atomic uint32_t head;                  /* Next slot to write, producer owned */
+    _Atomic uint32_t tail;                  /* Next slot to read, consumer owned */
+    _Atomic uint32_t dropped;               /* Records lost because the ring was full */
+    _Atomic uint32_t written;               /* Records successfully written */
+    uint32_t         hwm;                   /* Highest fill level seen by the producer */
+    dlog_record_t    records[DEFERRED_LOG_RING_SIZE];
+} dlog_ring_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Append a record (producer side)
+ *
+ * @param[in,out] ring Ring owned by the calling producer
+ * @param[in] timestamp_us Time of the event
+ * @param[in] fmt_id Format ID
+ * @param[in] args Raw arguments
+ * @param[in] nargs Number of arguments (extra ones are cut off)
+ *
+ * @return true if written, false if the ring was full and the record was dropped
+ */
+static inline bool dlog_ring_put(dlog_ring_t *ring, uint32_t timestamp_us, uint16_t fmt_id,
+                                 const uint32_t *args, uint32_t nargs)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t fill = head - tail;
+    if (fill >= DEFERRED_LOG_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    dlog_record_t *rec = &ring->records[head & (DEFERRED_LOG_RING_SIZE - 1u)];
+    if (nargs > DEFERRED_LOG_MAX_ARGS)
+    {
+        nargs = DEFERRED_LOG_MAX_ARGS;
+    }
+    rec->timestamp_us = timestamp_us;
+    rec->fmt_id = fmt_id;
+    rec->nargs = (uint8_t)nargs;
+    for (uint32_t i = 0; i < nargs; i++)
+    {
+        rec->args[i] = args[i];
+    }
+
+    if (fill + 1u > ring->hwm)
+    {
+        ring->hwm = fill + 1u;
+    }
+    atomic_fetch_add_explicit(&ring->written, 1, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1u, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Take the oldest record (consumer side)
+ *
+ * @param[in,out] ring Ring to read
+ * @param[out] out Copy of the record
+ *
+ * @return true if a record was taken, false if the ring was empty
+ */
+static inline bool dlog_ring_get(dlog_ring_t *ring, dlog_record_t *out)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail)
+    {
+        return false;
+    }
+
+    *out = ring->records[tail & (DEFERRED_LOG_RING_SIZE - 1u)];
+    atomic_store_explicit(&ring->tail, tail + 1u, memory_order_release);
+    return true;
+}
+
+#endif /* DEFERRED_LOG_RING_H */
@@ -0,0 +1,452 @@
+/******************************************************************************
+ * @file deferred_log.c
+ * @brief Deferred binary logger: per-task rings and the low priority consumer
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "deferred_log.h"
+#include "trace.h"
+#include "prof.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "DLOG"
+
+/* Size of a packed record header in a sink frame (timestamp, fmt_id, producer, nargs) */
+#define DEFERRED_LOG_PACKED_HEADER 8
+
+/* Longest formatted message */
+#define DEFERRED_LOG_LINE_LEN 128
+
+/* Thread local storage slot holding the caller's ring index + 1 (slot 0 belongs to pthreads) */
+#define DEFERRED_LOG_TLS_INDEX 1
+
+_Static_assert(configNUM_THREAD_LOCAL_STORAGE_POINTERS > DEFERRED_LOG_TLS_INDEX,
+               "CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS must leave a slot for the deferred logger");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Tag and format of one message ID
+ */
+typedef struct
+{
+    const char *tag;
+    const char *fmt;
+} deferred_log_format_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Find (or claim) the ring of the calling task
+ *
+ * @return Ring index, or -1 if every ring is owned by another task
+ */
+static int deferred_log_ring_of_caller(void);
+
+/**
+ * @brief Thread local storage deletion callback: give the ring of a deleted task back
+ *
+ * @param[in] index Storage slot (DEFERRED_LOG_TLS_INDEX)
+ * @param[in] value Ring index + 1
+ */
+static void deferred_log_release_ring(int index, void *value);
+
+/**
+ * @brief Consumer task: drain all rings every DEFERRED_LOG_FLUSH_MS
+ */
+static void deferred_log_task(void *arg);
+
+/**
+ * @brief Drain all rings once, printing and/or packing every record
+ *
+ * @param[in] now_ms Current time, used to decide when to ship a partial frame
+ */
+static void deferred_log_drain(uint32_t now_ms);
+
+/**
+ * @brief Format and print one record on the console
+ */
+static void deferred_log_print_record(const dlog_record_t *rec);
+
+/**
+ * @brief Append one record to the pending sink frame, shipping the frame first if it is full
+ */
+static void deferred_log_pack_record(const dlog_record_t *rec);
+
+/**
+ * @brief Hand the pending sink frame to the sink and start a new one
+ */
+static void deferred_log_ship(void);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static dlog_ring_t s_rings[DEFERRED_LOG_MAX_PRODUCERS];
+
+/* Task owning each ring, claimed with a compare-and-swap from 0 and reset when the task is deleted */
+static _Atomic uintptr_t s_ring_owner[DEFERRED_LOG_MAX_PRODUCERS];
+
+static _Atomic uint32_t s_dropped_no_ring = 0;
+
+static const deferred_log_format_t s_formats[DLOG_FMT_COUNT] =
+{
+#define DEFERRED_LOG_FMT_ENTRY(id, tag, fmt) [id] = { tag, fmt },
+    DEFERRED_LOG_FORMATS(DEFERRED_LOG_FMT_ENTRY)
+#undef DEFERRED_LOG_FMT_ENTRY
+};
+
+/* Consumer side state, only touched with s_drain_lock held */
+static SemaphoreHandle_t s_drain_lock = NULL;
+static TaskHandle_t s_task = NULL;
+
+/* Storage of the drain lock and the task, allocated at link time */
+static StaticSemaphore_t s_drain_lock_storage;
+static StaticTask_t s_task_tcb;
+static StackType_t s_task_stack[DEFERRED_LOG_TASK_STACK];
+static volatile uint32_t s_outputs = DEFERRED_LOG_OUTPUT_CONSOLE;
+static volatile deferred_log_sink_t s_sink = NULL;
+static uint8_t s_frame[DEFERRED_LOG_SINK_MTU];
+static size_t s_frame_len = 1;                  /* Byte 0 holds the record count */
+static uint32_t s_frame_started_ms = 0;
+static uint32_t s_printed = 0;
+static uint32_t s_shipped = 0;
+static uint32_t s_sink_errors = 0;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+esp_err_t deferred_log_init(void)
+{
+    if (s_task != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_drain_lock = xSemaphoreCreateMutexStatic(&s_drain_lock_storage);
+    s_task = xTaskCreateStatic(deferred_log_task, "dlog", DEFERRED_LOG_TASK_STACK, NULL,
+                               DEFERRED_LOG_TASK_PRIORITY, s_task_stack, &s_task_tcb);
+    if (s_drain_lock == NULL || s_task == NULL)
+    {
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Deferred logger started (%d rings x %d records)",
+             DEFERRED_LOG_MAX_PRODUCERS, DEFERRED_LOG_RING_SIZE);
+    return ESP_OK;
+}
+
+void deferred_log_write(uint16_t fmt_id, const uint32_t *args, size_t nargs)
+{
+    int ring = deferred_log_ring_of_caller();
+    if (ring < 0)
+    {
+        atomic_fetch_add_explicit(&s_dropped_no_ring, 1, memory_order_relaxed);
+        return;
+    }
+
+    (void)dlog_ring_put(&s_rings[ring], (uint32_t)esp_timer_get_time(), fmt_id, args, (uint32_t)nargs);
+}
+
+void deferred_log_set_output(uint32_t outputs)
+{
+    s_outputs = outputs;
+}
+
+void deferred_log_set_sink(deferred_log_sink_t sink)
+{
+    s_sink = sink;
+}
+
+esp_err_t deferred_log_get_stats(deferred_log_stats_t *stats)
+{
+    if (!stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    for (uint32_t r = 0; r < DEFERRED_LOG_MAX_PRODUCERS; r++)
+    {
+        if (atomic_load_explicit(&s_ring_owner[r], memory_order_relaxed) == 0)
+        {
+            continue;
+        }
+        stats->producers++;
+        stats->written += atomic_load_explicit(&s_rings[r].written, memory_order_relaxed);
+        stats->dropped += atomic_load_explicit(&s_rings[r].dropped, memory_order_relaxed);
+        stats->ring_hwm[r] = s_rings[r].hwm;
+    }
+    stats->dropped_no_ring = atomic_load_explicit(&s_dropped_no_ring, memory_order_relaxed);
+    stats->printed = s_printed;
+    stats->shipped = s_shipped;
+    stats->sink_errors = s_sink_errors;
+    return ESP_OK;
+}
+
+void deferred_log_print_stats(void)
+{
+    deferred_log_stats_t stats;
+    (void)deferred_log_get_stats(&stats);
+
+    ESP_LOGI(TAG, "written=%lu dropped=%lu no_ring=%lu printed=%lu shipped=%lu sink_err=%lu producers=%lu",
+             (unsigned long)stats.written, (unsigned long)stats.dropped,
+             (unsigned long)stats.dropped_no_ring, (unsigned long)stats.printed,
+             (unsigned long)stats.shipped, (unsigned long)stats.sink_errors,
+             (unsigned long)stats.producers);
+    for (uint32_t r = 0; r < DEFERRED_LOG_MAX_PRODUCERS; r++)
+    {
+        TaskHandle_t owner = (TaskHandle_t)atomic_load_explicit(&s_ring_owner[r], memory_order_relaxed);
+        if (owner != NULL)
+        {
+            ESP_LOGI(TAG, "  ring %lu: %-16s hwm=%lu/%d", (unsigned long)r, pcTaskGetName(owner),
+                     (unsigned long)stats.ring_hwm[r], DEFERRED_LOG_RING_SIZE);
+        }
+    }
+}
+
+void deferred_log_measure_cost(uint32_t iterations)
+{
+    const uint8_t mac[6] = {0xD8, 0x13, 0x2A, 0x2F, 0x3C, 0xE4};
+    uint64_t dlog_cycles = 0;
+    uint64_t logi_cycles = 0;
+    dlog_record_t discard;
+
+    /* #01 - Keep the consumer away while we own the rings */
+    if (s_drain_lock != NULL)
+    {
+        xSemaphoreTake(s_drain_lock, portMAX_DELAY);
+    }
+
+    /* #02 - DLOG, in batches that fit the ring so that no call takes the drop path */
+    int ring = deferred_log_ring_of_caller();
+    for (uint32_t done = 0; ring >= 0 && done < iterations; )
+    {
+        uint32_t batch = iterations - done;
+        if (batch > DEFERRED_LOG_RING_SIZE / 2)
+        {
+            batch = DEFERRED_LOG_RING_SIZE / 2;
+        }
+        while (dlog_ring_get(&s_rings[ring], &discard))
+        {
+        }
+
+        uint32_t start = (uint32_t)esp_cpu_get_cycle_count();
+        for (uint32_t i = 0; i < batch; i++)
+        {
+            DLOG(DLOG_ESPNOW_RECV, i, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        }
+        dlog_cycles += (uint32_t)esp_cpu_get_cycle_count() - start;
+        done += batch;
+    }
+    while (ring >= 0 && dlog_ring_get(&s_rings[ring], &discard))
+    {
+    }
+
+    if (s_drain_lock != NULL)
+    {
+        xSemaphoreGive(s_drain_lock);
+    }
+
+    /* #03 - The same message through ESP_LOGI, including the console output it causes */
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        uint32_t start = (uint32_t)esp_cpu_get_cycle_count();
+        ESP_LOGI("ESP_NOW_COMM_CALLBACK", "Received %lu bytes from %02x:%02x:%02x:%02x:%02x:%02x",
+                 (unsigned long)i, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        logi_cycles += (uint32_t)esp_cpu_get_cycle_count() - start;
+    }
+
+    if (ring < 0 || iterations == 0)
+    {
+        ESP_LOGW(TAG, "Cost measurement skipped (no ring for this task or no iterations)");
+        return;
+    }
+    ESP_LOGI(TAG, "Cost per call over %lu calls: DLOG %lu cycles, ESP_LOGI %lu cycles",
+             (unsigned long)iterations, (unsigned long)(dlog_cycles / iterations),
+             (unsigned long)(logi_cycles / iterations));
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static int deferred_log_ring_of_caller(void)
+{
+    /* #01 - Fast path: the task already owns a ring */
+    uintptr_t slot = (uintptr_t)pvTaskGetThreadLocalStoragePointer(NULL, DEFERRED_LOG_TLS_INDEX);
+    if (slot != 0)
+    {
+        return (int)slot - 1;
+    }
+
+    /* #02 - First record of this task: claim a free ring, released again when the task is deleted */
+    uintptr_t self = (uintptr_t)xTaskGetCurrentTaskHandle();
+    for (int r = 0; r < DEFERRED_LOG_MAX_PRODUCERS; r++)
+    {
+        uintptr_t expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&s_ring_owner[r], &expected, self,
+                                                    memory_order_acq_rel, memory_order_relaxed))
+        {
+            vTaskSetThreadLocalStoragePointerAndDelCallback(NULL, DEFERRED_LOG_TLS_INDEX, (void *)(uintptr_t)(r + 1),
+                                                            deferred_log_release_ring);
+            return r;
+        }
+    }
+    return -1;
+}
+
+static void deferred_log_release_ring(int index, void *value)
+{
+    (void)index;
+    uintptr_t slot = (uintptr_t)value;
+    if (slot == 0 || slot > DEFERRED_LOG_MAX_PRODUCERS)
+    {
+        return;
+    }
+
+    /* The producer is gone, so the next owner is still the only one writing head. Records it
+     * left behind are drained as usual, under the new owner's ring index. */
+    atomic_store_explicit(&s_ring_owner[slot - 1], 0, memory_order_release);
+}
+
+static void deferred_log_task(void *arg)
+{
+    (void)arg;
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(DEFERRED_LOG_FLUSH_MS));
+
+        xSemaphoreTake(s_drain_lock, portMAX_DELAY);
+        TRACE_BEGIN(TRACE_EV_DLOG_DRAIN);
+        PROF_BEGIN(PROF_SITE_DLOG_DRAIN);
+        deferred_log_drain((uint32_t)(esp_timer_get_time() / 1000));
+        PROF_END(PROF_SITE_DLOG_DRAIN);
+        TRACE_END(TRACE_EV_DLOG_DRAIN);
+        xSemaphoreGive(s_drain_lock);
+    }
+}
+
+static void deferred_log_drain(uint32_t now_ms)
+{
+    dlog_record_t rec;
+    uint32_t outputs = s_outputs;
+    bool ship = ((outputs & DEFERRED_LOG_OUTPUT_SINK) != 0) && (s_sink != NULL);
+
+    for (uint32_t r = 0; r < DEFERRED_LOG_MAX_PRODUCERS; r++)
+    {
+        while (dlog_ring_get(&s_rings[r], &rec))
+        {
+            rec.producer = (uint8_t)r;
+            if (outputs & DEFERRED_LOG_OUTPUT_CONSOLE)
+            {
+                deferred_log_print_record(&rec);
+            }
+            if (ship)
+            {
+                deferred_log_pack_record(&rec);
+            }
+        }
+    }
+
+    /* Partial frames wait so that shipping does not flood the link (and its own send callbacks) */
+    if (s_frame[0] != 0)
+    {
+        if (!ship)
+        {
+            s_frame[0] = 0;
+            s_frame_len = 1;
+        }
+        else if ((uint32_t)(now_ms - s_frame_started_ms) >= DEFERRED_LOG_SHIP_INTERVAL_MS)
+        {
+            deferred_log_ship();
+        }
+    }
+}
+
+static void deferred_log_print_record(const dlog_record_t *rec)
+{
+    char line[DEFERRED_LOG_LINE_LEN];
+    const uint32_t *a = rec->args;
+
+    if (rec->fmt_id >= DLOG_FMT_COUNT)
+    {
+        ESP_LOGW(TAG, "Unknown format %u", rec->fmt_id);
+        return;
+    }
+
+    /* Slots past nargs hold arguments of older records: formats never reference them,
+     * and the extra ones are ignored by snprintf */
+    (void)snprintf(line, sizeof(line), s_formats[rec->fmt_id].fmt,
+                   a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    ESP_LOGI(s_formats[rec->fmt_id].tag, "%s (@%lu.%03lu ms)", line,
+             (unsigned long)(rec->timestamp_us / 1000u), (unsigned long)(rec->timestamp_us % 1000u));
+    s_printed++;
+}
+
+static void deferred_log_pack_record(const dlog_record_t *rec)
+{
+    size_t rec_len = DEFERRED_LOG_PACKED_HEADER + (size_t)rec->nargs * 4u;
+    if (s_frame_len + rec_len > sizeof(s_frame) || s_frame[0] == UINT8_MAX)
+    {
+        deferred_log_ship();
+    }
+    if (s_frame[0] == 0)
+    {
+        s_frame_started_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    }
+
+    uint8_t *p = &s_frame[s_frame_len];
+    *p++ = (uint8_t)(rec->timestamp_us);
+    *p++ = (uint8_t)(rec->timestamp_us >> 8);
+    *p++ = (uint8_t)(rec->timestamp_us >> 16);
+    *p++ = (uint8_t)(rec->timestamp_us >> 24);
+    *p++ = (uint8_t)(rec->fmt_id);
+    *p++ = (uint8_t)(rec->fmt_id >> 8);
+    *p++ = rec->producer;
+    *p++ = rec->nargs;
+    for (uint32_t i = 0; i < rec->nargs; i++)
+    {
+        *p++ = (uint8_t)(rec->args[i]);
+        *p++ = (uint8_t)(rec->args[i] >> 8);
+        *p++ = (uint8_t)(rec->args[i] >> 16);
+        *p++ = (uint8_t)(rec->args[i] >> 24);
+    }
+    s_frame_len += rec_len;
+    s_frame[0]++;
+}
+
+static void deferred_log_ship(void)
+{
+    deferred_log_sink_t sink = s_sink;
+    if (sink != NULL && s_frame[0] != 0)
+    {
+        if (sink(s_frame, s_frame_len) == ESP_OK)
+        {
+            s_shipped += s_frame[0];
+        }
+        else
+        {
+            s_sink_errors++;
+        }
+    }
+    s_frame[0] = 0;
+    s_frame_len = 1;
+}
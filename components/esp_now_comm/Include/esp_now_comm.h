@@ -22,6 +22,14 @@
 /* ESP-NOW macros based on info from v5.5.1 ESP-IDF docs: https://docs.espressif.com/projects/esp-idf/en/stable/esp32/api-reference/network/esp_now.html */
 /* Maximum number of peer devices that can be registered (ESP-NOW supports up to 20) */
 #define ESP_NOW_COMM_MAX_PEERS 20
+/* Build switch: peers tracked; beyond ESP_NOW_COMM_MAX_PEERS the least recently active ones are unregistered */
+#ifndef ESP_NOW_COMM_MAX_LOGICAL_PEERS
+#define ESP_NOW_COMM_MAX_LOGICAL_PEERS 64
+#endif
+/* Build switch: longest wait for the peer list when a send has to register its peer again */
+#ifndef ESP_NOW_COMM_PEER_LOCK_WAIT_MS
+#define ESP_NOW_COMM_PEER_LOCK_WAIT_MS 10
+#endif
 /* Maximum number of encrypted peer devices (configurable, default 7, max 17) */
 #define ESP_NOW_COMM_MAX_ENCRYPT_PEERS 7
 /* Maximum size of ESP-NOW payload in bytes 
@@ -69,6 +77,94 @@ typedef struct
     esp_now_send_callback_t on_send;
 } esp_now_comm_config_t;
 
+/**
+ * @brief What a peer is to this device
+ */
+typedef enum
+{
+    ESP_NOW_COMM_ROLE_UNKNOWN = 0,      /* Registered without a role */
+    ESP_NOW_COMM_ROLE_CONTROLLER,       /* Sends drive commands */
+    ESP_NOW_COMM_ROLE_ROVER,            /* Another rover */
+    ESP_NOW_COMM_ROLE_MONITOR,          /* Only queries diagnostics */
+} esp_now_comm_peer_role_t;
+
+/**
+ * @brief Component-wide traffic counters (all peers and unknown senders)
+ */
+typedef struct
+{
+    uint32_t rx_frames;         /* Frames received and handed to the application */
+    uint32_t rx_bytes;          /* Payload bytes of rx_frames */
+    uint32_t rx_dropped;        /* Frames received but not handed to the application (bad length, no callback) */
+    uint32_t rx_unknown;        /* Frames from senders that are not known peers (included in rx_frames) */
+    uint32_t tx_frames;         /* Frames accepted by esp_now_send() */
+    uint32_t tx_bytes;          /* Payload bytes of tx_frames */
+    uint32_t tx_success;        /* Send callbacks reporting ESP_NOW_SEND_SUCCESS (MAC-layer ACK) */
+    uint32_t tx_fail;           /* Send callbacks reporting ESP_NOW_SEND_FAIL */
+    uint32_t tx_queue_full;     /* esp_now_send() rejected because the ESP-NOW TX queue was full */
+    uint32_t tx_errors;         /* esp_now_send() rejected for any other reason */
+    uint32_t last_rx_ms;        /* Time of the last received frame (ms since boot, 0 = never) */
+    uint32_t ready_ms;          /* Time esp_now_comm_init() completed (ms since boot, 0 = not yet) */
+    uint32_t first_cmd_ms;      /* Time of the first accepted control command (ms since boot, 0 = none
+                                   yet, see esp_now_comm_note_command()): the boot-to-first-command
+                                   time, kept across resets */
+    int8_t   last_rssi;         /* RSSI of the last received radio frame in dBm */
+    int8_t   last_noise_floor;  /* Noise floor of the last received radio frame in dBm */
+} esp_now_comm_stats_t;
+
+/**
+ * @brief Traffic counters and link quality of one peer
+ */
+typedef struct
+{
+    uint8_t  mac_addr[6];       /* MAC address of the peer */
+    uint32_t rx_frames;         /* Frames received from the peer */
+    uint32_t rx_bytes;          /* Payload bytes of rx_frames */
+    uint32_t rx_dropped;        /* Frames from the peer that were not handed to the application */
+    uint32_t tx_frames;         /* Frames to the peer accepted by esp_now_send() */
+    uint32_t tx_bytes;          /* Payload bytes of tx_frames */
+    uint32_t tx_success;        /* Frames to the peer that were ACKed */
+    uint32_t tx_fail;           /* Frames to the peer that were not ACKed */
+    uint32_t last_seen_ms;      /* Time of the last frame from the peer (ms since boot, 0 = never) */
+    uint32_t rx_seq_lost;       /* Sequence numbers skipped (see esp_now_comm_note_rx_seq()) */
+    uint32_t rx_seq_late;       /* Duplicate or out of order sequence numbers */
+    esp_now_comm_peer_role_t role;
+    int8_t   rssi;              /* RSSI of the last radio frame from the peer in dBm */
+    int8_t   rssi_avg;          /* Moving average of the RSSI in dBm (0 = no radio frame yet) */
+    int8_t   noise_floor;       /* Noise floor of the last radio frame from the peer in dBm */
+    uint8_t  tx_ack_pct;        /* Moving average of the frames to the peer that were ACKed, in % */
+    bool     registered;        /* Registered with the ESP-NOW driver right now */
+} esp_now_comm_peer_stats_t;
+
+/**
+ * @brief Logical peers versus driver registrations (see esp_now_comm_add_peer())
+ */
+typedef struct
+{
+    uint32_t logical;           /* Peers known (up to ESP_NOW_COMM_MAX_LOGICAL_PEERS) */
+    uint32_t registered;        /* Of those, registered with the driver (up to ESP_NOW_COMM_MAX_PEERS) */
+    uint32_t evictions;         /* Peers unregistered to make room for another one */
+    uint32_t readds;            /* Evicted peers registered again to send to them */
+    uint32_t readd_fail;        /* Sends dropped because their peer could not be registered again */
+    uint32_t adds;              /* esp_now_add_peer() calls that succeeded */
+    uint32_t add_avg_us;        /* Mean duration of esp_now_add_peer() */
+    uint32_t add_max_us;        /* Longest esp_now_add_peer() */
+    uint32_t evict_avg_us;      /* Mean duration of esp_now_del_peer() on eviction */
+    uint32_t evict_max_us;      /* Longest eviction */
+} esp_now_comm_peer_cache_stats_t;
+
+/**
+ * @brief Channel resynchronization state (see esp_now_comm_resync_channel())
+ */
+typedef struct
+{
+    uint8_t  channel;           /* Channel the peers are registered on (0 = follow the current channel) */
+    uint32_t changes;           /* Channel changes handled since boot */
+    uint32_t last_outage_ms;    /* Last frame before the last change to first frame after it (0 = none yet) */
+    uint32_t max_outage_ms;     /* Longest outage measured */
+    bool     outage_open;       /* A change happened and no frame has arrived since */
+} esp_now_comm_channel_stats_t;
+
 /*******************************************************************************/
 /*                     GLOBAL VARIABLES DECLARATIONS                           */
 /*******************************************************************************/
@@ -122,14 +218,20 @@ esp_err_t esp_now_comm_init(esp_now_comm_config_t *config);
  * @brief Add a peer device for ESP-NOW communication
  *
  * @details Registers a peer device by its MAC address. The peer must be added
- *          before any data can be sent to it. Up to ESP_NOW_COMM_MAX_PEERS
- *          peers can be registered.
+ *          before any data can be sent to it. Up to ESP_NOW_COMM_MAX_LOGICAL_PEERS
+ *          peers can be added; the driver holds ESP_NOW_COMM_MAX_PEERS, so once
+ *          it is full the peer that has been quiet the longest is unregistered
+ *          to make room, and registered again by the next esp_now_comm_send()
+ *          to it. Its counters are kept. Adding a known peer again does nothing.
+ *          Safe to call from any task (not from the ESP-NOW callbacks).
  *
  * @param[in] mac_addr 6-byte MAC address of the peer device
  *
  * @return
  *      - ESP_OK on success
- *      - ESP_ERR_INVALID_ARG if mac_addr is NULL or max peers exceeded
+ *      - ESP_ERR_INVALID_ARG if mac_addr is NULL or not initialized
+ *      - ESP_ERR_ESPNOW_FULL if ESP_NOW_COMM_MAX_LOGICAL_PEERS peers are known already
+ *        (remove one first; known peers are never dropped to make room)
  *      - Other esp_err_t codes if operation fails
  */
 esp_err_t esp_now_comm_add_peer(const uint8_t *mac_addr);
@@ -137,8 +239,8 @@ esp_err_t esp_now_comm_add_peer(const uint8_t *mac_addr);
 /**
  * @brief Remove a peer device from ESP-NOW communication
  *
- * @details Unregisters a previously added peer. After removal, no data can
- *          be sent to this peer until it is added again.
+ * @details Forgets a previously added peer and unregisters it from the driver.
+ *          After removal, no data can be sent to this peer until it is added again.
  *
  * @param[in] mac_addr 6-byte MAC address of the peer to remove
  *
@@ -155,12 +257,15 @@ esp_err_t esp_now_comm_remove_peer(const uint8_t *mac_addr);
  * @details Transmits data to the specified peer. The send completion
  *          is reported asynchronously via the on_send callback.
  * 
- *          Note - Messages can be sent ONLY TO REGISTERED PEERS. If the
- *                peer is not registered, the send operation will fail.
+ *          Note - Messages can be sent ONLY TO ADDED PEERS. If the
+ *                peer is not added, the send operation will fail. A peer that
+ *                was unregistered to make room is registered again first,
+ *                which may evict another one (ESP_ERR_TIMEOUT if the peer
+ *                list stays busy for ESP_NOW_COMM_PEER_LOCK_WAIT_MS).
  *
  *          Addressing modes:
- *          - Specific MAC address (unicast): Sends to one registered peer
- *          - NULL (broadcast to peers): Sends to all registered peers
+ *          - Specific MAC address (unicast): Sends to one added peer
+ *          - NULL (broadcast to peers): Sends to the peers registered right now
  *          - {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF} (broadcast): Sends to all ESP32 devices in range,
  *            regardless of peer registration
  *
@@ -177,6 +282,25 @@ esp_err_t esp_now_comm_remove_peer(const uint8_t *mac_addr);
  */
 esp_err_t esp_now_comm_send(const uint8_t *mac_addr, const uint8_t *data, int len);
 
+/**
+ * @brief Feed a synthetic frame through the receive path
+ *
+ * @details Runs the same dispatch as a frame arriving from the radio, including
+ *          the user on_recv callback, but in the context of the calling task.
+ *          Intended for load generation and soak testing (see load_gen component),
+ *          where many peers have to be simulated from a single device.
+ *          No radio metadata (RSSI, channel) is available for injected frames.
+ *
+ * @param[in] src_mac 6-byte MAC address the frame pretends to come from
+ * @param[in] data Pointer to the payload
+ * @param[in] len Length of the payload in bytes (max ESP_NOW_COMM_PAYLOAD_SIZE)
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if parameters are invalid
+ */
+esp_err_t esp_now_comm_inject_recv(const uint8_t *src_mac, const uint8_t *data, int len);
+
 /**
  * @brief Get this device's MAC address
  *
@@ -194,12 +318,173 @@ esp_err_t esp_now_comm_send(const uint8_t *mac_addr, const uint8_t *data, int le
  */
 esp_err_t esp_now_comm_get_mac(uint8_t *mac_addr);
 
+/**
+ * @brief Get the component-wide traffic counters
+ *
+ * @details Counters are updated lock-free from the ESP-NOW callbacks and the
+ *          sending task, so the snapshot is consistent per field, not across
+ *          fields. Counters wrap at 2^32.
+ *
+ * @param[out] stats Filled with the current counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_now_comm_get_stats(esp_now_comm_stats_t *stats);
+
+/**
+ * @brief Get the traffic counters and link quality of one added peer
+ *
+ * @param[in] mac_addr 6-byte MAC address of the peer
+ * @param[out] stats Filled with the peer counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if mac_addr or stats is NULL
+ *      - ESP_ERR_NOT_FOUND if mac_addr is not an added peer
+ */
+esp_err_t esp_now_comm_get_peer_stats(const uint8_t *mac_addr, esp_now_comm_peer_stats_t *stats);
+
+/**
+ * @brief Set the role of an added peer
+ *
+ * @param[in] mac_addr 6-byte MAC address of the peer
+ * @param[in] role Role of the peer (peers start as ESP_NOW_COMM_ROLE_UNKNOWN)
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if mac_addr is NULL
+ *      - ESP_ERR_NOT_FOUND if mac_addr is not an added peer
+ */
+esp_err_t esp_now_comm_set_peer_role(const uint8_t *mac_addr, esp_now_comm_peer_role_t role);
+
+/**
+ * @brief Check whether a MAC address is an added peer with ESP_NOW_COMM_ROLE_CONTROLLER
+ *
+ * @details Lock-free peer table lookup, cheap enough to turn strangers away
+ *          in the receive callback.
+ *
+ * @param[in] mac_addr 6-byte MAC address
+ *
+ * @return true if the peer is a controller
+ */
+bool esp_now_comm_peer_is_controller(const uint8_t *mac_addr);
+
+/**
+ * @brief Track the sequence number carried by a frame received from a peer
+ *
+ * @details For messages that carry a per-sender sequence number. Call from the
+ *          receive callback only; numbers skipped and numbers that arrive late
+ *          show up in the peer stats.
+ *
+ * @param[in] mac_addr 6-byte MAC address of the sender
+ * @param[in] seq Sequence number of the frame
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_FOUND if mac_addr is NULL or not an added peer
+ */
+esp_err_t esp_now_comm_note_rx_seq(const uint8_t *mac_addr, uint16_t seq);
+
+/**
+ * @brief Record that the receive callback accepted a control command
+ *
+ * @details Call from the receive callback once a frame has passed the lease
+ *          check and is known to be a command. The first call sets
+ *          esp_now_comm_stats_t::first_cmd_ms; beacons, echo, diagnostics and
+ *          frames from strangers never do.
+ */
+void esp_now_comm_note_command(void);
+
+/**
+ * @brief Name of a peer role
+ *
+ * @param[in] role Role
+ *
+ * @return Static string
+ */
+const char *esp_now_comm_peer_role_name(esp_now_comm_peer_role_t role);
+
+/**
+ * @brief Get the counters of all added peers
+ *
+ * @param[out] stats Array receiving one entry per added peer
+ * @param[in] max_peers Capacity of the stats array
+ *
+ * @return Number of entries written
+ */
+int esp_now_comm_get_all_peer_stats(esp_now_comm_peer_stats_t *stats, int max_peers);
+
+/**
+ * @brief Get the number of logical and registered peers, evictions and the add/evict latency
+ *
+ * @param[out] stats Filled with the counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_now_comm_get_peer_cache_stats(esp_now_comm_peer_cache_stats_t *stats);
+
+/**
+ * @brief Reset the component-wide and all per-peer counters to zero
+ */
+void esp_now_comm_reset_stats(void);
+
+/**
+ * @brief Print the component-wide and per-peer counters on the console
+ */
+void esp_now_comm_print_stats(void);
+
+/**
+ * @brief Tell all peers that the radio is about to move / has moved to another channel
+ *
+ * @details Sends ESP_NOW_MSG_CHANNEL_CHANGE on the channel the radio is on now.
+ *          Called while still on the old channel before a planned switch, and by
+ *          esp_now_comm_resync_channel() on the new one.
+ *
+ * @param[in] new_channel Channel the rover is / will be on
+ * @param[in] old_channel Channel it leaves
+ *
+ * @return Result of esp_now_comm_send()
+ */
+esp_err_t esp_now_comm_notify_channel(uint8_t new_channel, uint8_t old_channel);
+
+/**
+ * @brief Move all peers to a new channel after the radio changed channel
+ *
+ * @details Updates every peer registered with the driver to new_channel, announces the change
+ *          on it and measures the link outage: the time from the last frame
+ *          received before the change to the first frame received after it.
+ *
+ * @param[in] new_channel Channel the radio is on now
+ * @param[in] old_channel Channel it was on
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - First esp_now_mod_peer() error otherwise (the remaining peers are still updated)
+ */
+esp_err_t esp_now_comm_resync_channel(uint8_t new_channel, uint8_t old_channel);
+
+/**
+ * @brief Get the channel resynchronization state and outage measurements
+ *
+ * @param[out] stats Filled with the state
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_now_comm_get_channel_stats(esp_now_comm_channel_stats_t *stats);
+
 /**
  * @brief Deinitialize ESP-NOW communication subsystem
  *
  * @details Shuts down ESP-NOW and WiFi. After this call, all peers are
- *          unregistered and communication is no longer possible until
- *          esp_now_comm_init is called again.
+ *          unregistered and dropped from the peer table (add them again
+ *          after the next esp_now_comm_init), and communication is no longer
+ *          possible until esp_now_comm_init is called again.
  *
  * @return ESP_OK on success
  */
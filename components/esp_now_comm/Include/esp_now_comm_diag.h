@@ -0,0 +1,160 @@
+/******************************************************************************
+ * @file esp_now_comm_diag.h
+ * @brief Remote diagnostics: paginated request/response queries over ESP-NOW
+ *
+ * @details A controller sends ESP_NOW_MSG_DIAG_QUERY naming a topic and a page;
+ *          the rover answers with ESP_NOW_MSG_DIAG_REPLY frames (see
+ *          esp_now_comm_protocol.h for both layouts). Each topic is served by a
+ *          provider that fills one page at a time. The counters and the topic
+ *          index are built in, the application registers the others (main.c:
+ *          histograms, tasks, config values, recent events).
+ *
+ *          The receive path only copies the query into a queue; providers run
+ *          and replies are sent from a low-priority task, so a query never adds
+ *          work to the WiFi task or delays the control path. Queries that find
+ *          the queue full are dropped and counted; the controller retries.
+ *          The older single-purpose queries (ESP_NOW_MSG_LATENCY_QUERY and
+ *          ESP_NOW_MSG_FLIGHT_REC_QUERY) go through the same queue and task.
+ *
+ *          tools/diag_cli.py builds queries and renders the replies.
+ *
+ ******************************************************************************/
+
+#ifndef ESP_NOW_COMM_DIAG_H
+#define ESP_NOW_COMM_DIAG_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_now_comm.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Service task: below everything but idle, so queries only use spare CPU */
+#define ESP_NOW_COMM_DIAG_TASK_PRIORITY 1
+#define ESP_NOW_COMM_DIAG_TASK_STACK    3072
+
+/* Queries waiting for the service task */
+#define ESP_NOW_COMM_DIAG_QUEUE_LEN     4
+
+/* Pause between the pages of an "all pages" reply, leaves the TX queue to other traffic */
+#define ESP_NOW_COMM_DIAG_PAGE_GAP_MS   10
+
+/* Topic identifiers (u8), 0 and 1 are built in */
+#define ESP_NOW_DIAG_TOPIC_INDEX        0   /* u8 id of every registered topic */
+#define ESP_NOW_DIAG_TOPIC_COUNTERS     1   /* esp_now_comm_get_stats() and per-peer counters */
+#define ESP_NOW_DIAG_TOPIC_HISTOGRAMS   2
+#define ESP_NOW_DIAG_TOPIC_TASKS        3
+#define ESP_NOW_DIAG_TOPIC_CONFIG       4
+#define ESP_NOW_DIAG_TOPIC_EVENTS       5
+#define ESP_NOW_DIAG_TOPIC_PROFILE      6   /* Profiling builds only, see prof.h */
+#define ESP_NOW_DIAG_TOPIC_WIFI         7   /* Disconnect analytics, see wifi_manager_serialize_disconnect_stats() */
+#define ESP_NOW_DIAG_MAX_TOPICS         16
+
+/* Page number in a query asking for every page of the topic */
+#define ESP_NOW_DIAG_PAGE_ALL           0xFFFF
+
+/* Reply status */
+#define ESP_NOW_DIAG_STATUS_OK              0
+#define ESP_NOW_DIAG_STATUS_UNKNOWN_TOPIC   1
+#define ESP_NOW_DIAG_STATUS_BAD_PAGE        2
+#define ESP_NOW_DIAG_STATUS_ERROR           3
+
+/* Reply frame: message ID, 7-byte header, page data */
+#define ESP_NOW_DIAG_REPLY_HEADER       7
+#define ESP_NOW_DIAG_PAGE_MAX           (ESP_NOW_COMM_PAYLOAD_SIZE - 1 - ESP_NOW_DIAG_REPLY_HEADER)
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Fill one page of a topic
+ *
+ * @details Called from the service task, never from the receive path.
+ *
+ * @param[in] page Page to fill, from 0
+ * @param[out] buf Page data
+ * @param[in] len Size of buf (ESP_NOW_DIAG_PAGE_MAX)
+ * @param[out] out_len Bytes written to buf
+ * @param[out] page_count Number of pages the topic has right now (at least 1)
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_FOUND if page >= page_count (page_count still set)
+ *      - Other error codes on failure
+ */
+typedef esp_err_t (*esp_now_comm_diag_provider_t)(uint16_t page, uint8_t *buf, size_t len,
+                                                  size_t *out_len, uint16_t *page_count);
+
+/**
+ * @brief Service counters
+ */
+typedef struct
+{
+    uint32_t queries;           /* Well-formed queries accepted into the queue (all three kinds) */
+    uint32_t dropped;           /* Queries dropped: queue full, malformed or service not running */
+    uint32_t replies;           /* Reply frames accepted by esp_now_comm_send(), report and page frames included */
+    uint32_t send_errors;       /* Reply frames esp_now_comm_send() rejected */
+} esp_now_comm_diag_stats_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Start the diagnostics service task
+ *
+ * @return
+ *      - ESP_OK on success (also if already running)
+ *      - ESP_FAIL if the queue or task could not be created
+ */
+esp_err_t esp_now_comm_diag_init(void);
+
+/**
+ * @brief Register the provider of a topic (replaces a previous one)
+ *
+ * @param[in] topic Topic identifier, ESP_NOW_DIAG_TOPIC_COUNTERS + 1 .. ESP_NOW_DIAG_MAX_TOPICS - 1
+ * @param[in] provider Page provider, NULL to unregister
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if the topic is out of range or built in
+ */
+esp_err_t esp_now_comm_diag_register(uint8_t topic, esp_now_comm_diag_provider_t provider);
+
+/**
+ * @brief Queue a received ESP_NOW_MSG_DIAG_QUERY, _LATENCY_QUERY or _FLIGHT_REC_QUERY frame, never blocks
+ *
+ * @details Call from the receive callback.
+ *
+ * @param[in] mac_addr Requester, the replies go there (must be a registered peer)
+ * @param[in] data Query frame, including the message ID
+ * @param[in] len Frame length
+ *
+ * @return
+ *      - ESP_OK if the query was queued
+ *      - ESP_ERR_INVALID_SIZE if the frame is too short
+ *      - ESP_ERR_INVALID_ARG if the frame is not one of the three queries
+ *      - ESP_ERR_INVALID_STATE if the service is not running
+ *      - ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t esp_now_comm_diag_submit(const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/**
+ * @brief Get the service counters
+ *
+ * @param[out] stats Filled with the counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_now_comm_diag_get_stats(esp_now_comm_diag_stats_t *stats);
+
+#endif /* ESP_NOW_COMM_DIAG_H */
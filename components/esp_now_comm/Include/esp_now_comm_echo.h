@@ -0,0 +1,124 @@
+/******************************************************************************
+ * @file esp_now_comm_echo.h
+ * @brief ESP-NOW round-trip benchmark: echo requests and an RTT histogram
+ *
+ * @details Every ESP_NOW_MSG_ECHO_REQUEST received is sent back unchanged as
+ *          ESP_NOW_MSG_ECHO_REPLY, so a controller (or a second rover) can time
+ *          the link. With ESP_NOW_COMM_ECHO_INTERVAL_MS != 0 the rover also
+ *          sends requests itself, to one peer per period in turn, and records
+ *          the round-trip time of the reply; the peer has to echo 0xDA frames
+ *          as 0xDB with the payload unchanged. Only one request is open at a
+ *          time: a reply is timed only if it comes from the peer the open
+ *          request went to and carries its sequence number, and the time is
+ *          taken from the request, not from the reply. Stale, duplicate and
+ *          unsolicited replies are counted and ignored.
+ *
+ *          The histogram is the link latency seen by the command path, so
+ *          running the echo build once in WIFI_MANAGER_MODE_STA and once in
+ *          WIFI_MANAGER_MODE_ESPNOW_ONLY shows what the AP costs. RTTs are kept
+ *          per radio profile (the one active when the reply arrives), so one run
+ *          that steps through the profiles with ESP_NOW_MSG_RADIO_PROFILE_SET
+ *          compares them.
+ *
+ ******************************************************************************/
+
+#ifndef ESP_NOW_COMM_ECHO_H
+#define ESP_NOW_COMM_ECHO_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_now_comm.h"
+#include "wifi_manager.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch: period of the rover's own echo requests, 0 = only answer requests */
+#ifndef ESP_NOW_COMM_ECHO_INTERVAL_MS
+#define ESP_NOW_COMM_ECHO_INTERVAL_MS 0
+#endif
+
+/* Request frame: message ID, u16 sequence, u32 send time (us, sender clock), padding up to the payload size */
+#define ESP_NOW_COMM_ECHO_HEADER    7
+
+/* Payload length of the rover's own requests, the size of a typical command frame */
+#define ESP_NOW_COMM_ECHO_LEN       32
+
+/* Number of log2 buckets: bucket n counts RTTs of [2^n, 2^(n+1)) us, the last one everything above */
+#define ESP_NOW_COMM_ECHO_BUCKETS   18
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief RTT histogram of the replies received under one radio profile
+ */
+typedef struct
+{
+    uint32_t replies;                           /* Replies to own requests (at most one per request) */
+    uint32_t min_us;                            /* Smallest RTT (UINT32_MAX if replies == 0) */
+    uint32_t max_us;                            /* Largest RTT */
+    uint32_t buckets[ESP_NOW_COMM_ECHO_BUCKETS];
+} esp_now_comm_echo_hist_t;
+
+/**
+ * @brief Echo counters and RTT histograms
+ */
+typedef struct
+{
+    uint32_t requests_sent;                     /* Own requests accepted by esp_now_comm_send() */
+    uint32_t answered;                          /* Requests of other devices echoed back */
+    uint32_t ignored;                           /* Replies that answer no open request: stale, duplicate, unsolicited */
+    esp_now_comm_echo_hist_t profiles[WIFI_RADIO_PROFILE_COUNT];   /* Indexed by wifi_radio_profile_t */
+} esp_now_comm_echo_stats_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Start sending echo requests every interval_ms
+ *
+ * @param[in] interval_ms Request period, 0 to only answer requests
+ *
+ * @return
+ *      - ESP_OK on success (also if interval_ms is 0)
+ *      - ESP_ERR_INVALID_STATE if already started
+ *      - Error code of the esp_timer calls otherwise
+ */
+esp_err_t esp_now_comm_echo_start(uint32_t interval_ms);
+
+/**
+ * @brief Handle a received ESP_NOW_MSG_ECHO_REQUEST or ESP_NOW_MSG_ECHO_REPLY frame
+ *
+ * @details Call from the receive callback. Requests are echoed from here, replies
+ *          are timed here.
+ *
+ * @param[in] mac_addr Sender (must be a registered peer for a request to be answered)
+ * @param[in] data Frame, including the message ID
+ * @param[in] len Frame length
+ */
+void esp_now_comm_echo_handle(const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/**
+ * @brief Get the echo counters and the RTT histograms
+ *
+ * @param[out] stats Filled with the counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_now_comm_echo_get_stats(esp_now_comm_echo_stats_t *stats);
+
+/**
+ * @brief Print the echo counters and the RTT percentiles of each radio profile that saw replies
+ */
+void esp_now_comm_echo_print(void);
+
+#endif /* ESP_NOW_COMM_ECHO_H */
@@ -0,0 +1,211 @@
+/******************************************************************************
+ * @file esp_now_comm_lease.h
+ * @brief Control lease: only one controller at a time drives the rover
+ *
+ * @details Any device that knows the rover's MAC can send to it, so two
+ *          controllers in range would interleave their commands. A controller
+ *          takes a time-limited lease with ESP_NOW_MSG_LEASE_ACQUIRE and renews
+ *          it by sending the request again before it runs out; while the lease
+ *          is held, control frames (every message outside the diagnostics and
+ *          link management ranges, see ESP_NOW_MSG_IS_CONTROL()) from anybody
+ *          else are dropped in esp_now_comm's receive callback right after the
+ *          peer lookup: before latency marks, profiling, per-peer accounting,
+ *          the deferred log and the application callback. Diagnostics and echo
+ *          messages are not gated; radio configuration messages are, see
+ *          esp_now_comm_lease_may_configure().
+ *
+ *          A request with a higher priority than the holder's preempts it; an
+ *          equal or lower one is refused. The holder gives the lease up with
+ *          ESP_NOW_MSG_LEASE_RELEASE or passes it on with
+ *          ESP_NOW_MSG_LEASE_HANDOFF (the new holder keeps the priority). Only
+ *          paired controllers (esp_now_comm_pairing.h) can hold the lease.
+ *          With ESP_NOW_COMM_LEASE_IMPLICIT, a paired controller that sends
+ *          commands while nobody holds the lease gets an implicit one at
+ *          ESP_NOW_LEASE_PRIO_IMPLICIT, renewed by its own commands, so
+ *          controllers that don't speak the lease messages keep working one at
+ *          a time.
+ *
+ *          Every request is answered with ESP_NOW_MSG_LEASE_STATUS; a holder
+ *          that loses the lease to a preemption or a handoff is told the same
+ *          way. The receive path reads the lease through a seqlock, the
+ *          requests update it in a short critical section.
+ *
+ *          Frames: acquire  u8 priority, u16 duration (ms, 0 = default)
+ *                  release  no payload
+ *                  handoff  u8 new holder MAC[6], u16 duration (ms, 0 = default)
+ *                  status   u8 esp_now_comm_lease_result_t, u8 holder MAC[6]
+ *                           (zero if none), u8 priority, u16 remaining (ms),
+ *                           u16 epoch (bumped on every change of holder)
+ *
+ ******************************************************************************/
+
+#ifndef ESP_NOW_COMM_LEASE_H
+#define ESP_NOW_COMM_LEASE_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now_comm.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch: drop control frames of controllers without the lease (0 = accept all, e.g. for load_gen soak runs) */
+#ifndef ESP_NOW_COMM_LEASE_ENFORCE
+#define ESP_NOW_COMM_LEASE_ENFORCE 1
+#endif
+
+/* Build switch: a paired controller's commands take the lease while nobody holds it */
+#ifndef ESP_NOW_COMM_LEASE_IMPLICIT
+#define ESP_NOW_COMM_LEASE_IMPLICIT 1
+#endif
+
+/* Build switch: lease duration of requests asking for 0 ms, and of implicit leases */
+#ifndef ESP_NOW_COMM_LEASE_DEFAULT_MS
+#define ESP_NOW_COMM_LEASE_DEFAULT_MS 1000
+#endif
+
+/* Build switch: longest lease granted, longer requests are cut to it */
+#ifndef ESP_NOW_COMM_LEASE_MAX_MS
+#define ESP_NOW_COMM_LEASE_MAX_MS 10000
+#endif
+
+/* Priority of implicit leases: any explicit request with a priority above it preempts them */
+#define ESP_NOW_LEASE_PRIO_IMPLICIT 0
+
+/* Frame lengths, including the message ID */
+#define ESP_NOW_LEASE_ACQUIRE_LEN   4
+#define ESP_NOW_LEASE_RELEASE_LEN   1
+#define ESP_NOW_LEASE_HANDOFF_LEN   9
+#define ESP_NOW_LEASE_STATUS_LEN    13
+
+_Static_assert(ESP_NOW_COMM_LEASE_DEFAULT_MS > 0 && ESP_NOW_COMM_LEASE_DEFAULT_MS <= ESP_NOW_COMM_LEASE_MAX_MS &&
+               ESP_NOW_COMM_LEASE_MAX_MS <= 0xFFFF, "Lease durations must fit the u16 of the status frame");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Outcome of a lease request, sent back in ESP_NOW_MSG_LEASE_STATUS
+ */
+typedef enum
+{
+    ESP_NOW_LEASE_GRANTED = 0,      /* The requester holds the lease now */
+    ESP_NOW_LEASE_RENEWED,          /* The holder's lease was extended */
+    ESP_NOW_LEASE_BUSY,             /* Held by another controller at an equal or higher priority */
+    ESP_NOW_LEASE_NOT_PAIRED,       /* The requester (or handoff target) is not a paired controller */
+    ESP_NOW_LEASE_NOT_HOLDER,       /* Release or handoff from a controller that doesn't hold the lease */
+    ESP_NOW_LEASE_RELEASED,         /* The holder gave the lease up */
+    ESP_NOW_LEASE_HANDED_OFF,       /* The holder passed the lease on */
+    ESP_NOW_LEASE_PREEMPTED,        /* To the former holder: a higher priority request took the lease */
+    ESP_NOW_LEASE_INVALID,          /* Malformed request */
+} esp_now_comm_lease_result_t;
+
+/**
+ * @brief Lease holder and counters
+ */
+typedef struct
+{
+    uint8_t  holder[6];         /* Current holder (valid if held) */
+    bool     held;              /* A controller holds an unexpired lease */
+    uint8_t  priority;          /* Priority of the lease */
+    uint32_t remaining_ms;      /* Time left on the lease */
+    uint16_t epoch;             /* Changes of holder since boot (wraps) */
+    uint32_t grants;            /* Leases granted to a new holder (including implicit ones and handoffs) */
+    uint32_t implicit;          /* Of those, implicit ones */
+    uint32_t renewals;          /* Leases extended by their holder */
+    uint32_t preemptions;       /* Holders displaced by a higher priority */
+    uint32_t handoffs;          /* Leases passed on by their holder */
+    uint32_t releases;          /* Leases given up by their holder */
+    uint32_t expiries;          /* Leases that ran out before the next request */
+    uint32_t refused;           /* Requests answered with BUSY, NOT_PAIRED, NOT_HOLDER or INVALID, or from strangers */
+    uint32_t admitted;          /* Control frames of the holder */
+    uint32_t dropped;           /* Control frames dropped because the sender didn't hold the lease */
+    uint32_t config_refused;    /* Radio configuration commands refused by esp_now_comm_lease_may_configure() */
+} esp_now_comm_lease_stats_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Check whether a control frame may be handed on
+ *
+ * @details Called by esp_now_comm's receive callback for every control frame,
+ *          right after the peer lookup. With a lease held this is a seqlock
+ *          read, a clock read and a 6-byte compare; with the lease free a
+ *          sender that is not a controller is refused without further work.
+ *
+ * @param[in] mac_addr Sender
+ * @param[in] controller The sender is a peer with ESP_NOW_COMM_ROLE_CONTROLLER
+ *
+ * @return true if the sender holds the lease (or took an implicit one), false to drop the frame
+ */
+bool esp_now_comm_lease_admit(const uint8_t *mac_addr, bool controller);
+
+/**
+ * @brief Check whether a sender may change the radio configuration
+ *
+ * @details For the commands that move the rover off its controller's link
+ *          (WiFi mode, channel, radio profile). Allowed for the lease holder,
+ *          or for any paired controller while nobody holds the lease; never
+ *          for strangers, even with ESP_NOW_COMM_LEASE_ENFORCE off. Takes no
+ *          lease. Refusals are counted.
+ *
+ * @param[in] mac_addr Sender
+ *
+ * @return true if the command may be applied
+ */
+bool esp_now_comm_lease_may_configure(const uint8_t *mac_addr);
+
+/**
+ * @brief Handle a received ESP_NOW_MSG_LEASE_ACQUIRE, _RELEASE or _HANDOFF frame
+ *
+ * @details Call from the receive callback. Answers with ESP_NOW_MSG_LEASE_STATUS.
+ *          Frames from senders that are not controller peers are counted as
+ *          refused and dropped unanswered, before the pairing list is looked at.
+ *
+ * @param[in] mac_addr Sender
+ * @param[in] data Frame, including the message ID
+ * @param[in] len Frame length
+ */
+void esp_now_comm_lease_handle(const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/**
+ * @brief Take the lease away from its holder (e.g. on a local stop request)
+ *
+ * @details The holder is told with ESP_NOW_LEASE_PREEMPTED.
+ */
+void esp_now_comm_lease_revoke(void);
+
+/**
+ * @brief Get the lease holder and counters
+ *
+ * @param[out] stats Filled with the counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_now_comm_lease_get_stats(esp_now_comm_lease_stats_t *stats);
+
+/**
+ * @brief Name of a lease result
+ *
+ * @param[in] result Result
+ *
+ * @return Static string
+ */
+const char *esp_now_comm_lease_result_name(esp_now_comm_lease_result_t result);
+
+/**
+ * @brief Print the lease holder and counters
+ */
+void esp_now_comm_lease_print(void);
+
+#endif /* ESP_NOW_COMM_LEASE_H */
@@ -0,0 +1,197 @@
+/******************************************************************************
+ * @file esp_now_comm_pairing.h
+ * @brief ESP-NOW discovery and pairing with controllers, persisted in NVS
+ *
+ * @details A controller looking for rovers broadcasts ESP_NOW_MSG_PAIR_BEACON
+ *          (to FF:FF:FF:FF:FF:FF, so it needs no peer entry). The rover adds
+ *          the controller as a peer with ESP_NOW_COMM_ROLE_CONTROLLER, answers
+ *          with ESP_NOW_MSG_PAIR_REPLY carrying its capabilities, and stores
+ *          the controller's MAC in NVS; the controller adds the rover as a peer
+ *          when the reply arrives. Beacons are handled in an esp_timer
+ *          callback, never in the WiFi task.
+ *
+ *          At boot esp_now_comm_pairing_init() registers every stored
+ *          controller right after esp_now_comm_init(), so a paired rover takes
+ *          commands without waiting for a beacon. Control frames that arrive
+ *          in between find no controller peer and are dropped. Up to
+ *          ESP_NOW_COMM_PAIRING_MAX controllers are kept, most recently paired
+ *          first; a new one pushes out the oldest.
+ *
+ *          Beacons from controllers that are not stored yet are only accepted
+ *          while none is stored or within ESP_NOW_COMM_PAIRING_WINDOW_MS of
+ *          boot, and then only into a free place: adding a controller to a
+ *          full list pushes out the oldest one, which needs pairing to be
+ *          armed (esp_now_comm_pairing_arm(), or ESP_NOW_MSG_PAIR_ARM from the
+ *          controller in charge). A stranger's beacon during the boot window
+ *          never evicts a stored controller. Stored controllers are always
+ *          answered; a beacon that only changes their order is written to NVS
+ *          at most once per ESP_NOW_COMM_PAIRING_SAVE_MIN_MS.
+ *
+ *          Frames: beacon   u8 version, u8 role, u16 capabilities, u32 nonce
+ *                  reply    u8 version, u8 role, u16 capabilities, u32 nonce of
+ *                           the beacon, u8 channel, u8 flags
+ *
+ ******************************************************************************/
+
+#ifndef ESP_NOW_COMM_PAIRING_H
+#define ESP_NOW_COMM_PAIRING_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_now_comm.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch: controllers remembered in NVS */
+#ifndef ESP_NOW_COMM_PAIRING_MAX
+#define ESP_NOW_COMM_PAIRING_MAX 4
+#endif
+
+/* Build switch: new controllers take free places this long after boot (and always while none is stored), 0 = always */
+#ifndef ESP_NOW_COMM_PAIRING_WINDOW_MS
+#define ESP_NOW_COMM_PAIRING_WINDOW_MS 60000
+#endif
+
+/* Build switch: how long esp_now_comm_pairing_arm() lets a new controller in, pushing out the oldest if needed */
+#ifndef ESP_NOW_COMM_PAIRING_ARM_MS
+#define ESP_NOW_COMM_PAIRING_ARM_MS 60000
+#endif
+
+/* Build switch: shortest gap between NVS writes that only reorder the stored controllers */
+#ifndef ESP_NOW_COMM_PAIRING_SAVE_MIN_MS
+#define ESP_NOW_COMM_PAIRING_SAVE_MIN_MS 600000
+#endif
+
+/* Version of the pairing frames */
+#define ESP_NOW_PAIR_VERSION        1
+
+/* Frame lengths, including the message ID */
+#define ESP_NOW_PAIR_BEACON_LEN     9
+#define ESP_NOW_PAIR_REPLY_LEN      11
+
+/* Capability bits of the reply */
+#define ESP_NOW_PAIR_CAP_DRIVE      (1u << 0)   /* Takes drive commands */
+#define ESP_NOW_PAIR_CAP_DIAG       (1u << 1)   /* Answers ESP_NOW_MSG_DIAG_QUERY */
+#define ESP_NOW_PAIR_CAP_ECHO       (1u << 2)   /* Answers ESP_NOW_MSG_ECHO_REQUEST */
+#define ESP_NOW_PAIR_CAP_ESPNOW_ONLY (1u << 3)  /* Runs without an AP, pinned to the reply's channel */
+
+/* Flag bits of the reply */
+#define ESP_NOW_PAIR_FLAG_KNOWN     (1u << 0)   /* The controller was already stored */
+
+_Static_assert(ESP_NOW_COMM_PAIRING_MAX <= ESP_NOW_COMM_MAX_PEERS, "Paired controllers must fit the peer list");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Pairing counters and boot timing (times in ms since boot, 0 = not yet)
+ */
+typedef struct
+{
+    uint8_t  paired;            /* Controllers stored */
+    uint8_t  restored;          /* Controllers registered from NVS at boot */
+    uint32_t beacons;           /* Beacons received */
+    uint32_t replies;           /* Replies sent */
+    uint32_t rejected;          /* Beacons of new controllers outside the pairing window or unarmed with a full list, or malformed */
+    uint32_t busy;              /* Beacons dropped while another one was being handled */
+    uint32_t errors;            /* Failed peer registrations, replies or NVS writes */
+    uint32_t saves;             /* NVS writes of the list */
+    uint32_t restore_ms;        /* Stored controllers registered */
+    uint32_t paired_ms;         /* First new controller paired by discovery in this boot */
+    uint32_t first_cmd_ms;      /* First command from a paired controller: the time to first command */
+    bool     first_cmd_cached;  /* That controller was restored from NVS, not discovered in this boot */
+} esp_now_comm_pairing_stats_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Register the stored controllers as peers and start answering beacons
+ *
+ * @details Call right after esp_now_comm_init(). NVS must be initialized.
+ *
+ * @return
+ *      - ESP_OK on success (also if nothing is stored)
+ *      - Error code of the esp_timer calls otherwise
+ */
+esp_err_t esp_now_comm_pairing_init(void);
+
+/**
+ * @brief Handle a received ESP_NOW_MSG_PAIR_BEACON frame
+ *
+ * @details Call from the receive callback: checks the frame and hands the
+ *          work to the pairing timer.
+ *
+ * @param[in] mac_addr Sender
+ * @param[in] data Frame, including the message ID
+ * @param[in] len Frame length
+ */
+void esp_now_comm_pairing_handle(const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/**
+ * @brief Note a command frame, for the boot-to-first-command time
+ *
+ * @details Call from the receive callback for every control frame. Only the
+ *          first one from a paired controller is recorded; after that this is
+ *          a single atomic load.
+ *
+ * @param[in] mac_addr Sender
+ */
+void esp_now_comm_pairing_note_command(const uint8_t *mac_addr);
+
+/**
+ * @brief Let the next new controller in for ESP_NOW_COMM_PAIRING_ARM_MS
+ *
+ * @details Outside the boot window, or with the list full, a new controller is
+ *          only paired while armed; it then pushes out the oldest stored one.
+ *          Pairing a new controller disarms.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_STATE if esp_now_comm_pairing_init() has not run
+ */
+esp_err_t esp_now_comm_pairing_arm(void);
+
+/**
+ * @brief Check whether a MAC address is a stored controller
+ *
+ * @param[in] mac_addr 6-byte MAC address
+ *
+ * @return true if paired
+ */
+bool esp_now_comm_pairing_is_paired(const uint8_t *mac_addr);
+
+/**
+ * @brief Forget all stored controllers: unregister them and erase them from NVS
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - Error code of the NVS calls otherwise
+ */
+esp_err_t esp_now_comm_pairing_forget(void);
+
+/**
+ * @brief Get the pairing counters and boot timing
+ *
+ * @param[out] stats Filled with the counters
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t esp_now_comm_pairing_get_stats(esp_now_comm_pairing_stats_t *stats);
+
+/**
+ * @brief Print the stored controllers, counters and boot timing
+ */
+void esp_now_comm_pairing_print(void);
+
+#endif /* ESP_NOW_COMM_PAIRING_H */
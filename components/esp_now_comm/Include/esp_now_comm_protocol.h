@@ -0,0 +1,78 @@
+/******************************************************************************
+ * @file esp_now_comm_protocol.h
+ * @brief Message identifiers of the application protocol carried over ESP-NOW
+ *
+ * @details The first payload byte of every frame identifies the message. The
+ *          rest of the frame is message specific and little endian.
+ *          0xD0..0xDF is reserved for diagnostics, 0xE0..0xEF for link
+ *          management (pairing, control lease). Everything else is control
+ *          traffic, accepted only from the lease holder.
+ *
+ ******************************************************************************/
+
+#ifndef ESP_NOW_COMM_PROTOCOL_H
+#define ESP_NOW_COMM_PROTOCOL_H
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Controller -> rover, no payload: request the latency histograms */
+#define ESP_NOW_MSG_LATENCY_QUERY  0xD0
+/* Rover -> controller: one frame per stage, payload as produced by latency_probe_serialize() */
+#define ESP_NOW_MSG_LATENCY_REPORT 0xD1
+/* Rover -> controller: deferred log records, payload as handed to the deferred_log sink */
+#define ESP_NOW_MSG_DLOG_RECORDS   0xD2
+/* Controller -> rover, payload u16 first record (optional, default 0): request one flight recorder page */
+#define ESP_NOW_MSG_FLIGHT_REC_QUERY  0xD3
+/* Rover -> controller: one page as produced by flight_recorder_dump_page() */
+#define ESP_NOW_MSG_FLIGHT_REC_PAGE   0xD4
+/* Controller -> rover, no payload: clear a frozen flight recorder and resume recording.
+ * Same senders as ESP_NOW_MSG_WIFI_MODE_SET */
+#define ESP_NOW_MSG_FLIGHT_REC_RESUME 0xD5
+/* Rover -> controller, every SYS_MONITOR_PERIOD_MS: payload as produced by sys_monitor_serialize() */
+#define ESP_NOW_MSG_SYSMON_REPORT     0xD6
+/* Controller -> rover: u8 request id, u8 topic, u16 page (0xFFFF = all pages), see esp_now_comm_diag.h */
+#define ESP_NOW_MSG_DIAG_QUERY        0xD7
+/* Rover -> controller: u8 request id, u8 topic, u8 status, u16 page, u16 page count, page data */
+#define ESP_NOW_MSG_DIAG_REPLY        0xD8
+/* Controller -> rover, no payload: clear the cycle profiling table (profiling builds only).
+ * Same senders as ESP_NOW_MSG_WIFI_MODE_SET */
+#define ESP_NOW_MSG_PROF_RESET        0xD9
+/* Either direction: u16 sequence, u32 send time (us, sender clock), padding; echoed back unchanged as 0xDB */
+#define ESP_NOW_MSG_ECHO_REQUEST      0xDA
+/* Reply to ESP_NOW_MSG_ECHO_REQUEST, payload of the request, see esp_now_comm_echo.h */
+#define ESP_NOW_MSG_ECHO_REPLY        0xDB
+/* Controller -> rover: u8 wifi_manager_mode_t, u8 ESP-NOW-only channel; stored in NVS, effective after reboot.
+ * Lease holder (or a paired controller while the lease is free) only, see esp_now_comm_lease_may_configure() */
+#define ESP_NOW_MSG_WIFI_MODE_SET     0xDC
+/* Rover -> controller: u8 new channel, u8 old channel; sent on the old channel before a planned move and on the new one after any move */
+#define ESP_NOW_MSG_CHANNEL_CHANGE    0xDD
+/* Controller -> rover: u8 channel; ESP-NOW-only mode: move the radio now (not stored), for link outage tests.
+ * Same senders as ESP_NOW_MSG_WIFI_MODE_SET */
+#define ESP_NOW_MSG_CHANNEL_SET       0xDE
+/* Controller -> rover: u8 wifi_radio_profile_t (base profile), optional u8 auto low latency (0/1); not stored.
+ * Same senders as ESP_NOW_MSG_WIFI_MODE_SET */
+#define ESP_NOW_MSG_RADIO_PROFILE_SET 0xDF
+
+/* Controller -> broadcast: u8 version, u8 role, u16 capabilities, u32 nonce; see esp_now_comm_pairing.h */
+#define ESP_NOW_MSG_PAIR_BEACON       0xE0
+/* Rover -> controller: u8 version, u8 role, u16 capabilities, u32 nonce of the beacon, u8 channel, u8 flags */
+#define ESP_NOW_MSG_PAIR_REPLY        0xE1
+/* Controller -> rover: u8 priority, u16 duration (ms, 0 = default); takes or renews the control lease, see esp_now_comm_lease.h */
+#define ESP_NOW_MSG_LEASE_ACQUIRE     0xE2
+/* Holder -> rover, no payload: give the control lease up */
+#define ESP_NOW_MSG_LEASE_RELEASE     0xE3
+/* Holder -> rover: u8 new holder MAC[6], u16 duration (ms, 0 = default); pass the lease on */
+#define ESP_NOW_MSG_LEASE_HANDOFF     0xE4
+/* Rover -> controller: u8 result, u8 holder MAC[6], u8 priority, u16 remaining (ms), u16 epoch */
+#define ESP_NOW_MSG_LEASE_STATUS      0xE5
+/* Controller in charge -> rover, no payload: arm pairing, see esp_now_comm_pairing_arm() */
+#define ESP_NOW_MSG_PAIR_ARM          0xE6
+/* Simulated peer -> rover (load generator, injected only): u8 peer index, u32 sequence, fill; dispatched, never acted on */
+#define ESP_NOW_MSG_LOAD_GEN_DATA     0xE7
+
+/* Control traffic (drive commands): outside the diagnostics and link management ranges */
+#define ESP_NOW_MSG_IS_CONTROL(id)    ((uint8_t)(id) < 0xD0u || (uint8_t)(id) > 0xEFu)
+
+#endif /* ESP_NOW_COMM_PROTOCOL_H */
@@ -0,0 +1,464 @@
+/******************************************************************************
+ * @file esp_now_peer_table.h
+ * @brief Hash-indexed table of the ESP-NOW peers and their runtime state
+ *
+ * @details Plain C11 with no ESP-IDF dependencies, shared by the firmware
+ *          (esp_now_comm.c) and the host benchmarks. The entries live in a
+ *          dense array; a separate open addressing index of 16-bit slots
+ *          (8-bit fingerprint, entry number) is probed linearly from the home
+ *          slot given by a multiplicative hash of the 6-byte MAC. A lookup from
+ *          the receive callback is one multiply, a couple of 16-bit loads and
+ *          one 64-bit compare; a frame from an unknown sender almost always
+ *          ends at an empty slot or a fingerprint mismatch without touching an
+ *          entry. The index stays at most half full.
+ *
+ *          The table tracks logical peers. Only some of them are registered
+ *          with the ESP-NOW driver at a time (the driver holds 20); the
+ *          registered flag and last_active_ms let the owner pick the least
+ *          recently active one to unregister (peer_table_lru()).
+ *
+ *          Insert and remove must come from one task at a time (esp_now_comm
+ *          serializes them with a mutex). Lookups may run concurrently with
+ *          them: an entry's MAC and key are written before its index slot is
+ *          published, removal leaves a tombstone so that probe chains through
+ *          the slot stay intact, and the key is two 32-bit words checked
+ *          against the entry's generation, so a lookup never matches a key
+ *          that is being rewritten. Runtime fields are atomics updated with
+ *          relaxed ordering.
+ *
+ *          A lookup only pins the entry for as long as the insert side leaves
+ *          it alone: a caller still holding the pointer when the peer is
+ *          removed and the entry refilled adds its update to the new peer.
+ *          Insert takes free entries round robin, so a freed entry comes back
+ *          last and that window is only open when the table is nearly full;
+ *          the cost is at most one frame's counters, RSSI sample and activity
+ *          time credited to the wrong peer.
+ *
+ ******************************************************************************/
+
+#ifndef ESP_NOW_PEER_TABLE_H
+#define ESP_NOW_PEER_TABLE_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Entries the table accepts (logical peers, more than the ESP-NOW driver holds at once) */
+#ifndef PEER_TABLE_MAX_ENTRIES
+#define PEER_TABLE_MAX_ENTRIES 64
+#endif
+
+/* Slots of the index; must be a power of two */
+#ifndef PEER_TABLE_SLOTS
+#define PEER_TABLE_SLOTS 128
+#endif
+
+_Static_assert((PEER_TABLE_SLOTS & (PEER_TABLE_SLOTS - 1)) == 0, "PEER_TABLE_SLOTS must be a power of two");
+_Static_assert(PEER_TABLE_MAX_ENTRIES * 2 <= PEER_TABLE_SLOTS, "The peer index must stay at most half full");
+_Static_assert(PEER_TABLE_MAX_ENTRIES < 0xFF, "Entry numbers must fit the low byte of an index slot");
+
+/* Index slot values: empty, tombstone, otherwise fingerprint << 8 | (entry number + 1) */
+#define PEER_INDEX_EMPTY        0x0000u
+#define PEER_INDEX_TOMBSTONE    0x00FFu
+
+/* Shift of the RSSI average (alpha = 1/8) and of the ACK ratio average (alpha = 1/16) */
+#define PEER_TABLE_RSSI_SHIFT   3
+#define PEER_TABLE_ACK_SHIFT    4
+
+/* Full scale of the ACK ratio average */
+#define PEER_TABLE_ACK_ONE      0xFFFFu
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Traffic counters, updated lock-free from the callbacks and the sending task
+ */
+typedef struct
+{
+    _Atomic uint32_t rx_frames;
+    _Atomic uint32_t rx_bytes;
+    _Atomic uint32_t rx_dropped;
+    _Atomic uint32_t tx_frames;
+    _Atomic uint32_t tx_bytes;
+    _Atomic uint32_t tx_success;
+    _Atomic uint32_t tx_fail;
+    _Atomic uint32_t last_seen_ms;
+    _Atomic int8_t   rssi;
+    _Atomic int8_t   noise_floor;
+} peer_counters_t;
+
+/**
+ * @brief One peer and its runtime state
+ */
+typedef struct
+{
+    _Atomic bool     in_use;            /* Holds a peer (for iterating over the entries) */
+    _Atomic bool     registered;        /* Registered with the ESP-NOW driver (changed by the inserting task only) */
+    uint8_t          role;              /* Application defined (esp_now_comm_peer_role_t) */
+    uint8_t          mac_addr[6];       /* Written before the entry is indexed, never while in use */
+    _Atomic uint32_t gen;               /* Odd while the key is rewritten, bumped by every insert */
+    _Atomic uint32_t key_lo;            /* mac_addr packed by peer_table_key(), bits 0..31 */
+    _Atomic uint32_t key_hi;            /* Bits 32..47 */
+    peer_counters_t  counters;
+    _Atomic uint32_t last_active_ms;    /* Last frame to or from the peer, orders the peers for eviction */
+
+    /* Link quality */
+    _Atomic int16_t  rssi_avg_q4;       /* Moving average of the RSSI in 1/16 dBm, 0 = no sample yet */
+    _Atomic uint16_t tx_ack_avg;        /* Moving average of ACKed sends, PEER_TABLE_ACK_ONE = all ACKed */
+
+    /* Sequence state of the frames received from the peer (written by the receiving task only) */
+    _Atomic bool     rx_seq_valid;      /* rx_seq holds a sequence number */
+    _Atomic uint16_t rx_seq;            /* Highest sequence number received */
+    _Atomic uint32_t rx_seq_lost;       /* Sequence numbers skipped */
+    _Atomic uint32_t rx_seq_late;       /* Duplicates and frames older than rx_seq */
+} peer_entry_t;
+
+/**
+ * @brief Peer table
+ */
+typedef struct
+{
+    uint32_t         count;                             /* Entries in use */
+    uint32_t         next;                              /* Entry the next insert tries first */
+    _Atomic uint16_t index[PEER_TABLE_SLOTS];           /* PEER_INDEX_* or fingerprint << 8 | (entry + 1) */
+    peer_entry_t     entries[PEER_TABLE_MAX_ENTRIES];
+} peer_table_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Pack a MAC address into the 48-bit table key
+ */
+static inline uint64_t peer_table_key(const uint8_t *mac)
+{
+    return (uint64_t)mac[0] | ((uint64_t)mac[1] << 8) | ((uint64_t)mac[2] << 16) |
+           ((uint64_t)mac[3] << 24) | ((uint64_t)mac[4] << 32) | ((uint64_t)mac[5] << 40);
+}
+
+/**
+ * @brief Hash of a key (Fibonacci hashing: bits 32..63 of key * 2^64 / phi);
+ *        the low bits give the home slot, the top 8 bits the fingerprint
+ */
+static inline uint32_t peer_table_hash(uint64_t key)
+{
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/**
+ * @brief Reset all counters of a set to zero
+ */
+static inline void peer_table_clear_counters(peer_counters_t *c)
+{
+    atomic_store_explicit(&c->rx_frames, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->rx_bytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->rx_dropped, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->tx_frames, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->tx_bytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->tx_success, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->tx_fail, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->last_seen_ms, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->rssi, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->noise_floor, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Reset the counters, link quality and sequence state of an entry
+ */
+static inline void peer_table_clear_entry(peer_entry_t *e)
+{
+    peer_table_clear_counters(&e->counters);
+    atomic_store_explicit(&e->rssi_avg_q4, 0, memory_order_relaxed);
+    atomic_store_explicit(&e->tx_ack_avg, PEER_TABLE_ACK_ONE, memory_order_relaxed);
+    atomic_store_explicit(&e->rx_seq_valid, false, memory_order_relaxed);
+    atomic_store_explicit(&e->rx_seq, 0, memory_order_relaxed);
+    atomic_store_explicit(&e->rx_seq_lost, 0, memory_order_relaxed);
+    atomic_store_explicit(&e->rx_seq_late, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Empty the table
+ */
+static inline void peer_table_init(peer_table_t *t)
+{
+    t->count = 0;
+    t->next = 0;
+    for (uint32_t i = 0; i < PEER_TABLE_SLOTS; i++)
+    {
+        atomic_store_explicit(&t->index[i], PEER_INDEX_EMPTY, memory_order_relaxed);
+    }
+    for (uint32_t i = 0; i < PEER_TABLE_MAX_ENTRIES; i++)
+    {
+        atomic_store_explicit(&t->entries[i].in_use, false, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Probe the index for a key
+ *
+ * @param[in] t Table
+ * @param[in] key Key from peer_table_key()
+ * @param[out] slot Index slot of the key, if found
+ *
+ * @return Entry of the key, NULL if it is not in the table
+ */
+static inline peer_entry_t *peer_table_probe(peer_table_t *t, uint64_t key, uint32_t *slot)
+{
+    uint32_t hash = peer_table_hash(key);
+    uint32_t fingerprint = (hash >> 24) << 8;
+    uint32_t i = hash & (PEER_TABLE_SLOTS - 1u);
+
+    for (uint32_t n = 0; n < PEER_TABLE_SLOTS; n++)
+    {
+        uint32_t v = atomic_load_explicit(&t->index[i], memory_order_acquire);
+        if (v == PEER_INDEX_EMPTY)
+        {
+            return NULL;
+        }
+        if ((v & 0xFF00u) == fingerprint && (v & 0xFFu) != PEER_INDEX_TOMBSTONE)
+        {
+            peer_entry_t *e = &t->entries[(v & 0xFFu) - 1u];
+            uint32_t gen = atomic_load_explicit(&e->gen, memory_order_acquire);
+            if ((gen & 1u) == 0 &&
+                atomic_load_explicit(&e->key_lo, memory_order_relaxed) == (uint32_t)key &&
+                atomic_load_explicit(&e->key_hi, memory_order_relaxed) == (uint32_t)(key >> 32))
+            {
+                atomic_thread_fence(memory_order_acquire);
+                if (atomic_load_explicit(&e->gen, memory_order_relaxed) == gen)
+                {
+                    *slot = i;
+                    return e;
+                }
+            }
+        }
+        i = (i + 1u) & (PEER_TABLE_SLOTS - 1u);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the entry of a MAC address
+ *
+ * @param[in] t Table
+ * @param[in] mac 6-byte MAC address
+ *
+ * @return Entry, NULL if the MAC is not in the table
+ */
+static inline peer_entry_t *peer_table_find(peer_table_t *t, const uint8_t *mac)
+{
+    uint32_t slot;
+    return peer_table_probe(t, peer_table_key(mac), &slot);
+}
+
+/**
+ * @brief Add a MAC address, or return its entry if it is already in the table
+ *
+ * @details A new entry starts with role 0, unregistered and with cleared runtime state.
+ *          Free entries are taken round robin from the one after the last
+ *          insert, so the entry of a peer just removed is reused last.
+ *
+ * @param[in,out] t Table
+ * @param[in] mac 6-byte MAC address
+ *
+ * @return Entry, NULL if the table already holds PEER_TABLE_MAX_ENTRIES entries
+ */
+static inline peer_entry_t *peer_table_insert(peer_table_t *t, const uint8_t *mac)
+{
+    peer_entry_t *e = peer_table_find(t, mac);
+    if (e != NULL || t->count >= PEER_TABLE_MAX_ENTRIES)
+    {
+        return e;
+    }
+
+    /* #01 - Fill the next free entry; lookups skip it while its generation is odd */
+    uint32_t entry = t->next;
+    while (atomic_load_explicit(&t->entries[entry].in_use, memory_order_relaxed))
+    {
+        entry = (entry + 1u) % PEER_TABLE_MAX_ENTRIES;
+    }
+    t->next = (entry + 1u) % PEER_TABLE_MAX_ENTRIES;
+    e = &t->entries[entry];
+    uint64_t key = peer_table_key(mac);
+    uint32_t gen = atomic_load_explicit(&e->gen, memory_order_relaxed);
+    atomic_store_explicit(&e->gen, gen + 1u, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (int b = 0; b < 6; b++)
+    {
+        e->mac_addr[b] = mac[b];
+    }
+    atomic_store_explicit(&e->key_lo, (uint32_t)key, memory_order_relaxed);
+    atomic_store_explicit(&e->key_hi, (uint32_t)(key >> 32), memory_order_relaxed);
+    atomic_store_explicit(&e->gen, gen + 2u, memory_order_release);
+    e->role = 0;
+    peer_table_clear_entry(e);
+    atomic_store_explicit(&e->registered, false, memory_order_relaxed);
+    atomic_store_explicit(&e->last_active_ms, 0, memory_order_relaxed);
+    atomic_store_explicit(&e->in_use, true, memory_order_relaxed);
+
+    /* #02 - Publish it in the first free slot of its chain (the key is not in the chain) */
+    uint32_t hash = peer_table_hash(key);
+    uint32_t i = hash & (PEER_TABLE_SLOTS - 1u);
+    uint32_t v = atomic_load_explicit(&t->index[i], memory_order_relaxed);
+    while (v != PEER_INDEX_EMPTY && v != PEER_INDEX_TOMBSTONE)
+    {
+        i = (i + 1u) & (PEER_TABLE_SLOTS - 1u);
+        v = atomic_load_explicit(&t->index[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&t->index[i], (uint16_t)(((hash >> 24) << 8) | (entry + 1u)), memory_order_release);
+    t->count++;
+    return e;
+}
+
+/**
+ * @brief Remove a MAC address
+ *
+ * @details The index slot becomes a tombstone. Tombstones directly in front of
+ *          an empty slot end no chain that the empty slot doesn't end already,
+ *          so they are turned back into empty slots to keep misses short.
+ *
+ * @param[in,out] t Table
+ * @param[in] mac 6-byte MAC address
+ *
+ * @return true if the MAC was in the table
+ */
+static inline bool peer_table_remove(peer_table_t *t, const uint8_t *mac)
+{
+    uint32_t i;
+    peer_entry_t *e = peer_table_probe(t, peer_table_key(mac), &i);
+    if (e == NULL)
+    {
+        return false;
+    }
+
+    atomic_store_explicit(&t->index[i], PEER_INDEX_TOMBSTONE, memory_order_release);
+    atomic_store_explicit(&e->in_use, false, memory_order_relaxed);
+    t->count--;
+
+    if (atomic_load_explicit(&t->index[(i + 1u) & (PEER_TABLE_SLOTS - 1u)], memory_order_relaxed) == PEER_INDEX_EMPTY)
+    {
+        for (uint32_t n = 0; n < PEER_TABLE_SLOTS; n++)
+        {
+            if (atomic_load_explicit(&t->index[i], memory_order_relaxed) != PEER_INDEX_TOMBSTONE)
+            {
+                break;
+            }
+            atomic_store_explicit(&t->index[i], PEER_INDEX_EMPTY, memory_order_release);
+            i = (i - 1u) & (PEER_TABLE_SLOTS - 1u);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief true if the entry holds a peer (for iterating over t->entries)
+ */
+static inline bool peer_table_in_use(const peer_entry_t *e)
+{
+    return atomic_load_explicit((_Atomic bool *)&e->in_use, memory_order_acquire);
+}
+
+/**
+ * @brief Mark the peer as active now (a frame was sent to it or received from it)
+ */
+static inline void peer_table_touch(peer_entry_t *e, uint32_t now_ms)
+{
+    atomic_store_explicit(&e->last_active_ms, now_ms, memory_order_relaxed);
+}
+
+/**
+ * @brief Find the registered peer that has been inactive the longest
+ *
+ * @details A linear pass over the entries, only taken when a peer has to be
+ *          registered while the driver is full. Ages are compared relative to
+ *          now_ms, so the order holds across the wrap of the millisecond clock.
+ *
+ * @param[in] t Table
+ * @param[in] now_ms Current time in ms
+ *
+ * @return Least recently active registered entry, NULL if none is registered
+ */
+static inline peer_entry_t *peer_table_lru(peer_table_t *t, uint32_t now_ms)
+{
+    peer_entry_t *victim = NULL;
+    uint32_t victim_age = 0;
+
+    for (uint32_t i = 0; i < PEER_TABLE_MAX_ENTRIES; i++)
+    {
+        peer_entry_t *e = &t->entries[i];
+        if (!atomic_load_explicit(&e->in_use, memory_order_relaxed) ||
+            !atomic_load_explicit(&e->registered, memory_order_relaxed))
+        {
+            continue;
+        }
+        uint32_t age = now_ms - atomic_load_explicit(&e->last_active_ms, memory_order_relaxed);
+        if (victim == NULL || age > victim_age)
+        {
+            victim = e;
+            victim_age = age;
+        }
+    }
+    return victim;
+}
+
+/**
+ * @brief Fold one RSSI sample into the moving average
+ */
+static inline void peer_table_note_rssi(peer_entry_t *e, int8_t rssi)
+{
+    int32_t sample = (int32_t)rssi * 16;
+    int32_t avg = atomic_load_explicit(&e->rssi_avg_q4, memory_order_relaxed);
+    avg = (avg == 0) ? sample : avg + (sample - avg) / (1 << PEER_TABLE_RSSI_SHIFT);
+    atomic_store_explicit(&e->rssi_avg_q4, (int16_t)((avg != 0) ? avg : -1), memory_order_relaxed);
+}
+
+/**
+ * @brief Fold one send result into the ACK ratio average
+ */
+static inline void peer_table_note_ack(peer_entry_t *e, bool acked)
+{
+    int32_t sample = acked ? (int32_t)PEER_TABLE_ACK_ONE : 0;
+    int32_t avg = atomic_load_explicit(&e->tx_ack_avg, memory_order_relaxed);
+    avg += (sample - avg) / (1 << PEER_TABLE_ACK_SHIFT);
+    atomic_store_explicit(&e->tx_ack_avg, (uint16_t)avg, memory_order_relaxed);
+}
+
+/**
+ * @brief Track the sequence number of a frame received from the peer
+ *
+ * @details Numbers ahead of rx_seq (by less than half the range) advance it and
+ *          count the skipped ones as lost; anything else is a duplicate or
+ *          arrived out of order and counts as late.
+ */
+static inline void peer_table_note_seq(peer_entry_t *e, uint16_t seq)
+{
+    if (!atomic_load_explicit(&e->rx_seq_valid, memory_order_relaxed))
+    {
+        atomic_store_explicit(&e->rx_seq, seq, memory_order_relaxed);
+        atomic_store_explicit(&e->rx_seq_valid, true, memory_order_relaxed);
+        return;
+    }
+
+    uint16_t ahead = (uint16_t)(seq - atomic_load_explicit(&e->rx_seq, memory_order_relaxed));
+    if (ahead != 0 && ahead < 0x8000u)
+    {
+        atomic_fetch_add_explicit(&e->rx_seq_lost, (uint32_t)ahead - 1u, memory_order_relaxed);
+        atomic_store_explicit(&e->rx_seq, seq, memory_order_relaxed);
+    }
+    else
+    {
+        atomic_fetch_add_explicit(&e->rx_seq_late, 1, memory_order_relaxed);
+    }
+}
+
+#endif /* ESP_NOW_PEER_TABLE_H */
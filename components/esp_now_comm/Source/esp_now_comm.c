@@ -8,20 +8,46 @@
 /*                                 INCLUDES                                    */
 /*******************************************************************************/
 #include "esp_now_comm.h"
+#include "esp_now_comm_protocol.h"
+#include "esp_now_comm_lease.h"
+#include "esp_now_peer_table.h"
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_wifi.h"
 #include "esp_now.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "string.h"
+#include "latency_probe.h"
+#include "trace.h"
+#include "prof.h"
+#include "heap_monitor.h"
+#include "deferred_log.h"
+#include "flight_recorder.h"
 
 /*******************************************************************************/
 /*                                  MACROS                                     */
 /*******************************************************************************/
 #define TAG "ESP_NOW_COMM"
 
+_Static_assert(ESP_NOW_COMM_MAX_LOGICAL_PEERS >= ESP_NOW_COMM_MAX_PEERS, "Logical peers must include the registered ones");
+_Static_assert(PEER_TABLE_MAX_ENTRIES >= ESP_NOW_COMM_MAX_LOGICAL_PEERS, "The peer table must hold every logical peer");
+
 /*******************************************************************************/
 /*                                DATA TYPES                                   */
 /*******************************************************************************/
 
+/**
+ * @brief Durations of one kind of driver call (written with g_peer_lock held)
+ */
+typedef struct
+{
+    _Atomic uint32_t count;
+    _Atomic uint32_t total_us;
+    _Atomic uint32_t max_us;
+} esp_now_comm_timing_t;
+
 /*******************************************************************************/
 /*                     GLOBAL FUNCTION DECLARATIONS                            */
 /*******************************************************************************/
@@ -58,6 +84,66 @@ static void esp_now_send_cb(const uint8_t *mac_addr, esp_now_send_status_t statu
  */
 static void esp_now_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
 
+/**
+ * @brief Find the table entry of a registered peer
+ * 
+ * @param[in] mac_addr 6-byte MAC address to look up (may be NULL)
+ * 
+ * @return Entry of the peer, NULL if mac_addr is not a registered peer
+ */
+static inline peer_entry_t *esp_now_comm_find_peer(const uint8_t *mac_addr);
+
+/**
+ * @brief Register a logical peer with the ESP-NOW driver
+ * 
+ * @details If the driver is full, the registered peer that has been inactive
+ *          the longest is unregistered first. Call with g_peer_lock held.
+ * 
+ * @param[in,out] peer Entry of the peer
+ * 
+ * @return ESP_OK if the peer is registered, error of the driver calls otherwise
+ */
+static esp_err_t esp_now_comm_register_peer(peer_entry_t *peer);
+
+/**
+ * @brief Register an evicted peer again before sending to it
+ * 
+ * @details Called from the sending task, possibly the WiFi task, so the wait
+ *          for the peer list is bounded by ESP_NOW_COMM_PEER_LOCK_WAIT_MS.
+ * 
+ * @param[in] mac_addr 6-byte MAC address of the peer
+ * 
+ * @return ESP_OK if the peer is registered, ESP_ERR_TIMEOUT or error of the driver calls otherwise
+ */
+static esp_err_t esp_now_comm_readd_peer(const uint8_t *mac_addr);
+
+/**
+ * @brief Add the duration of a driver call started at start_us
+ * 
+ * @param[in,out] timing Durations of that kind of call
+ * @param[in] start_us esp_timer_get_time() before the call
+ * 
+ * @return None
+ */
+static void esp_now_comm_time(esp_now_comm_timing_t *timing, int64_t start_us);
+
+/**
+ * @brief Increment a counter without locking
+ * 
+ * @param[in,out] counter Counter to increment
+ * @param[in] n Amount to add
+ * 
+ * @return None
+ */
+static inline void esp_now_comm_count(_Atomic uint32_t *counter, uint32_t n);
+
+/**
+ * @brief Current time in milliseconds since boot, never 0 (0 means "never")
+ * 
+ * @return Time in ms
+ */
+static inline uint32_t esp_now_comm_now_ms(void);
+
 /*******************************************************************************/
 /*                             STATIC VARIABLES                                */
 /*******************************************************************************/
@@ -67,9 +153,39 @@ static void esp_now_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t
 static esp_now_comm_config_t g_config = {0};
 
 /**
- * Counter tracking number of registered peers
+ * Logical peers and their runtime state, indexed by MAC (changed with g_peer_lock held).
+ * At most ESP_NOW_COMM_MAX_PEERS of them are registered with the driver at a time.
  */
-static uint8_t g_peer_count = 0;
+static peer_table_t g_peers;
+static SemaphoreHandle_t g_peer_lock = NULL;
+static StaticSemaphore_t g_peer_lock_storage;
+static _Atomic uint32_t g_registered;
+
+/* Evictions from the driver and the cost of the driver calls */
+static _Atomic uint32_t g_evictions;
+static _Atomic uint32_t g_readds;
+static _Atomic uint32_t g_readd_fail;
+static esp_now_comm_timing_t g_add_time;
+static esp_now_comm_timing_t g_evict_time;
+
+/**
+ * Component-wide counters (sum over all peers plus unknown senders)
+ */
+static peer_counters_t g_counters;
+static _Atomic uint32_t g_rx_unknown;
+static _Atomic uint32_t g_tx_queue_full;
+static _Atomic uint32_t g_tx_errors;
+
+/* Channel the peers are registered on (0 = current), channel changes and the link outage they caused */
+static uint8_t g_channel = 0;
+static _Atomic uint32_t g_channel_changes;
+static _Atomic uint32_t g_outage_since_ms;      /* Last frame before an unresolved change, 0 = none open */
+static _Atomic uint32_t g_last_outage_ms;
+static _Atomic uint32_t g_max_outage_ms;
+
+/* Boot milestones (ms since boot): ESP-NOW ready, first accepted command */
+static uint32_t g_ready_ms = 0;
+static _Atomic uint32_t g_first_cmd_ms;
 
 /*******************************************************************************/
 /*                     GLOBAL FUNCTION DEFINITIONS                             */
@@ -86,6 +202,10 @@ esp_err_t esp_now_comm_init(esp_now_comm_config_t *config)
 
     /* #01 - Copy user configuration to global config */
     memcpy(&g_config, config, sizeof(esp_now_comm_config_t));
+    if (g_peer_lock == NULL) 
+    {
+        g_peer_lock = xSemaphoreCreateMutexStatic(&g_peer_lock_storage);
+    }
 
     /* #02 - IMPORTANT: WiFi MUST already be initialized by calling code (e.g., web_server_init)
      * This component assumes:
@@ -137,6 +257,7 @@ esp_err_t esp_now_comm_init(esp_now_comm_config_t *config)
      *   - Invoked whenever any ESP32 sends a message directed at this device's MAC
      *   - Note: No peer registration required to receive from a sender
      *   - Any device that knows this device's MAC can send to it (open to all)
+     *     (the application only acts on control frames of the lease holder, see esp_now_comm_lease.h)
      *   - Peer registration is only required for SENDING, not for RECEIVING
      */
     ret = esp_now_register_send_cb(esp_now_send_cb);
@@ -152,7 +273,8 @@ esp_err_t esp_now_comm_init(esp_now_comm_config_t *config)
         return ret;
     }
 
-    ESP_LOGI(TAG, "ESP-NOW communication initialized successfully");
+    g_ready_ms = esp_now_comm_now_ms();
+    ESP_LOGI(TAG, "ESP-NOW communication initialized successfully (%lu ms after boot)", (unsigned long)g_ready_ms);
     ESP_LOGI(TAG, "Device MAC: %02x:%02x:%02x:%02x:%02x:%02x",
              g_config.mac_addr[0], g_config.mac_addr[1], g_config.mac_addr[2],
              g_config.mac_addr[3], g_config.mac_addr[4], g_config.mac_addr[5]);
@@ -162,62 +284,81 @@ esp_err_t esp_now_comm_init(esp_now_comm_config_t *config)
 
 esp_err_t esp_now_comm_add_peer(const uint8_t *mac_addr)
 {
-    if (!mac_addr || g_peer_count >= ESP_NOW_COMM_MAX_PEERS) 
+    if (!mac_addr || g_peer_lock == NULL) 
     {
         return ESP_ERR_INVALID_ARG;
     }
 
-    /* #01 - Configure peer information structure */
-    esp_now_peer_info_t peer = 
+    /* #01 - Track the peer; a known one keeps its state */
+    xSemaphoreTake(g_peer_lock, portMAX_DELAY);
+    bool known = (esp_now_comm_find_peer(mac_addr) != NULL);
+    peer_entry_t *peer = peer_table_insert(&g_peers, mac_addr);
+    if (!peer) 
     {
-        .peer_addr = {0},       /* ESPNOW peer MAC address that is also the MAC address of station or softap */
-        .lmk = {0},             /* [currently unused] ESPNOW peer local master key that is used to encrypt data */
-        .channel = 0,           /* Wi-Fi channel that peer uses to send/receive ESPNOW data. If the value is 0,
-                                     use the current channel which station or softap is on. Otherwise, it must be
-                                     set as the channel that station or softap is on. */
-        .ifidx = WIFI_IF_STA,   /* Wi-Fi interface that peer uses to send/receive ESPNOW data */
-        .encrypt = false,       /* [currently unused] ESPNOW data that this peer sends/receives is encrypted or not */
-        .priv = NULL            /* [currently unused] ESPNOW peer private data (generic pointer for application-specific custom data) */
-    };
-    memcpy(peer.peer_addr, mac_addr, 6); // Set peer MAC address of the device we want to communicate with
+        xSemaphoreGive(g_peer_lock);
+        ESP_LOGW(TAG, "Peer table full (%d), not adding %02x:%02x:%02x:%02x:%02x:%02x", 
+                 ESP_NOW_COMM_MAX_LOGICAL_PEERS, mac_addr[0], mac_addr[1], mac_addr[2], 
+                 mac_addr[3], mac_addr[4], mac_addr[5]);
+        return ESP_ERR_ESPNOW_FULL;
+    }
 
-    /* #02 - Register peer with ESP-NOW */
-    esp_err_t ret = esp_now_add_peer(&peer);
+    /* #02 - Register it with the driver right away: it is the most recently active peer now */
+    peer_table_touch(peer, esp_now_comm_now_ms());
+    esp_err_t ret = esp_now_comm_register_peer(peer);
+    if (ret != ESP_OK && !known) 
+    {
+        (void)peer_table_remove(&g_peers, mac_addr);
+    }
+    xSemaphoreGive(g_peer_lock);
     if (ret != ESP_OK) 
     {
         ESP_LOGE(TAG, "esp_now_add_peer failed: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    /* #03 - Increment peer count and log the MAC address of the added peer */
-    g_peer_count++;
-    ESP_LOGI(TAG, "Peer added: %02x:%02x:%02x:%02x:%02x:%02x", 
-             mac_addr[0], mac_addr[1], mac_addr[2], 
-             mac_addr[3], mac_addr[4], mac_addr[5]);
+    /* #03 - Log the MAC address of the added peer */
+    if (!known) 
+    {
+        ESP_LOGI(TAG, "Peer added: %02x:%02x:%02x:%02x:%02x:%02x", 
+                 mac_addr[0], mac_addr[1], mac_addr[2], 
+                 mac_addr[3], mac_addr[4], mac_addr[5]);
+    }
 
     return ESP_OK;
 }
 
 esp_err_t esp_now_comm_remove_peer(const uint8_t *mac_addr)
 {
-    if (!mac_addr) 
+    if (!mac_addr || g_peer_lock == NULL) 
     {
         return ESP_ERR_INVALID_ARG;
     }
 
-    /* #01 - Unregister peer from ESP-NOW */
-    esp_err_t ret = esp_now_del_peer(mac_addr);
-    if (ret != ESP_OK) 
+    /* #01 - Unregister peer from ESP-NOW (unless it was evicted already) */
+    xSemaphoreTake(g_peer_lock, portMAX_DELAY);
+    peer_entry_t *peer = esp_now_comm_find_peer(mac_addr);
+    if (!peer) 
     {
-        ESP_LOGE(TAG, "esp_now_del_peer failed: %s", esp_err_to_name(ret));
-        return ret;
+        xSemaphoreGive(g_peer_lock);
+        ESP_LOGE(TAG, "esp_now_del_peer failed: %s", esp_err_to_name(ESP_ERR_ESPNOW_NOT_FOUND));
+        return ESP_ERR_ESPNOW_NOT_FOUND;
     }
-
-    /* #02 - Decrement current registered peer count and log the MAC address of the removed peer */
-    if (g_peer_count > 0) 
+    if (atomic_load_explicit(&peer->registered, memory_order_relaxed)) 
     {
-        g_peer_count--;
+        esp_err_t ret = esp_now_del_peer(mac_addr);
+        if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_NOT_FOUND) 
+        {
+            xSemaphoreGive(g_peer_lock);
+            ESP_LOGE(TAG, "esp_now_del_peer failed: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        atomic_store_explicit(&peer->registered, false, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&g_registered, 1, memory_order_relaxed);
     }
+
+    /* #02 - Drop the peer from the table and log the MAC address of the removed peer */
+    (void)peer_table_remove(&g_peers, mac_addr);
+    xSemaphoreGive(g_peer_lock);
     ESP_LOGI(TAG, "Peer removed: %02x:%02x:%02x:%02x:%02x:%02x", 
              mac_addr[0], mac_addr[1], mac_addr[2], 
              mac_addr[3], mac_addr[4], mac_addr[5]);
@@ -232,8 +373,81 @@ esp_err_t esp_now_comm_send(const uint8_t *mac_addr, const uint8_t *data, int le
         return ESP_ERR_INVALID_ARG;
     }
 
-    /* Send the provided uint8_t array as ESP-NOW data, with the given length to the specified MAC address (must be registered as a peer first) */
-    return esp_now_send(mac_addr, data, len);
+    HEAP_MONITOR_HOT_SCOPE(HEAP_REGION_ESPNOW_SEND);
+
+    /* #01 - A peer that was evicted from the driver to make room is registered again first */
+    peer_entry_t *peer = esp_now_comm_find_peer(mac_addr);
+    if (peer && !atomic_load_explicit(&peer->registered, memory_order_relaxed)) 
+    {
+        esp_err_t ret = esp_now_comm_readd_peer(mac_addr);
+        if (ret != ESP_OK) 
+        {
+            esp_now_comm_count(&g_tx_errors, 1);
+            return ret;
+        }
+    }
+
+    /* #02 - Send the provided uint8_t array as ESP-NOW data, with the given length to the specified MAC address (must be registered as a peer first) */
+    TRACE_BEGIN(TRACE_EV_ESPNOW_SEND);
+    PROF_BEGIN(PROF_SITE_ESPNOW_SEND);
+    esp_err_t ret = esp_now_send(mac_addr, data, len);
+    if (ret == ESP_ERR_ESPNOW_NOT_FOUND && peer && esp_now_comm_readd_peer(mac_addr) == ESP_OK) 
+    {
+        /* Evicted by another task between the check and the send */
+        ret = esp_now_send(mac_addr, data, len);
+    }
+    PROF_END(PROF_SITE_ESPNOW_SEND);
+    TRACE_END(TRACE_EV_ESPNOW_SEND);
+    if (ret != ESP_OK) 
+    {
+        esp_now_comm_count((ret == ESP_ERR_ESPNOW_NO_MEM) ? &g_tx_queue_full : &g_tx_errors, 1);
+        return ret;
+    }
+
+    /* #03 - Account the frame globally and per destination (NULL means every registered peer) */
+    esp_now_comm_count(&g_counters.tx_frames, 1);
+    esp_now_comm_count(&g_counters.tx_bytes, (uint32_t)len);
+    if (mac_addr != NULL) 
+    {
+        if (peer) 
+        {
+            esp_now_comm_count(&peer->counters.tx_frames, 1);
+            esp_now_comm_count(&peer->counters.tx_bytes, (uint32_t)len);
+            peer_table_touch(peer, esp_now_comm_now_ms());
+        }
+        return ESP_OK;
+    }
+    for (int i = 0; i < PEER_TABLE_MAX_ENTRIES; i++) 
+    {
+        peer = &g_peers.entries[i];
+        if (peer_table_in_use(peer) && atomic_load_explicit(&peer->registered, memory_order_relaxed)) 
+        {
+            esp_now_comm_count(&peer->counters.tx_frames, 1);
+            esp_now_comm_count(&peer->counters.tx_bytes, (uint32_t)len);
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_now_comm_inject_recv(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!src_mac || !data || len <= 0 || len > ESP_NOW_COMM_PAYLOAD_SIZE) 
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Build the same reception info the ESP-NOW stack would hand us. There is no
+     * radio metadata for a synthetic frame, so rx_ctrl stays NULL. */
+    esp_now_recv_info_t recv_info = 
+    {
+        .src_addr = (uint8_t *)src_mac,
+        .des_addr = g_config.mac_addr,
+        .rx_ctrl = NULL
+    };
+    esp_now_recv_cb(&recv_info, data, len);
+
+    return ESP_OK;
 }
 
 esp_err_t esp_now_comm_get_mac(uint8_t *mac_addr)
@@ -248,11 +462,321 @@ esp_err_t esp_now_comm_get_mac(uint8_t *mac_addr)
     return ESP_OK;
 }
 
+esp_err_t esp_now_comm_get_stats(esp_now_comm_stats_t *stats)
+{
+    if (!stats) 
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->rx_frames = atomic_load_explicit(&g_counters.rx_frames, memory_order_relaxed);
+    stats->rx_bytes = atomic_load_explicit(&g_counters.rx_bytes, memory_order_relaxed);
+    stats->rx_dropped = atomic_load_explicit(&g_counters.rx_dropped, memory_order_relaxed);
+    stats->rx_unknown = atomic_load_explicit(&g_rx_unknown, memory_order_relaxed);
+    stats->tx_frames = atomic_load_explicit(&g_counters.tx_frames, memory_order_relaxed);
+    stats->tx_bytes = atomic_load_explicit(&g_counters.tx_bytes, memory_order_relaxed);
+    stats->tx_success = atomic_load_explicit(&g_counters.tx_success, memory_order_relaxed);
+    stats->tx_fail = atomic_load_explicit(&g_counters.tx_fail, memory_order_relaxed);
+    stats->tx_queue_full = atomic_load_explicit(&g_tx_queue_full, memory_order_relaxed);
+    stats->tx_errors = atomic_load_explicit(&g_tx_errors, memory_order_relaxed);
+    stats->last_rx_ms = atomic_load_explicit(&g_counters.last_seen_ms, memory_order_relaxed);
+    stats->ready_ms = g_ready_ms;
+    stats->first_cmd_ms = atomic_load_explicit(&g_first_cmd_ms, memory_order_relaxed);
+    stats->last_rssi = atomic_load_explicit(&g_counters.rssi, memory_order_relaxed);
+    stats->last_noise_floor = atomic_load_explicit(&g_counters.noise_floor, memory_order_relaxed);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_comm_get_peer_stats(const uint8_t *mac_addr, esp_now_comm_peer_stats_t *stats)
+{
+    if (!mac_addr || !stats) 
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    peer_entry_t *peer = esp_now_comm_find_peer(mac_addr);
+    if (!peer) 
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const peer_counters_t *c = &peer->counters;
+    int16_t rssi_avg_q4 = atomic_load_explicit(&peer->rssi_avg_q4, memory_order_relaxed);
+    memcpy(stats->mac_addr, peer->mac_addr, 6);
+    stats->role = (esp_now_comm_peer_role_t)peer->role;
+    stats->rx_frames = atomic_load_explicit(&c->rx_frames, memory_order_relaxed);
+    stats->rx_bytes = atomic_load_explicit(&c->rx_bytes, memory_order_relaxed);
+    stats->rx_dropped = atomic_load_explicit(&c->rx_dropped, memory_order_relaxed);
+    stats->tx_frames = atomic_load_explicit(&c->tx_frames, memory_order_relaxed);
+    stats->tx_bytes = atomic_load_explicit(&c->tx_bytes, memory_order_relaxed);
+    stats->tx_success = atomic_load_explicit(&c->tx_success, memory_order_relaxed);
+    stats->tx_fail = atomic_load_explicit(&c->tx_fail, memory_order_relaxed);
+    stats->last_seen_ms = atomic_load_explicit(&c->last_seen_ms, memory_order_relaxed);
+    stats->rssi = atomic_load_explicit(&c->rssi, memory_order_relaxed);
+    stats->noise_floor = atomic_load_explicit(&c->noise_floor, memory_order_relaxed);
+    stats->rssi_avg = (int8_t)(rssi_avg_q4 / 16);
+    stats->tx_ack_pct = (uint8_t)((atomic_load_explicit(&peer->tx_ack_avg, memory_order_relaxed) * 100u +
+                                   PEER_TABLE_ACK_ONE / 2u) / PEER_TABLE_ACK_ONE);
+    stats->rx_seq_lost = atomic_load_explicit(&peer->rx_seq_lost, memory_order_relaxed);
+    stats->rx_seq_late = atomic_load_explicit(&peer->rx_seq_late, memory_order_relaxed);
+    stats->registered = atomic_load_explicit(&peer->registered, memory_order_relaxed);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_comm_set_peer_role(const uint8_t *mac_addr, esp_now_comm_peer_role_t role)
+{
+    if (!mac_addr) 
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    peer_entry_t *peer = esp_now_comm_find_peer(mac_addr);
+    if (!peer) 
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    peer->role = (uint8_t)role;
+    return ESP_OK;
+}
+
+bool esp_now_comm_peer_is_controller(const uint8_t *mac_addr)
+{
+    peer_entry_t *peer = mac_addr ? esp_now_comm_find_peer(mac_addr) : NULL;
+    return peer && peer->role == ESP_NOW_COMM_ROLE_CONTROLLER;
+}
+
+esp_err_t esp_now_comm_note_rx_seq(const uint8_t *mac_addr, uint16_t seq)
+{
+    peer_entry_t *peer = esp_now_comm_find_peer(mac_addr);
+    if (!peer) 
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    peer_table_note_seq(peer, seq);
+    return ESP_OK;
+}
+
+void esp_now_comm_note_command(void)
+{
+    if (atomic_load_explicit(&g_first_cmd_ms, memory_order_relaxed) == 0) 
+    {
+        uint32_t none = 0;
+        atomic_compare_exchange_strong_explicit(&g_first_cmd_ms, &none, esp_now_comm_now_ms(),
+                                                memory_order_relaxed, memory_order_relaxed);
+    }
+}
+
+const char *esp_now_comm_peer_role_name(esp_now_comm_peer_role_t role)
+{
+    switch (role)
+    {
+        case ESP_NOW_COMM_ROLE_UNKNOWN:    return "unknown";
+        case ESP_NOW_COMM_ROLE_CONTROLLER: return "controller";
+        case ESP_NOW_COMM_ROLE_ROVER:      return "rover";
+        case ESP_NOW_COMM_ROLE_MONITOR:    return "monitor";
+        default:                           return "?";
+    }
+}
+
+int esp_now_comm_get_all_peer_stats(esp_now_comm_peer_stats_t *stats, int max_peers)
+{
+    int count = 0;
+    if (!stats) 
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < PEER_TABLE_MAX_ENTRIES && count < max_peers; i++) 
+    {
+        if (peer_table_in_use(&g_peers.entries[i]) &&
+            esp_now_comm_get_peer_stats(g_peers.entries[i].mac_addr, &stats[count]) == ESP_OK) 
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+esp_err_t esp_now_comm_get_peer_cache_stats(esp_now_comm_peer_cache_stats_t *stats)
+{
+    if (!stats) 
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t adds = atomic_load_explicit(&g_add_time.count, memory_order_relaxed);
+    uint32_t evictions = atomic_load_explicit(&g_evict_time.count, memory_order_relaxed);
+    stats->logical = g_peers.count;
+    stats->registered = atomic_load_explicit(&g_registered, memory_order_relaxed);
+    stats->evictions = atomic_load_explicit(&g_evictions, memory_order_relaxed);
+    stats->readds = atomic_load_explicit(&g_readds, memory_order_relaxed);
+    stats->readd_fail = atomic_load_explicit(&g_readd_fail, memory_order_relaxed);
+    stats->adds = adds;
+    stats->add_avg_us = (adds != 0) ? atomic_load_explicit(&g_add_time.total_us, memory_order_relaxed) / adds : 0;
+    stats->add_max_us = atomic_load_explicit(&g_add_time.max_us, memory_order_relaxed);
+    stats->evict_avg_us = (evictions != 0) ? atomic_load_explicit(&g_evict_time.total_us, memory_order_relaxed) / evictions : 0;
+    stats->evict_max_us = atomic_load_explicit(&g_evict_time.max_us, memory_order_relaxed);
+    return ESP_OK;
+}
+
+void esp_now_comm_reset_stats(void)
+{
+    peer_table_clear_counters(&g_counters);
+    atomic_store_explicit(&g_rx_unknown, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_tx_queue_full, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_tx_errors, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_evictions, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_readds, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_readd_fail, 0, memory_order_relaxed);
+    for (int i = 0; i < PEER_TABLE_MAX_ENTRIES; i++) 
+    {
+        peer_table_clear_entry(&g_peers.entries[i]);
+    }
+}
+
+void esp_now_comm_print_stats(void)
+{
+    esp_now_comm_stats_t stats;
+    esp_now_comm_peer_cache_stats_t cache;
+    esp_now_comm_peer_stats_t p;
+
+    (void)esp_now_comm_get_stats(&stats);
+    ESP_LOGI(TAG, "RX %lu frames / %lu B (dropped %lu, unknown %lu), last RSSI %d dBm, noise %d dBm",
+             (unsigned long)stats.rx_frames, (unsigned long)stats.rx_bytes,
+             (unsigned long)stats.rx_dropped, (unsigned long)stats.rx_unknown,
+             stats.last_rssi, stats.last_noise_floor);
+    ESP_LOGI(TAG, "TX %lu frames / %lu B, ack %lu, fail %lu, queue full %lu, errors %lu",
+             (unsigned long)stats.tx_frames, (unsigned long)stats.tx_bytes,
+             (unsigned long)stats.tx_success, (unsigned long)stats.tx_fail,
+             (unsigned long)stats.tx_queue_full, (unsigned long)stats.tx_errors);
+    ESP_LOGI(TAG, "Boot: ESP-NOW ready at %lu ms, first command at %lu ms",
+             (unsigned long)stats.ready_ms, (unsigned long)stats.first_cmd_ms);
+
+    esp_now_comm_channel_stats_t channel;
+    (void)esp_now_comm_get_channel_stats(&channel);
+    if (channel.changes != 0) 
+    {
+        ESP_LOGI(TAG, "Channel %d: %lu changes, last outage %lu ms%s, max %lu ms", channel.channel,
+                 (unsigned long)channel.changes, (unsigned long)channel.last_outage_ms,
+                 channel.outage_open ? " (link not back yet)" : "", (unsigned long)channel.max_outage_ms);
+    }
+
+    (void)esp_now_comm_get_peer_cache_stats(&cache);
+    ESP_LOGI(TAG, "Peers: %lu known, %lu registered, evictions %lu, re-adds %lu (failed %lu), "
+             "add avg %lu max %lu us, evict avg %lu max %lu us",
+             (unsigned long)cache.logical, (unsigned long)cache.registered, (unsigned long)cache.evictions,
+             (unsigned long)cache.readds, (unsigned long)cache.readd_fail, (unsigned long)cache.add_avg_us,
+             (unsigned long)cache.add_max_us, (unsigned long)cache.evict_avg_us, (unsigned long)cache.evict_max_us);
+
+    /* Only the registered peers, the evicted ones have been quiet for a while */
+    uint32_t now_ms = esp_now_comm_now_ms();
+    for (int i = 0; i < PEER_TABLE_MAX_ENTRIES; i++) 
+    {
+        const peer_entry_t *entry = &g_peers.entries[i];
+        if (!peer_table_in_use(entry) || !atomic_load_explicit(&entry->registered, memory_order_relaxed) ||
+            esp_now_comm_get_peer_stats(entry->mac_addr, &p) != ESP_OK) 
+        {
+            continue;
+        }
+        ESP_LOGI(TAG, "  %02x:%02x:%02x:%02x:%02x:%02x %s rx %lu/%lu B tx %lu/%lu B ack %lu fail %lu (%u%%), "
+                 "RSSI %d avg %d, seq lost %lu late %lu, seen %ld ms ago",
+                 p.mac_addr[0], p.mac_addr[1], p.mac_addr[2],
+                 p.mac_addr[3], p.mac_addr[4], p.mac_addr[5], esp_now_comm_peer_role_name(p.role),
+                 (unsigned long)p.rx_frames, (unsigned long)p.rx_bytes,
+                 (unsigned long)p.tx_frames, (unsigned long)p.tx_bytes,
+                 (unsigned long)p.tx_success, (unsigned long)p.tx_fail, p.tx_ack_pct, p.rssi, p.rssi_avg,
+                 (unsigned long)p.rx_seq_lost, (unsigned long)p.rx_seq_late,
+                 (p.last_seen_ms != 0) ? (long)(now_ms - p.last_seen_ms) : -1L);
+    }
+}
+
+esp_err_t esp_now_comm_notify_channel(uint8_t new_channel, uint8_t old_channel)
+{
+    const uint8_t frame[3] = { ESP_NOW_MSG_CHANNEL_CHANGE, new_channel, old_channel };
+    return esp_now_comm_send(NULL, frame, sizeof(frame));
+}
+
+esp_err_t esp_now_comm_resync_channel(uint8_t new_channel, uint8_t old_channel)
+{
+    esp_err_t first_err = ESP_OK;
+
+    /* #01 - The outage runs from the last frame heard on the old channel (or from now if none was) */
+    uint32_t last_rx_ms = atomic_load_explicit(&g_counters.last_seen_ms, memory_order_relaxed);
+    atomic_store_explicit(&g_outage_since_ms, (last_rx_ms != 0) ? last_rx_ms : esp_now_comm_now_ms(),
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_channel_changes, 1, memory_order_relaxed);
+    flight_recorder_link(FR_LINK_CHANNEL_CHANGE, (uint32_t)new_channel | ((uint32_t)old_channel << 8), 0);
+
+    /* #02 - Move every registered peer to the new channel (evicted ones are registered on it when re-added) */
+    if (g_peer_lock != NULL) 
+    {
+        xSemaphoreTake(g_peer_lock, portMAX_DELAY);
+    }
+    g_channel = new_channel;
+    for (int i = 0; i < PEER_TABLE_MAX_ENTRIES; i++) 
+    {
+        const peer_entry_t *entry = &g_peers.entries[i];
+        if (!peer_table_in_use(entry) || !atomic_load_explicit(&entry->registered, memory_order_relaxed)) 
+        {
+            continue;
+        }
+
+        esp_now_peer_info_t peer;
+        esp_err_t ret = esp_now_get_peer(entry->mac_addr, &peer);
+        if (ret == ESP_OK) 
+        {
+            peer.channel = new_channel;
+            ret = esp_now_mod_peer(&peer);
+        }
+        if (ret != ESP_OK && first_err == ESP_OK) 
+        {
+            first_err = ret;
+        }
+    }
+    if (g_peer_lock != NULL) 
+    {
+        xSemaphoreGive(g_peer_lock);
+    }
+
+    /* #03 - Announce on the new channel so that a controller scanning for us finds us */
+    (void)esp_now_comm_notify_channel(new_channel, old_channel);
+    ESP_LOGW(TAG, "Channel changed %d -> %d, peers moved", old_channel, new_channel);
+    return first_err;
+}
+
+esp_err_t esp_now_comm_get_channel_stats(esp_now_comm_channel_stats_t *stats)
+{
+    if (!stats) 
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->channel = g_channel;
+    stats->changes = atomic_load_explicit(&g_channel_changes, memory_order_relaxed);
+    stats->last_outage_ms = atomic_load_explicit(&g_last_outage_ms, memory_order_relaxed);
+    stats->max_outage_ms = atomic_load_explicit(&g_max_outage_ms, memory_order_relaxed);
+    stats->outage_open = atomic_load_explicit(&g_outage_since_ms, memory_order_relaxed) != 0;
+    return ESP_OK;
+}
+
 esp_err_t esp_now_comm_deinit(void)
 {
     /* Deinitialize the ESP-NOW protocol stack
      * This releases ESP-NOW resources and stops receiving packets */
     esp_now_deinit();
+
+    /* The driver forgot its peers: so does the table, or a re-init would take them for registered */
+    if (g_peer_lock != NULL) 
+    {
+        xSemaphoreTake(g_peer_lock, portMAX_DELAY);
+        for (int i = 0; i < PEER_TABLE_MAX_ENTRIES; i++) 
+        {
+            atomic_store_explicit(&g_peers.entries[i].registered, false, memory_order_relaxed);
+        }
+        peer_table_init(&g_peers);
+        atomic_store_explicit(&g_registered, 0, memory_order_relaxed);
+        xSemaphoreGive(g_peer_lock);
+    }
     
     /* Stop the WiFi driver
      * This powers down the WiFi radio */
@@ -268,6 +792,19 @@ esp_err_t esp_now_comm_deinit(void)
 
 static void esp_now_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
+    PROF_SCOPE(PROF_SITE_ESPNOW_SEND_CB);
+    TRACE_INSTANT(TRACE_EV_ESPNOW_SEND_CB, status);
+
+    /* Account the MAC-layer result globally and for the destination peer */
+    peer_entry_t *peer = esp_now_comm_find_peer(mac_addr);
+    bool acked = (status == ESP_NOW_SEND_SUCCESS);
+    esp_now_comm_count(acked ? &g_counters.tx_success : &g_counters.tx_fail, 1);
+    if (peer) 
+    {
+        esp_now_comm_count(acked ? &peer->counters.tx_success : &peer->counters.tx_fail, 1);
+        peer_table_note_ack(peer, acked);
+    }
+
     /* Invoke user callback if registered */
     if (g_config.on_send) 
     {
@@ -277,9 +814,197 @@ static void esp_now_send_cb(const uint8_t *mac_addr, esp_now_send_status_t statu
 
 static void esp_now_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
 {
-    /* Invoke user callback if registered */
-    if (g_config.on_recv) 
+    /* #01 - Control frames of senders without the lease end here, before any instrumentation, accounting
+     * or logging. The peer entry tells controllers from everybody else without the pairing lock. */
+    peer_entry_t *peer = esp_now_comm_find_peer(recv_info->src_addr);
+    if (data && len > 0 && ESP_NOW_MSG_IS_CONTROL(data[0]) &&
+        !esp_now_comm_lease_admit(recv_info->src_addr, peer && peer->role == ESP_NOW_COMM_ROLE_CONTROLLER))
     {
-        g_config.on_recv(recv_info->src_addr, data, len);
+        return;
     }
+
+    /* Reference timestamp for the command-to-actuation latency of this frame */
+    LATENCY_PROBE_FRAME_BEGIN();
+    PROF_SCOPE(PROF_SITE_ESPNOW_RECV);
+    HEAP_MONITOR_HOT_SCOPE(HEAP_REGION_ESPNOW_RECV);
+    TRACE_BEGIN(TRACE_EV_ESPNOW_RECV);
+
+    /* #02 - Update sender statistics: lock-free counters, last-seen time and signal quality.
+     * Injected frames (esp_now_comm_inject_recv) carry no radio metadata. */
+    uint32_t now_ms = esp_now_comm_now_ms();
+    atomic_store_explicit(&g_counters.last_seen_ms, now_ms, memory_order_relaxed);
+    if (recv_info->rx_ctrl) 
+    {
+        atomic_store_explicit(&g_counters.rssi, (int8_t)recv_info->rx_ctrl->rssi, memory_order_relaxed);
+        atomic_store_explicit(&g_counters.noise_floor, (int8_t)recv_info->rx_ctrl->noise_floor, memory_order_relaxed);
+    }
+    if (peer) 
+    {
+        atomic_store_explicit(&peer->counters.last_seen_ms, now_ms, memory_order_relaxed);
+        peer_table_touch(peer, now_ms);
+        if (recv_info->rx_ctrl) 
+        {
+            atomic_store_explicit(&peer->counters.rssi, (int8_t)recv_info->rx_ctrl->rssi, memory_order_relaxed);
+            atomic_store_explicit(&peer->counters.noise_floor, (int8_t)recv_info->rx_ctrl->noise_floor, memory_order_relaxed);
+            peer_table_note_rssi(peer, (int8_t)recv_info->rx_ctrl->rssi);
+        }
+    }
+    else 
+    {
+        esp_now_comm_count(&g_rx_unknown, 1);
+    }
+
+    /* #03 - Frames that can't be delivered are dropped here */
+    if (!g_config.on_recv || !data || len <= 0 || len > ESP_NOW_COMM_PAYLOAD_SIZE) 
+    {
+        esp_now_comm_count(&g_counters.rx_dropped, 1);
+        if (peer) 
+        {
+            esp_now_comm_count(&peer->counters.rx_dropped, 1);
+        }
+        TRACE_END(TRACE_EV_ESPNOW_RECV);
+        return;
+    }
+
+    esp_now_comm_count(&g_counters.rx_frames, 1);
+    esp_now_comm_count(&g_counters.rx_bytes, (uint32_t)len);
+    if (atomic_load_explicit(&g_outage_since_ms, memory_order_relaxed) != 0) 
+    {
+        /* First frame after a channel change closes the outage */
+        uint32_t since_ms = atomic_exchange_explicit(&g_outage_since_ms, 0, memory_order_relaxed);
+        if (since_ms != 0) 
+        {
+            uint32_t outage_ms = now_ms - since_ms;
+            atomic_store_explicit(&g_last_outage_ms, outage_ms, memory_order_relaxed);
+            if (outage_ms > atomic_load_explicit(&g_max_outage_ms, memory_order_relaxed)) 
+            {
+                atomic_store_explicit(&g_max_outage_ms, outage_ms, memory_order_relaxed);
+            }
+            DLOG(DLOG_ESPNOW_CHANNEL_OUTAGE, outage_ms);
+        }
+    }
+    if (peer) 
+    {
+        esp_now_comm_count(&peer->counters.rx_frames, 1);
+        esp_now_comm_count(&peer->counters.rx_bytes, (uint32_t)len);
+    }
+
+    /* #04 - Invoke user callback */
+    LATENCY_PROBE_MARK(LATENCY_STAGE_DISPATCH);
+    g_config.on_recv(recv_info->src_addr, data, len);
+    TRACE_END(TRACE_EV_ESPNOW_RECV);
+}
+
+static inline peer_entry_t *esp_now_comm_find_peer(const uint8_t *mac_addr)
+{
+    return mac_addr ? peer_table_find(&g_peers, mac_addr) : NULL;
+}
+
+static esp_err_t esp_now_comm_register_peer(peer_entry_t *peer)
+{
+    if (atomic_load_explicit(&peer->registered, memory_order_relaxed)) 
+    {
+        return ESP_OK;
+    }
+
+    /* #01 - Make room: unregister the peer that has been quiet the longest */
+    if (atomic_load_explicit(&g_registered, memory_order_relaxed) >= ESP_NOW_COMM_MAX_PEERS) 
+    {
+        peer_entry_t *victim = peer_table_lru(&g_peers, esp_now_comm_now_ms());
+        if (!victim) 
+        {
+            return ESP_ERR_ESPNOW_FULL;
+        }
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t ret = esp_now_del_peer(victim->mac_addr);
+        if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_NOT_FOUND) 
+        {
+            return ret;
+        }
+        esp_now_comm_time(&g_evict_time, start_us);
+        atomic_store_explicit(&victim->registered, false, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&g_registered, 1, memory_order_relaxed);
+        esp_now_comm_count(&g_evictions, 1);
+    }
+
+    /* #02 - Configure peer information structure */
+    esp_now_peer_info_t info = 
+    {
+        .peer_addr = {0},       /* ESPNOW peer MAC address that is also the MAC address of station or softap */
+        .lmk = {0},             /* [currently unused] ESPNOW peer local master key that is used to encrypt data */
+        .channel = g_channel,   /* Wi-Fi channel that peer uses to send/receive ESPNOW data. If the value is 0,
+                                     use the current channel which station or softap is on. Otherwise, it must be
+                                     set as the channel that station or softap is on. */
+        .ifidx = WIFI_IF_STA,   /* Wi-Fi interface that peer uses to send/receive ESPNOW data */
+        .encrypt = false,       /* [currently unused] ESPNOW data that this peer sends/receives is encrypted or not */
+        .priv = NULL            /* [currently unused] ESPNOW peer private data (generic pointer for application-specific custom data) */
+    };
+    memcpy(info.peer_addr, peer->mac_addr, 6); // Set peer MAC address of the device we want to communicate with
+
+    /* #03 - Register peer with ESP-NOW */
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t ret = esp_now_add_peer(&info);
+    if (ret != ESP_OK && ret != ESP_ERR_ESPNOW_EXIST) 
+    {
+        return ret;
+    }
+    esp_now_comm_time(&g_add_time, start_us);
+    atomic_store_explicit(&peer->registered, true, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_registered, 1, memory_order_relaxed);
+    return ESP_OK;
+}
+
+static esp_err_t esp_now_comm_readd_peer(const uint8_t *mac_addr)
+{
+    if (g_peer_lock == NULL || 
+        xSemaphoreTake(g_peer_lock, pdMS_TO_TICKS(ESP_NOW_COMM_PEER_LOCK_WAIT_MS)) != pdTRUE) 
+    {
+        esp_now_comm_count(&g_readd_fail, 1);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    /* The peer may have been removed or registered again while waiting */
+    esp_err_t ret = ESP_ERR_ESPNOW_NOT_FOUND;
+    peer_entry_t *peer = esp_now_comm_find_peer(mac_addr);
+    if (peer && atomic_load_explicit(&peer->registered, memory_order_relaxed)) 
+    {
+        ret = ESP_OK;
+    }
+    else if (peer) 
+    {
+        ret = esp_now_comm_register_peer(peer);
+        if (ret == ESP_OK) 
+        {
+            esp_now_comm_count(&g_readds, 1);
+        }
+    }
+    xSemaphoreGive(g_peer_lock);
+
+    if (ret != ESP_OK) 
+    {
+        esp_now_comm_count(&g_readd_fail, 1);
+    }
+    return ret;
+}
+
+static void esp_now_comm_time(esp_now_comm_timing_t *timing, int64_t start_us)
+{
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+    atomic_fetch_add_explicit(&timing->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&timing->total_us, elapsed_us, memory_order_relaxed);
+    if (elapsed_us > atomic_load_explicit(&timing->max_us, memory_order_relaxed)) 
+    {
+        atomic_store_explicit(&timing->max_us, elapsed_us, memory_order_relaxed);
+    }
+}
+
+static inline void esp_now_comm_count(_Atomic uint32_t *counter, uint32_t n)
+{
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+static inline uint32_t esp_now_comm_now_ms(void)
+{
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    return (now_ms != 0) ? now_ms : 1;
 }
\ No newline at end of file
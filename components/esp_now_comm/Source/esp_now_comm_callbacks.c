@@ -1,15 +1,32 @@
 #include "esp_now_comm_callbacks.h"
+#include "esp_now_comm_protocol.h"
+#include "esp_now_comm_diag.h"
+#include "esp_now_comm_echo.h"
+#include "esp_now_comm_pairing.h"
+#include "esp_now_comm_lease.h"
+#include "wifi_manager.h"
+#include "latency_probe.h"
+#include "deferred_log.h"
+#include "flight_recorder.h"
+#include "trace.h"
+#include "prof.h"
+#include "heap_monitor.h"
 #include "esp_log.h"
 
 #define TAG "ESP_NOW_COMM_CALLBACK"
 
 void on_data_send_callback(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
-    /* Determine if send succeeded or failed and log the result */
-    const char *status_str = (status == ESP_NOW_SEND_SUCCESS) ? "SUCCESS" : "FAIL";
-    ESP_LOGI(TAG, "Send to %02x:%02x:%02x:%02x:%02x:%02x: %s", 
-             mac_addr[0], mac_addr[1], mac_addr[2], 
-             mac_addr[3], mac_addr[4], mac_addr[5], status_str);
+    /* Determine if send succeeded or failed and log the result (deferred, this runs in the WiFi task) */
+    dlog_fmt_id_t msg = (status == ESP_NOW_SEND_SUCCESS) ? DLOG_ESPNOW_SEND_OK : DLOG_ESPNOW_SEND_FAIL;
+    DLOG(msg, mac_addr[0], mac_addr[1], mac_addr[2], 
+         mac_addr[3], mac_addr[4], mac_addr[5]);
+    if (status != ESP_NOW_SEND_SUCCESS)
+    {
+        flight_recorder_link(FR_LINK_ESPNOW_SEND_FAIL,
+                             ((uint32_t)mac_addr[2] << 24) | ((uint32_t)mac_addr[3] << 16) |
+                             ((uint32_t)mac_addr[4] << 8) | mac_addr[5], 0);
+    }
     
     /* Here you could implement retry logic, update statistics, etc.
      * For example: increment failure counter if status is FAIL
@@ -18,12 +35,117 @@ void on_data_send_callback(const uint8_t *mac_addr, esp_now_send_status_t status
 
 void on_data_recv_callback(const uint8_t *mac_addr, const uint8_t *data, int len)
 {
-    /* Log the reception event with peer MAC address and data length */
-    ESP_LOGI(TAG, "Received %d bytes from %02x:%02x:%02x:%02x:%02x:%02x", 
-             len, mac_addr[0], mac_addr[1], mac_addr[2], 
-             mac_addr[3], mac_addr[4], mac_addr[5]);
+    /* Log the reception event with peer MAC address and data length (deferred, see deferred_log.h) */
+    DLOG(DLOG_ESPNOW_RECV, (uint32_t)len, mac_addr[0], mac_addr[1], mac_addr[2], 
+         mac_addr[3], mac_addr[4], mac_addr[5]);
     
-    /* Here you could parse the received data and take action
-     * For example: deserialize protocol messages, update device state, etc.
-     */
-}
\ No newline at end of file
+    /* Control frames got here only if the sender holds the lease (checked in esp_now_comm.c) */
+    if (len < 1)
+    {
+        return;
+    }
+
+    /* The first byte identifies the message (see esp_now_comm_protocol.h) */
+    LATENCY_PROBE_MARK(LATENCY_STAGE_DECODE);
+    HEAP_MONITOR_HOT_SCOPE(HEAP_REGION_CMD_DECODE);
+    flight_recorder_cmd_rx(mac_addr, data, len);
+    TRACE_BEGIN(TRACE_EV_CMD_DECODE);
+    PROF_BEGIN(PROF_SITE_CMD_DECODE);
+    switch (data[0])
+    {
+        case ESP_NOW_MSG_FLIGHT_REC_RESUME:
+            /* Erases the history of the last fault: same gate as the mode */
+            if (esp_now_comm_lease_may_configure(mac_addr))
+            {
+                flight_recorder_resume();
+            }
+            break;
+
+        case ESP_NOW_MSG_LATENCY_QUERY:
+        case ESP_NOW_MSG_FLIGHT_REC_QUERY:
+        case ESP_NOW_MSG_DIAG_QUERY:
+            /* Answered from the low-priority diagnostics task, not here in the WiFi task */
+            (void)esp_now_comm_diag_submit(mac_addr, data, len);
+            break;
+
+        case ESP_NOW_MSG_ECHO_REQUEST:
+        case ESP_NOW_MSG_ECHO_REPLY:
+            esp_now_comm_echo_handle(mac_addr, data, len);
+            break;
+
+        case ESP_NOW_MSG_PAIR_BEACON:
+            esp_now_comm_pairing_handle(mac_addr, data, len);
+            break;
+
+        case ESP_NOW_MSG_PAIR_ARM:
+            /* Lets a new controller push out a stored one: same gate as the mode */
+            if (esp_now_comm_lease_may_configure(mac_addr))
+            {
+                (void)esp_now_comm_pairing_arm();
+            }
+            break;
+
+        case ESP_NOW_MSG_LEASE_ACQUIRE:
+        case ESP_NOW_MSG_LEASE_RELEASE:
+        case ESP_NOW_MSG_LEASE_HANDOFF:
+            esp_now_comm_lease_handle(mac_addr, data, len);
+            break;
+
+        case ESP_NOW_MSG_WIFI_MODE_SET:
+            /* Persistent and able to cut the rover off its controller: only from the one in charge,
+             * and the flash write happens in the esp_timer task */
+            if (len >= 3 && esp_now_comm_lease_may_configure(mac_addr))
+            {
+                (void)wifi_manager_request_mode((wifi_manager_mode_t)data[1], data[2]);
+            }
+            break;
+
+        case ESP_NOW_MSG_CHANNEL_SET:
+            /* Moves the radio away from the controller's channel: same gate as the mode */
+            if (len >= 2 && esp_now_comm_lease_may_configure(mac_addr))
+            {
+                (void)wifi_manager_switch_channel(data[1]);
+            }
+            break;
+
+        case ESP_NOW_MSG_RADIO_PROFILE_SET:
+            /* Low power or no auto low latency slows the link down: same gate as the mode */
+            if (len < 2 || !esp_now_comm_lease_may_configure(mac_addr))
+            {
+                break;
+            }
+            (void)wifi_manager_set_radio_profile((wifi_radio_profile_t)data[1]);
+            if (len >= 3)
+            {
+                wifi_manager_set_auto_low_latency(data[2] != 0);
+            }
+            break;
+
+#if PROF_ENABLED
+        case ESP_NOW_MSG_PROF_RESET:
+            /* Would cut a measurement short: same gate as the mode */
+            if (esp_now_comm_lease_may_configure(mac_addr))
+            {
+                prof_reset();
+            }
+            break;
+#endif
+
+        default:
+            if (!ESP_NOW_MSG_IS_CONTROL(data[0]))
+            {
+                /* Diagnostics and link management messages meant for other devices */
+                break;
+            }
+            /* Control traffic from the lease holder: keep WiFi scans off the air */
+            wifi_manager_note_espnow_activity();
+            esp_now_comm_note_command();
+            esp_now_comm_pairing_note_command(mac_addr);
+            /* Here you could parse the remaining protocol messages and take action
+             * For example: deserialize drive commands, update device state, etc.
+             */
+            break;
+    }
+    PROF_END(PROF_SITE_CMD_DECODE);
+    TRACE_END(TRACE_EV_CMD_DECODE);
+}
@@ -0,0 +1,435 @@
+/******************************************************************************
+ * @file esp_now_comm_diag.c
+ * @brief Remote diagnostics: paginated request/response queries over ESP-NOW
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_now_comm_diag.h"
+#include "esp_now_comm_protocol.h"
+#include "latency_probe.h"
+#include "flight_recorder.h"
+#include "deferred_log.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "ESP_NOW_DIAG"
+
+/* Query frame: message ID, u8 request id, u8 topic, u16 page */
+#define DIAG_QUERY_LEN 5
+
+/* Counters topic: page 0 is the component totals, then DIAG_PEERS_PER_PAGE peers per page */
+#define DIAG_TOTALS_LEN     50
+#define DIAG_PEER_LEN       40
+#define DIAG_PEERS_PER_PAGE (ESP_NOW_DIAG_PAGE_MAX / DIAG_PEER_LEN)
+
+_Static_assert(DIAG_TOTALS_LEN <= ESP_NOW_DIAG_PAGE_MAX, "Counter totals must fit one page");
+_Static_assert(1 + FLIGHT_RECORDER_PAGE_SIZE <= ESP_NOW_COMM_PAYLOAD_SIZE,
+               "A flight recorder page must fit one ESP-NOW frame");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief One queued query
+ */
+typedef struct
+{
+    uint8_t  mac_addr[6];
+    uint8_t  msg_id;            /* ESP_NOW_MSG_DIAG_QUERY, _LATENCY_QUERY or _FLIGHT_REC_QUERY */
+    uint8_t  request_id;
+    uint8_t  topic;
+    uint16_t page;              /* First record for ESP_NOW_MSG_FLIGHT_REC_QUERY */
+} diag_query_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Service task: answers queued queries
+ */
+static void diag_task(void *arg);
+
+/**
+ * @brief Build and send the reply for one page
+ *
+ * @param[in] query Query being answered
+ * @param[in] page Page to send
+ *
+ * @return Page count of the topic (0 if the topic is unknown)
+ */
+static uint16_t diag_send_page(const diag_query_t *query, uint16_t page);
+
+/**
+ * @brief Answer an ESP_NOW_MSG_LATENCY_QUERY with one report frame per instrumented stage
+ *
+ * @param[in] query Query being answered
+ */
+static void diag_send_latency_report(const diag_query_t *query);
+
+/**
+ * @brief Answer an ESP_NOW_MSG_FLIGHT_REC_QUERY with one dump page
+ *
+ * @param[in] query Query being answered, page holding the first record
+ */
+static void diag_send_flight_recorder_page(const diag_query_t *query);
+
+/**
+ * @brief Built-in ESP_NOW_DIAG_TOPIC_INDEX provider
+ */
+static esp_err_t diag_provide_index(uint16_t page, uint8_t *buf, size_t len,
+                                    size_t *out_len, uint16_t *page_count);
+
+/**
+ * @brief Built-in ESP_NOW_DIAG_TOPIC_COUNTERS provider
+ *
+ * @details Page 0 (little endian): u32 now_ms, then the u32 fields of
+ *          esp_now_comm_stats_t from rx_frames to last_rx_ms, i8 last_rssi,
+ *          i8 last_noise_floor. Following pages: DIAG_PEERS_PER_PAGE peers of
+ *          u8 mac[6], u32 rx_frames, rx_bytes, rx_dropped, tx_frames, tx_bytes,
+ *          tx_success, tx_fail, last_seen_ms, i8 rssi, i8 noise_floor.
+ */
+static esp_err_t diag_provide_counters(uint16_t page, uint8_t *buf, size_t len,
+                                       size_t *out_len, uint16_t *page_count);
+
+/**
+ * @brief Store a little-endian u32, return the position after it
+ */
+static inline uint8_t *diag_put_u32(uint8_t *p, uint32_t v);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static QueueHandle_t s_queue = NULL;
+static TaskHandle_t s_task = NULL;
+
+/* Storage of the queue and the task, allocated at link time */
+static StaticQueue_t s_queue_storage;
+static uint8_t s_queue_items[ESP_NOW_COMM_DIAG_QUEUE_LEN * sizeof(diag_query_t)];
+static StaticTask_t s_task_tcb;
+static StackType_t s_task_stack[ESP_NOW_COMM_DIAG_TASK_STACK];
+
+static volatile esp_now_comm_diag_provider_t s_providers[ESP_NOW_DIAG_MAX_TOPICS] =
+{
+    [ESP_NOW_DIAG_TOPIC_INDEX] = diag_provide_index,
+    [ESP_NOW_DIAG_TOPIC_COUNTERS] = diag_provide_counters,
+};
+
+static _Atomic uint32_t s_queries = 0;
+static _Atomic uint32_t s_dropped = 0;
+static _Atomic uint32_t s_replies = 0;
+static _Atomic uint32_t s_send_errors = 0;
+
+/* Peer counters copied by the counters provider, static to keep the task stack small */
+static esp_now_comm_peer_stats_t s_peer_stats[ESP_NOW_COMM_MAX_LOGICAL_PEERS];
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+esp_err_t esp_now_comm_diag_init(void)
+{
+    if (s_task != NULL)
+    {
+        return ESP_OK;
+    }
+
+    s_queue = xQueueCreateStatic(ESP_NOW_COMM_DIAG_QUEUE_LEN, sizeof(diag_query_t),
+                                 s_queue_items, &s_queue_storage);
+    s_task = xTaskCreateStatic(diag_task, "espnow_diag", ESP_NOW_COMM_DIAG_TASK_STACK, NULL,
+                               ESP_NOW_COMM_DIAG_TASK_PRIORITY, s_task_stack, &s_task_tcb);
+    if (s_queue == NULL || s_task == NULL)
+    {
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Diagnostics service started");
+    return ESP_OK;
+}
+
+esp_err_t esp_now_comm_diag_register(uint8_t topic, esp_now_comm_diag_provider_t provider)
+{
+    if (topic <= ESP_NOW_DIAG_TOPIC_COUNTERS || topic >= ESP_NOW_DIAG_MAX_TOPICS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_providers[topic] = provider;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_comm_diag_submit(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (!mac_addr || !data || len < 1 || (data[0] == ESP_NOW_MSG_DIAG_QUERY && len < DIAG_QUERY_LEN))
+    {
+        atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (s_queue == NULL)
+    {
+        atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    diag_query_t query = { 0 };
+    memcpy(query.mac_addr, mac_addr, sizeof(query.mac_addr));
+    query.msg_id = data[0];
+    switch (data[0])
+    {
+        case ESP_NOW_MSG_DIAG_QUERY:
+            query.request_id = data[1];
+            query.topic = data[2];
+            query.page = (uint16_t)(data[3] | (data[4] << 8));
+            break;
+
+        case ESP_NOW_MSG_LATENCY_QUERY:
+            break;
+
+        case ESP_NOW_MSG_FLIGHT_REC_QUERY:
+            query.page = (len >= 3) ? (uint16_t)(data[1] | (data[2] << 8)) : 0;
+            break;
+
+        default:
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    /* No wait: the caller is the WiFi task */
+    if (xQueueSend(s_queue, &query, 0) != pdTRUE)
+    {
+        atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        return ESP_ERR_NO_MEM;
+    }
+
+    atomic_fetch_add_explicit(&s_queries, 1, memory_order_relaxed);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_comm_diag_get_stats(esp_now_comm_diag_stats_t *stats)
+{
+    if (!stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->queries = atomic_load_explicit(&s_queries, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+    stats->replies = atomic_load_explicit(&s_replies, memory_order_relaxed);
+    stats->send_errors = atomic_load_explicit(&s_send_errors, memory_order_relaxed);
+    return ESP_OK;
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void diag_task(void *arg)
+{
+    (void)arg;
+    diag_query_t query;
+    while (true)
+    {
+        if (xQueueReceive(s_queue, &query, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        if (query.msg_id == ESP_NOW_MSG_LATENCY_QUERY)
+        {
+            diag_send_latency_report(&query);
+            continue;
+        }
+        if (query.msg_id == ESP_NOW_MSG_FLIGHT_REC_QUERY)
+        {
+            diag_send_flight_recorder_page(&query);
+            continue;
+        }
+
+        if (query.page != ESP_NOW_DIAG_PAGE_ALL)
+        {
+            (void)diag_send_page(&query, query.page);
+            continue;
+        }
+
+        /* All pages: the page count is re-read from every reply, the topic may grow or shrink meanwhile */
+        uint16_t page_count = diag_send_page(&query, 0);
+        for (uint16_t page = 1; page < page_count; page++)
+        {
+            vTaskDelay(pdMS_TO_TICKS(ESP_NOW_COMM_DIAG_PAGE_GAP_MS));
+            page_count = diag_send_page(&query, page);
+        }
+    }
+}
+
+static uint16_t diag_send_page(const diag_query_t *query, uint16_t page)
+{
+    uint8_t frame[ESP_NOW_COMM_PAYLOAD_SIZE];
+    uint8_t *data = &frame[1 + ESP_NOW_DIAG_REPLY_HEADER];
+    size_t data_len = 0;
+    uint16_t page_count = 0;
+    uint8_t status = ESP_NOW_DIAG_STATUS_UNKNOWN_TOPIC;
+
+    /* #01 - Page data */
+    esp_now_comm_diag_provider_t provider = (query->topic < ESP_NOW_DIAG_MAX_TOPICS)
+                                            ? s_providers[query->topic] : NULL;
+    if (provider != NULL)
+    {
+        esp_err_t ret = provider(page, data, ESP_NOW_DIAG_PAGE_MAX, &data_len, &page_count);
+        if (ret == ESP_OK)
+        {
+            status = ESP_NOW_DIAG_STATUS_OK;
+        }
+        else
+        {
+            status = (ret == ESP_ERR_NOT_FOUND) ? ESP_NOW_DIAG_STATUS_BAD_PAGE : ESP_NOW_DIAG_STATUS_ERROR;
+            data_len = 0;
+        }
+    }
+
+    /* #02 - Header */
+    frame[0] = ESP_NOW_MSG_DIAG_REPLY;
+    frame[1] = query->request_id;
+    frame[2] = query->topic;
+    frame[3] = status;
+    frame[4] = (uint8_t)page;
+    frame[5] = (uint8_t)(page >> 8);
+    frame[6] = (uint8_t)page_count;
+    frame[7] = (uint8_t)(page_count >> 8);
+
+    /* #03 - Send to the requester */
+    esp_err_t ret = esp_now_comm_send(query->mac_addr, frame, (int)(1 + ESP_NOW_DIAG_REPLY_HEADER + data_len));
+    atomic_fetch_add_explicit((ret == ESP_OK) ? &s_replies : &s_send_errors, 1, memory_order_relaxed);
+    return page_count;
+}
+
+static void diag_send_latency_report(const diag_query_t *query)
+{
+    uint8_t frame[ESP_NOW_COMM_PAYLOAD_SIZE];
+
+    /* The reference stage has no histogram of its own, start after it */
+    for (int stage = LATENCY_STAGE_RECV_CB + 1; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        frame[0] = ESP_NOW_MSG_LATENCY_REPORT;
+        size_t len = latency_probe_serialize((latency_stage_t)stage, &frame[1], sizeof(frame) - 1);
+        if (len == 0)
+        {
+            continue;
+        }
+
+        esp_err_t ret = esp_now_comm_send(query->mac_addr, frame, (int)(len + 1));
+        atomic_fetch_add_explicit((ret == ESP_OK) ? &s_replies : &s_send_errors, 1, memory_order_relaxed);
+        if (ret != ESP_OK)
+        {
+            DLOG(DLOG_LATENCY_REPORT_FAIL, (uint32_t)stage, (uint32_t)ret);
+            return;
+        }
+    }
+}
+
+static void diag_send_flight_recorder_page(const diag_query_t *query)
+{
+    uint8_t frame[1 + FLIGHT_RECORDER_PAGE_SIZE];
+
+    frame[0] = ESP_NOW_MSG_FLIGHT_REC_PAGE;
+    size_t page_len = flight_recorder_dump_page(query->page, &frame[1], sizeof(frame) - 1);
+    esp_err_t ret = esp_now_comm_send(query->mac_addr, frame, (int)(page_len + 1));
+    atomic_fetch_add_explicit((ret == ESP_OK) ? &s_replies : &s_send_errors, 1, memory_order_relaxed);
+}
+
+static esp_err_t diag_provide_index(uint16_t page, uint8_t *buf, size_t len,
+                                    size_t *out_len, uint16_t *page_count)
+{
+    *page_count = 1;
+    if (page != 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t n = 0;
+    for (uint8_t topic = 0; topic < ESP_NOW_DIAG_MAX_TOPICS && n < len; topic++)
+    {
+        if (s_providers[topic] != NULL)
+        {
+            buf[n++] = topic;
+        }
+    }
+    *out_len = n;
+    return ESP_OK;
+}
+
+static esp_err_t diag_provide_counters(uint16_t page, uint8_t *buf, size_t len,
+                                       size_t *out_len, uint16_t *page_count)
+{
+    int peers = esp_now_comm_get_all_peer_stats(s_peer_stats, ESP_NOW_COMM_MAX_LOGICAL_PEERS);
+    *page_count = (uint16_t)(1 + (peers + DIAG_PEERS_PER_PAGE - 1) / DIAG_PEERS_PER_PAGE);
+    if (page >= *page_count || len < DIAG_TOTALS_LEN)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t *p = buf;
+    if (page == 0)
+    {
+        /* #01 - Component totals */
+        esp_now_comm_stats_t stats;
+        (void)esp_now_comm_get_stats(&stats);
+        p = diag_put_u32(p, (uint32_t)(esp_timer_get_time() / 1000));
+        p = diag_put_u32(p, stats.rx_frames);
+        p = diag_put_u32(p, stats.rx_bytes);
+        p = diag_put_u32(p, stats.rx_dropped);
+        p = diag_put_u32(p, stats.rx_unknown);
+        p = diag_put_u32(p, stats.tx_frames);
+        p = diag_put_u32(p, stats.tx_bytes);
+        p = diag_put_u32(p, stats.tx_success);
+        p = diag_put_u32(p, stats.tx_fail);
+        p = diag_put_u32(p, stats.tx_queue_full);
+        p = diag_put_u32(p, stats.tx_errors);
+        p = diag_put_u32(p, stats.last_rx_ms);
+        *p++ = (uint8_t)stats.last_rssi;
+        *p++ = (uint8_t)stats.last_noise_floor;
+    }
+    else
+    {
+        /* #02 - One slice of the peers */
+        int first = (page - 1) * DIAG_PEERS_PER_PAGE;
+        for (int i = first; i < peers && i < first + DIAG_PEERS_PER_PAGE; i++)
+        {
+            const esp_now_comm_peer_stats_t *peer = &s_peer_stats[i];
+            memcpy(p, peer->mac_addr, 6);
+            p += 6;
+            p = diag_put_u32(p, peer->rx_frames);
+            p = diag_put_u32(p, peer->rx_bytes);
+            p = diag_put_u32(p, peer->rx_dropped);
+            p = diag_put_u32(p, peer->tx_frames);
+            p = diag_put_u32(p, peer->tx_bytes);
+            p = diag_put_u32(p, peer->tx_success);
+            p = diag_put_u32(p, peer->tx_fail);
+            p = diag_put_u32(p, peer->last_seen_ms);
+            *p++ = (uint8_t)peer->rssi;
+            *p++ = (uint8_t)peer->noise_floor;
+        }
+    }
+
+    *out_len = (size_t)(p - buf);
+    return ESP_OK;
+}
+
+static inline uint8_t *diag_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
@@ -0,0 +1,282 @@
+/******************************************************************************
+ * @file esp_now_comm_echo.c
+ * @brief ESP-NOW round-trip benchmark: echo requests and an RTT histogram
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_now_comm_echo.h"
+#include "esp_now_comm_protocol.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "ESP_NOW_ECHO"
+
+_Static_assert(ESP_NOW_COMM_ECHO_HEADER <= ESP_NOW_COMM_ECHO_LEN &&
+               ESP_NOW_COMM_ECHO_LEN <= ESP_NOW_COMM_PAYLOAD_SIZE, "Echo requests must fit one frame");
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief esp_timer callback: send one request to the next peer in turn
+ */
+static void echo_timer_cb(void *arg);
+
+/**
+ * @brief Add one round-trip time to the histogram of the active radio profile
+ */
+static void echo_record(uint32_t rtt_us);
+
+/**
+ * @brief Upper bound of the bucket holding the given percentile, 0 if empty
+ */
+static uint32_t echo_percentile(const esp_now_comm_echo_hist_t *hist, uint32_t pct);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static esp_timer_handle_t s_timer = NULL;
+static uint16_t s_seq = 0;
+static uint32_t s_next_peer = 0;
+
+/* Peer list of the timer, too large for its stack */
+static esp_now_comm_peer_stats_t s_peers[ESP_NOW_COMM_MAX_LOGICAL_PEERS];
+
+/* The one open request, shared by the timer and the WiFi task */
+static portMUX_TYPE s_probe_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_probe_open = false;
+static uint8_t s_probe_mac[6];
+static uint16_t s_probe_seq = 0;
+static uint32_t s_probe_sent_us = 0;
+
+/* RTT histogram of one radio profile */
+typedef struct
+{
+    _Atomic uint32_t replies;
+    _Atomic uint32_t min_us;
+    _Atomic uint32_t max_us;
+    _Atomic uint32_t buckets[ESP_NOW_COMM_ECHO_BUCKETS];
+} echo_hist_state_t;
+
+static _Atomic uint32_t s_requests_sent;
+static _Atomic uint32_t s_answered;
+static _Atomic uint32_t s_ignored;
+static echo_hist_state_t s_hist[WIFI_RADIO_PROFILE_COUNT];
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+esp_err_t esp_now_comm_echo_start(uint32_t interval_ms)
+{
+    if (interval_ms == 0)
+    {
+        return ESP_OK;
+    }
+    if (s_timer != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const esp_timer_create_args_t args =
+    {
+        .callback = echo_timer_cb,
+        .name = "espnow_echo",
+    };
+    esp_err_t ret = esp_timer_create(&args, &s_timer);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ESP_LOGI(TAG, "Sending echo requests every %lu ms", (unsigned long)interval_ms);
+    return esp_timer_start_periodic(s_timer, (uint64_t)interval_ms * 1000u);
+}
+
+void esp_now_comm_echo_handle(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (len < ESP_NOW_COMM_ECHO_HEADER)
+    {
+        return;
+    }
+
+    if (data[0] == ESP_NOW_MSG_ECHO_REQUEST)
+    {
+        /* Requests are numbered per sender: gaps are frames lost on the way in */
+        (void)esp_now_comm_note_rx_seq(mac_addr, (uint16_t)(data[1] | (data[2] << 8)));
+
+        uint8_t frame[ESP_NOW_COMM_PAYLOAD_SIZE];
+        memcpy(frame, data, (size_t)len);
+        frame[0] = ESP_NOW_MSG_ECHO_REPLY;
+        if (esp_now_comm_send(mac_addr, frame, len) == ESP_OK)
+        {
+            atomic_fetch_add_explicit(&s_answered, 1, memory_order_relaxed);
+        }
+    }
+    else if (data[0] == ESP_NOW_MSG_ECHO_REPLY)
+    {
+        /* Only the answer to the open request, from the peer it went to, is timed; once */
+        uint32_t now_us = (uint32_t)esp_timer_get_time();
+        uint16_t seq = (uint16_t)(data[1] | (data[2] << 8));
+        portENTER_CRITICAL(&s_probe_lock);
+        bool match = s_probe_open && seq == s_probe_seq && memcmp(mac_addr, s_probe_mac, 6) == 0;
+        uint32_t sent_us = s_probe_sent_us;
+        if (match)
+        {
+            s_probe_open = false;
+        }
+        portEXIT_CRITICAL(&s_probe_lock);
+        if (match)
+        {
+            echo_record(now_us - sent_us);
+        }
+        else
+        {
+            atomic_fetch_add_explicit(&s_ignored, 1, memory_order_relaxed);
+        }
+    }
+}
+
+esp_err_t esp_now_comm_echo_get_stats(esp_now_comm_echo_stats_t *stats)
+{
+    if (!stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->requests_sent = atomic_load_explicit(&s_requests_sent, memory_order_relaxed);
+    stats->answered = atomic_load_explicit(&s_answered, memory_order_relaxed);
+    stats->ignored = atomic_load_explicit(&s_ignored, memory_order_relaxed);
+    for (uint32_t p = 0; p < WIFI_RADIO_PROFILE_COUNT; p++)
+    {
+        const echo_hist_state_t *h = &s_hist[p];
+        esp_now_comm_echo_hist_t *out = &stats->profiles[p];
+        out->replies = atomic_load_explicit(&h->replies, memory_order_relaxed);
+        out->min_us = (out->replies != 0) ? atomic_load_explicit(&h->min_us, memory_order_relaxed) : UINT32_MAX;
+        out->max_us = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+        for (uint32_t b = 0; b < ESP_NOW_COMM_ECHO_BUCKETS; b++)
+        {
+            out->buckets[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+    }
+    return ESP_OK;
+}
+
+void esp_now_comm_echo_print(void)
+{
+    esp_now_comm_echo_stats_t stats;
+    (void)esp_now_comm_echo_get_stats(&stats);
+
+    ESP_LOGI(TAG, "Echo: sent %lu, answered %lu, replies ignored %lu", (unsigned long)stats.requests_sent,
+             (unsigned long)stats.answered, (unsigned long)stats.ignored);
+    for (uint32_t p = 0; p < WIFI_RADIO_PROFILE_COUNT; p++)
+    {
+        const esp_now_comm_echo_hist_t *h = &stats.profiles[p];
+        if (h->replies == 0)
+        {
+            continue;
+        }
+        ESP_LOGI(TAG, "  RTT %-11s (us): replies %lu p50<=%lu p90<=%lu p99<=%lu min=%lu max=%lu",
+                 wifi_manager_radio_profile_name((wifi_radio_profile_t)p), (unsigned long)h->replies,
+                 (unsigned long)echo_percentile(h, 50), (unsigned long)echo_percentile(h, 90),
+                 (unsigned long)echo_percentile(h, 99), (unsigned long)h->min_us, (unsigned long)h->max_us);
+    }
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void echo_timer_cb(void *arg)
+{
+    (void)arg;
+    uint8_t frame[ESP_NOW_COMM_ECHO_LEN] = { 0 };
+
+    /* #01 - Pick the next peer in turn; a request still open is abandoned (its reply is ignored) */
+    int count = esp_now_comm_get_all_peer_stats(s_peers, ESP_NOW_COMM_MAX_LOGICAL_PEERS);
+    if (count <= 0)
+    {
+        return;
+    }
+    const uint8_t *mac = s_peers[s_next_peer++ % (uint32_t)count].mac_addr;
+
+    /* #02 - Open the request before sending it, the reply may come back before esp_now_comm_send() returns */
+    s_seq++;
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    portENTER_CRITICAL(&s_probe_lock);
+    memcpy(s_probe_mac, mac, 6);
+    s_probe_seq = s_seq;
+    s_probe_sent_us = now_us;
+    s_probe_open = true;
+    portEXIT_CRITICAL(&s_probe_lock);
+
+    frame[0] = ESP_NOW_MSG_ECHO_REQUEST;
+    frame[1] = (uint8_t)s_seq;
+    frame[2] = (uint8_t)(s_seq >> 8);
+    frame[3] = (uint8_t)now_us;
+    frame[4] = (uint8_t)(now_us >> 8);
+    frame[5] = (uint8_t)(now_us >> 16);
+    frame[6] = (uint8_t)(now_us >> 24);
+    if (esp_now_comm_send(mac, frame, sizeof(frame)) == ESP_OK)
+    {
+        atomic_fetch_add_explicit(&s_requests_sent, 1, memory_order_relaxed);
+    }
+    else
+    {
+        portENTER_CRITICAL(&s_probe_lock);
+        s_probe_open = false;
+        portEXIT_CRITICAL(&s_probe_lock);
+    }
+}
+
+static void echo_record(uint32_t rtt_us)
+{
+    echo_hist_state_t *h = &s_hist[wifi_manager_get_radio_profile()];
+    uint32_t bucket = (rtt_us != 0) ? (31u - (uint32_t)__builtin_clz(rtt_us)) : 0;
+    if (bucket >= ESP_NOW_COMM_ECHO_BUCKETS)
+    {
+        bucket = ESP_NOW_COMM_ECHO_BUCKETS - 1;
+    }
+
+    /* Replies are only timed in the WiFi task, plain load/store is enough for min/max */
+    uint32_t replies = atomic_load_explicit(&h->replies, memory_order_relaxed);
+    if (replies == 0 || rtt_us < atomic_load_explicit(&h->min_us, memory_order_relaxed))
+    {
+        atomic_store_explicit(&h->min_us, rtt_us, memory_order_relaxed);
+    }
+    if (rtt_us > atomic_load_explicit(&h->max_us, memory_order_relaxed))
+    {
+        atomic_store_explicit(&h->max_us, rtt_us, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_store_explicit(&h->replies, replies + 1, memory_order_relaxed);
+}
+
+static uint32_t echo_percentile(const esp_now_comm_echo_hist_t *hist, uint32_t pct)
+{
+    if (hist->replies == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = ((uint64_t)hist->replies * pct + 99u) / 100u;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < ESP_NOW_COMM_ECHO_BUCKETS; b++)
+    {
+        seen += hist->buckets[b];
+        if (seen >= rank && seen != 0)
+        {
+            uint32_t upper = (b + 1u >= ESP_NOW_COMM_ECHO_BUCKETS) ? UINT32_MAX : ((1u << (b + 1u)) - 1u);
+            return (upper < hist->max_us) ? upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
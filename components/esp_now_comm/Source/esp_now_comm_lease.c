@@ -0,0 +1,553 @@
+/******************************************************************************
+ * @file esp_now_comm_lease.c
+ * @brief Control lease: only one controller at a time drives the rover
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_now_comm_lease.h"
+#include "esp_now_comm_pairing.h"
+#include "esp_now_comm_protocol.h"
+#include "flight_recorder.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "ESP_NOW_LEASE"
+
+_Static_assert(ESP_NOW_LEASE_STATUS_LEN <= ESP_NOW_COMM_PAYLOAD_SIZE, "Lease frames must fit one frame");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Lease as seen by the receive path
+ */
+typedef struct
+{
+    uint8_t  holder[6];
+    uint8_t  priority;
+    bool     held;              /* Set while granted, expires_ms decides whether it is still valid */
+    uint32_t expires_ms;
+    uint16_t epoch;
+} lease_state_t;
+
+/**
+ * @brief Controller to tell about a change it didn't ask for
+ */
+typedef struct
+{
+    bool    valid;
+    uint8_t mac[6];
+    esp_now_comm_lease_result_t result;
+} lease_notice_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Copy the lease (seqlock read, never blocks)
+ */
+static void lease_read(lease_state_t *state);
+
+/**
+ * @brief Start an update of s_lease: take the writer lock and make s_lease_seq odd
+ *
+ * @details Only plain stores to the returned state until lease_end().
+ *
+ * @return s_lease, to be modified in place
+ */
+static lease_state_t *lease_begin(void);
+
+/**
+ * @brief Publish the update: make s_lease_seq even again and release the writer lock
+ */
+static void lease_end(void);
+
+/**
+ * @brief Take or renew the lease
+ *
+ * @param[in] mac_addr Requester
+ * @param[in] priority Requested priority
+ * @param[in] duration_ms Requested duration, 0 = default
+ * @param[out] notice Holder displaced by the request, if any
+ *
+ * @return Outcome for the requester
+ */
+static esp_now_comm_lease_result_t lease_acquire(const uint8_t *mac_addr, uint8_t priority, uint32_t duration_ms,
+                                                 lease_notice_t *notice);
+
+/**
+ * @brief Give the lease up, or pass it to target (NULL = release)
+ *
+ * @param[in] mac_addr Requester, must be the holder
+ * @param[in] target New holder, NULL to release
+ * @param[in] duration_ms Duration of the new holder's lease, 0 = default
+ * @param[out] notice New holder to tell, if any
+ *
+ * @return Outcome for the requester
+ */
+static esp_now_comm_lease_result_t lease_release(const uint8_t *mac_addr, const uint8_t *target, uint32_t duration_ms,
+                                                 lease_notice_t *notice);
+
+/**
+ * @brief Send ESP_NOW_MSG_LEASE_STATUS with the current lease
+ */
+static void lease_send_status(const uint8_t *mac_addr, esp_now_comm_lease_result_t result);
+
+/**
+ * @brief Record a change of holder in the flight recorder
+ */
+static void lease_record(const lease_state_t *state);
+
+/**
+ * @brief true if the lease is granted and not expired at now_ms
+ */
+static inline bool lease_active(const lease_state_t *state, uint32_t now_ms);
+
+/**
+ * @brief Lease duration for a requested one (0 = default, capped at the maximum)
+ */
+static inline uint32_t lease_duration(uint32_t duration_ms);
+
+/**
+ * @brief Current time in milliseconds since boot
+ */
+static inline uint32_t lease_now_ms(void);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+
+/* Lease published through a seqlock: s_lease_seq is odd while a writer is updating s_lease.
+ * Writers (the receive path) serialize on s_lease_lock, the admission check never takes it. */
+static lease_state_t s_lease;
+static _Atomic uint32_t s_lease_seq;
+static portMUX_TYPE s_lease_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static _Atomic uint32_t s_grants;
+static _Atomic uint32_t s_implicit;
+static _Atomic uint32_t s_renewals;
+static _Atomic uint32_t s_preemptions;
+static _Atomic uint32_t s_handoffs;
+static _Atomic uint32_t s_releases;
+static _Atomic uint32_t s_expiries;
+static _Atomic uint32_t s_refused;
+static _Atomic uint32_t s_admitted;
+static _Atomic uint32_t s_dropped;
+static _Atomic uint32_t s_config_refused;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+bool esp_now_comm_lease_admit(const uint8_t *mac_addr, bool controller)
+{
+#if ESP_NOW_COMM_LEASE_ENFORCE
+    lease_state_t lease;
+    lease_read(&lease);
+    uint32_t now_ms = lease_now_ms();
+
+    /* #01 - Lease held: the holder's frames pass, everybody else's are dropped */
+    if (lease_active(&lease, now_ms))
+    {
+        if (memcmp(lease.holder, mac_addr, 6) != 0)
+        {
+            atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        atomic_fetch_add_explicit(&s_admitted, 1, memory_order_relaxed);
+
+        /* An implicit lease lives as long as its holder keeps sending; renewed at half time to keep writes rare */
+        if (lease.priority == ESP_NOW_LEASE_PRIO_IMPLICIT &&
+            lease.expires_ms - now_ms < ESP_NOW_COMM_LEASE_DEFAULT_MS / 2u)
+        {
+            lease_notice_t notice;
+            (void)lease_acquire(mac_addr, ESP_NOW_LEASE_PRIO_IMPLICIT, 0, &notice);
+        }
+        return true;
+    }
+
+    /* #02 - Lease free: a paired controller takes an implicit one. Anybody else is turned away here (and
+     * in esp_now_comm_lease_handle()), so a stranger's flood never reaches the pairing lock in lease_acquire(). */
+#if ESP_NOW_COMM_LEASE_IMPLICIT
+    lease_notice_t notice;
+    if (controller && lease_acquire(mac_addr, ESP_NOW_LEASE_PRIO_IMPLICIT, 0, &notice) == ESP_NOW_LEASE_GRANTED)
+    {
+        atomic_fetch_add_explicit(&s_implicit, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s_admitted, 1, memory_order_relaxed);
+        return true;
+    }
+#endif
+    atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+    return false;
+#else
+    (void)mac_addr;
+    (void)controller;
+    atomic_fetch_add_explicit(&s_admitted, 1, memory_order_relaxed);
+    return true;
+#endif
+}
+
+bool esp_now_comm_lease_may_configure(const uint8_t *mac_addr)
+{
+    lease_state_t lease;
+    lease_read(&lease);
+
+    bool allowed = lease_active(&lease, lease_now_ms()) ? (memcmp(lease.holder, mac_addr, 6) == 0)
+                                                         : esp_now_comm_pairing_is_paired(mac_addr);
+    if (!allowed)
+    {
+        atomic_fetch_add_explicit(&s_config_refused, 1, memory_order_relaxed);
+    }
+    return allowed;
+}
+
+void esp_now_comm_lease_handle(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    esp_now_comm_lease_result_t result = ESP_NOW_LEASE_INVALID;
+    lease_notice_t notice = { .valid = false };
+
+    /* Only controller peers can hold a lease: strangers are dropped before the pairing lock and without a reply */
+    if (!esp_now_comm_peer_is_controller(mac_addr))
+    {
+        atomic_fetch_add_explicit(&s_refused, 1, memory_order_relaxed);
+        return;
+    }
+
+    switch (data[0])
+    {
+        case ESP_NOW_MSG_LEASE_ACQUIRE:
+            if (len >= ESP_NOW_LEASE_ACQUIRE_LEN)
+            {
+                result = lease_acquire(mac_addr, data[1], (uint32_t)data[2] | ((uint32_t)data[3] << 8), &notice);
+            }
+            break;
+
+        case ESP_NOW_MSG_LEASE_RELEASE:
+            result = lease_release(mac_addr, NULL, 0, &notice);
+            break;
+
+        case ESP_NOW_MSG_LEASE_HANDOFF:
+            if (len >= ESP_NOW_LEASE_HANDOFF_LEN)
+            {
+                result = lease_release(mac_addr, &data[1], (uint32_t)data[7] | ((uint32_t)data[8] << 8), &notice);
+            }
+            break;
+
+        default:
+            return;
+    }
+
+    if (result == ESP_NOW_LEASE_BUSY || result == ESP_NOW_LEASE_NOT_PAIRED ||
+        result == ESP_NOW_LEASE_NOT_HOLDER || result == ESP_NOW_LEASE_INVALID)
+    {
+        atomic_fetch_add_explicit(&s_refused, 1, memory_order_relaxed);
+    }
+
+    /* The requester always hears back; a holder displaced (or a controller handed the lease) too */
+    lease_send_status(mac_addr, result);
+    if (notice.valid)
+    {
+        lease_send_status(notice.mac, notice.result);
+    }
+}
+
+void esp_now_comm_lease_revoke(void)
+{
+    lease_notice_t notice = { .valid = false };
+    uint32_t now_ms = lease_now_ms();
+
+    lease_state_t *lease = lease_begin();
+    if (lease_active(lease, now_ms))
+    {
+        notice.valid = true;
+        notice.result = ESP_NOW_LEASE_PREEMPTED;
+        memcpy(notice.mac, lease->holder, 6);
+        lease->held = false;
+        lease->epoch++;
+    }
+    lease_state_t after = *lease;
+    lease_end();
+
+    if (notice.valid)
+    {
+        atomic_fetch_add_explicit(&s_preemptions, 1, memory_order_relaxed);
+        lease_record(&after);
+        lease_send_status(notice.mac, notice.result);
+        ESP_LOGW(TAG, "Lease revoked from %02x:%02x:%02x:%02x:%02x:%02x", notice.mac[0], notice.mac[1],
+                 notice.mac[2], notice.mac[3], notice.mac[4], notice.mac[5]);
+    }
+}
+
+esp_err_t esp_now_comm_lease_get_stats(esp_now_comm_lease_stats_t *stats)
+{
+    if (!stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    lease_state_t lease;
+    lease_read(&lease);
+    uint32_t now_ms = lease_now_ms();
+    memcpy(stats->holder, lease.holder, 6);
+    stats->held = lease_active(&lease, now_ms);
+    stats->priority = lease.priority;
+    stats->remaining_ms = stats->held ? (lease.expires_ms - now_ms) : 0;
+    stats->epoch = lease.epoch;
+    stats->grants = atomic_load_explicit(&s_grants, memory_order_relaxed);
+    stats->implicit = atomic_load_explicit(&s_implicit, memory_order_relaxed);
+    stats->renewals = atomic_load_explicit(&s_renewals, memory_order_relaxed);
+    stats->preemptions = atomic_load_explicit(&s_preemptions, memory_order_relaxed);
+    stats->handoffs = atomic_load_explicit(&s_handoffs, memory_order_relaxed);
+    stats->releases = atomic_load_explicit(&s_releases, memory_order_relaxed);
+    stats->expiries = atomic_load_explicit(&s_expiries, memory_order_relaxed);
+    stats->refused = atomic_load_explicit(&s_refused, memory_order_relaxed);
+    stats->admitted = atomic_load_explicit(&s_admitted, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+    stats->config_refused = atomic_load_explicit(&s_config_refused, memory_order_relaxed);
+    return ESP_OK;
+}
+
+const char *esp_now_comm_lease_result_name(esp_now_comm_lease_result_t result)
+{
+    switch (result)
+    {
+        case ESP_NOW_LEASE_GRANTED:     return "granted";
+        case ESP_NOW_LEASE_RENEWED:     return "renewed";
+        case ESP_NOW_LEASE_BUSY:        return "busy";
+        case ESP_NOW_LEASE_NOT_PAIRED:  return "not paired";
+        case ESP_NOW_LEASE_NOT_HOLDER:  return "not holder";
+        case ESP_NOW_LEASE_RELEASED:    return "released";
+        case ESP_NOW_LEASE_HANDED_OFF:  return "handed off";
+        case ESP_NOW_LEASE_PREEMPTED:   return "preempted";
+        case ESP_NOW_LEASE_INVALID:     return "invalid";
+        default:                        return "?";
+    }
+}
+
+void esp_now_comm_lease_print(void)
+{
+    esp_now_comm_lease_stats_t stats;
+    (void)esp_now_comm_lease_get_stats(&stats);
+
+    if (stats.held)
+    {
+        ESP_LOGI(TAG, "Lease: %02x:%02x:%02x:%02x:%02x:%02x priority %u, %lu ms left, epoch %u",
+                 stats.holder[0], stats.holder[1], stats.holder[2], stats.holder[3], stats.holder[4],
+                 stats.holder[5], stats.priority, (unsigned long)stats.remaining_ms, stats.epoch);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Lease: free, epoch %u", stats.epoch);
+    }
+    ESP_LOGI(TAG, "  grants %lu (implicit %lu), renewals %lu, preemptions %lu, handoffs %lu, releases %lu, "
+             "expiries %lu, refused %lu; control frames admitted %lu, dropped %lu; radio config refused %lu",
+             (unsigned long)stats.grants, (unsigned long)stats.implicit, (unsigned long)stats.renewals,
+             (unsigned long)stats.preemptions, (unsigned long)stats.handoffs, (unsigned long)stats.releases,
+             (unsigned long)stats.expiries, (unsigned long)stats.refused, (unsigned long)stats.admitted,
+             (unsigned long)stats.dropped, (unsigned long)stats.config_refused);
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void lease_read(lease_state_t *state)
+{
+    /* Copy until no writer was active before or during the copy */
+    uint32_t seq;
+    do
+    {
+        seq = atomic_load_explicit(&s_lease_seq, memory_order_acquire);
+        *state = *(volatile const lease_state_t *)&s_lease;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1u) != 0 || seq != atomic_load_explicit(&s_lease_seq, memory_order_relaxed));
+}
+
+static lease_state_t *lease_begin(void)
+{
+    portENTER_CRITICAL(&s_lease_lock);
+    atomic_store_explicit(&s_lease_seq, atomic_load_explicit(&s_lease_seq, memory_order_relaxed) + 1u,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return &s_lease;
+}
+
+static void lease_end(void)
+{
+    atomic_store_explicit(&s_lease_seq, atomic_load_explicit(&s_lease_seq, memory_order_relaxed) + 1u,
+                          memory_order_release);
+    portEXIT_CRITICAL(&s_lease_lock);
+}
+
+static esp_now_comm_lease_result_t lease_acquire(const uint8_t *mac_addr, uint8_t priority, uint32_t duration_ms,
+                                                 lease_notice_t *notice)
+{
+    notice->valid = false;
+
+    /* #01 - Only paired controllers drive (checked outside the critical section, pairing has its own lock) */
+    if (!esp_now_comm_pairing_is_paired(mac_addr))
+    {
+        return ESP_NOW_LEASE_NOT_PAIRED;
+    }
+
+    /* #02 - Renew, grant, preempt or refuse */
+    esp_now_comm_lease_result_t result;
+    uint32_t now_ms = lease_now_ms();
+    bool expired = false;
+    lease_state_t *lease = lease_begin();
+    bool active = lease_active(lease, now_ms);
+    if (active && memcmp(lease->holder, mac_addr, 6) == 0)
+    {
+        result = ESP_NOW_LEASE_RENEWED;
+    }
+    else if (!active || priority > lease->priority)
+    {
+        if (active)
+        {
+            notice->valid = true;
+            notice->result = ESP_NOW_LEASE_PREEMPTED;
+            memcpy(notice->mac, lease->holder, 6);
+        }
+        expired = !active && lease->held;
+        memcpy(lease->holder, mac_addr, 6);
+        lease->epoch++;
+        result = ESP_NOW_LEASE_GRANTED;
+    }
+    else
+    {
+        result = ESP_NOW_LEASE_BUSY;
+    }
+    if (result != ESP_NOW_LEASE_BUSY)
+    {
+        lease->held = true;
+        lease->priority = priority;
+        lease->expires_ms = now_ms + lease_duration(duration_ms);
+    }
+    lease_state_t after = *lease;
+    lease_end();
+
+    /* #03 - Account and record the change of holder */
+    if (result == ESP_NOW_LEASE_RENEWED)
+    {
+        atomic_fetch_add_explicit(&s_renewals, 1, memory_order_relaxed);
+    }
+    else if (result == ESP_NOW_LEASE_GRANTED)
+    {
+        atomic_fetch_add_explicit(&s_grants, 1, memory_order_relaxed);
+        if (notice->valid)
+        {
+            atomic_fetch_add_explicit(&s_preemptions, 1, memory_order_relaxed);
+        }
+        if (expired)
+        {
+            atomic_fetch_add_explicit(&s_expiries, 1, memory_order_relaxed);
+        }
+        lease_record(&after);
+    }
+    return result;
+}
+
+static esp_now_comm_lease_result_t lease_release(const uint8_t *mac_addr, const uint8_t *target, uint32_t duration_ms,
+                                                 lease_notice_t *notice)
+{
+    notice->valid = false;
+    if (target != NULL && (memcmp(target, mac_addr, 6) == 0 || !esp_now_comm_pairing_is_paired(target)))
+    {
+        return ESP_NOW_LEASE_NOT_PAIRED;
+    }
+
+    esp_now_comm_lease_result_t result = ESP_NOW_LEASE_NOT_HOLDER;
+    uint32_t now_ms = lease_now_ms();
+    lease_state_t *lease = lease_begin();
+    if (lease_active(lease, now_ms) && memcmp(lease->holder, mac_addr, 6) == 0)
+    {
+        if (target != NULL)
+        {
+            /* The new holder keeps the priority, so a handoff can't be used to shed a preemption guard */
+            memcpy(lease->holder, target, 6);
+            lease->expires_ms = now_ms + lease_duration(duration_ms);
+            notice->valid = true;
+            notice->result = ESP_NOW_LEASE_GRANTED;
+            memcpy(notice->mac, target, 6);
+            result = ESP_NOW_LEASE_HANDED_OFF;
+        }
+        else
+        {
+            lease->held = false;
+            result = ESP_NOW_LEASE_RELEASED;
+        }
+        lease->epoch++;
+    }
+    lease_state_t after = *lease;
+    lease_end();
+
+    if (result == ESP_NOW_LEASE_HANDED_OFF)
+    {
+        atomic_fetch_add_explicit(&s_handoffs, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s_grants, 1, memory_order_relaxed);
+        lease_record(&after);
+    }
+    else if (result == ESP_NOW_LEASE_RELEASED)
+    {
+        atomic_fetch_add_explicit(&s_releases, 1, memory_order_relaxed);
+        lease_record(&after);
+    }
+    return result;
+}
+
+static void lease_send_status(const uint8_t *mac_addr, esp_now_comm_lease_result_t result)
+{
+    lease_state_t lease;
+    lease_read(&lease);
+    uint32_t now_ms = lease_now_ms();
+    bool active = lease_active(&lease, now_ms);
+    uint32_t remaining_ms = active ? (lease.expires_ms - now_ms) : 0;
+
+    uint8_t frame[ESP_NOW_LEASE_STATUS_LEN] = { ESP_NOW_MSG_LEASE_STATUS, (uint8_t)result };
+    if (active)
+    {
+        memcpy(&frame[2], lease.holder, 6);
+        frame[8] = lease.priority;
+    }
+    frame[9] = (uint8_t)remaining_ms;
+    frame[10] = (uint8_t)(remaining_ms >> 8);
+    frame[11] = (uint8_t)lease.epoch;
+    frame[12] = (uint8_t)(lease.epoch >> 8);
+    (void)esp_now_comm_send(mac_addr, frame, sizeof(frame));
+}
+
+static void lease_record(const lease_state_t *state)
+{
+    uint32_t holder = state->held ? (((uint32_t)state->holder[2] << 24) | ((uint32_t)state->holder[3] << 16) |
+                                     ((uint32_t)state->holder[4] << 8) | state->holder[5]) : 0;
+    flight_recorder_link(FR_LINK_LEASE_CHANGE, holder, 0);
+}
+
+static inline bool lease_active(const lease_state_t *state, uint32_t now_ms)
+{
+    return state->held && (int32_t)(state->expires_ms - now_ms) > 0;
+}
+
+static inline uint32_t lease_duration(uint32_t duration_ms)
+{
+    if (duration_ms == 0)
+    {
+        return ESP_NOW_COMM_LEASE_DEFAULT_MS;
+    }
+    return (duration_ms < ESP_NOW_COMM_LEASE_MAX_MS) ? duration_ms : ESP_NOW_COMM_LEASE_MAX_MS;
+}
+
+static inline uint32_t lease_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
@@ -0,0 +1,548 @@
+/******************************************************************************
+ * @file esp_now_comm_pairing.c
+ * @brief ESP-NOW discovery and pairing with controllers, persisted in NVS
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "esp_now_comm_pairing.h"
+#include "esp_now_comm_protocol.h"
+#include "wifi_manager.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "ESP_NOW_PAIR"
+
+#define PAIRING_NVS_NAMESPACE   "espnow_pair"
+#define PAIRING_NVS_KEY         "controllers"
+#define PAIRING_NVS_VERSION     1
+
+_Static_assert(ESP_NOW_PAIR_BEACON_LEN <= ESP_NOW_COMM_PAYLOAD_SIZE &&
+               ESP_NOW_PAIR_REPLY_LEN <= ESP_NOW_COMM_PAYLOAD_SIZE, "Pairing frames must fit one frame");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Controllers as stored in NVS, most recently paired first
+ */
+typedef struct
+{
+    uint8_t version;                                /* PAIRING_NVS_VERSION */
+    uint8_t count;
+    uint8_t macs[ESP_NOW_COMM_PAIRING_MAX][6];
+} pairing_nvs_t;
+
+/**
+ * @brief One paired controller
+ */
+typedef struct
+{
+    uint8_t mac[6];
+    bool    restored;       /* Registered from NVS at boot */
+} pairing_entry_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief esp_timer callback: register, answer and store the controller of the pending beacon
+ */
+static void pairing_timer_cb(void *arg);
+
+/**
+ * @brief Index of a controller in s_entries, -1 if not paired (call with s_lock held)
+ */
+static int pairing_find(const uint8_t *mac_addr);
+
+/**
+ * @brief Move a controller to the front of the list, adding it if new
+ *
+ * @param[in] mac_addr Controller
+ * @param[out] evicted MAC pushed out of a full list
+ *
+ * @return true if a controller was pushed out
+ */
+static bool pairing_promote(const uint8_t *mac_addr, uint8_t *evicted);
+
+/**
+ * @brief Write the list to NVS
+ */
+static esp_err_t pairing_save(void);
+
+/**
+ * @brief Send the reply to a beacon
+ */
+static esp_err_t pairing_reply(const uint8_t *mac_addr, uint32_t nonce, bool known);
+
+/**
+ * @brief Current time in milliseconds since boot, never 0 (0 means "never")
+ */
+static inline uint32_t pairing_now_ms(void);
+
+/**
+ * @brief true while esp_now_comm_pairing_arm() lets a new controller in
+ */
+static inline bool pairing_armed(uint32_t now_ms);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static esp_timer_handle_t s_timer = NULL;
+
+/* Paired controllers and the beacon waiting for the timer, shared by the WiFi task and the timer */
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static pairing_entry_t s_entries[ESP_NOW_COMM_PAIRING_MAX];
+static uint8_t s_count = 0;
+static bool s_pending = false;
+static uint8_t s_pending_mac[6];
+static uint32_t s_pending_nonce = 0;
+
+static _Atomic uint32_t s_beacons;
+static _Atomic uint32_t s_replies;
+static _Atomic uint32_t s_rejected;
+static _Atomic uint32_t s_busy;
+static _Atomic uint32_t s_errors;
+static _Atomic uint32_t s_saves;
+static _Atomic uint32_t s_armed_ms;     /* Time of esp_now_comm_pairing_arm(), 0 = not armed */
+static uint32_t s_saved_ms = 0;         /* Last NVS write, pairing timer only */
+static uint8_t s_restored = 0;
+static uint32_t s_restore_ms = 0;
+static _Atomic uint32_t s_paired_ms;
+static _Atomic uint32_t s_first_cmd_ms;
+static _Atomic bool s_first_cmd_cached;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+esp_err_t esp_now_comm_pairing_init(void)
+{
+    if (s_timer != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* #01 - Register the stored controllers; until then their control frames are dropped as from strangers */
+    pairing_nvs_t stored = { 0 };
+    nvs_handle_t nvs;
+    if (nvs_open(PAIRING_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        size_t len = sizeof(stored);
+        esp_err_t ret = nvs_get_blob(nvs, PAIRING_NVS_KEY, &stored, &len);
+        nvs_close(nvs);
+        if (ret != ESP_OK || len != sizeof(stored) || stored.version != PAIRING_NVS_VERSION ||
+            stored.count > ESP_NOW_COMM_PAIRING_MAX)
+        {
+            stored.count = 0;
+        }
+    }
+
+    for (uint8_t i = 0; i < stored.count; i++)
+    {
+        const uint8_t *mac = stored.macs[i];
+        if (esp_now_comm_add_peer(mac) != ESP_OK)
+        {
+            atomic_fetch_add_explicit(&s_errors, 1, memory_order_relaxed);
+            continue;
+        }
+        (void)esp_now_comm_set_peer_role(mac, ESP_NOW_COMM_ROLE_CONTROLLER);
+        memcpy(s_entries[s_count].mac, mac, 6);
+        s_entries[s_count].restored = true;
+        s_count++;
+        ESP_LOGI(TAG, "Restored controller %02x:%02x:%02x:%02x:%02x:%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+    s_restored = s_count;
+    if (s_count != 0)
+    {
+        s_restore_ms = pairing_now_ms();
+    }
+
+    /* #02 - Beacons are handled in this timer, never in the WiFi task */
+    const esp_timer_create_args_t args =
+    {
+        .callback = pairing_timer_cb,
+        .name = "espnow_pair",
+    };
+    esp_err_t ret = esp_timer_create(&args, &s_timer);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "%u controller(s) restored at %lu ms, new ones accepted %s", s_count,
+             (unsigned long)s_restore_ms,
+             (s_count == 0 || ESP_NOW_COMM_PAIRING_WINDOW_MS == 0) ? "until paired" : "for a while after boot");
+    return ESP_OK;
+}
+
+void esp_now_comm_pairing_handle(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (len < ESP_NOW_PAIR_BEACON_LEN || data[1] != ESP_NOW_PAIR_VERSION || data[2] != ESP_NOW_COMM_ROLE_CONTROLLER)
+    {
+        atomic_fetch_add_explicit(&s_rejected, 1, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_add_explicit(&s_beacons, 1, memory_order_relaxed);
+    if (s_timer == NULL)
+    {
+        return;
+    }
+
+    uint32_t nonce = (uint32_t)data[5] | ((uint32_t)data[6] << 8) | ((uint32_t)data[7] << 16) | ((uint32_t)data[8] << 24);
+    uint32_t now_ms = pairing_now_ms();
+    bool window_open = (ESP_NOW_COMM_PAIRING_WINDOW_MS == 0) || (now_ms < ESP_NOW_COMM_PAIRING_WINDOW_MS);
+    bool armed = pairing_armed(now_ms);
+
+    /* Stored controllers always; new ones into a free place in the window, over the oldest only when armed */
+    portENTER_CRITICAL(&s_lock);
+    bool accepted = (pairing_find(mac_addr) >= 0) || (s_count == 0) || armed ||
+                    (window_open && s_count < ESP_NOW_COMM_PAIRING_MAX);
+    bool busy = accepted && s_pending;
+    if (accepted && !busy)
+    {
+        memcpy(s_pending_mac, mac_addr, 6);
+        s_pending_nonce = nonce;
+        s_pending = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!accepted)
+    {
+        atomic_fetch_add_explicit(&s_rejected, 1, memory_order_relaxed);
+    }
+    else if (busy)
+    {
+        atomic_fetch_add_explicit(&s_busy, 1, memory_order_relaxed);
+    }
+    else
+    {
+        (void)esp_timer_start_once(s_timer, 0);
+    }
+}
+
+void esp_now_comm_pairing_note_command(const uint8_t *mac_addr)
+{
+    if (atomic_load_explicit(&s_first_cmd_ms, memory_order_relaxed) != 0)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    int index = pairing_find(mac_addr);
+    bool restored = (index >= 0) && s_entries[index].restored;
+    portEXIT_CRITICAL(&s_lock);
+    if (index < 0)
+    {
+        return;
+    }
+
+    /* Only the receiving task gets here, so the flag is in place before the time is published */
+    atomic_store_explicit(&s_first_cmd_cached, restored, memory_order_relaxed);
+    atomic_store_explicit(&s_first_cmd_ms, pairing_now_ms(), memory_order_release);
+}
+
+esp_err_t esp_now_comm_pairing_arm(void)
+{
+    if (s_timer == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    atomic_store_explicit(&s_armed_ms, pairing_now_ms(), memory_order_relaxed);
+    ESP_LOGW(TAG, "Pairing armed for %u ms", (unsigned)ESP_NOW_COMM_PAIRING_ARM_MS);
+    return ESP_OK;
+}
+
+bool esp_now_comm_pairing_is_paired(const uint8_t *mac_addr)
+{
+    if (!mac_addr)
+    {
+        return false;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    bool paired = pairing_find(mac_addr) >= 0;
+    portEXIT_CRITICAL(&s_lock);
+    return paired;
+}
+
+esp_err_t esp_now_comm_pairing_forget(void)
+{
+    pairing_entry_t entries[ESP_NOW_COMM_PAIRING_MAX];
+
+    portENTER_CRITICAL(&s_lock);
+    uint8_t count = s_count;
+    memcpy(entries, s_entries, sizeof(entries));
+    s_count = 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        (void)esp_now_comm_remove_peer(entries[i].mac);
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(PAIRING_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_erase_key(nvs, PAIRING_NVS_KEY);
+    if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    ESP_LOGW(TAG, "Forgot %u controller(s)", count);
+    return ret;
+}
+
+esp_err_t esp_now_comm_pairing_get_stats(esp_now_comm_pairing_stats_t *stats)
+{
+    if (!stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    stats->paired = s_count;
+    portEXIT_CRITICAL(&s_lock);
+    stats->restored = s_restored;
+    stats->beacons = atomic_load_explicit(&s_beacons, memory_order_relaxed);
+    stats->replies = atomic_load_explicit(&s_replies, memory_order_relaxed);
+    stats->rejected = atomic_load_explicit(&s_rejected, memory_order_relaxed);
+    stats->busy = atomic_load_explicit(&s_busy, memory_order_relaxed);
+    stats->errors = atomic_load_explicit(&s_errors, memory_order_relaxed);
+    stats->saves = atomic_load_explicit(&s_saves, memory_order_relaxed);
+    stats->restore_ms = s_restore_ms;
+    stats->paired_ms = atomic_load_explicit(&s_paired_ms, memory_order_relaxed);
+    stats->first_cmd_ms = atomic_load_explicit(&s_first_cmd_ms, memory_order_acquire);
+    stats->first_cmd_cached = atomic_load_explicit(&s_first_cmd_cached, memory_order_relaxed);
+    return ESP_OK;
+}
+
+void esp_now_comm_pairing_print(void)
+{
+    esp_now_comm_pairing_stats_t stats;
+    pairing_entry_t entries[ESP_NOW_COMM_PAIRING_MAX];
+
+    (void)esp_now_comm_pairing_get_stats(&stats);
+    portENTER_CRITICAL(&s_lock);
+    uint8_t count = s_count;
+    memcpy(entries, s_entries, sizeof(entries));
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Pairing: %u controller(s) (%u restored), beacons %lu, replies %lu, rejected %lu, busy %lu, errors %lu, saves %lu",
+             stats.paired, stats.restored, (unsigned long)stats.beacons, (unsigned long)stats.replies,
+             (unsigned long)stats.rejected, (unsigned long)stats.busy, (unsigned long)stats.errors,
+             (unsigned long)stats.saves);
+    ESP_LOGI(TAG, "  boot: restored at %lu ms, paired at %lu ms, first command at %lu ms (%s pairing)",
+             (unsigned long)stats.restore_ms, (unsigned long)stats.paired_ms, (unsigned long)stats.first_cmd_ms,
+             (stats.first_cmd_ms == 0) ? "no" : (stats.first_cmd_cached ? "cached" : "fresh"));
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const uint8_t *mac = entries[i].mac;
+        ESP_LOGI(TAG, "  %02x:%02x:%02x:%02x:%02x:%02x%s", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+                 entries[i].restored ? " (from NVS)" : "");
+    }
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void pairing_timer_cb(void *arg)
+{
+    (void)arg;
+    uint8_t mac[6];
+
+    portENTER_CRITICAL(&s_lock);
+    bool pending = s_pending;
+    uint32_t nonce = s_pending_nonce;
+    int index = pairing_find(s_pending_mac);
+    bool full = (s_count == ESP_NOW_COMM_PAIRING_MAX);
+    memcpy(mac, s_pending_mac, 6);
+    portEXIT_CRITICAL(&s_lock);
+    if (!pending)
+    {
+        return;
+    }
+
+    /* #01 - A new controller only pushes out a stored one while armed (the arming may have run out since the beacon) */
+    uint32_t now_ms = pairing_now_ms();
+    if (index < 0 && full && !pairing_armed(now_ms))
+    {
+        atomic_fetch_add_explicit(&s_rejected, 1, memory_order_relaxed);
+        portENTER_CRITICAL(&s_lock);
+        s_pending = false;
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+
+    /* #02 - Register the controller so that the reply (and everything after it) can be sent */
+    esp_err_t ret = esp_now_comm_add_peer(mac);
+    if (ret == ESP_OK)
+    {
+        (void)esp_now_comm_set_peer_role(mac, ESP_NOW_COMM_ROLE_CONTROLLER);
+        ret = pairing_reply(mac, nonce, index >= 0);
+    }
+
+    /* #03 - Store it as the most recent controller: a new one right away, a reorder at most once per
+     *       ESP_NOW_COMM_PAIRING_SAVE_MIN_MS so that alternating controllers don't wear the flash */
+    if (ret == ESP_OK && index != 0)
+    {
+        uint8_t evicted[6];
+        if (pairing_promote(mac, evicted))
+        {
+            (void)esp_now_comm_remove_peer(evicted);
+            ESP_LOGW(TAG, "Controller %02x:%02x:%02x:%02x:%02x:%02x pushed out",
+                     evicted[0], evicted[1], evicted[2], evicted[3], evicted[4], evicted[5]);
+        }
+        if (index < 0 || s_saved_ms == 0 || now_ms - s_saved_ms >= ESP_NOW_COMM_PAIRING_SAVE_MIN_MS)
+        {
+            ret = pairing_save();
+        }
+        if (index < 0)
+        {
+            uint32_t none = 0;
+            atomic_compare_exchange_strong_explicit(&s_paired_ms, &none, now_ms,
+                                                    memory_order_relaxed, memory_order_relaxed);
+            atomic_store_explicit(&s_armed_ms, 0, memory_order_relaxed);
+            ESP_LOGI(TAG, "Paired with controller %02x:%02x:%02x:%02x:%02x:%02x",
+                     mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        }
+    }
+    if (ret != ESP_OK)
+    {
+        atomic_fetch_add_explicit(&s_errors, 1, memory_order_relaxed);
+        ESP_LOGW(TAG, "Pairing with %02x:%02x:%02x:%02x:%02x:%02x failed: %s",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], esp_err_to_name(ret));
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_pending = false;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static int pairing_find(const uint8_t *mac_addr)
+{
+    for (int i = 0; i < s_count; i++)
+    {
+        if (memcmp(s_entries[i].mac, mac_addr, 6) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool pairing_promote(const uint8_t *mac_addr, uint8_t *evicted)
+{
+    bool pushed_out = false;
+
+    portENTER_CRITICAL(&s_lock);
+    int index = pairing_find(mac_addr);
+    pairing_entry_t entry = { .restored = false };
+    memcpy(entry.mac, mac_addr, 6);
+    if (index >= 0)
+    {
+        entry = s_entries[index];
+    }
+    else if (s_count == ESP_NOW_COMM_PAIRING_MAX)
+    {
+        index = s_count - 1;
+        memcpy(evicted, s_entries[index].mac, 6);
+        pushed_out = true;
+    }
+    else
+    {
+        index = s_count++;
+    }
+    memmove(&s_entries[1], &s_entries[0], (size_t)index * sizeof(s_entries[0]));
+    s_entries[0] = entry;
+    portEXIT_CRITICAL(&s_lock);
+    return pushed_out;
+}
+
+static esp_err_t pairing_save(void)
+{
+    pairing_nvs_t stored = { .version = PAIRING_NVS_VERSION };
+
+    portENTER_CRITICAL(&s_lock);
+    stored.count = s_count;
+    for (uint8_t i = 0; i < s_count; i++)
+    {
+        memcpy(stored.macs[i], s_entries[i].mac, 6);
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(PAIRING_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_set_blob(nvs, PAIRING_NVS_KEY, &stored, sizeof(stored));
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (ret == ESP_OK)
+    {
+        s_saved_ms = pairing_now_ms();
+        atomic_fetch_add_explicit(&s_saves, 1, memory_order_relaxed);
+    }
+    return ret;
+}
+
+static esp_err_t pairing_reply(const uint8_t *mac_addr, uint32_t nonce, bool known)
+{
+    wifi_manager_state_t wifi = { 0 };
+    (void)wifi_manager_get_state(&wifi);
+
+    uint16_t caps = ESP_NOW_PAIR_CAP_DRIVE | ESP_NOW_PAIR_CAP_DIAG | ESP_NOW_PAIR_CAP_ECHO;
+    if (wifi_manager_get_mode() == WIFI_MANAGER_MODE_ESPNOW_ONLY)
+    {
+        caps |= ESP_NOW_PAIR_CAP_ESPNOW_ONLY;
+    }
+
+    const uint8_t frame[ESP_NOW_PAIR_REPLY_LEN] =
+    {
+        ESP_NOW_MSG_PAIR_REPLY, ESP_NOW_PAIR_VERSION, ESP_NOW_COMM_ROLE_ROVER,
+        (uint8_t)caps, (uint8_t)(caps >> 8),
+        (uint8_t)nonce, (uint8_t)(nonce >> 8), (uint8_t)(nonce >> 16), (uint8_t)(nonce >> 24),
+        wifi.channel, known ? ESP_NOW_PAIR_FLAG_KNOWN : 0
+    };
+    esp_err_t ret = esp_now_comm_send(mac_addr, frame, sizeof(frame));
+    if (ret == ESP_OK)
+    {
+        atomic_fetch_add_explicit(&s_replies, 1, memory_order_relaxed);
+    }
+    return ret;
+}
+
+static inline uint32_t pairing_now_ms(void)
+{
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    return (now_ms != 0) ? now_ms : 1;
+}
+
+static inline bool pairing_armed(uint32_t now_ms)
+{
+    uint32_t armed_ms = atomic_load_explicit(&s_armed_ms, memory_order_relaxed);
+    return (armed_ms != 0) && (now_ms - armed_ms < ESP_NOW_COMM_PAIRING_ARM_MS);
+}
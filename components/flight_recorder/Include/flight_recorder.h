@@ -0,0 +1,180 @@
+/******************************************************************************
+ * @file flight_recorder.h
+ * @brief Black-box recorder of the last seconds of commands, state and link events
+ *
+ * @details Always on: received commands, control-loop state, motor currents and
+ *          link events are appended as fixed 16-byte records (see
+ *          flight_recorder_ring.h) to a RAM ring holding the last
+ *          FLIGHT_RECORDER_RECORDS records. Recording costs one atomic increment
+ *          and a 16-byte store, from any task or ISR.
+ *
+ *          On a fault the recorder freezes: new records are discarded until
+ *          flight_recorder_resume(), so the history leading to the fault can be
+ *          dumped on the console or over ESP-NOW and decoded on the host with
+ *          tools/flight_recorder_decode.py.
+ *
+ *          The ring is kept in .noinit RAM, which survives watchdog and panic
+ *          resets. If the previous run ended that way, flight_recorder_init()
+ *          keeps its records and starts frozen with FR_FAULT_WATCHDOG/PANIC.
+ *
+ ******************************************************************************/
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "flight_recorder_ring.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Dump page: u8 fault, u8 flags, u16 total, u16 start, u8 count, then count records */
+#define FLIGHT_RECORDER_PAGE_HEADER  7
+#define FLIGHT_RECORDER_PAGE_RECORDS 15
+#define FLIGHT_RECORDER_PAGE_SIZE    (FLIGHT_RECORDER_PAGE_HEADER + FLIGHT_RECORDER_PAGE_RECORDS * sizeof(fr_record_t))
+
+/* Page flags */
+#define FLIGHT_RECORDER_FLAG_FROZEN    (1u << 0)
+#define FLIGHT_RECORDER_FLAG_RECOVERED (1u << 1)    /* Records are from the run before the last reset */
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Recorder state
+ */
+typedef struct
+{
+    bool       frozen;          /* Recording is stopped */
+    bool       recovered;       /* Contents survived a watchdog/panic reset */
+    fr_fault_t fault;           /* Cause of the freeze, FR_FAULT_NONE while recording */
+    uint32_t   total;           /* Records available for dumping (at most FLIGHT_RECORDER_RECORDS) */
+    uint32_t   written;         /* Records written since the ring was last cleared */
+    uint32_t   discarded;       /* Records discarded while frozen */
+} flight_recorder_status_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Set up the recorder; call once, early at boot
+ *
+ * @details Keeps (and freezes) the contents of the previous run after a
+ *          watchdog or panic reset, clears them otherwise. Records a
+ *          FR_REC_BOOT record in both cases (the recovered one only after resume).
+ *
+ * @return ESP_OK
+ */
+esp_err_t flight_recorder_init(void);
+
+/**
+ * @brief Append one record (no-op while frozen). Safe from tasks and ISRs.
+ *
+ * @param[in] type fr_record_type_t
+ * @param[in] arg0 Type specific
+ * @param[in] arg1 Type specific
+ * @param[in] arg2 Type specific
+ */
+void flight_recorder_record(fr_record_type_t type, uint8_t arg0, uint32_t arg1, uint32_t arg2);
+
+/**
+ * @brief Record a received command frame
+ *
+ * @param[in] mac_addr Sender MAC address
+ * @param[in] data Frame, data[0] being the message ID
+ * @param[in] len Frame length
+ */
+void flight_recorder_cmd_rx(const uint8_t *mac_addr, const uint8_t *data, int len);
+
+/**
+ * @brief Record one control-loop tick
+ *
+ * @param[in] mode Control mode
+ * @param[in] left_setpoint Left wheel setpoint
+ * @param[in] right_setpoint Right wheel setpoint
+ * @param[in] left_output Left wheel output (duty)
+ * @param[in] right_output Right wheel output (duty)
+ */
+void flight_recorder_control(uint8_t mode, int16_t left_setpoint, int16_t right_setpoint,
+                             int16_t left_output, int16_t right_output);
+
+/**
+ * @brief Record motor currents
+ *
+ * @param[in] left_ma Left motor current in mA
+ * @param[in] right_ma Right motor current in mA
+ */
+void flight_recorder_current(uint32_t left_ma, uint32_t right_ma);
+
+/**
+ * @brief Record a link event
+ *
+ * @param[in] event Event
+ * @param[in] detail Event specific (see fr_link_event_t)
+ * @param[in] rssi RSSI in dBm, 0 if unknown
+ */
+void flight_recorder_link(fr_link_event_t event, uint32_t detail, int8_t rssi);
+
+/**
+ * @brief Record a fault and freeze the recorder (first fault wins)
+ *
+ * @param[in] fault Cause
+ * @param[in] arg1 Fault specific detail
+ * @param[in] arg2 Fault specific detail
+ */
+void flight_recorder_freeze(fr_fault_t fault, uint32_t arg1, uint32_t arg2);
+
+/**
+ * @brief Clear the ring and start recording again
+ *
+ * @details Does nothing unless the recorder is frozen, so a running history
+ *          is never cleared under its producers. The new history starts with
+ *          a FR_REC_BOOT record carrying the reset reason of the current run.
+ */
+void flight_recorder_resume(void);
+
+/**
+ * @brief Check whether the recorder is frozen
+ */
+bool flight_recorder_is_frozen(void);
+
+/**
+ * @brief Get the recorder state
+ *
+ * @param[out] status Filled with the current state
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if status is NULL
+ */
+esp_err_t flight_recorder_get_status(flight_recorder_status_t *status);
+
+/**
+ * @brief Serialize one dump page
+ *
+ * @details Records are numbered from 0 (oldest still held) to total - 1.
+ *          Records overwritten while dumping an unfrozen recorder are skipped.
+ *
+ * @param[in] start Number of the first record of the page
+ * @param[out] buf Output buffer
+ * @param[in] len Size of buf, at least FLIGHT_RECORDER_PAGE_HEADER
+ *
+ * @return Bytes written, 0 if buf is too small
+ */
+size_t flight_recorder_dump_page(uint32_t start, uint8_t *buf, size_t len);
+
+/**
+ * @brief Print every page as a "FR <hex>" line on the console
+ */
+void flight_recorder_dump_console(void);
+
+#endif /* FLIGHT_RECORDER_H */
@@ -0,0 +1,154 @@
+/******************************************************************************
+ * @file flight_recorder_ring.h
+ * @brief Record format and ring of the black-box flight recorder
+ *
+ * @details Plain C11 with no ESP-IDF dependencies, shared by the firmware and the
+ *          host benchmarks. Any number of producers (tasks or ISRs) reserve a slot
+ *          with one atomic increment of head and fill it in; the slot sequence
+ *          number is written last, so a reader can tell complete records from
+ *          ones that were being written (or overwritten) while it was reading.
+ *
+ *          The record layout is part of the dump format decoded by
+ *          tools/flight_recorder_decode.py; change both together.
+ *
+ ******************************************************************************/
+
+#ifndef FLIGHT_RECORDER_RING_H
+#define FLIGHT_RECORDER_RING_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Records kept; must be a power of two. 1024 x 16 bytes holds a few seconds of
+ * 50 Hz commands plus control and current samples. */
+#ifndef FLIGHT_RECORDER_RECORDS
+#define FLIGHT_RECORDER_RECORDS 1024
+#endif
+
+_Static_assert((FLIGHT_RECORDER_RECORDS & (FLIGHT_RECORDER_RECORDS - 1)) == 0,
+               "FLIGHT_RECORDER_RECORDS must be a power of two");
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Record types, with the meaning of the record arguments
+ */
+typedef enum
+{
+    FR_REC_NONE = 0,        /* Never written */
+    FR_REC_BOOT,            /* arg0: reset reason */
+    FR_REC_CMD_RX,          /* arg0: message ID, arg1: len | mac[4] << 16 | mac[5] << 24, arg2: payload bytes 1..4 */
+    FR_REC_CONTROL,         /* arg0: mode, arg1: left | right setpoint (int16 each), arg2: left | right output (int16 each) */
+    FR_REC_CURRENT,         /* arg1: left motor mA, arg2: right motor mA */
+    FR_REC_LINK,            /* arg0: fr_link_event_t, arg1: reason / IPv4 address, arg2: RSSI (int32) */
+    FR_REC_FAULT,           /* arg0: fr_fault_t, arg1/arg2: fault specific detail */
+} fr_record_type_t;
+
+/**
+ * @brief Link events (FR_REC_LINK arg0)
+ */
+typedef enum
+{
+    FR_LINK_WIFI_DISCONNECTED = 0,  /* arg1: disconnect reason */
+    FR_LINK_WIFI_GOT_IP,            /* arg1: IPv4 address in network order */
+    FR_LINK_ESPNOW_SEND_FAIL,       /* arg1: mac[2..5] of the peer */
+    FR_LINK_CHANNEL_CHANGE,         /* arg1: new channel | old channel << 8 */
+    FR_LINK_LEASE_CHANGE,           /* arg1: mac[2..5] of the new control lease holder, 0 = none */
+} fr_link_event_t;
+
+/**
+ * @brief Causes that freeze the recorder (FR_REC_FAULT arg0)
+ */
+typedef enum
+{
+    FR_FAULT_NONE = 0,
+    FR_FAULT_FAILSAFE,      /* Command timeout / link loss stopped the motors */
+    FR_FAULT_OVERCURRENT,   /* arg1: motor index, arg2: mA */
+    FR_FAULT_WATCHDOG,      /* Previous run ended in a watchdog reset (arg1: reset reason) */
+    FR_FAULT_PANIC,         /* Previous run ended in a panic (arg1: reset reason) */
+    FR_FAULT_MANUAL,        /* Frozen on request */
+} fr_fault_t;
+
+/**
+ * @brief One fixed-size record (16 bytes)
+ */
+typedef struct
+{
+    uint32_t timestamp_us;  /* Low 32 bits of esp_timer time */
+    uint16_t seq;           /* (index + 1) & 0xFFFF once complete, written last */
+    uint8_t  type;          /* fr_record_type_t */
+    uint8_t  arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+} fr_record_t;
+
+_Static_assert(sizeof(fr_record_t) == 16, "fr_record_t must stay 16 bytes");
+
+/**
+ * @brief Recorder ring
+ */
+typedef struct
+{
+    _Atomic uint32_t head;                      /* Records ever reserved */
+    fr_record_t      records[FLIGHT_RECORDER_RECORDS];
+} fr_ring_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Append a record, overwriting the oldest one
+ */
+static inline void fr_ring_record(fr_ring_t *ring, uint32_t timestamp_us, uint8_t type, uint8_t arg0,
+                                  uint32_t arg1, uint32_t arg2)
+{
+    uint32_t index = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    fr_record_t *rec = &ring->records[index & (FLIGHT_RECORDER_RECORDS - 1u)];
+    _Atomic uint16_t *seq = (_Atomic uint16_t *)&rec->seq;
+
+    /* Mark the slot as being written: any value but the final one */
+    atomic_store_explicit(seq, (uint16_t)~(index + 1u), memory_order_relaxed);
+    atomic_signal_fence(memory_order_release);
+    rec->timestamp_us = timestamp_us;
+    rec->type = type;
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+    rec->arg2 = arg2;
+    atomic_store_explicit(seq, (uint16_t)(index + 1u), memory_order_release);
+}
+
+/**
+ * @brief Copy a complete record
+ *
+ * @param[in] ring Ring to read
+ * @param[in] index Absolute record index (0 = first record ever written)
+ * @param[out] out Copy of the record
+ *
+ * @return true if the record is complete and still holds index, false otherwise
+ */
+static inline bool fr_ring_read(const fr_ring_t *ring, uint32_t index, fr_record_t *out)
+{
+    const fr_record_t *rec = &ring->records[index & (FLIGHT_RECORDER_RECORDS - 1u)];
+    uint16_t expected = (uint16_t)(index + 1u);
+
+    if (atomic_load_explicit((_Atomic uint16_t *)&rec->seq, memory_order_acquire) != expected)
+    {
+        return false;
+    }
+    *out = *rec;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit((_Atomic uint16_t *)&rec->seq, memory_order_relaxed) == expected;
+}
+
+#endif /* FLIGHT_RECORDER_RING_H */
@@ -0,0 +1,259 @@
+/******************************************************************************
+ * @file flight_recorder.c
+ * @brief Black-box recorder of the last seconds of commands, state and link events
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "flight_recorder.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "FLIGHT_REC"
+
+/* Marks the .noinit state as initialized by a previous run ("FRC1") */
+#define FLIGHT_RECORDER_MAGIC 0x31435246u
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Recorder state kept across watchdog and panic resets
+ */
+typedef struct
+{
+    uint32_t         magic;
+    _Atomic uint32_t fault;     /* fr_fault_t; FR_FAULT_NONE while recording */
+    fr_ring_t        ring;
+} flight_recorder_state_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Empty the ring
+ */
+static void flight_recorder_clear(void);
+
+/**
+ * @brief Timestamp of a record
+ */
+static inline uint32_t flight_recorder_now_us(void);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static __NOINIT_ATTR flight_recorder_state_t s_state;
+
+static bool s_recovered = false;
+static _Atomic uint32_t s_discarded = 0;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+esp_err_t flight_recorder_init(void)
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool crashed = (reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT ||
+                    reason == ESP_RST_WDT || reason == ESP_RST_PANIC);
+
+    /* #01 - Keep the history of a run that ended in a watchdog or panic reset */
+    if (crashed && s_state.magic == FLIGHT_RECORDER_MAGIC)
+    {
+        s_recovered = true;
+        fr_fault_t fault = (reason == ESP_RST_PANIC) ? FR_FAULT_PANIC : FR_FAULT_WATCHDOG;
+        uint32_t expected = FR_FAULT_NONE;
+        /* A fault that froze the recorder before the reset stays the reported cause */
+        (void)atomic_compare_exchange_strong(&s_state.fault, &expected, (uint32_t)fault);
+        ESP_LOGW(TAG, "Recovered %lu records from before the reset (reason %d), frozen",
+                 (unsigned long)atomic_load(&s_state.ring.head), (int)reason);
+        return ESP_OK;
+    }
+
+    /* #02 - Fresh start */
+    flight_recorder_clear();
+    s_state.magic = FLIGHT_RECORDER_MAGIC;
+    atomic_store(&s_state.fault, FR_FAULT_NONE);
+    flight_recorder_record(FR_REC_BOOT, (uint8_t)reason, 0, 0);
+    return ESP_OK;
+}
+
+IRAM_ATTR void flight_recorder_record(fr_record_type_t type, uint8_t arg0, uint32_t arg1, uint32_t arg2)
+{
+    if (atomic_load_explicit(&s_state.fault, memory_order_relaxed) != FR_FAULT_NONE)
+    {
+        atomic_fetch_add_explicit(&s_discarded, 1, memory_order_relaxed);
+        return;
+    }
+    fr_ring_record(&s_state.ring, flight_recorder_now_us(), (uint8_t)type, arg0, arg1, arg2);
+}
+
+void flight_recorder_cmd_rx(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    if (!mac_addr || !data || len < 1)
+    {
+        return;
+    }
+
+    /* Payload bytes after the message ID, little endian, zero padded */
+    uint32_t payload = 0;
+    for (int i = 1; i < len && i <= 4; i++)
+    {
+        payload |= (uint32_t)data[i] << (8 * (i - 1));
+    }
+    uint32_t len_mac = ((uint32_t)len & 0xFFFFu) | ((uint32_t)mac_addr[4] << 16) | ((uint32_t)mac_addr[5] << 24);
+    flight_recorder_record(FR_REC_CMD_RX, data[0], len_mac, payload);
+}
+
+void flight_recorder_control(uint8_t mode, int16_t left_setpoint, int16_t right_setpoint,
+                             int16_t left_output, int16_t right_output)
+{
+    flight_recorder_record(FR_REC_CONTROL, mode,
+                           (uint16_t)left_setpoint | ((uint32_t)(uint16_t)right_setpoint << 16),
+                           (uint16_t)left_output | ((uint32_t)(uint16_t)right_output << 16));
+}
+
+void flight_recorder_current(uint32_t left_ma, uint32_t right_ma)
+{
+    flight_recorder_record(FR_REC_CURRENT, 0, left_ma, right_ma);
+}
+
+void flight_recorder_link(fr_link_event_t event, uint32_t detail, int8_t rssi)
+{
+    flight_recorder_record(FR_REC_LINK, (uint8_t)event, detail, (uint32_t)(int32_t)rssi);
+}
+
+IRAM_ATTR void flight_recorder_freeze(fr_fault_t fault, uint32_t arg1, uint32_t arg2)
+{
+    /* The fault record is the last one of the frozen history */
+    flight_recorder_record(FR_REC_FAULT, (uint8_t)fault, arg1, arg2);
+
+    uint32_t expected = FR_FAULT_NONE;
+    (void)atomic_compare_exchange_strong(&s_state.fault, &expected, (uint32_t)fault);
+}
+
+void flight_recorder_resume(void)
+{
+    /* Only a frozen ring can be cleared safely: producers discard their records until the fault is reset */
+    if (!flight_recorder_is_frozen())
+    {
+        return;
+    }
+    flight_recorder_clear();
+    s_recovered = false;
+    atomic_store(&s_state.fault, FR_FAULT_NONE);
+    /* The new history starts like a fresh boot's, with the reset reason of this run */
+    flight_recorder_record(FR_REC_BOOT, (uint8_t)esp_reset_reason(), 0, 0);
+    ESP_LOGI(TAG, "Recording resumed");
+}
+
+bool flight_recorder_is_frozen(void)
+{
+    return atomic_load_explicit(&s_state.fault, memory_order_relaxed) != FR_FAULT_NONE;
+}
+
+esp_err_t flight_recorder_get_status(flight_recorder_status_t *status)
+{
+    if (!status)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t head = atomic_load(&s_state.ring.head);
+    status->fault = (fr_fault_t)atomic_load(&s_state.fault);
+    status->frozen = (status->fault != FR_FAULT_NONE);
+    status->recovered = s_recovered;
+    status->written = head;
+    status->total = (head < FLIGHT_RECORDER_RECORDS) ? head : FLIGHT_RECORDER_RECORDS;
+    status->discarded = atomic_load_explicit(&s_discarded, memory_order_relaxed);
+    return ESP_OK;
+}
+
+size_t flight_recorder_dump_page(uint32_t start, uint8_t *buf, size_t len)
+{
+    flight_recorder_status_t status;
+    if (!buf || len < FLIGHT_RECORDER_PAGE_HEADER)
+    {
+        return 0;
+    }
+    (void)flight_recorder_get_status(&status);
+
+    /* #01 - Copy the records, oldest first */
+    uint32_t oldest = status.written - status.total;
+    uint32_t count = 0;
+    uint8_t *p = &buf[FLIGHT_RECORDER_PAGE_HEADER];
+    for (uint32_t n = start; n < status.total && count < FLIGHT_RECORDER_PAGE_RECORDS; n++)
+    {
+        fr_record_t rec;
+        if ((size_t)(p - buf) + sizeof(rec) > len)
+        {
+            break;
+        }
+        if (!fr_ring_read(&s_state.ring, oldest + n, &rec))
+        {
+            continue;
+        }
+        /* Little endian target: the in-memory layout is the wire layout */
+        memcpy(p, &rec, sizeof(rec));
+        p += sizeof(rec);
+        count++;
+    }
+
+    /* #02 - Header */
+    buf[0] = (uint8_t)status.fault;
+    buf[1] = (uint8_t)((status.frozen ? FLIGHT_RECORDER_FLAG_FROZEN : 0u) |
+                       (status.recovered ? FLIGHT_RECORDER_FLAG_RECOVERED : 0u));
+    buf[2] = (uint8_t)status.total;
+    buf[3] = (uint8_t)(status.total >> 8);
+    buf[4] = (uint8_t)start;
+    buf[5] = (uint8_t)(start >> 8);
+    buf[6] = (uint8_t)count;
+    return (size_t)(p - buf);
+}
+
+void flight_recorder_dump_console(void)
+{
+    uint8_t page[FLIGHT_RECORDER_PAGE_SIZE];
+    flight_recorder_status_t status;
+    (void)flight_recorder_get_status(&status);
+
+    ESP_LOGI(TAG, "Dump: %lu records, fault %d%s (decode with tools/flight_recorder_decode.py)",
+             (unsigned long)status.total, (int)status.fault, status.recovered ? ", recovered" : "");
+    for (uint32_t start = 0; start < status.total; start += FLIGHT_RECORDER_PAGE_RECORDS)
+    {
+        size_t len = flight_recorder_dump_page(start, page, sizeof(page));
+        printf("FR ");
+        for (size_t i = 0; i < len; i++)
+        {
+            printf("%02x", page[i]);
+        }
+        printf("\n");
+    }
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void flight_recorder_clear(void)
+{
+    memset(s_state.ring.records, 0, sizeof(s_state.ring.records));
+    atomic_store(&s_state.ring.head, 0);
+}
+
+static inline uint32_t flight_recorder_now_us(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
@@ -0,0 +1,165 @@
+/******************************************************************************
+ * @file heap_monitor.h
+ * @brief Steady-state heap allocation monitor and fragmentation history
+ *
+ * @details Once heap_monitor_start() is called (after initialize_components()),
+ *          every heap allocation and free is counted per task through the
+ *          ESP-IDF heap hooks (CONFIG_HEAP_USE_HOOKS). The tasks are the tags:
+ *          each component does its work in its own task (dlog, espnow_diag,
+ *          wifi, main, ...). Code that must not allocate is wrapped in
+ *          HEAP_MONITOR_HOT_SCOPE(region); an allocation made by that task while
+ *          it is inside the region is flagged against the region, kept in a
+ *          short history and reported by the next heap_monitor_sample().
+ *
+ *          heap_monitor_sample() also records the fragmentation of the 8-bit
+ *          capable heap (largest free block against total free) in a history
+ *          of HEAP_MONITOR_HISTORY samples.
+ *
+ *          The hooks only use atomics and never allocate; without
+ *          CONFIG_HEAP_USE_HOOKS only the fragmentation history is available.
+ *
+ ******************************************************************************/
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Tasks accounted separately; further tasks and ISRs share one extra entry */
+#define HEAP_MONITOR_MAX_TASKS      16
+
+/* Flagged hot-path allocations kept for the report */
+#define HEAP_MONITOR_HOT_LOG        8
+
+/* Fragmentation samples kept */
+#define HEAP_MONITOR_HISTORY        32
+
+/* Fragmentation (1000 - 1000 * largest free block / free) above this is warned about */
+#define HEAP_MONITOR_WARN_FRAG_PERMILLE 500
+
+/* Hot-path regions: X(id, name). Append only. */
+#define HEAP_MONITOR_REGIONS(X) \
+    X(HEAP_REGION_ESPNOW_RECV, "espnow_recv") \
+    X(HEAP_REGION_ESPNOW_SEND, "espnow_send") \
+    X(HEAP_REGION_CMD_DECODE,  "cmd_decode")
+
+/* Region of the calling task until the end of the enclosing block (left by any path) */
+#define HEAP_MONITOR_CONCAT_(a, b)  a##b
+#define HEAP_MONITOR_CONCAT(a, b)   HEAP_MONITOR_CONCAT_(a, b)
+#define HEAP_MONITOR_HOT_SCOPE(region) \
+    uint8_t HEAP_MONITOR_CONCAT(heap_monitor_prev_, __LINE__) \
+        __attribute__((cleanup(heap_monitor_hot_scope_exit))) = heap_monitor_hot_enter(region)
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Hot-path region IDs
+ */
+typedef enum
+{
+#define HEAP_MONITOR_REGION_ENUM(id, name) id,
+    HEAP_MONITOR_REGIONS(HEAP_MONITOR_REGION_ENUM)
+#undef HEAP_MONITOR_REGION_ENUM
+    HEAP_REGION_COUNT,
+    HEAP_REGION_NONE = 0xFF
+} heap_region_t;
+
+/**
+ * @brief Totals since heap_monitor_start()
+ */
+typedef struct
+{
+    bool     hooks;                 /* Allocations are tracked (CONFIG_HEAP_USE_HOOKS) */
+    uint32_t allocs;                /* Allocations of all tasks */
+    uint32_t alloc_bytes;           /* Bytes requested by allocs */
+    uint32_t frees;
+    uint32_t hot_allocs;            /* Allocations inside a hot-path region: must stay 0 */
+} heap_monitor_stats_t;
+
+/**
+ * @brief One fragmentation sample
+ */
+typedef struct
+{
+    uint32_t uptime_s;
+    uint32_t free_bytes;            /* Free 8-bit capable heap */
+    uint32_t largest_free_block;
+    uint16_t frag_permille;         /* 1000 - 1000 * largest_free_block / free_bytes */
+} heap_monitor_sample_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Start steady-state accounting (clears all counters)
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NOT_SUPPORTED if the heap hooks are not compiled in (sampling still works)
+ */
+esp_err_t heap_monitor_start(void);
+
+/**
+ * @brief Record a fragmentation sample and warn about new hot-path allocations
+ *
+ * @details Call periodically from one task (the main loop).
+ *
+ * @param[out] sample Filled with the new sample, may be NULL
+ *
+ * @return ESP_OK
+ */
+esp_err_t heap_monitor_sample(heap_monitor_sample_t *sample);
+
+/**
+ * @brief Get the totals since heap_monitor_start()
+ *
+ * @param[out] stats Filled with the totals
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t heap_monitor_get_stats(heap_monitor_stats_t *stats);
+
+/**
+ * @brief Print per-task and per-region counts, flagged allocations and the fragmentation trend
+ */
+void heap_monitor_print(void);
+
+/**
+ * @brief Enter a hot-path region (use HEAP_MONITOR_HOT_SCOPE())
+ *
+ * @param[in] region Region entered
+ *
+ * @return Region the task was in before, restored by heap_monitor_hot_exit()
+ */
+uint8_t heap_monitor_hot_enter(heap_region_t region);
+
+/**
+ * @brief Leave a hot-path region
+ *
+ * @param[in] prev Value returned by the matching heap_monitor_hot_enter()
+ */
+void heap_monitor_hot_exit(uint8_t prev);
+
+/**
+ * @brief Cleanup handler of HEAP_MONITOR_HOT_SCOPE()
+ */
+static inline void heap_monitor_hot_scope_exit(uint8_t *prev)
+{
+    heap_monitor_hot_exit(*prev);
+}
+
+#endif /* HEAP_MONITOR_H */
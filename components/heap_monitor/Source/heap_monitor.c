@@ -0,0 +1,391 @@
+/******************************************************************************
+ * @file heap_monitor.c
+ * @brief Steady-state heap allocation monitor and fragmentation history
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "heap_monitor.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "HEAP_MON"
+
+/* Entry shared by ISRs and tasks beyond HEAP_MONITOR_MAX_TASKS */
+#define HEAP_MONITOR_OTHER HEAP_MONITOR_MAX_TASKS
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Per-task accounting, claimed by the task with a compare-and-swap from 0
+ */
+typedef struct
+{
+    _Atomic uintptr_t owner;        /* TaskHandle_t */
+    _Atomic uint32_t  allocs;
+    _Atomic uint32_t  alloc_bytes;
+    _Atomic uint32_t  frees;
+    _Atomic uint32_t  hot_allocs;
+    volatile uint8_t  region;       /* Hot-path region the task is in, written by the task only */
+} heap_monitor_task_t;
+
+/**
+ * @brief One flagged hot-path allocation
+ */
+typedef struct
+{
+    uint32_t time_ms;
+    uint32_t size;
+    uint8_t  region;
+    uint8_t  task;                  /* Index into s_tasks */
+} heap_monitor_hot_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Accounting entry of the calling context, claimed on first use
+ *
+ * @return Index into s_tasks
+ */
+static uint8_t heap_monitor_task_index(void);
+
+/**
+ * @brief Refresh the list of live tasks used by heap_monitor_task_name()
+ */
+static void heap_monitor_refresh_tasks(void);
+
+/**
+ * @brief Name of the task owning an entry, looked up among the live tasks
+ */
+static const char *heap_monitor_task_name(uint8_t index);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static heap_monitor_task_t s_tasks[HEAP_MONITOR_MAX_TASKS + 1];
+static volatile bool s_running = false;
+
+/* Flagged allocations: the last HEAP_MONITOR_HOT_LOG, s_hot_total in all */
+static heap_monitor_hot_t s_hot_log[HEAP_MONITOR_HOT_LOG];
+static _Atomic uint32_t s_hot_total = 0;
+static _Atomic uint32_t s_region_allocs[HEAP_REGION_COUNT];
+static uint32_t s_hot_reported = 0;
+
+/* Fragmentation history, written by heap_monitor_sample() only */
+static heap_monitor_sample_t s_history[HEAP_MONITOR_HISTORY];
+static uint32_t s_history_count = 0;
+static bool s_frag_warned = false;
+
+static const char *const s_region_names[HEAP_REGION_COUNT] =
+{
+#define HEAP_MONITOR_REGION_NAME(id, name) [id] = name,
+    HEAP_MONITOR_REGIONS(HEAP_MONITOR_REGION_NAME)
+#undef HEAP_MONITOR_REGION_NAME
+};
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+/* Live tasks, used to name the entries when printing */
+static TaskStatus_t s_task_status[HEAP_MONITOR_MAX_TASKS + 8];
+static UBaseType_t s_task_status_count = 0;
+#endif
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+#if CONFIG_HEAP_USE_HOOKS
+/* ESP-IDF heap hooks: called for every allocation and free, from any context, possibly with the
+ * flash cache disabled. IRAM only, no allocation, no blocking. */
+IRAM_ATTR void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    (void)caps;
+    if (!s_running || ptr == NULL)
+    {
+        return;
+    }
+
+    uint8_t index = heap_monitor_task_index();
+    heap_monitor_task_t *task = &s_tasks[index];
+    atomic_fetch_add_explicit(&task->allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&task->alloc_bytes, (uint32_t)size, memory_order_relaxed);
+
+    uint8_t region = task->region;
+    if (index == HEAP_MONITOR_OTHER || region >= HEAP_REGION_COUNT)
+    {
+        return;
+    }
+
+    /* Allocation on a hot path: flag it */
+    atomic_fetch_add_explicit(&task->hot_allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s_region_allocs[region], 1, memory_order_relaxed);
+    uint32_t n = atomic_fetch_add_explicit(&s_hot_total, 1, memory_order_relaxed);
+    heap_monitor_hot_t *log = &s_hot_log[n % HEAP_MONITOR_HOT_LOG];
+    log->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    log->size = (uint32_t)size;
+    log->region = region;
+    log->task = index;
+}
+
+IRAM_ATTR void esp_heap_trace_free_hook(void *ptr)
+{
+    if (!s_running || ptr == NULL)
+    {
+        return;
+    }
+    atomic_fetch_add_explicit(&s_tasks[heap_monitor_task_index()].frees, 1, memory_order_relaxed);
+}
+#endif /* CONFIG_HEAP_USE_HOOKS */
+
+esp_err_t heap_monitor_start(void)
+{
+    s_running = false;
+    for (int i = 0; i <= HEAP_MONITOR_MAX_TASKS; i++)
+    {
+        atomic_store_explicit(&s_tasks[i].allocs, 0, memory_order_relaxed);
+        atomic_store_explicit(&s_tasks[i].alloc_bytes, 0, memory_order_relaxed);
+        atomic_store_explicit(&s_tasks[i].frees, 0, memory_order_relaxed);
+        atomic_store_explicit(&s_tasks[i].hot_allocs, 0, memory_order_relaxed);
+    }
+    for (int r = 0; r < HEAP_REGION_COUNT; r++)
+    {
+        atomic_store_explicit(&s_region_allocs[r], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&s_hot_total, 0, memory_order_relaxed);
+    s_hot_reported = 0;
+
+#if CONFIG_HEAP_USE_HOOKS
+    s_running = true;
+    ESP_LOGI(TAG, "Steady-state allocation tracking started");
+    return ESP_OK;
+#else
+    ESP_LOGW(TAG, "CONFIG_HEAP_USE_HOOKS is off, only fragmentation is tracked");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t heap_monitor_sample(heap_monitor_sample_t *sample)
+{
+    /* #01 - Fragmentation */
+    heap_monitor_sample_t *s = &s_history[s_history_count % HEAP_MONITOR_HISTORY];
+    s->uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    s->free_bytes = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    s->largest_free_block = (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    s->frag_permille = (s->free_bytes != 0)
+        ? (uint16_t)(1000u - (uint32_t)(((uint64_t)s->largest_free_block * 1000u) / s->free_bytes))
+        : 0;
+    s_history_count++;
+
+    bool fragmented = s->frag_permille > HEAP_MONITOR_WARN_FRAG_PERMILLE;
+    if (fragmented && !s_frag_warned)
+    {
+        ESP_LOGW(TAG, "Heap fragmented: largest free block %lu of %lu B free (%u.%u%%)",
+                 (unsigned long)s->largest_free_block, (unsigned long)s->free_bytes,
+                 s->frag_permille / 10, s->frag_permille % 10);
+    }
+    s_frag_warned = fragmented;
+
+    /* #02 - Hot-path allocations since the previous sample (the log keeps the last few) */
+    uint32_t total = atomic_load_explicit(&s_hot_total, memory_order_relaxed);
+    uint32_t first = (total - s_hot_reported > HEAP_MONITOR_HOT_LOG) ? total - HEAP_MONITOR_HOT_LOG : s_hot_reported;
+    if (total != s_hot_reported)
+    {
+        heap_monitor_refresh_tasks();
+        ESP_LOGW(TAG, "%lu heap allocation(s) on the hot path since the last sample",
+                 (unsigned long)(total - s_hot_reported));
+    }
+    for (uint32_t n = first; n < total; n++)
+    {
+        const heap_monitor_hot_t *log = &s_hot_log[n % HEAP_MONITOR_HOT_LOG];
+        ESP_LOGW(TAG, "  %lu B in %s by %s at %lu ms", (unsigned long)log->size,
+                 (log->region < HEAP_REGION_COUNT) ? s_region_names[log->region] : "?",
+                 heap_monitor_task_name(log->task), (unsigned long)log->time_ms);
+    }
+    s_hot_reported = total;
+
+    if (sample != NULL)
+    {
+        *sample = *s;
+    }
+    return ESP_OK;
+}
+
+esp_err_t heap_monitor_get_stats(heap_monitor_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    stats->hooks = s_running;
+    for (int i = 0; i <= HEAP_MONITOR_MAX_TASKS; i++)
+    {
+        stats->allocs += atomic_load_explicit(&s_tasks[i].allocs, memory_order_relaxed);
+        stats->alloc_bytes += atomic_load_explicit(&s_tasks[i].alloc_bytes, memory_order_relaxed);
+        stats->frees += atomic_load_explicit(&s_tasks[i].frees, memory_order_relaxed);
+    }
+    stats->hot_allocs = atomic_load_explicit(&s_hot_total, memory_order_relaxed);
+    return ESP_OK;
+}
+
+void heap_monitor_print(void)
+{
+    heap_monitor_stats_t stats;
+    (void)heap_monitor_get_stats(&stats);
+
+    heap_monitor_refresh_tasks();
+
+    /* #01 - Steady-state allocations per task */
+    if (stats.hooks)
+    {
+        ESP_LOGI(TAG, "Since start: %lu allocs / %lu B, %lu frees, %lu on the hot path%s",
+                 (unsigned long)stats.allocs, (unsigned long)stats.alloc_bytes, (unsigned long)stats.frees,
+                 (unsigned long)stats.hot_allocs, (stats.hot_allocs == 0) ? " (allocation-free)" : "");
+        for (uint8_t i = 0; i <= HEAP_MONITOR_MAX_TASKS; i++)
+        {
+            const heap_monitor_task_t *t = &s_tasks[i];
+            uint32_t allocs = atomic_load_explicit(&t->allocs, memory_order_relaxed);
+            uint32_t frees = atomic_load_explicit(&t->frees, memory_order_relaxed);
+            if (allocs == 0 && frees == 0)
+            {
+                continue;
+            }
+            ESP_LOGI(TAG, "  %-16s allocs %6lu / %7lu B, frees %6lu, hot %lu", heap_monitor_task_name(i),
+                     (unsigned long)allocs,
+                     (unsigned long)atomic_load_explicit(&t->alloc_bytes, memory_order_relaxed),
+                     (unsigned long)frees,
+                     (unsigned long)atomic_load_explicit(&t->hot_allocs, memory_order_relaxed));
+        }
+        for (int r = 0; r < HEAP_REGION_COUNT; r++)
+        {
+            uint32_t n = atomic_load_explicit(&s_region_allocs[r], memory_order_relaxed);
+            if (n != 0)
+            {
+                ESP_LOGW(TAG, "  hot region %s: %lu allocations", s_region_names[r], (unsigned long)n);
+            }
+        }
+    }
+
+    /* #02 - Fragmentation trend over the history */
+    uint32_t count = (s_history_count < HEAP_MONITOR_HISTORY) ? s_history_count : HEAP_MONITOR_HISTORY;
+    if (count == 0)
+    {
+        return;
+    }
+    const heap_monitor_sample_t *oldest = &s_history[(s_history_count - count) % HEAP_MONITOR_HISTORY];
+    const heap_monitor_sample_t *last = &s_history[(s_history_count - 1) % HEAP_MONITOR_HISTORY];
+    uint16_t frag_min = UINT16_MAX;
+    uint16_t frag_max = 0;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint16_t frag = s_history[n].frag_permille;
+        frag_min = (frag < frag_min) ? frag : frag_min;
+        frag_max = (frag > frag_max) ? frag : frag_max;
+    }
+    ESP_LOGI(TAG, "Heap free %lu B, largest block %lu B, fragmentation %u.%u%% (%u.%u..%u.%u%% over %lus), free %+ld B",
+             (unsigned long)last->free_bytes, (unsigned long)last->largest_free_block,
+             last->frag_permille / 10, last->frag_permille % 10, frag_min / 10, frag_min % 10,
+             frag_max / 10, frag_max % 10, (unsigned long)(last->uptime_s - oldest->uptime_s),
+             (long)last->free_bytes - (long)oldest->free_bytes);
+}
+
+uint8_t heap_monitor_hot_enter(heap_region_t region)
+{
+    if (xPortInIsrContext())
+    {
+        return HEAP_REGION_NONE;
+    }
+
+    heap_monitor_task_t *task = &s_tasks[heap_monitor_task_index()];
+    uint8_t prev = task->region;
+    task->region = (uint8_t)region;
+    return prev;
+}
+
+void heap_monitor_hot_exit(uint8_t prev)
+{
+    if (xPortInIsrContext())
+    {
+        return;
+    }
+
+    s_tasks[heap_monitor_task_index()].region = prev;
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static IRAM_ATTR uint8_t heap_monitor_task_index(void)
+{
+    if (xPortInIsrContext())
+    {
+        return HEAP_MONITOR_OTHER;
+    }
+
+    uintptr_t self = (uintptr_t)xTaskGetCurrentTaskHandle();
+    for (uint8_t i = 0; i < HEAP_MONITOR_MAX_TASKS; i++)
+    {
+        uintptr_t owner = atomic_load_explicit(&s_tasks[i].owner, memory_order_relaxed);
+        if (owner == self)
+        {
+            return i;
+        }
+        if (owner == 0)
+        {
+            uintptr_t expected = 0;
+            if (atomic_compare_exchange_strong_explicit(&s_tasks[i].owner, &expected, self,
+                                                        memory_order_relaxed, memory_order_relaxed) ||
+                expected == self)
+            {
+                s_tasks[i].region = HEAP_REGION_NONE;
+                return i;
+            }
+        }
+    }
+    return HEAP_MONITOR_OTHER;
+}
+
+static void heap_monitor_refresh_tasks(void)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    s_task_status_count = uxTaskGetSystemState(s_task_status, sizeof(s_task_status) / sizeof(s_task_status[0]), NULL);
+#endif
+}
+
+static const char *heap_monitor_task_name(uint8_t index)
+{
+    if (index >= HEAP_MONITOR_MAX_TASKS)
+    {
+        return "(isr/other)";
+    }
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    uintptr_t owner = atomic_load_explicit(&s_tasks[index].owner, memory_order_relaxed);
+    for (UBaseType_t i = 0; i < s_task_status_count; i++)
+    {
+        if ((uintptr_t)s_task_status[i].xHandle == owner)
+        {
+            return s_task_status[i].pcTaskName;
+        }
+    }
+    return "(deleted)";
+#else
+    return "(task)";
+#endif
+}
@@ -0,0 +1,171 @@
+/******************************************************************************
+ * @file latency_probe.h
+ * @brief Command-to-actuation latency instrumentation
+ *
+ * @details Every frame gets a cycle counter timestamp when it enters the ESP-NOW
+ *          receive callback. Each later stage on the way to the motors records
+ *          the cycles elapsed since that timestamp into a per-stage log2
+ *          histogram. Histogram updates are relaxed atomic increments, so any
+ *          task or callback may record without locks.
+ *
+ *          Synchronous stages (everything running inside the receive callback)
+ *          use the "current frame" stamp set by LATENCY_PROBE_FRAME_BEGIN().
+ *          Code that hands a command over to another task (e.g. the control loop)
+ *          must carry the stamp along with the command (LATENCY_PROBE_FRAME_STAMP())
+ *          and record with LATENCY_PROBE_MARK_FROM().
+ *
+ ******************************************************************************/
+
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch. With 0 every LATENCY_PROBE_* macro compiles to nothing. */
+#ifndef LATENCY_PROBE_ENABLED
+#define LATENCY_PROBE_ENABLED 1
+#endif
+
+/* Number of log2 buckets per stage: bucket n counts deltas of [2^n, 2^(n+1)) cycles */
+#define LATENCY_PROBE_BUCKETS 32
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Stages of the path from radio to PWM, in the order a frame passes them
+ */
+typedef enum
+{
+    LATENCY_STAGE_RECV_CB = 0,      /* esp_now_recv_cb entry: reference point, no histogram of its own */
+    LATENCY_STAGE_ENQUEUE,          /* Frame handed to a queue for deferred processing */
+    LATENCY_STAGE_DISPATCH,         /* Frame handed to the application receive callback */
+    LATENCY_STAGE_DECODE,           /* Application has decoded the message type */
+    LATENCY_STAGE_CONTROL_PICKUP,   /* Control loop picked up the resulting command */
+    LATENCY_STAGE_PWM_UPDATE,       /* PWM registers written with the new duty */
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/**
+ * @brief Snapshot of one stage histogram
+ */
+typedef struct
+{
+    uint32_t count;                             /* Number of recorded frames */
+    uint32_t min_cycles;                        /* Smallest delta (UINT32_MAX if count == 0) */
+    uint32_t max_cycles;                        /* Largest delta */
+    uint32_t buckets[LATENCY_PROBE_BUCKETS];    /* log2 histogram of the deltas */
+} latency_probe_hist_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Start timing a new frame (call at receive callback entry)
+ *
+ * @return Cycle counter stamp of the frame, also kept as the "current frame"
+ */
+uint32_t latency_probe_frame_begin(void);
+
+/**
+ * @brief Get the stamp of the frame currently in the receive path
+ *
+ * @return Stamp set by the last latency_probe_frame_begin()
+ */
+uint32_t latency_probe_frame_stamp(void);
+
+/**
+ * @brief Record that a frame reached a stage
+ *
+ * @param[in] stage Stage that was reached
+ * @param[in] stamp Stamp of the frame, from latency_probe_frame_begin()
+ */
+void latency_probe_mark(latency_stage_t stage, uint32_t stamp);
+
+/**
+ * @brief Enable or disable recording at runtime
+ *
+ * @details When disabled, marks cost one load and a branch.
+ *
+ * @param[in] enabled true to record, false to ignore marks
+ */
+void latency_probe_set_enabled(bool enabled);
+
+/**
+ * @brief Clear all stage histograms
+ */
+void latency_probe_reset(void);
+
+/**
+ * @brief Take a snapshot of one stage histogram
+ *
+ * @param[in] stage Stage to read
+ * @param[out] hist Snapshot (fields are read one by one, not atomically as a whole)
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if stage is out of range or hist is NULL
+ */
+esp_err_t latency_probe_get(latency_stage_t stage, latency_probe_hist_t *hist);
+
+/**
+ * @brief Short name of a stage, for reports
+ *
+ * @param[in] stage Stage
+ *
+ * @return Name string, "?" if out of range
+ */
+const char *latency_probe_stage_name(latency_stage_t stage);
+
+/**
+ * @brief Print all stage histograms on the console
+ *
+ * @details One line per stage with count, p50/p90/p99 upper bounds and min/max,
+ *          all converted to microseconds.
+ */
+void latency_probe_print(void);
+
+/**
+ * @brief Serialize one stage histogram for transmission
+ *
+ * @details Layout (little endian, see tools/latency_probe_decode.py):
+ *          u8 stage, u8 num_buckets, u16 cpu_mhz, u32 count, u32 min_cycles,
+ *          u32 max_cycles, u16 buckets[num_buckets] (saturating at 0xFFFF).
+ *          Trailing empty buckets are not sent.
+ *
+ * @param[in] stage Stage to serialize
+ * @param[out] buf Output buffer
+ * @param[in] len Size of buf in bytes
+ *
+ * @return Number of bytes written, 0 if stage is invalid or buf is too small
+ */
+size_t latency_probe_serialize(latency_stage_t stage, uint8_t *buf, size_t len);
+
+/*******************************************************************************/
+/*                           INSTRUMENTATION MACROS                            */
+/*******************************************************************************/
+#if LATENCY_PROBE_ENABLED
+#define LATENCY_PROBE_FRAME_BEGIN()             ((void)latency_probe_frame_begin())
+#define LATENCY_PROBE_FRAME_STAMP()             latency_probe_frame_stamp()
+#define LATENCY_PROBE_MARK(stage)               latency_probe_mark((stage), latency_probe_frame_stamp())
+#define LATENCY_PROBE_MARK_FROM(stage, stamp)   latency_probe_mark((stage), (stamp))
+#else
+#define LATENCY_PROBE_FRAME_BEGIN()             ((void)0)
+#define LATENCY_PROBE_FRAME_STAMP()             (0u)
+#define LATENCY_PROBE_MARK(stage)               ((void)0)
+#define LATENCY_PROBE_MARK_FROM(stage, stamp)   ((void)(stamp))
+#endif
+
+#endif /* LATENCY_PROBE_H */
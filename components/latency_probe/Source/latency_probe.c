@@ -0,0 +1,268 @@
+/******************************************************************************
+ * @file latency_probe.c
+ * @brief Command-to-actuation latency instrumentation
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "latency_probe.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "LATENCY"
+
+/* Size of one serialized stage header (everything before the buckets) */
+#define LATENCY_PROBE_SERIALIZED_HEADER 16
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Live histogram of one stage, updated lock-free
+ */
+typedef struct
+{
+    _Atomic uint32_t count;
+    _Atomic uint32_t min_cycles;
+    _Atomic uint32_t max_cycles;
+    _Atomic uint32_t buckets[LATENCY_PROBE_BUCKETS];
+} latency_probe_stage_hist_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Upper bound of the bucket holding the given percentile
+ *
+ * @param[in] hist Stage snapshot
+ * @param[in] pct Percentile 0..100
+ *
+ * @return Upper bound in cycles, 0 if the histogram is empty
+ */
+static uint32_t latency_probe_percentile(const latency_probe_hist_t *hist, uint32_t pct);
+
+/**
+ * @brief Convert cycles to microseconds
+ */
+static uint32_t latency_probe_cycles_to_us(uint32_t cycles);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static latency_probe_stage_hist_t s_stages[LATENCY_STAGE_COUNT] =
+{
+    [0 ... LATENCY_STAGE_COUNT - 1] = { .min_cycles = UINT32_MAX }
+};
+
+/* Stamp of the frame currently travelling through the synchronous receive path */
+static volatile uint32_t s_current_stamp = 0;
+
+static volatile bool s_enabled = true;
+
+static const char *const s_stage_names[LATENCY_STAGE_COUNT] =
+{
+    [LATENCY_STAGE_RECV_CB]         = "recv_cb",
+    [LATENCY_STAGE_ENQUEUE]         = "enqueue",
+    [LATENCY_STAGE_DISPATCH]        = "dispatch",
+    [LATENCY_STAGE_DECODE]          = "decode",
+    [LATENCY_STAGE_CONTROL_PICKUP]  = "control_pickup",
+    [LATENCY_STAGE_PWM_UPDATE]      = "pwm_update",
+};
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+IRAM_ATTR uint32_t latency_probe_frame_begin(void)
+{
+    uint32_t stamp = (uint32_t)esp_cpu_get_cycle_count();
+    s_current_stamp = stamp;
+    return stamp;
+}
+
+IRAM_ATTR uint32_t latency_probe_frame_stamp(void)
+{
+    return s_current_stamp;
+}
+
+IRAM_ATTR void latency_probe_mark(latency_stage_t stage, uint32_t stamp)
+{
+    if (!s_enabled || (unsigned)stage >= LATENCY_STAGE_COUNT)
+    {
+        return;
+    }
+
+    /* Unsigned subtraction handles counter wrap (every ~26 s at 160 MHz) */
+    uint32_t delta = (uint32_t)esp_cpu_get_cycle_count() - stamp;
+    uint32_t bucket = (delta != 0) ? (31u - (uint32_t)__builtin_clz(delta)) : 0;
+    latency_probe_stage_hist_t *h = &s_stages[stage];
+
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+
+    /* min/max: retry only while our value still improves on the stored one */
+    uint32_t cur = atomic_load_explicit(&h->max_cycles, memory_order_relaxed);
+    while (delta > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max_cycles, &cur, delta,
+                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    cur = atomic_load_explicit(&h->min_cycles, memory_order_relaxed);
+    while (delta < cur &&
+           !atomic_compare_exchange_weak_explicit(&h->min_cycles, &cur, delta,
+                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+void latency_probe_set_enabled(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+void latency_probe_reset(void)
+{
+    for (uint32_t s = 0; s < LATENCY_STAGE_COUNT; s++)
+    {
+        latency_probe_stage_hist_t *h = &s_stages[s];
+        atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->min_cycles, UINT32_MAX, memory_order_relaxed);
+        atomic_store_explicit(&h->max_cycles, 0, memory_order_relaxed);
+        for (uint32_t b = 0; b < LATENCY_PROBE_BUCKETS; b++)
+        {
+            atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+        }
+    }
+}
+
+esp_err_t latency_probe_get(latency_stage_t stage, latency_probe_hist_t *hist)
+{
+    if ((unsigned)stage >= LATENCY_STAGE_COUNT || !hist)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    latency_probe_stage_hist_t *h = &s_stages[stage];
+    hist->count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    hist->min_cycles = atomic_load_explicit(&h->min_cycles, memory_order_relaxed);
+    hist->max_cycles = atomic_load_explicit(&h->max_cycles, memory_order_relaxed);
+    for (uint32_t b = 0; b < LATENCY_PROBE_BUCKETS; b++)
+    {
+        hist->buckets[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+    }
+    return ESP_OK;
+}
+
+const char *latency_probe_stage_name(latency_stage_t stage)
+{
+    return ((unsigned)stage < LATENCY_STAGE_COUNT) ? s_stage_names[stage] : "?";
+}
+
+void latency_probe_print(void)
+{
+    latency_probe_hist_t hist;
+
+    ESP_LOGI(TAG, "Latency since recv_cb entry (us, log2 bucket upper bounds):");
+    for (uint32_t s = LATENCY_STAGE_RECV_CB + 1; s < LATENCY_STAGE_COUNT; s++)
+    {
+        (void)latency_probe_get((latency_stage_t)s, &hist);
+        if (hist.count == 0)
+        {
+            ESP_LOGI(TAG, "  %-14s no samples", s_stage_names[s]);
+            continue;
+        }
+        ESP_LOGI(TAG, "  %-14s n=%lu p50<=%lu p90<=%lu p99<=%lu min=%lu max=%lu",
+                 s_stage_names[s], (unsigned long)hist.count,
+                 (unsigned long)latency_probe_cycles_to_us(latency_probe_percentile(&hist, 50)),
+                 (unsigned long)latency_probe_cycles_to_us(latency_probe_percentile(&hist, 90)),
+                 (unsigned long)latency_probe_cycles_to_us(latency_probe_percentile(&hist, 99)),
+                 (unsigned long)latency_probe_cycles_to_us(hist.min_cycles),
+                 (unsigned long)latency_probe_cycles_to_us(hist.max_cycles));
+    }
+}
+
+size_t latency_probe_serialize(latency_stage_t stage, uint8_t *buf, size_t len)
+{
+    latency_probe_hist_t hist;
+    if (!buf || latency_probe_get(stage, &hist) != ESP_OK)
+    {
+        return 0;
+    }
+
+    /* #01 - Drop trailing empty buckets */
+    uint32_t num_buckets = LATENCY_PROBE_BUCKETS;
+    while (num_buckets > 0 && hist.buckets[num_buckets - 1] == 0)
+    {
+        num_buckets--;
+    }
+    if (len < LATENCY_PROBE_SERIALIZED_HEADER + num_buckets * 2u)
+    {
+        return 0;
+    }
+
+    /* #02 - Header */
+    uint32_t mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    uint8_t *p = buf;
+    *p++ = (uint8_t)stage;
+    *p++ = (uint8_t)num_buckets;
+    *p++ = (uint8_t)mhz;
+    *p++ = (uint8_t)(mhz >> 8);
+    const uint32_t words[3] = { hist.count, hist.min_cycles, hist.max_cycles };
+    for (uint32_t w = 0; w < 3; w++)
+    {
+        *p++ = (uint8_t)(words[w]);
+        *p++ = (uint8_t)(words[w] >> 8);
+        *p++ = (uint8_t)(words[w] >> 16);
+        *p++ = (uint8_t)(words[w] >> 24);
+    }
+
+    /* #03 - Buckets, saturated to 16 bits */
+    for (uint32_t b = 0; b < num_buckets; b++)
+    {
+        uint32_t v = (hist.buckets[b] > 0xFFFFu) ? 0xFFFFu : hist.buckets[b];
+        *p++ = (uint8_t)v;
+        *p++ = (uint8_t)(v >> 8);
+    }
+
+    return (size_t)(p - buf);
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static uint32_t latency_probe_percentile(const latency_probe_hist_t *hist, uint32_t pct)
+{
+    if (hist->count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = ((uint64_t)hist->count * pct + 99u) / 100u;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < LATENCY_PROBE_BUCKETS; b++)
+    {
+        seen += hist->buckets[b];
+        if (seen >= rank && seen != 0)
+        {
+            uint32_t upper = (b >= 31u) ? UINT32_MAX : ((1u << (b + 1u)) - 1u);
+            return (upper < hist->max_cycles) ? upper : hist->max_cycles;
+        }
+    }
+    return hist->max_cycles;
+}
+
+static uint32_t latency_probe_cycles_to_us(uint32_t cycles)
+{
+    return cycles / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+}
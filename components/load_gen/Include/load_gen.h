@@ -0,0 +1,107 @@
+/******************************************************************************
+ * @file load_gen.h
+ * @brief Multi-peer ESP-NOW traffic generator for soak and scaling tests
+ *
+ ******************************************************************************/
+
+#ifndef LOAD_GEN_H
+#define LOAD_GEN_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "load_gen_core.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch for the firmware load generator mode (see [env:seeed_xiao_esp32c6_loadgen]
+ * in platformio.ini). When 0 the application never starts the generator. */
+#ifndef LOAD_GEN_ENABLED
+#define LOAD_GEN_ENABLED 0
+#endif
+
+/* Depth of the queue between the generator and the receive path. It stands in for
+ * the WiFi task's receive queue, so its high-water mark is what we want to watch. */
+#ifndef LOAD_GEN_QUEUE_DEPTH
+#define LOAD_GEN_QUEUE_DEPTH 32
+#endif
+
+/* Resolution of the generator clock. FreeRTOS ticks are 10 ms on this target,
+ * which would make every peer burst, so an esp_timer drives the generator instead. */
+#define LOAD_GEN_TICK_US 1000
+
+/* Priorities of the generator and of the task that pushes frames through the
+ * receive path. The injector stands in for the WiFi task, so it runs above the
+ * generator: if it can't keep up, the queue fills and frames are dropped. */
+#define LOAD_GEN_GENERATOR_PRIORITY 4
+#define LOAD_GEN_INJECTOR_PRIORITY  5
+
+/* Default traffic shape: every peer at 50 Hz, mostly small control frames */
+#define LOAD_GEN_DEFAULT_CONFIG()       \
+    {                                   \
+        .num_peers = 20,                \
+        .rate_hz = 50,                  \
+        .large_frame_pct = 10,          \
+        .small_len = 16,                \
+        .large_len = 200,               \
+        .duration_ms = 30000,           \
+        .seed = 1                       \
+    }
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Start a load generator run
+ *
+ * @details Spawns a generator task that synthesizes frames from cfg->num_peers
+ *          simulated peers (locally administered MACs 02:4C:47:00:00:<n>, added
+ *          with esp_now_comm_add_peer() for the run) and an injector task that
+ *          pushes them through esp_now_comm_inject_recv(), i.e. through the same
+ *          dispatch and user callbacks as real traffic. The frames carry
+ *          ESP_NOW_MSG_LOAD_GEN_DATA, so they trigger no control handling.
+ *          Latency is measured from the moment a frame was due to the moment its
+ *          dispatch returned, so it includes queueing delay.
+ *          esp_now_comm_init() must have been called before.
+ *
+ * @param[in] cfg Traffic shape for this run
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if cfg is NULL
+ *      - ESP_ERR_INVALID_STATE if a run is already in progress
+ *      - ESP_ERR_NO_MEM if the tasks could not be created
+ *      - ESP_FAIL if the queue could not be created
+ */
+esp_err_t load_gen_start(const lg_config_t *cfg);
+
+/**
+ * @brief Check whether a run is in progress
+ *
+ * @return true while the generator or the injector is still active
+ */
+bool load_gen_is_running(void);
+
+/**
+ * @brief Get the report of the current or last run
+ *
+ * @param[out] report Filled with throughput, drops, queue high-water mark and latency percentiles
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if report is NULL
+ */
+esp_err_t load_gen_get_report(lg_report_t *report);
+
+/**
+ * @brief Print the report of the current or last run on the console
+ */
+void load_gen_print_report(void);
+
+#endif /* LOAD_GEN_H */
@@ -0,0 +1,216 @@
+/******************************************************************************
+ * @file load_gen_core.h
+ * @brief Platform independent core of the multi-peer traffic generator
+ *
+ * @details Everything in this file is plain C with no ESP-IDF dependencies so
+ *          that the same peer scheduling and statistics code runs both in the
+ *          firmware load generator (load_gen.c) and in the host simulator
+ *          (host/load_gen). Time is always passed in by the caller in
+ *          microseconds.
+ *
+ ******************************************************************************/
+
+#ifndef LOAD_GEN_CORE_H
+#define LOAD_GEN_CORE_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Upper bound on simulated peers. Deliberately larger than ESP_NOW_COMM_MAX_PEERS
+ * so that scaling beyond the driver limit can be exercised as well. */
+#define LG_MAX_PEERS 64
+
+/* Latency histogram layout: values below LG_HIST_LINEAR_LIMIT get one bucket each,
+ * every following power of two is split into LG_HIST_SUB_BUCKETS buckets.
+ * This bounds the relative quantization error to 1/LG_HIST_SUB_BUCKETS (12.5%). */
+#define LG_HIST_SUB_BITS     3
+#define LG_HIST_SUB_BUCKETS  (1u << LG_HIST_SUB_BITS)
+#define LG_HIST_LINEAR_LIMIT (2u * LG_HIST_SUB_BUCKETS)
+#define LG_HIST_BUCKETS      (LG_HIST_LINEAR_LIMIT + (32u - (LG_HIST_SUB_BITS + 1u)) * LG_HIST_SUB_BUCKETS)
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Traffic shape for one load generator run
+ */
+typedef struct
+{
+    uint8_t  num_peers;         /* Number of simulated peers (1..LG_MAX_PEERS) */
+    uint16_t rate_hz;           /* Frames per second sent by EACH peer */
+    uint8_t  large_frame_pct;   /* Percentage (0..100) of frames that use large_len instead of small_len */
+    uint8_t  small_len;         /* Payload length of a "control" sized frame in bytes */
+    uint8_t  large_len;         /* Payload length of a "bulk" sized frame in bytes */
+    uint32_t duration_ms;       /* Length of the run in milliseconds */
+    uint32_t seed;              /* Seed for the frame mix and the per-peer phase offsets */
+} lg_config_t;
+
+/**
+ * @brief Per-peer scheduling state
+ */
+typedef struct
+{
+    uint64_t next_due_us;       /* Time at which the next frame of this peer is due */
+    uint32_t seq;               /* Sequence number of the next frame */
+} lg_peer_t;
+
+/**
+ * @brief Frame produced by the scheduler
+ */
+typedef struct
+{
+    uint64_t due_us;            /* Time the frame was supposed to hit the receive path */
+    uint32_t seq;               /* Per-peer sequence number */
+    uint8_t  peer;              /* Index of the simulated peer */
+    uint8_t  len;               /* Payload length in bytes */
+} lg_frame_t;
+
+/**
+ * @brief Scheduler for N peers sending at a fixed rate with a random size mix
+ */
+typedef struct
+{
+    lg_config_t cfg;
+    uint32_t    period_us;      /* Per-peer frame period derived from rate_hz */
+    uint32_t    rng;            /* xorshift32 state for the size mix */
+    uint64_t    end_us;         /* Time after which no more frames are produced */
+    lg_peer_t   peers[LG_MAX_PEERS];
+} lg_sched_t;
+
+/**
+ * @brief Log-linear latency histogram (values in microseconds)
+ */
+typedef struct
+{
+    uint32_t buckets[LG_HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+} lg_hist_t;
+
+/**
+ * @brief Result of a load generator run
+ */
+typedef struct
+{
+    uint32_t duration_us;       /* Wall time covered by the run */
+    uint32_t frames_offered;    /* Frames produced by the scheduler */
+    uint32_t frames_delivered;  /* Frames that made it through the receive path */
+    uint32_t frames_dropped;    /* Frames rejected because the queue was full */
+    uint32_t bytes_delivered;   /* Payload bytes that made it through the receive path */
+    uint32_t queue_hwm;         /* Highest observed queue occupancy */
+    uint32_t queue_depth;       /* Configured queue capacity */
+    uint32_t latency_p50_us;
+    uint32_t latency_p90_us;
+    uint32_t latency_p99_us;
+    uint32_t latency_max_us;
+    uint32_t latency_avg_us;
+} lg_report_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Record one latency sample
+ *
+ * @details Kept inline because it sits on the measured path; it is a handful of
+ *          integer operations and one store, with no branches on the bucket count.
+ *
+ * @param[in,out] hist Histogram to update
+ * @param[in] value_us Latency sample in microseconds
+ */
+static inline void lg_hist_record(lg_hist_t *hist, uint32_t value_us)
+{
+    uint32_t idx;
+    if (value_us < LG_HIST_LINEAR_LIMIT)
+    {
+        idx = value_us;
+    }
+    else
+    {
+        /* Position of the most significant bit selects the power of two, the
+         * LG_HIST_SUB_BITS bits below it select the sub-bucket. */
+        uint32_t msb = 31u - (uint32_t)__builtin_clz(value_us);
+        uint32_t sub = (value_us >> (msb - LG_HIST_SUB_BITS)) & (LG_HIST_SUB_BUCKETS - 1u);
+        idx = LG_HIST_LINEAR_LIMIT + (msb - (LG_HIST_SUB_BITS + 1u)) * LG_HIST_SUB_BUCKETS + sub;
+    }
+    hist->buckets[idx]++;
+    hist->count++;
+    hist->sum += value_us;
+    if (value_us > hist->max)
+    {
+        hist->max = value_us;
+    }
+}
+
+/**
+ * @brief Reset a histogram to zero samples
+ *
+ * @param[out] hist Histogram to clear
+ */
+void lg_hist_reset(lg_hist_t *hist);
+
+/**
+ * @brief Compute a percentile from the histogram
+ *
+ * @param[in] hist Histogram to evaluate
+ * @param[in] pct Percentile in the range 0..100
+ *
+ * @return Upper bound of the bucket holding the requested percentile, 0 if empty
+ */
+uint32_t lg_hist_percentile(const lg_hist_t *hist, uint32_t pct);
+
+/**
+ * @brief Prepare the scheduler for a new run
+ *
+ * @details Peers start with a random phase inside the first period so that
+ *          they do not all fire in the same instant.
+ *
+ * @param[out] sched Scheduler state
+ * @param[in] cfg Traffic shape (num_peers is clamped to LG_MAX_PEERS, rate_hz to >= 1)
+ * @param[in] start_us Time at which the run starts
+ */
+void lg_sched_init(lg_sched_t *sched, const lg_config_t *cfg, uint64_t start_us);
+
+/**
+ * @brief Pop the next frame that is due at or before now_us
+ *
+ * @details Frames are returned in due-time order across all peers. Call in a
+ *          loop until it returns false to drain everything due so far.
+ *
+ * @param[in,out] sched Scheduler state
+ * @param[in] now_us Current time
+ * @param[out] frame Filled with the due frame
+ *
+ * @return true if a frame was produced, false if nothing is due (or the run ended)
+ */
+bool lg_sched_next(lg_sched_t *sched, uint64_t now_us, lg_frame_t *frame);
+
+/**
+ * @brief Check whether the run is over
+ *
+ * @param[in] sched Scheduler state
+ * @param[in] now_us Current time
+ *
+ * @return true once now_us is past the configured duration
+ */
+bool lg_sched_done(const lg_sched_t *sched, uint64_t now_us);
+
+/**
+ * @brief Fill the latency fields of a report from a histogram
+ *
+ * @param[in] hist Latency histogram of the run
+ * @param[in,out] report Report whose latency_* fields are written
+ */
+void lg_report_fill_latency(const lg_hist_t *hist, lg_report_t *report);
+
+#endif /* LOAD_GEN_CORE_H */
@@ -0,0 +1,389 @@
+/******************************************************************************
+ * @file load_gen.c
+ * @brief Multi-peer ESP-NOW traffic generator for soak and scaling tests
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_now_comm.h"
+#include "esp_now_comm_protocol.h"
+#include "load_gen.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "LOAD_GEN"
+
+/* Stack sizes of the two tasks. The injector runs the whole receive dispatch,
+ * user callback included, so it needs the larger stack. */
+#define LOAD_GEN_GENERATOR_STACK_SIZE 2048
+#define LOAD_GEN_INJECTOR_STACK_SIZE  4096
+
+/* How long the injector waits for a frame before re-checking whether the run ended */
+#define LOAD_GEN_INJECTOR_POLL_MS 50
+
+/* Fill byte used for the payload after the header */
+#define LOAD_GEN_FILL_BYTE 0xA5
+
+/* Simulated peer MACs: locally administered, "LG", peer index in the last byte */
+#define LOAD_GEN_MAC_PREFIX {0x02, 0x4C, 0x47, 0x00, 0x00, 0x00}
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Periodic esp_timer callback waking up the generator task
+ *
+ * @param[in] arg Unused
+ */
+static void load_gen_tick_cb(void *arg);
+
+/**
+ * @brief Generator task: turns the schedule into queued frames
+ *
+ * @param[in] arg Unused
+ */
+static void load_gen_generator_task(void *arg);
+
+/**
+ * @brief Injector task: pushes queued frames through the ESP-NOW receive path
+ *
+ * @param[in] arg Unused
+ */
+static void load_gen_injector_task(void *arg);
+
+/**
+ * @brief Add or remove the simulated peers of a run
+ *
+ * @param[in] count Simulated peers (02:4C:47:00:00:00 .. count - 1)
+ * @param[in] add true to add them to esp_now_comm, false to remove them
+ */
+static void load_gen_peers(uint8_t count, bool add);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+/**
+ * Scheduler and latency histogram of the current run. Large, hence static.
+ */
+static lg_sched_t s_sched;
+static lg_hist_t s_hist;
+
+/**
+ * Report of the current run. Written by the generator (offered, dropped, hwm)
+ * and the injector (everything else), always under s_report_lock, which also
+ * covers the histogram's count, max and sum; readers copy it under the lock.
+ */
+static lg_report_t s_report;
+static portMUX_TYPE s_report_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static QueueHandle_t s_queue = NULL;
+static StaticQueue_t s_queue_storage;
+static uint8_t s_queue_items[LOAD_GEN_QUEUE_DEPTH * sizeof(lg_frame_t)];
+static TaskHandle_t s_generator_task = NULL;
+static esp_timer_handle_t s_tick_timer = NULL;
+static int64_t s_start_us = 0;
+static volatile bool s_generator_done = false;
+static volatile bool s_running = false;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+esp_err_t load_gen_start(const lg_config_t *cfg)
+{
+    if (!cfg)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* #01 - Create the queue standing in for the WiFi task's receive queue (reused across runs) */
+    if (s_queue == NULL)
+    {
+        s_queue = xQueueCreateStatic(LOAD_GEN_QUEUE_DEPTH, sizeof(lg_frame_t), s_queue_items, &s_queue_storage);
+        if (s_queue == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to create frame queue");
+            return ESP_FAIL;
+        }
+    }
+
+    /* #02 - Create the timer that clocks the generator (reused across runs) */
+    if (s_tick_timer == NULL)
+    {
+        const esp_timer_create_args_t timer_args =
+        {
+            .callback = load_gen_tick_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "load_gen_tick",
+            .skip_unhandled_events = true
+        };
+        esp_err_t ret = esp_timer_create(&timer_args, &s_tick_timer);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to create tick timer: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    /* #03 - Reset the run state */
+    portENTER_CRITICAL(&s_report_lock);
+    memset(&s_report, 0, sizeof(s_report));
+    s_report.queue_depth = LOAD_GEN_QUEUE_DEPTH;
+    lg_hist_reset(&s_hist);
+    portEXIT_CRITICAL(&s_report_lock);
+
+    /* #04 - Add the simulated peers, so the run loads the peer table and the driver's LRU eviction too */
+    uint8_t num_peers = (cfg->num_peers > LG_MAX_PEERS) ? LG_MAX_PEERS : cfg->num_peers;
+    load_gen_peers(num_peers, true);
+    s_start_us = esp_timer_get_time();
+    lg_sched_init(&s_sched, cfg, (uint64_t)s_start_us);
+    s_generator_done = false;
+    s_running = true;
+
+    /* #05 - Start the injector first so nothing piles up before it exists */
+    if (xTaskCreate(load_gen_injector_task, "load_gen_inj", LOAD_GEN_INJECTOR_STACK_SIZE,
+                    NULL, LOAD_GEN_INJECTOR_PRIORITY, NULL) != pdPASS)
+    {
+        s_running = false;
+        load_gen_peers(num_peers, false);
+        ESP_LOGE(TAG, "Failed to create injector task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* #06 - Start the clock, then the generator. Ticks before the generator exists are ignored.
+     * On failure the injector exits on its own once it sees the generator is done. */
+    esp_err_t ret = esp_timer_start_periodic(s_tick_timer, LOAD_GEN_TICK_US);
+    if (ret != ESP_OK)
+    {
+        s_generator_done = true;
+        ESP_LOGE(TAG, "Failed to start tick timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    if (xTaskCreate(load_gen_generator_task, "load_gen_gen", LOAD_GEN_GENERATOR_STACK_SIZE,
+                    NULL, LOAD_GEN_GENERATOR_PRIORITY, &s_generator_task) != pdPASS)
+    {
+        (void)esp_timer_stop(s_tick_timer);
+        s_generator_done = true;
+        ESP_LOGE(TAG, "Failed to create generator task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Started: %u peers x %u Hz, %u%% large (%u/%u bytes), %lu ms",
+             s_sched.cfg.num_peers, s_sched.cfg.rate_hz, s_sched.cfg.large_frame_pct,
+             s_sched.cfg.small_len, s_sched.cfg.large_len, (unsigned long)s_sched.cfg.duration_ms);
+
+    return ESP_OK;
+}
+
+bool load_gen_is_running(void)
+{
+    return s_running;
+}
+
+esp_err_t load_gen_get_report(lg_report_t *report)
+{
+    if (!report)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool running = s_running;
+    portENTER_CRITICAL(&s_report_lock);
+    *report = s_report;
+    uint32_t count = s_hist.count;
+    uint32_t max = s_hist.max;
+    uint64_t sum = s_hist.sum;
+    portEXIT_CRITICAL(&s_report_lock);
+
+    if (running)
+    {
+        /* Run still in progress: report what we have so far. The percentile scan is too long
+         * for the lock, so it reads buckets the injector may still be adding to. */
+        report->duration_us = (uint32_t)(esp_timer_get_time() - s_start_us);
+        lg_report_fill_latency(&s_hist, report);
+        report->latency_max_us = max;
+        report->latency_avg_us = (count != 0) ? (uint32_t)(sum / count) : 0;
+    }
+    return ESP_OK;
+}
+
+void load_gen_print_report(void)
+{
+    lg_report_t report;
+    (void)load_gen_get_report(&report);
+
+    uint32_t duration_ms = report.duration_us / 1000u;
+    uint32_t fps = (duration_ms != 0) ? (uint32_t)((uint64_t)report.frames_delivered * 1000u / duration_ms) : 0;
+    uint32_t bps = (duration_ms != 0) ? (uint32_t)((uint64_t)report.bytes_delivered * 1000u / duration_ms) : 0;
+
+    ESP_LOGI(TAG, "Report (%s): %lu ms, offered %lu, delivered %lu (%lu frames/s, %lu B/s), dropped %lu",
+             s_running ? "running" : "finished", (unsigned long)duration_ms,
+             (unsigned long)report.frames_offered, (unsigned long)report.frames_delivered,
+             (unsigned long)fps, (unsigned long)bps, (unsigned long)report.frames_dropped);
+    ESP_LOGI(TAG, "Queue high-water mark %lu/%lu, latency us: p50 %lu p90 %lu p99 %lu max %lu avg %lu",
+             (unsigned long)report.queue_hwm, (unsigned long)report.queue_depth,
+             (unsigned long)report.latency_p50_us, (unsigned long)report.latency_p90_us,
+             (unsigned long)report.latency_p99_us, (unsigned long)report.latency_max_us,
+             (unsigned long)report.latency_avg_us);
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void load_gen_tick_cb(void *arg)
+{
+    (void)arg;
+
+    if (s_generator_task != NULL)
+    {
+        xTaskNotifyGive(s_generator_task);
+    }
+}
+
+static void load_gen_generator_task(void *arg)
+{
+    (void)arg;
+    lg_frame_t frame;
+
+    while (true)
+    {
+        /* #01 - Sleep until the next generator tick */
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint64_t now_us = (uint64_t)esp_timer_get_time();
+
+        /* #02 - Queue everything that became due since the last tick. Never block:
+         * a full queue is exactly the overload condition we want to count. */
+        while (lg_sched_next(&s_sched, now_us, &frame))
+        {
+            bool queued = (xQueueSend(s_queue, &frame, 0) == pdTRUE);
+            UBaseType_t waiting = queued ? uxQueueMessagesWaiting(s_queue) : 0;
+
+            portENTER_CRITICAL(&s_report_lock);
+            s_report.frames_offered++;
+            if (!queued)
+            {
+                s_report.frames_dropped++;
+            }
+            else if (waiting > s_report.queue_hwm)
+            {
+                s_report.queue_hwm = waiting;
+            }
+            portEXIT_CRITICAL(&s_report_lock);
+        }
+
+        /* #03 - Stop once the configured duration has elapsed */
+        if (lg_sched_done(&s_sched, now_us))
+        {
+            break;
+        }
+    }
+
+    (void)esp_timer_stop(s_tick_timer);
+    s_generator_task = NULL;
+    s_generator_done = true;
+    vTaskDelete(NULL);
+}
+
+static void load_gen_injector_task(void *arg)
+{
+    (void)arg;
+    lg_frame_t frame;
+    uint8_t payload[ESP_NOW_COMM_PAYLOAD_SIZE];
+    uint8_t mac[6] = LOAD_GEN_MAC_PREFIX;
+
+    memset(payload, LOAD_GEN_FILL_BYTE, sizeof(payload));
+
+    while (true)
+    {
+        if (xQueueReceive(s_queue, &frame, pdMS_TO_TICKS(LOAD_GEN_INJECTOR_POLL_MS)) != pdTRUE)
+        {
+            /* Queue drained: done if the generator has finished too */
+            if (s_generator_done)
+            {
+                break;
+            }
+            continue;
+        }
+
+        /* #01 - Build the frame: a data message ID (no control side effects, no lease check),
+         *       peer index and sequence number up front, fill after */
+        mac[5] = frame.peer;
+        payload[0] = ESP_NOW_MSG_LOAD_GEN_DATA;
+        payload[1] = frame.peer;
+        payload[2] = (uint8_t)(frame.seq);
+        payload[3] = (uint8_t)(frame.seq >> 8);
+        payload[4] = (uint8_t)(frame.seq >> 16);
+        payload[5] = (uint8_t)(frame.seq >> 24);
+
+        /* #02 - Push it through the receive path exactly like a radio frame */
+        (void)esp_now_comm_inject_recv(mac, payload, frame.len);
+
+        /* #03 - Account for it: due time to dispatch return, queueing included */
+        uint64_t done_us = (uint64_t)esp_timer_get_time();
+        uint64_t latency_us = (done_us > frame.due_us) ? (done_us - frame.due_us) : 0;
+        portENTER_CRITICAL(&s_report_lock);
+        lg_hist_record(&s_hist, (latency_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency_us);
+        s_report.frames_delivered++;
+        s_report.bytes_delivered += frame.len;
+        portEXIT_CRITICAL(&s_report_lock);
+    }
+
+    /* #04 - Finalize and print the report. Both tasks are done with the histogram. */
+    lg_report_t latency = { 0 };
+    lg_report_fill_latency(&s_hist, &latency);
+    portENTER_CRITICAL(&s_report_lock);
+    s_report.duration_us = (uint32_t)(esp_timer_get_time() - s_start_us);
+    s_report.latency_p50_us = latency.latency_p50_us;
+    s_report.latency_p90_us = latency.latency_p90_us;
+    s_report.latency_p99_us = latency.latency_p99_us;
+    s_report.latency_max_us = latency.latency_max_us;
+    s_report.latency_avg_us = latency.latency_avg_us;
+    portEXIT_CRITICAL(&s_report_lock);
+    load_gen_peers(s_sched.cfg.num_peers, false);
+    s_running = false;
+    load_gen_print_report();
+
+    vTaskDelete(NULL);
+}
+
+static void load_gen_peers(uint8_t count, bool add)
+{
+    uint8_t mac[6] = LOAD_GEN_MAC_PREFIX;
+    uint8_t failed = 0;
+    esp_err_t last = ESP_OK;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        mac[5] = i;
+        esp_err_t ret = add ? esp_now_comm_add_peer(mac) : esp_now_comm_remove_peer(mac);
+        if (ret != ESP_OK)
+        {
+            failed++;
+            last = ret;
+        }
+    }
+    if (failed != 0)
+    {
+        ESP_LOGW(TAG, "%u of %u simulated peers could not be %s: %s", failed, count,
+                 add ? "added" : "removed", esp_err_to_name(last));
+    }
+}
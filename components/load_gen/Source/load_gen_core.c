@@ -0,0 +1,184 @@
+/******************************************************************************
+ * @file load_gen_core.c
+ * @brief Platform independent core of the multi-peer traffic generator
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include "load_gen_core.h"
+#include <string.h>
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief xorshift32 pseudo random number generator
+ *
+ * @param[in,out] state Generator state (must never be 0)
+ *
+ * @return Next pseudo random value
+ */
+static uint32_t lg_rand(uint32_t *state);
+
+/**
+ * @brief Largest value that falls into the given histogram bucket
+ *
+ * @param[in] idx Bucket index
+ *
+ * @return Inclusive upper bound of the bucket in microseconds
+ */
+static uint32_t lg_hist_bucket_upper(uint32_t idx);
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+void lg_hist_reset(lg_hist_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+uint32_t lg_hist_percentile(const lg_hist_t *hist, uint32_t pct)
+{
+    if (hist->count == 0)
+    {
+        return 0;
+    }
+
+    /* Rank of the sample we are looking for (1-based, rounded up) */
+    uint64_t rank = ((uint64_t)hist->count * pct + 99u) / 100u;
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t idx = 0; idx < LG_HIST_BUCKETS; idx++)
+    {
+        seen += hist->buckets[idx];
+        if (seen >= rank)
+        {
+            /* Never report more than the exact maximum we have seen */
+            uint32_t upper = lg_hist_bucket_upper(idx);
+            return (upper < hist->max) ? upper : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void lg_sched_init(lg_sched_t *sched, const lg_config_t *cfg, uint64_t start_us)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->cfg = *cfg;
+
+    /* #01 - Clamp the configuration to something the scheduler can represent */
+    if (sched->cfg.num_peers == 0)
+    {
+        sched->cfg.num_peers = 1;
+    }
+    if (sched->cfg.num_peers > LG_MAX_PEERS)
+    {
+        sched->cfg.num_peers = LG_MAX_PEERS;
+    }
+    if (sched->cfg.rate_hz == 0)
+    {
+        sched->cfg.rate_hz = 1;
+    }
+    if (sched->cfg.large_frame_pct > 100)
+    {
+        sched->cfg.large_frame_pct = 100;
+    }
+
+    sched->period_us = 1000000u / sched->cfg.rate_hz;
+    sched->rng = (cfg->seed != 0) ? cfg->seed : 0x2545F491u;
+    sched->end_us = start_us + (uint64_t)sched->cfg.duration_ms * 1000u;
+
+    /* #02 - Spread the peers over the first period */
+    for (uint32_t i = 0; i < sched->cfg.num_peers; i++)
+    {
+        sched->peers[i].next_due_us = start_us + (lg_rand(&sched->rng) % sched->period_us);
+        sched->peers[i].seq = 0;
+    }
+}
+
+bool lg_sched_next(lg_sched_t *sched, uint64_t now_us, lg_frame_t *frame)
+{
+    /* #01 - Find the peer whose next frame is due first */
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < sched->cfg.num_peers; i++)
+    {
+        if (sched->peers[i].next_due_us < sched->peers[best].next_due_us)
+        {
+            best = i;
+        }
+    }
+
+    lg_peer_t *peer = &sched->peers[best];
+    if (peer->next_due_us > now_us || peer->next_due_us >= sched->end_us)
+    {
+        return false;
+    }
+
+    /* #02 - Emit the frame and advance that peer by one period */
+    bool large = (lg_rand(&sched->rng) % 100u) < sched->cfg.large_frame_pct;
+    frame->due_us = peer->next_due_us;
+    frame->seq = peer->seq++;
+    frame->peer = (uint8_t)best;
+    frame->len = large ? sched->cfg.large_len : sched->cfg.small_len;
+
+    peer->next_due_us += sched->period_us;
+    return true;
+}
+
+bool lg_sched_done(const lg_sched_t *sched, uint64_t now_us)
+{
+    return now_us >= sched->end_us;
+}
+
+void lg_report_fill_latency(const lg_hist_t *hist, lg_report_t *report)
+{
+    report->latency_p50_us = lg_hist_percentile(hist, 50);
+    report->latency_p90_us = lg_hist_percentile(hist, 90);
+    report->latency_p99_us = lg_hist_percentile(hist, 99);
+    report->latency_max_us = hist->max;
+    report->latency_avg_us = (hist->count != 0) ? (uint32_t)(hist->sum / hist->count) : 0;
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static uint32_t lg_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint32_t lg_hist_bucket_upper(uint32_t idx)
+{
+    if (idx < LG_HIST_LINEAR_LIMIT)
+    {
+        return idx;
+    }
+
+    uint32_t k = idx - LG_HIST_LINEAR_LIMIT;
+    uint32_t msb = (LG_HIST_SUB_BITS + 1u) + k / LG_HIST_SUB_BUCKETS;
+    uint32_t sub = k % LG_HIST_SUB_BUCKETS;
+    uint32_t width = 1u << (msb - LG_HIST_SUB_BITS);
+    uint64_t upper = (1ull << msb) + (uint64_t)sub * width + width - 1u;
+    return (upper > UINT32_MAX) ? UINT32_MAX : (uint32_t)upper;
+}
@@ -0,0 +1,173 @@
+/******************************************************************************
+ * @file prof.h
+ * @brief Cycle profiling of hot-path sites with per-site aggregation
+ *
+ * @details PROF_SCOPE(site) at the top of a block reads the CPU cycle counter
+ *          and, when the block is left by any path, adds the elapsed cycles to
+ *          the site's entry: count, min, max and sum. PROF_BEGIN/PROF_END do
+ *          the same for a span that is not a block.
+ *
+ *          Sites are registered at compile time in PROF_SITES, so the table is
+ *          a static array indexed by the site ID; updates are relaxed atomics,
+ *          no locks, no heap. A site is meant to be hit from one context at a
+ *          time; concurrent hits of the same site are all counted, but a reader
+ *          may see the sum of one of them without its count.
+ *
+ *          prof_dump_console() prints the table, prof_reset() clears it; both
+ *          are also available remotely (diagnostics topic "profile" and
+ *          ESP_NOW_MSG_PROF_RESET, from the controller in charge only).
+ *
+ *          Profiling is a build switch: with PROF_ENABLED 0 (the default) every
+ *          PROF_* macro compiles to nothing and prof.c is empty.
+ *
+ ******************************************************************************/
+
+#ifndef PROF_H
+#define PROF_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch, set from build_flags (see the seeed_xiao_esp32c6_prof env) */
+#ifndef PROF_ENABLED
+#define PROF_ENABLED 0
+#endif
+
+/* Site registry: X(id, name). Names are at most PROF_NAME_LEN characters. */
+#define PROF_SITES(X) \
+    X(PROF_SITE_ESPNOW_RECV,    "espnow_recv") \
+    X(PROF_SITE_ESPNOW_SEND,    "espnow_send") \
+    X(PROF_SITE_ESPNOW_SEND_CB, "espnow_sendcb") \
+    X(PROF_SITE_CMD_DECODE,     "cmd_decode") \
+    X(PROF_SITE_DLOG_DRAIN,     "dlog_drain") \
+    X(PROF_SITE_SYS_MONITOR,    "sys_monitor")
+
+#define PROF_NAME_LEN 15
+
+/* Serialized table (prof_serialize()): u8 site, char name[15], u32 count, min, max, u64 sum */
+#define PROF_SERIALIZED_SITE 36
+
+#if PROF_ENABLED
+#include "esp_cpu.h"
+
+#define PROF_CONCAT_(a, b)  a##b
+#define PROF_CONCAT(a, b)   PROF_CONCAT_(a, b)
+
+#define PROF_SCOPE(site) \
+    prof_scope_t PROF_CONCAT(prof_scope_, __LINE__) __attribute__((cleanup(prof_scope_exit))) = \
+        { (uint32_t)esp_cpu_get_cycle_count(), (site) }
+#define PROF_BEGIN(site)    uint32_t prof_start_##site = (uint32_t)esp_cpu_get_cycle_count()
+#define PROF_END(site)      prof_record((site), (uint32_t)esp_cpu_get_cycle_count() - prof_start_##site)
+#else
+#define PROF_SCOPE(site)    ((void)0)
+#define PROF_BEGIN(site)    ((void)0)
+#define PROF_END(site)      ((void)0)
+#endif
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Site IDs
+ */
+typedef enum
+{
+#define PROF_SITE_ENUM(id, name) id,
+    PROF_SITES(PROF_SITE_ENUM)
+#undef PROF_SITE_ENUM
+    PROF_SITE_COUNT
+} prof_site_t;
+
+/**
+ * @brief State of one PROF_SCOPE()
+ */
+typedef struct
+{
+    uint32_t start;
+    prof_site_t site;
+} prof_scope_t;
+
+/**
+ * @brief Aggregate of one site
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t min_cycles;            /* UINT32_MAX while count is 0 */
+    uint32_t max_cycles;
+    uint64_t sum_cycles;
+} prof_stats_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Add one measurement to a site (use the PROF_* macros). Safe from tasks and ISRs.
+ *
+ * @param[in] site Site ID
+ * @param[in] cycles Elapsed cycles
+ */
+void prof_record(prof_site_t site, uint32_t cycles);
+
+/**
+ * @brief Read the aggregate of a site
+ *
+ * @param[in] site Site ID
+ * @param[out] stats Filled with the aggregate
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if site is out of range or stats is NULL
+ */
+esp_err_t prof_get(prof_site_t site, prof_stats_t *stats);
+
+/**
+ * @brief Name of a site
+ */
+const char *prof_site_name(prof_site_t site);
+
+/**
+ * @brief Clear every site
+ */
+void prof_reset(void);
+
+/**
+ * @brief Print the table on the console, including the cost of an empty scope
+ *
+ * @param[in] reset Clear the table after printing
+ */
+void prof_dump_console(bool reset);
+
+/**
+ * @brief Serialize sites for transmission (layout see PROF_SERIALIZED_SITE, little endian)
+ *
+ * @param[in] first First site to serialize
+ * @param[out] buf Output buffer
+ * @param[in] len Size of buf
+ *
+ * @return Bytes written; as many sites as fit
+ */
+size_t prof_serialize(prof_site_t first, uint8_t *buf, size_t len);
+
+#if PROF_ENABLED
+/**
+ * @brief Cleanup handler of PROF_SCOPE()
+ */
+static inline void prof_scope_exit(prof_scope_t *scope)
+{
+    prof_record(scope->site, (uint32_t)esp_cpu_get_cycle_count() - scope->start);
+}
+#endif
+
+#endif /* PROF_H */
@@ -0,0 +1,218 @@
+/******************************************************************************
+ * @file prof.c
+ * @brief Cycle profiling of hot-path sites with per-site aggregation
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include "prof.h"
+
+#if PROF_ENABLED
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Empty scopes timed to estimate the instrumentation cost */
+#define PROF_CALIBRATION_RUNS 32
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Aggregate of one site. The 64-bit sum is two 32-bit halves: a 64-bit
+ *        atomic add is not lock-free on the 32-bit target.
+ */
+typedef struct
+{
+    _Atomic uint32_t count;
+    _Atomic uint32_t min_cycles;
+    _Atomic uint32_t max_cycles;
+    _Atomic uint32_t sum_lo;
+    _Atomic uint32_t sum_hi;
+} prof_site_entry_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Cycles measured for an empty PROF_SCOPE(), included in every measurement
+ */
+static uint32_t prof_calibrate(void);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static prof_site_entry_t s_sites[PROF_SITE_COUNT] =
+{
+#define PROF_SITE_INIT(id, name) [id] = { .min_cycles = UINT32_MAX },
+    PROF_SITES(PROF_SITE_INIT)
+#undef PROF_SITE_INIT
+};
+
+static const char *const s_site_names[PROF_SITE_COUNT] =
+{
+#define PROF_SITE_NAME(id, name) [id] = name,
+    PROF_SITES(PROF_SITE_NAME)
+#undef PROF_SITE_NAME
+};
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+IRAM_ATTR void prof_record(prof_site_t site, uint32_t cycles)
+{
+    if ((unsigned)site >= PROF_SITE_COUNT)
+    {
+        return;
+    }
+    prof_site_entry_t *e = &s_sites[site];
+
+    /* #01 - Sum first, then count: a reader never sees a count without its cycles */
+    uint32_t lo = atomic_fetch_add_explicit(&e->sum_lo, cycles, memory_order_relaxed);
+    if (lo + cycles < lo)
+    {
+        atomic_fetch_add_explicit(&e->sum_hi, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&e->count, 1, memory_order_relaxed);
+
+    /* #02 - Extremes */
+    uint32_t cur = atomic_load_explicit(&e->min_cycles, memory_order_relaxed);
+    while (cycles < cur &&
+           !atomic_compare_exchange_weak_explicit(&e->min_cycles, &cur, cycles,
+                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    cur = atomic_load_explicit(&e->max_cycles, memory_order_relaxed);
+    while (cycles > cur &&
+           !atomic_compare_exchange_weak_explicit(&e->max_cycles, &cur, cycles,
+                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+esp_err_t prof_get(prof_site_t site, prof_stats_t *stats)
+{
+    if ((unsigned)site >= PROF_SITE_COUNT || stats == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const prof_site_entry_t *e = &s_sites[site];
+    stats->count = atomic_load_explicit(&e->count, memory_order_relaxed);
+    stats->min_cycles = atomic_load_explicit(&e->min_cycles, memory_order_relaxed);
+    stats->max_cycles = atomic_load_explicit(&e->max_cycles, memory_order_relaxed);
+    stats->sum_cycles = ((uint64_t)atomic_load_explicit(&e->sum_hi, memory_order_relaxed) << 32) |
+                        atomic_load_explicit(&e->sum_lo, memory_order_relaxed);
+    return ESP_OK;
+}
+
+const char *prof_site_name(prof_site_t site)
+{
+    return ((unsigned)site < PROF_SITE_COUNT) ? s_site_names[site] : "?";
+}
+
+void prof_reset(void)
+{
+    for (int site = 0; site < PROF_SITE_COUNT; site++)
+    {
+        prof_site_entry_t *e = &s_sites[site];
+        atomic_store_explicit(&e->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&e->sum_lo, 0, memory_order_relaxed);
+        atomic_store_explicit(&e->sum_hi, 0, memory_order_relaxed);
+        atomic_store_explicit(&e->min_cycles, UINT32_MAX, memory_order_relaxed);
+        atomic_store_explicit(&e->max_cycles, 0, memory_order_relaxed);
+    }
+}
+
+void prof_dump_console(bool reset)
+{
+    printf("PROF_DUMP_BEGIN,cpu_mhz=%d,scope_overhead_cycles=%lu\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+           (unsigned long)prof_calibrate());
+    printf("PROF,%-15s %10s %10s %10s %10s %14s\n", "site", "count", "min", "avg", "max", "sum");
+    for (int site = 0; site < PROF_SITE_COUNT; site++)
+    {
+        prof_stats_t stats;
+        (void)prof_get((prof_site_t)site, &stats);
+        if (stats.count == 0)
+        {
+            printf("PROF,%-15s %10d\n", s_site_names[site], 0);
+            continue;
+        }
+        printf("PROF,%-15s %10lu %10lu %10lu %10lu %14llu\n", s_site_names[site],
+               (unsigned long)stats.count, (unsigned long)stats.min_cycles,
+               (unsigned long)(stats.sum_cycles / stats.count), (unsigned long)stats.max_cycles,
+               (unsigned long long)stats.sum_cycles);
+    }
+    printf("PROF_DUMP_END\n");
+
+    if (reset)
+    {
+        prof_reset();
+    }
+}
+
+size_t prof_serialize(prof_site_t first, uint8_t *buf, size_t len)
+{
+    uint8_t *p = buf;
+    for (int site = (int)first; site < PROF_SITE_COUNT; site++)
+    {
+        if (buf == NULL || (size_t)(p - buf) + PROF_SERIALIZED_SITE > len)
+        {
+            break;
+        }
+
+        prof_stats_t stats;
+        (void)prof_get((prof_site_t)site, &stats);
+        const uint32_t words[5] =
+        {
+            stats.count, stats.min_cycles, stats.max_cycles,
+            (uint32_t)stats.sum_cycles, (uint32_t)(stats.sum_cycles >> 32),
+        };
+
+        *p++ = (uint8_t)site;
+        memset(p, 0, PROF_NAME_LEN);
+        memcpy(p, s_site_names[site], strnlen(s_site_names[site], PROF_NAME_LEN));
+        p += PROF_NAME_LEN;
+        for (int w = 0; w < 5; w++)
+        {
+            *p++ = (uint8_t)words[w];
+            *p++ = (uint8_t)(words[w] >> 8);
+            *p++ = (uint8_t)(words[w] >> 16);
+            *p++ = (uint8_t)(words[w] >> 24);
+        }
+    }
+    return (size_t)(p - buf);
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static uint32_t prof_calibrate(void)
+{
+    uint32_t best = UINT32_MAX;
+    for (int i = 0; i < PROF_CALIBRATION_RUNS; i++)
+    {
+        uint32_t start = (uint32_t)esp_cpu_get_cycle_count();
+        uint32_t elapsed = (uint32_t)esp_cpu_get_cycle_count() - start;
+        if (elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+#endif /* PROF_ENABLED */
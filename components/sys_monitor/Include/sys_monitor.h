@@ -0,0 +1,182 @@
+/******************************************************************************
+ * @file sys_monitor.h
+ * @brief Periodic system headroom monitor: task CPU, stacks, heap and ISR load
+ *
+ * @details Every sys_monitor_sample() takes one snapshot of all tasks
+ *          (runtime share since the previous sample and stack high-water mark),
+ *          the free and minimum-ever free heap and the ISR load, checks them
+ *          against the SYS_MONITOR_WARN_* thresholds and hands a compact report
+ *          to the sink (ESP-NOW telemetry in main.c).
+ *
+ *          Everything is in static buffers and the cost of each sample is
+ *          measured and reported, so the monitor's own budget is visible.
+ *          Per-task CPU needs CONFIG_FREERTOS_USE_TRACE_FACILITY and
+ *          CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (set in the sdkconfig);
+ *          without them only heap and ISR load are reported.
+ *
+ *          ISR load is measured by wrapping the body of interrupt handlers in
+ *          SYS_MONITOR_ISR_ENTER()/SYS_MONITOR_ISR_EXIT(); FreeRTOS charges ISR
+ *          time to the interrupted task, so it is not visible otherwise.
+ *
+ ******************************************************************************/
+
+#ifndef SYS_MONITOR_H
+#define SYS_MONITOR_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Sampling period used by the main loop */
+#define SYS_MONITOR_PERIOD_MS 10000
+
+/* Tasks covered by one snapshot (the firmware runs about a dozen) */
+#define SYS_MONITOR_MAX_TASKS 16
+
+/* Task name bytes kept in a report */
+#define SYS_MONITOR_NAME_LEN 8
+
+/* Warning thresholds */
+#define SYS_MONITOR_WARN_STACK_BYTES   256     /* Stack high-water mark below this */
+#define SYS_MONITOR_WARN_HEAP_BYTES    16384   /* Free heap below this */
+#define SYS_MONITOR_WARN_CPU_PERMILLE  850     /* Non-idle CPU above this */
+#define SYS_MONITOR_WARN_ISR_PERMILLE  100     /* Time in instrumented ISRs above this */
+
+/* Warning flags (sys_monitor_snapshot_t.warnings) */
+#define SYS_MONITOR_WARN_STACK  (1u << 0)
+#define SYS_MONITOR_WARN_HEAP   (1u << 1)
+#define SYS_MONITOR_WARN_CPU    (1u << 2)
+#define SYS_MONITOR_WARN_ISR    (1u << 3)
+
+/* Serialized report: 16-byte header plus 12 bytes per task */
+#define SYS_MONITOR_REPORT_HEADER   16
+#define SYS_MONITOR_REPORT_TASK     12
+#define SYS_MONITOR_REPORT_MAX      (SYS_MONITOR_REPORT_HEADER + SYS_MONITOR_MAX_TASKS * SYS_MONITOR_REPORT_TASK)
+
+/* ISR load instrumentation, see file description */
+#define SYS_MONITOR_ISR_ENTER()     uint32_t sys_monitor_isr_start_ = sys_monitor_isr_cycles_now()
+#define SYS_MONITOR_ISR_EXIT()      sys_monitor_isr_account(sys_monitor_isr_start_)
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief One task in a snapshot
+ */
+typedef struct
+{
+    char     name[SYS_MONITOR_NAME_LEN + 1];
+    uint8_t  priority;
+    uint16_t cpu_permille;          /* Share of the CPU since the previous sample */
+    uint32_t stack_free_min;        /* Stack high-water mark: least free stack ever, bytes */
+} sys_monitor_task_t;
+
+/**
+ * @brief One system snapshot
+ */
+typedef struct
+{
+    uint32_t uptime_s;
+    uint32_t heap_free;             /* Free 8-bit capable heap, bytes */
+    uint32_t heap_min_free;         /* Minimum free heap since boot, bytes */
+    uint16_t cpu_load_permille;     /* 1000 - idle share */
+    uint16_t isr_load_permille;     /* Share of time in instrumented ISRs */
+    uint32_t sample_us;             /* Cost of taking this snapshot */
+    uint8_t  warnings;              /* SYS_MONITOR_WARN_* flags */
+    uint8_t  num_tasks;
+    sys_monitor_task_t tasks[SYS_MONITOR_MAX_TASKS];
+} sys_monitor_snapshot_t;
+
+/**
+ * @brief Sink receiving serialized reports
+ *
+ * @details Report layout (little endian, decoded by tools/sys_monitor_decode.py):
+ *          u32 uptime_s, u32 heap_free, u32 heap_min_free, u16 cpu_load_permille,
+ *          u8 isr_load_permille / 4, u8 warnings; then per task
+ *          char name[8], u16 cpu_permille, u16 stack_free_min.
+ *
+ * @param[in] report Serialized report
+ * @param[in] len Report length
+ *
+ * @return ESP_OK if the report was accepted
+ */
+typedef esp_err_t (*sys_monitor_sink_t)(const uint8_t *report, size_t len);
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Set the sink that receives every report (NULL to stop publishing)
+ *
+ * @param[in] sink Report transmit function
+ */
+void sys_monitor_set_sink(sys_monitor_sink_t sink);
+
+/**
+ * @brief Take a snapshot, warn about crossed thresholds and publish it
+ *
+ * @details Call periodically from one task (every SYS_MONITOR_PERIOD_MS from
+ *          the main loop). The first call only establishes the CPU baseline.
+ *
+ * @param[out] snapshot Filled with the snapshot, may be NULL
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_SIZE if more than SYS_MONITOR_MAX_TASKS tasks exist
+ *        (the snapshot then has no task entries)
+ */
+esp_err_t sys_monitor_sample(sys_monitor_snapshot_t *snapshot);
+
+/**
+ * @brief Get a copy of the most recent snapshot, safe from any task
+ *
+ * @param[out] snapshot Filled with the snapshot
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if snapshot is NULL
+ *      - ESP_ERR_INVALID_STATE if no sample was taken yet
+ */
+esp_err_t sys_monitor_get_last(sys_monitor_snapshot_t *snapshot);
+
+/**
+ * @brief Print a snapshot on the console
+ *
+ * @param[in] snapshot Snapshot to print
+ */
+void sys_monitor_print(const sys_monitor_snapshot_t *snapshot);
+
+/**
+ * @brief Serialize a snapshot in the report layout (see sys_monitor_sink_t)
+ *
+ * @param[in] snapshot Snapshot
+ * @param[out] buf Output buffer
+ * @param[in] len Size of buf
+ *
+ * @return Bytes written; tasks that do not fit are left out
+ */
+size_t sys_monitor_serialize(const sys_monitor_snapshot_t *snapshot, uint8_t *buf, size_t len);
+
+/**
+ * @brief Cycle counter read used by SYS_MONITOR_ISR_ENTER()
+ */
+uint32_t sys_monitor_isr_cycles_now(void);
+
+/**
+ * @brief Account the cycles of one ISR run (used by SYS_MONITOR_ISR_EXIT())
+ *
+ * @param[in] start Cycle counter at ISR entry
+ */
+void sys_monitor_isr_account(uint32_t start);
+
+#endif /* SYS_MONITOR_H */
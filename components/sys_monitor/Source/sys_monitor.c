@@ -0,0 +1,340 @@
+/******************************************************************************
+ * @file sys_monitor.c
+ * @brief Periodic system headroom monitor: task CPU, stacks, heap and ISR load
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "sys_monitor.h"
+#include "prof.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+#define TAG "SYS_MON"
+
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+#define SYS_MONITOR_HAS_RUNTIME_STATS 1
+#else
+#define SYS_MONITOR_HAS_RUNTIME_STATS 0
+#endif
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Fill the task part of a snapshot
+ *
+ * @return ESP_ERR_INVALID_SIZE if some tasks did not fit, ESP_OK otherwise
+ */
+static esp_err_t sys_monitor_sample_tasks(sys_monitor_snapshot_t *snap);
+
+/**
+ * @brief Set the warning flags and log the ones that were not set in the previous snapshot
+ */
+static void sys_monitor_check(sys_monitor_snapshot_t *snap);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static volatile sys_monitor_sink_t s_sink = NULL;
+
+/* Snapshot and report buffers: static so the monitor's stack use stays small */
+static sys_monitor_snapshot_t s_snapshot;
+static uint8_t s_report[SYS_MONITOR_REPORT_MAX];
+
+/* Copy of the last snapshot for other tasks (sys_monitor_get_last()) */
+static sys_monitor_snapshot_t s_last;
+static bool s_have_last = false;
+static portMUX_TYPE s_last_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ISR accounting */
+static _Atomic uint32_t s_isr_cycles = 0;
+static uint32_t s_prev_isr_cycles = 0;
+static uint64_t s_prev_sample_us = 0;
+
+static uint8_t s_prev_warnings = 0;
+
+#if SYS_MONITOR_HAS_RUNTIME_STATS
+/* Task states of this sample and runtime counters of the previous one, keyed by task number */
+static TaskStatus_t s_task_status[SYS_MONITOR_MAX_TASKS];
+static UBaseType_t s_prev_task_number[SYS_MONITOR_MAX_TASKS];
+static uint32_t s_prev_task_runtime[SYS_MONITOR_MAX_TASKS];
+static UBaseType_t s_prev_task_count = 0;
+static uint32_t s_prev_total_runtime = 0;
+#endif
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+void sys_monitor_set_sink(sys_monitor_sink_t sink)
+{
+    s_sink = sink;
+}
+
+esp_err_t sys_monitor_sample(sys_monitor_snapshot_t *snapshot)
+{
+    PROF_SCOPE(PROF_SITE_SYS_MONITOR);
+    int64_t start_us = esp_timer_get_time();
+    sys_monitor_snapshot_t *snap = &s_snapshot;
+
+    /* #01 - Tasks */
+    esp_err_t ret = sys_monitor_sample_tasks(snap);
+
+    /* #02 - Heap */
+    snap->heap_free = (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    snap->heap_min_free = (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+    /* #03 - ISR load since the previous sample */
+    uint64_t now_us = (uint64_t)esp_timer_get_time();
+    uint32_t isr_cycles = atomic_load_explicit(&s_isr_cycles, memory_order_relaxed);
+    uint64_t elapsed_cycles = (now_us - s_prev_sample_us) * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    snap->isr_load_permille = (s_prev_sample_us != 0 && elapsed_cycles != 0)
+        ? (uint16_t)(((uint64_t)(isr_cycles - s_prev_isr_cycles) * 1000u) / elapsed_cycles)
+        : 0;
+    s_prev_isr_cycles = isr_cycles;
+    s_prev_sample_us = now_us;
+    snap->uptime_s = (uint32_t)(now_us / 1000000u);
+
+    /* #04 - Thresholds, then publish */
+    sys_monitor_check(snap);
+    snap->sample_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    sys_monitor_sink_t sink = s_sink;
+    if (sink != NULL)
+    {
+        size_t len = sys_monitor_serialize(snap, s_report, sizeof(s_report));
+        (void)sink(s_report, len);
+    }
+
+    portENTER_CRITICAL(&s_last_lock);
+    s_last = *snap;
+    s_have_last = true;
+    portEXIT_CRITICAL(&s_last_lock);
+
+    if (snapshot != NULL)
+    {
+        *snapshot = *snap;
+    }
+    return ret;
+}
+
+esp_err_t sys_monitor_get_last(sys_monitor_snapshot_t *snapshot)
+{
+    if (snapshot == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    portENTER_CRITICAL(&s_last_lock);
+    if (s_have_last)
+    {
+        *snapshot = s_last;
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_last_lock);
+    return ret;
+}
+
+void sys_monitor_print(const sys_monitor_snapshot_t *snapshot)
+{
+    if (!snapshot)
+    {
+        return;
+    }
+
+    ESP_LOGI(TAG, "up %lus cpu %u.%u%% isr %u.%u%% heap free %lu min %lu (sample %lu us)",
+             (unsigned long)snapshot->uptime_s,
+             snapshot->cpu_load_permille / 10u, snapshot->cpu_load_permille % 10u,
+             snapshot->isr_load_permille / 10u, snapshot->isr_load_permille % 10u,
+             (unsigned long)snapshot->heap_free, (unsigned long)snapshot->heap_min_free,
+             (unsigned long)snapshot->sample_us);
+    for (uint32_t t = 0; t < snapshot->num_tasks; t++)
+    {
+        const sys_monitor_task_t *task = &snapshot->tasks[t];
+        ESP_LOGI(TAG, "  %-8s prio %2u cpu %3u.%u%% stack free min %lu",
+                 task->name, task->priority, task->cpu_permille / 10u, task->cpu_permille % 10u,
+                 (unsigned long)task->stack_free_min);
+    }
+}
+
+size_t sys_monitor_serialize(const sys_monitor_snapshot_t *snapshot, uint8_t *buf, size_t len)
+{
+    if (!snapshot || !buf || len < SYS_MONITOR_REPORT_HEADER)
+    {
+        return 0;
+    }
+
+    /* #01 - Header */
+    uint8_t *p = buf;
+    const uint32_t words[3] = { snapshot->uptime_s, snapshot->heap_free, snapshot->heap_min_free };
+    for (uint32_t w = 0; w < 3; w++)
+    {
+        *p++ = (uint8_t)(words[w]);
+        *p++ = (uint8_t)(words[w] >> 8);
+        *p++ = (uint8_t)(words[w] >> 16);
+        *p++ = (uint8_t)(words[w] >> 24);
+    }
+    *p++ = (uint8_t)(snapshot->cpu_load_permille);
+    *p++ = (uint8_t)(snapshot->cpu_load_permille >> 8);
+    *p++ = (uint8_t)((snapshot->isr_load_permille > 1020u) ? 255u : snapshot->isr_load_permille / 4u);
+    *p++ = snapshot->warnings;
+
+    /* #02 - Tasks */
+    for (uint32_t t = 0; t < snapshot->num_tasks; t++)
+    {
+        if ((size_t)(p - buf) + SYS_MONITOR_REPORT_TASK > len)
+        {
+            break;
+        }
+        const sys_monitor_task_t *task = &snapshot->tasks[t];
+        uint32_t stack = (task->stack_free_min > 0xFFFFu) ? 0xFFFFu : task->stack_free_min;
+        memcpy(p, task->name, SYS_MONITOR_NAME_LEN);
+        p += SYS_MONITOR_NAME_LEN;
+        *p++ = (uint8_t)(task->cpu_permille);
+        *p++ = (uint8_t)(task->cpu_permille >> 8);
+        *p++ = (uint8_t)(stack);
+        *p++ = (uint8_t)(stack >> 8);
+    }
+
+    return (size_t)(p - buf);
+}
+
+IRAM_ATTR uint32_t sys_monitor_isr_cycles_now(void)
+{
+    return (uint32_t)esp_cpu_get_cycle_count();
+}
+
+IRAM_ATTR void sys_monitor_isr_account(uint32_t start)
+{
+    atomic_fetch_add_explicit(&s_isr_cycles, (uint32_t)esp_cpu_get_cycle_count() - start, memory_order_relaxed);
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static esp_err_t sys_monitor_sample_tasks(sys_monitor_snapshot_t *snap)
+{
+    snap->num_tasks = 0;
+    snap->cpu_load_permille = 0;
+
+#if SYS_MONITOR_HAS_RUNTIME_STATS
+    uint32_t total_runtime = 0;
+    UBaseType_t count = uxTaskGetSystemState(s_task_status, SYS_MONITOR_MAX_TASKS, &total_runtime);
+    if (count == 0)
+    {
+        /* More tasks than SYS_MONITOR_MAX_TASKS: uxTaskGetSystemState() fills nothing */
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* #01 - Runtime shares since the previous sample (counters are 32 bit, deltas wrap correctly) */
+    uint32_t total_delta = total_runtime - s_prev_total_runtime;
+    bool have_baseline = (s_prev_total_runtime != 0) && (total_delta != 0);
+    uint32_t idle_permille = 0;
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t *ts = &s_task_status[i];
+        sys_monitor_task_t *task = &snap->tasks[i];
+
+        uint32_t prev_runtime = ts->ulRunTimeCounter;       /* New task: no share yet */
+        for (UBaseType_t j = 0; j < s_prev_task_count; j++)
+        {
+            if (s_prev_task_number[j] == ts->xTaskNumber)
+            {
+                prev_runtime = s_prev_task_runtime[j];
+                break;
+            }
+        }
+        uint32_t permille = have_baseline
+            ? (uint32_t)(((uint64_t)(ts->ulRunTimeCounter - prev_runtime) * 1000u) / total_delta)
+            : 0;
+
+        strncpy(task->name, ts->pcTaskName, SYS_MONITOR_NAME_LEN);
+        task->name[SYS_MONITOR_NAME_LEN] = '\0';
+        task->priority = (uint8_t)ts->uxCurrentPriority;
+        task->cpu_permille = (uint16_t)permille;
+        /* ESP-IDF reports the high-water mark in bytes */
+        task->stack_free_min = (uint32_t)ts->usStackHighWaterMark;
+        if (strncmp(ts->pcTaskName, "IDLE", 4) == 0)
+        {
+            idle_permille += permille;
+        }
+    }
+
+    /* #02 - Keep this sample as the baseline of the next one */
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        s_prev_task_number[i] = s_task_status[i].xTaskNumber;
+        s_prev_task_runtime[i] = s_task_status[i].ulRunTimeCounter;
+    }
+    s_prev_task_count = count;
+    s_prev_total_runtime = total_runtime;
+
+    snap->num_tasks = (uint8_t)count;
+    snap->cpu_load_permille = have_baseline ? (uint16_t)((idle_permille < 1000u) ? 1000u - idle_permille : 0u) : 0;
+#endif
+    return ESP_OK;
+}
+
+static void sys_monitor_check(sys_monitor_snapshot_t *snap)
+{
+    uint8_t warnings = 0;
+
+    for (uint32_t t = 0; t < snap->num_tasks; t++)
+    {
+        if (snap->tasks[t].stack_free_min < SYS_MONITOR_WARN_STACK_BYTES)
+        {
+            warnings |= SYS_MONITOR_WARN_STACK;
+            if (!(s_prev_warnings & SYS_MONITOR_WARN_STACK))
+            {
+                ESP_LOGW(TAG, "Task %s has only %lu bytes of stack left", snap->tasks[t].name,
+                         (unsigned long)snap->tasks[t].stack_free_min);
+            }
+        }
+    }
+    if (snap->heap_free < SYS_MONITOR_WARN_HEAP_BYTES)
+    {
+        warnings |= SYS_MONITOR_WARN_HEAP;
+    }
+    if (snap->cpu_load_permille > SYS_MONITOR_WARN_CPU_PERMILLE)
+    {
+        warnings |= SYS_MONITOR_WARN_CPU;
+    }
+    if (snap->isr_load_permille > SYS_MONITOR_WARN_ISR_PERMILLE)
+    {
+        warnings |= SYS_MONITOR_WARN_ISR;
+    }
+
+    /* Warn once per crossing, not every sample */
+    uint8_t raised = warnings & (uint8_t)~s_prev_warnings;
+    if (raised & SYS_MONITOR_WARN_HEAP)
+    {
+        ESP_LOGW(TAG, "Free heap low: %lu bytes", (unsigned long)snap->heap_free);
+    }
+    if (raised & SYS_MONITOR_WARN_CPU)
+    {
+        ESP_LOGW(TAG, "CPU load high: %u permille", snap->cpu_load_permille);
+    }
+    if (raised & SYS_MONITOR_WARN_ISR)
+    {
+        ESP_LOGW(TAG, "ISR load high: %u permille", snap->isr_load_permille);
+    }
+
+    snap->warnings = warnings;
+    s_prev_warnings = warnings;
+}
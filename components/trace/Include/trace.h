@@ -0,0 +1,119 @@
+/******************************************************************************
+ * @file trace.h
+ * @brief Timeline tracing of tasks and events, exported as Chrome trace JSON
+ *
+ * @details TRACE_BEGIN/TRACE_END bracket a span, TRACE_INSTANT marks a point
+ *          in time. Each call stores a 12-byte record (CPU cycle counter, event,
+ *          phase, task, argument) in a RAM ring that keeps the last
+ *          TRACE_RING_SIZE records. trace_dump_console() prints the ring, and
+ *          tools/trace_to_chrome.py turns the capture into a JSON file for
+ *          chrome://tracing or https://ui.perfetto.dev.
+ *
+ *          Tracing is a build switch: with TRACE_ENABLED 0 (the default) every
+ *          TRACE_* macro compiles to nothing and trace.c is empty.
+ *
+ ******************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Build switch, set from build_flags (see the seeed_xiao_esp32c6_trace env) */
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+/* Records kept; must be a power of two */
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 1024
+#endif
+
+/* Tasks that get their own timeline; further tasks share TRACE_TID_OTHER */
+#define TRACE_MAX_TASKS 16
+#define TRACE_TID_OTHER 0xFE
+#define TRACE_TID_ISR   0xFF
+
+/* Event registry: X(id, name, category). IDs are stored in the records and
+ * tools/trace_to_chrome.py parses this list, so append only, one entry per line. */
+#define TRACE_EVENTS(X) \
+    X(TRACE_EV_ESPNOW_RECV,    "espnow_recv",    "esp_now_comm") \
+    X(TRACE_EV_ESPNOW_SEND,    "espnow_send",    "esp_now_comm") \
+    X(TRACE_EV_ESPNOW_SEND_CB, "espnow_send_cb", "esp_now_comm") \
+    X(TRACE_EV_CMD_DECODE,     "cmd_decode",     "control") \
+    X(TRACE_EV_WIFI_EVENT,     "wifi_event",     "wifi_manager") \
+    X(TRACE_EV_WIFI_GOT_IP,    "wifi_got_ip",    "wifi_manager") \
+    X(TRACE_EV_DLOG_DRAIN,     "dlog_drain",     "deferred_log") \
+    X(TRACE_EV_MAIN_LOOP,      "main_loop",      "main")
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(ev)         trace_record((ev), TRACE_PHASE_BEGIN, 0)
+#define TRACE_END(ev)           trace_record((ev), TRACE_PHASE_END, 0)
+#define TRACE_INSTANT(ev, arg)  trace_record((ev), TRACE_PHASE_INSTANT, (uint32_t)(arg))
+#else
+#define TRACE_BEGIN(ev)         ((void)0)
+#define TRACE_END(ev)           ((void)0)
+#define TRACE_INSTANT(ev, arg)  ((void)0)
+#endif
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Event IDs
+ */
+typedef enum
+{
+#define TRACE_EVENT_ENUM(id, name, cat) id,
+    TRACE_EVENTS(TRACE_EVENT_ENUM)
+#undef TRACE_EVENT_ENUM
+    TRACE_EV_COUNT
+} trace_event_t;
+
+/**
+ * @brief Record phases (same letters as the Chrome trace format)
+ */
+typedef enum
+{
+    TRACE_PHASE_BEGIN   = 'B',
+    TRACE_PHASE_END     = 'E',
+    TRACE_PHASE_INSTANT = 'i',
+} trace_phase_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Store one record (use the TRACE_* macros). Safe from tasks and ISRs.
+ *
+ * @param[in] event Event ID
+ * @param[in] phase Begin, end or instant
+ * @param[in] arg Event argument (shown in the trace viewer)
+ */
+void trace_record(trace_event_t event, trace_phase_t phase, uint32_t arg);
+
+/**
+ * @brief Start (or restart) recording; recording is on from boot
+ */
+void trace_start(void);
+
+/**
+ * @brief Stop recording, e.g. to freeze the timeline around an event of interest
+ */
+void trace_stop(void);
+
+/**
+ * @brief Stop recording, print the ring for tools/trace_to_chrome.py, then clear it and restart
+ */
+void trace_dump_console(void);
+
+#endif /* TRACE_H */
@@ -0,0 +1,178 @@
+/******************************************************************************
+ * @file trace.c
+ * @brief Timeline tracing of tasks and events
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+
+/* Records per dump line */
+#define TRACE_RECORDS_PER_LINE 16
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief One trace record (12 bytes, dumped as is, little endian)
+ */
+typedef struct
+{
+    uint32_t cycles;        /* CPU cycle counter */
+    uint16_t event;         /* trace_event_t */
+    uint8_t  phase;         /* trace_phase_t */
+    uint8_t  tid;           /* Task index, TRACE_TID_OTHER or TRACE_TID_ISR */
+    uint32_t arg;
+} trace_rec_t;
+
+_Static_assert(sizeof(trace_rec_t) == 12, "trace_rec_t must stay 12 bytes");
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Timeline index of the calling context
+ */
+static uint8_t trace_tid_of_caller(void);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static trace_rec_t s_ring[TRACE_RING_SIZE];
+static _Atomic uint32_t s_head = 0;
+static volatile bool s_running = true;
+
+/* Task owning each timeline, claimed with a compare-and-swap from 0 */
+static _Atomic uintptr_t s_tasks[TRACE_MAX_TASKS];
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+IRAM_ATTR void trace_record(trace_event_t event, trace_phase_t phase, uint32_t arg)
+{
+    if (!s_running)
+    {
+        return;
+    }
+
+    uint32_t cycles = (uint32_t)esp_cpu_get_cycle_count();
+    uint32_t index = atomic_fetch_add_explicit(&s_head, 1, memory_order_relaxed);
+    trace_rec_t *rec = &s_ring[index & (TRACE_RING_SIZE - 1u)];
+    rec->cycles = cycles;
+    rec->event = (uint16_t)event;
+    rec->phase = (uint8_t)phase;
+    rec->tid = trace_tid_of_caller();
+    rec->arg = arg;
+}
+
+void trace_start(void)
+{
+    s_running = true;
+}
+
+void trace_stop(void)
+{
+    s_running = false;
+}
+
+void trace_dump_console(void)
+{
+    /* #01 - Freeze the ring; let records that were being written complete */
+    trace_stop();
+    vTaskDelay(1);
+
+    uint32_t head = atomic_load(&s_head);
+    uint32_t count = (head < TRACE_RING_SIZE) ? head : TRACE_RING_SIZE;
+    uint32_t first = head - count;
+
+    /* #02 - Header and timeline names */
+    printf("TRACE_DUMP_BEGIN,cpu_mhz=%d,records=%lu,lost=%lu\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+           (unsigned long)count, (unsigned long)(head - count));
+    for (uint32_t t = 0; t < TRACE_MAX_TASKS; t++)
+    {
+        TaskHandle_t task = (TaskHandle_t)atomic_load(&s_tasks[t]);
+        if (task != NULL)
+        {
+            printf("TRACE_TASK,%lu,%s\n", (unsigned long)t, pcTaskGetName(task));
+        }
+    }
+
+    /* #03 - Records, oldest first */
+    for (uint32_t n = 0; n < count; n += TRACE_RECORDS_PER_LINE)
+    {
+        printf("TRACE,");
+        for (uint32_t i = n; i < count && i < n + TRACE_RECORDS_PER_LINE; i++)
+        {
+            const uint8_t *bytes = (const uint8_t *)&s_ring[(first + i) & (TRACE_RING_SIZE - 1u)];
+            for (uint32_t b = 0; b < sizeof(trace_rec_t); b++)
+            {
+                printf("%02x", bytes[b]);
+            }
+        }
+        printf("\n");
+    }
+    printf("TRACE_DUMP_END\n");
+
+    /* #04 - Start a fresh window */
+    atomic_store(&s_head, 0);
+    trace_start();
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static IRAM_ATTR uint8_t trace_tid_of_caller(void)
+{
+    if (xPortInIsrContext())
+    {
+        return TRACE_TID_ISR;
+    }
+
+    uintptr_t self = (uintptr_t)xTaskGetCurrentTaskHandle();
+    for (uint8_t t = 0; t < TRACE_MAX_TASKS; t++)
+    {
+        uintptr_t owner = atomic_load_explicit(&s_tasks[t], memory_order_relaxed);
+        if (owner == self)
+        {
+            return t;
+        }
+        if (owner == 0)
+        {
+            uintptr_t expected = 0;
+            if (atomic_compare_exchange_strong_explicit(&s_tasks[t], &expected, self,
+                                                        memory_order_relaxed, memory_order_relaxed))
+            {
+                return t;
+            }
+            if (expected == self)
+            {
+                return t;
+            }
+        }
+    }
+    return TRACE_TID_OTHER;
+}
+
+#endif /* TRACE_ENABLED */
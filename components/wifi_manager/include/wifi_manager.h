@@ -3,9 +3,13 @@
 /*******************************************************************************/
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "esp_wifi.h"
+#include "wifi_reconnect.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,33 +37,216 @@ typedef esp_err_t (*wifi_disconnect_cb_t)(void);
  */
 typedef void (*wifi_status_display_cb_t)(const char *status_line, const char *detail_line);
 
+/**
+ * @brief Callback function type for channel changes
+ *
+ * @details on_channel_leaving is called before a planned switch (radio still on
+ *          old_channel), on_channel_change after the radio moved, whether planned
+ *          or detected (AP moved, reconnect on another channel).
+ *
+ * @param new_channel Channel the radio is / will be on
+ * @param old_channel Channel it leaves
+ */
+typedef void (*wifi_channel_change_cb_t)(uint8_t new_channel, uint8_t old_channel);
+
+/**
+ * @brief Operating mode, read from NVS by wifi_manager_start()
+ */
+typedef enum {
+    WIFI_MANAGER_MODE_STA = 0,          /**< Join WIFI_SSID, ESP-NOW follows the channel of the AP */
+    WIFI_MANAGER_MODE_ESPNOW_ONLY,      /**< No association and no scans, radio pinned to a fixed channel */
+    WIFI_MANAGER_MODE_COUNT
+} wifi_manager_mode_t;
+
+/**
+ * @brief Channel of WIFI_MANAGER_MODE_ESPNOW_ONLY when NVS holds none
+ */
+#define WIFI_MANAGER_DEFAULT_CHANNEL 1
+
+/**
+ * @brief Radio profile: power save mode, listen interval and TX power applied together
+ */
+typedef enum {
+    WIFI_RADIO_PROFILE_LOW_LATENCY = 0, /**< Modem sleep off, full TX power: ESP-NOW frames are received at once */
+    WIFI_RADIO_PROFILE_BALANCED,        /**< Modem sleep per DTIM (driver default), reduced TX power */
+    WIFI_RADIO_PROFILE_LOW_POWER,       /**< Modem sleep over a listen interval of 10 beacons, low TX power */
+    WIFI_RADIO_PROFILE_COUNT
+} wifi_radio_profile_t;
+
+/**
+ * @brief Radio profile statistics since boot
+ */
+typedef struct {
+    wifi_radio_profile_t active;                        /**< Profile in effect now */
+    wifi_radio_profile_t base;                          /**< Profile while no commands arrive */
+    bool auto_low_latency;                              /**< ESP-NOW commands switch to WIFI_RADIO_PROFILE_LOW_LATENCY */
+    uint32_t switches;                                  /**< Profile changes applied */
+    uint32_t residency_ms[WIFI_RADIO_PROFILE_COUNT];    /**< Time spent in each profile */
+} wifi_manager_radio_stats_t;
+
+/**
+ * @brief How a connect attempt finds the AP
+ */
+typedef enum {
+    WIFI_CONNECT_PATH_CACHED = 0,   /**< Directed: BSSID, channel and authmode of the last good AP from NVS */
+    WIFI_CONNECT_PATH_SCAN,         /**< Full scan of all channels for WIFI_SSID */
+    WIFI_CONNECT_PATH_COUNT
+} wifi_connect_path_t;
+
+/**
+ * @brief Number of log2 time-to-connect buckets: bucket n counts [2^n, 2^(n+1)) ms, the last one everything above
+ */
+#define WIFI_MANAGER_CONNECT_BUCKETS 16
+
+/**
+ * @brief Time-to-connect histogram of one path (start of the attempt to IP address)
+ */
+typedef struct {
+    uint32_t count;                                 /**< Successful connects */
+    uint32_t min_ms;                                /**< UINT32_MAX if count == 0 */
+    uint32_t max_ms;
+    uint32_t buckets[WIFI_MANAGER_CONNECT_BUCKETS];
+} wifi_manager_connect_hist_t;
+
+/**
+ * @brief Distinct disconnect reasons counted individually, further ones only in reason_overflow
+ */
+#define WIFI_MANAGER_DISCONNECT_REASONS 12
+
+/**
+ * @brief RSSI bins of link losses: >= -50, -60, -70, -80, -90 dBm and below -90 dBm
+ */
+#define WIFI_MANAGER_RSSI_BINS 6
+
+/**
+ * @brief Size of the wifi_manager_serialize_disconnect_stats() report
+ *
+ * @details u32 disconnects, link_losses, reason_overflow; u32 rssi_bins[];
+ *          u32 recover count, min_ms, max_ms, buckets[]; u8 number of reasons,
+ *          then per reason u16 reason, u32 count. All little endian.
+ */
+#define WIFI_MANAGER_DISCONNECT_REPORT_MAX \
+    (4 * (3 + WIFI_MANAGER_RSSI_BINS + 3 + WIFI_MANAGER_CONNECT_BUCKETS) + 1 + 6 * WIFI_MANAGER_DISCONNECT_REASONS)
+
+/**
+ * @brief Count of one disconnect reason
+ */
+typedef struct {
+    uint16_t reason;                /**< wifi_err_reason_t */
+    uint32_t count;                 /**< 0 if the slot is unused */
+} wifi_manager_reason_count_t;
+
+/**
+ * @brief Disconnect statistics since boot
+ */
+typedef struct {
+    uint32_t disconnects;           /**< WIFI_EVENT_STA_DISCONNECTED events, including failed attempts */
+    uint32_t link_losses;           /**< Disconnects of an established connection */
+    uint32_t reason_overflow;       /**< Disconnects whose reason found no free slot */
+    wifi_manager_reason_count_t reasons[WIFI_MANAGER_DISCONNECT_REASONS];  /**< In order of first occurrence */
+    uint32_t rssi_bins[WIFI_MANAGER_RSSI_BINS];     /**< RSSI the driver reported with each link loss */
+    wifi_manager_connect_hist_t recover;            /**< Link loss to the next IP address */
+} wifi_manager_disconnect_stats_t;
+
+/**
+ * @brief Connect statistics since boot
+ */
+typedef struct {
+    wifi_manager_connect_hist_t paths[WIFI_CONNECT_PATH_COUNT];
+    uint32_t cache_fallbacks;       /**< Directed connects that failed and fell back to a full scan */
+    bool cache_valid;               /**< NVS holds a usable AP entry */
+} wifi_manager_connect_stats_t;
+
+/**
+ * @brief Reconnect scheduler snapshot
+ */
+typedef struct {
+    wifi_rc_state_t state;          /**< Scheduler state (see wifi_reconnect.h) */
+    uint32_t consecutive_failures;  /**< Failed attempts since the last connection */
+    uint32_t next_attempt_in_ms;    /**< Time to the scheduled attempt, 0 if none is pending */
+    wifi_rc_stats_t counters;       /**< Attempts, failures, deferrals and outage times since boot */
+} wifi_manager_reconnect_stats_t;
+
 /**
  * @brief WiFi manager configuration structure
  */
 typedef struct {
     wifi_disconnect_cb_t on_disconnect;        /**< Optional callback for disconnection handling */
     wifi_status_display_cb_t on_status_update; /**< Optional callback for status display updates */
+    wifi_channel_change_cb_t on_channel_leaving; /**< Optional callback before a planned channel switch */
+    wifi_channel_change_cb_t on_channel_change;  /**< Optional callback after the radio changed channel */
 } wifi_manager_callbacks_t;
 
-/*******************************************************************************/
-/*                     GLOBAL VARIABLES DECLARATIONS                           */
-/*******************************************************************************/
+/**
+ * @brief Link state in wifi_manager_state_t
+ */
+typedef enum {
+    WIFI_LINK_DOWN = 0,         /**< WiFi not started */
+    WIFI_LINK_CONNECTING,       /**< Started, no IP yet: scanning, associating or waiting for the next attempt */
+    WIFI_LINK_CONNECTED,        /**< Associated and got an IP */
+    WIFI_LINK_ESPNOW_ONLY,      /**< WIFI_MANAGER_MODE_ESPNOW_ONLY, never associates */
+} wifi_link_state_t;
+
+/**
+ * @brief Connectivity snapshot returned by wifi_manager_get_state()
+ */
+typedef struct {
+    wifi_link_state_t link;             /**< Link state */
+    uint32_t ip;                        /**< IPv4 address as esp_ip4_addr_t::addr (network order), 0 if none */
+    uint8_t channel;                    /**< Primary channel of the radio, 0 if unknown */
+    int8_t rssi;                        /**< RSSI of the AP in dBm (refreshed every WIFI_MANAGER_CHANNEL_POLL_MS), 0 if not associated */
+    uint16_t last_disconnect_reason;    /**< wifi_err_reason_t of the last disconnect, 0 if none */
+    uint32_t reconnects;                /**< Connections after the first one */
+} wifi_manager_state_t;
+
+/**
+ * @brief Period of the channel check (detects changes the WiFi events don't report)
+ */
+#define WIFI_MANAGER_CHANNEL_POLL_MS 500
+
+/**
+ * @brief Time left for the notice on the old channel to go out before a planned switch
+ */
+#define WIFI_MANAGER_CHANNEL_LEAVE_MS 20
+
+/**
+ * @brief Reconnect attempts are held back this long after the last ESP-NOW command (0 = never)
+ *
+ * @details A scan takes the radio off the ESP-NOW channel for seconds; while the
+ *          rover is being driven the command link has priority over the AP.
+ */
+#ifndef WIFI_MANAGER_SCAN_HOLD_MS
+#define WIFI_MANAGER_SCAN_HOLD_MS 2000
+#endif
 
 /**
- * @brief WiFi event group for connection state management
+ * @brief Radio profile applied at start and whenever no commands arrive (wifi_radio_profile_t)
  */
-extern EventGroupHandle_t WiFi_EventGroup;
+#ifndef WIFI_MANAGER_RADIO_PROFILE
+#define WIFI_MANAGER_RADIO_PROFILE WIFI_RADIO_PROFILE_BALANCED
+#endif
+
+/**
+ * @brief Switch to WIFI_RADIO_PROFILE_LOW_LATENCY while ESP-NOW commands arrive (the rover is driven)
+ */
+#ifndef WIFI_MANAGER_AUTO_LOW_LATENCY
+#define WIFI_MANAGER_AUTO_LOW_LATENCY 1
+#endif
 
 /**
- * @brief Event group bits for WiFi connection status
+ * @brief Time after the last ESP-NOW command before the base profile is restored
  */
-#define WIFI_CONNECTED_BIT BIT0 // We have connected to the AP specified in the WiFi credentials
-#define WIFI_FAIL_BIT      BIT1 // We have failed to connect to the AP after max retries
+#define WIFI_MANAGER_LOW_LATENCY_HOLD_MS 3000
 
 /**
- * @brief Buffer to store the current IP address in STA mode (e.g., "192.168.1.100")
+ * @brief Boot with the blocking wifi_manager_init() instead of wifi_manager_start()
+ *
+ * @details Only kept to compare the boot-to-first-command time against the
+ *          non-blocking start (see esp_now_comm_stats_t::first_cmd_ms).
  */
-extern char STA_IP_Addr_String[16];
+#ifndef WIFI_MANAGER_BLOCKING_INIT
+#define WIFI_MANAGER_BLOCKING_INIT 0
+#endif
 
 /*******************************************************************************/
 /*                        GLOBAL FUNCTION DECLARATIONS                         */
@@ -79,20 +266,235 @@ extern char STA_IP_Addr_String[16];
 esp_err_t wifi_manager_get_channel(uint8_t *primary, wifi_second_chan_t *second);
 
 /**
- * @brief Initialize WiFi in station mode with optional callbacks
+ * @brief Start WiFi in station mode without waiting for the connection
+ *
+ * @details Initializes the WiFi driver, registers the WiFi and IP event handlers,
+ *          configures the station with the credentials from WiFi_Credentials.h
+ *          (WIFI_SSID, WIFI_PASSWORD) and starts the driver. The connection is
+ *          made in the background: progress is reported through the callbacks,
+ *          wifi_manager_get_state() and wifi_manager_wait_connected(). The driver is
+ *          running on return, so ESP-NOW can be initialized immediately.
+ *
+ *          If NVS holds the last good AP (BSSID, channel, authmode) for WIFI_SSID,
+ *          the first attempt and every reconnect after a lost link are directed at
+ *          it on its single channel; a failed directed attempt falls back to a full
+ *          scan. The AP is saved again whenever the station gets an IP from a
+ *          different one. NVS must be initialized before.
+ *
+ *          In WIFI_MANAGER_MODE_ESPNOW_ONLY (see wifi_manager_set_mode()) the
+ *          driver is started without a station config, modem sleep is disabled
+ *          and the radio is set to the stored channel; nothing associates or scans.
+ *
+ * @param callbacks Optional callbacks for disconnect and status updates (can be NULL)
+ * @return ESP_OK once the driver is started
+ * @return Error code of the failing driver call otherwise
+ */
+esp_err_t wifi_manager_start(const wifi_manager_callbacks_t *callbacks);
+
+/**
+ * @brief Wait until the station connected or gave up
+ *
+ * @param timeout Ticks to wait, portMAX_DELAY to wait indefinitely
+ * @return ESP_OK if connected to the AP
+ * @return ESP_FAIL on failure after WIFI_MAXIMUM_RETRY attempts
+ * @return ESP_ERR_TIMEOUT if neither happened within timeout
+ * @return ESP_ERR_INVALID_STATE if WiFi was not started
+ * @return ESP_ERR_NOT_SUPPORTED in WIFI_MANAGER_MODE_ESPNOW_ONLY
+ */
+esp_err_t wifi_manager_wait_connected(TickType_t timeout);
+
+/**
+ * @brief Initialize WiFi in station mode and wait for the connection
  *
- * @details This function initializes the WiFi driver, sets up event handlers
- *          for WiFi and IP events, configures the station mode with the
- *          credentials from WiFi_Credentials.h (WIFI_SSID, WIFI_PASSWORD), and waits
- *          for the connection to complete. All WiFi-related initialization
- *          logic is encapsulated in this component.
+ * @details wifi_manager_start() followed by wifi_manager_wait_connected(portMAX_DELAY).
+ *          Blocks for as long as the AP takes to accept (or WIFI_MAXIMUM_RETRY
+ *          attempts), so boot time depends on the AP.
  *
  * @param callbacks Optional callbacks for disconnect and status updates (can be NULL)
- * @return ESP_OK on successful connection to the AP
+ * @return ESP_OK on successful connection to the AP (at once in WIFI_MANAGER_MODE_ESPNOW_ONLY)
  * @return ESP_FAIL on failure after WIFI_MAXIMUM_RETRY attempts
  */
 esp_err_t wifi_manager_init(const wifi_manager_callbacks_t *callbacks);
 
+/**
+ * @brief Get a consistent snapshot of the connectivity state
+ *
+ * @details The state is published through a seqlock: the reader never takes a
+ *          lock and never blocks, it only copies again if a writer (event task or
+ *          channel poll timer) updated the state during the copy. Safe to call
+ *          from control and telemetry code at any rate, not from an ISR.
+ *
+ * @param[out] state Filled with the snapshot
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if state is NULL
+ */
+esp_err_t wifi_manager_get_state(wifi_manager_state_t *state);
+
+/**
+ * @brief Get the operating mode in effect since wifi_manager_start()
+ *
+ * @return Operating mode
+ */
+wifi_manager_mode_t wifi_manager_get_mode(void);
+
+/**
+ * @brief Store the operating mode and the ESP-NOW-only channel in NVS
+ *
+ * @details Takes effect at the next wifi_manager_start(), i.e. after a reboot.
+ *
+ * @param mode Operating mode
+ * @param channel Channel used in WIFI_MANAGER_MODE_ESPNOW_ONLY (1-13), peers must use the same
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if mode or channel is out of range
+ * @return NVS error code otherwise
+ */
+esp_err_t wifi_manager_set_mode(wifi_manager_mode_t mode, uint8_t channel);
+
+/**
+ * @brief Have wifi_manager_set_mode() run from the esp_timer task
+ *
+ * @details For the ESP-NOW receive callback, which runs in the WiFi task and
+ *          must not wait for a flash write. A request still pending is
+ *          replaced; the outcome is logged.
+ *
+ * @param mode Operating mode
+ * @param channel Channel used in WIFI_MANAGER_MODE_ESPNOW_ONLY (1-13)
+ * @return ESP_OK if the store is scheduled
+ * @return ESP_ERR_INVALID_ARG if mode or channel is out of range
+ * @return ESP_ERR_INVALID_STATE before wifi_manager_start()
+ */
+esp_err_t wifi_manager_request_mode(wifi_manager_mode_t mode, uint8_t channel);
+
+/**
+ * @brief Move the radio to another channel now (WIFI_MANAGER_MODE_ESPNOW_ONLY only, not stored)
+ *
+ * @details Calls on_channel_leaving at once, switches the channel
+ *          WIFI_MANAGER_CHANNEL_LEAVE_MS later from the esp_timer task and then
+ *          calls on_channel_change. Used to test how the link survives a switch.
+ *          Does not block, may be called from the receive callback.
+ *
+ * @param channel Channel 1-13
+ * @return ESP_OK if the switch is scheduled
+ * @return ESP_ERR_INVALID_ARG if the channel is out of range
+ * @return ESP_ERR_INVALID_STATE in WIFI_MANAGER_MODE_STA (the AP decides the channel) or before start
+ */
+esp_err_t wifi_manager_switch_channel(uint8_t channel);
+
+/**
+ * @brief Get the time-to-connect histograms of both connect paths
+ *
+ * @param[out] stats Filled with the statistics
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t wifi_manager_get_connect_stats(wifi_manager_connect_stats_t *stats);
+
+/**
+ * @brief Record that an ESP-NOW command arrived
+ *
+ * @details Reconnect attempts wait WIFI_MANAGER_SCAN_HOLD_MS and, with auto low
+ *          latency on, the radio switches to WIFI_RADIO_PROFILE_LOW_LATENCY until
+ *          WIFI_MANAGER_LOW_LATENCY_HOLD_MS after the last command. Lock-free,
+ *          callable from the ESP-NOW receive callback.
+ */
+void wifi_manager_note_espnow_activity(void);
+
+/**
+ * @brief Get the state and counters of the reconnect scheduler
+ *
+ * @param[out] stats Filled with the snapshot
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t wifi_manager_get_reconnect_stats(wifi_manager_reconnect_stats_t *stats);
+
+/**
+ * @brief Print the time-to-connect histograms and the reconnect scheduler state
+ */
+void wifi_manager_print_connect_stats(void);
+
+/**
+ * @brief Set the base radio profile, used whenever the auto low latency switch is not holding the radio
+ *
+ * @details Applied from the esp_timer task, so it can be called from any task
+ *          including the WiFi task. The listen interval only takes effect at the
+ *          next association. In WIFI_MANAGER_MODE_ESPNOW_ONLY modem sleep stays off,
+ *          only the TX power follows the profile.
+ *
+ * @param profile Radio profile
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if profile is out of range
+ * @return ESP_ERR_INVALID_STATE if WiFi was not started
+ */
+esp_err_t wifi_manager_set_radio_profile(wifi_radio_profile_t profile);
+
+/**
+ * @brief Get the radio profile in effect now
+ *
+ * @return Active radio profile
+ */
+wifi_radio_profile_t wifi_manager_get_radio_profile(void);
+
+/**
+ * @brief Enable or disable the automatic switch to WIFI_RADIO_PROFILE_LOW_LATENCY while commands arrive
+ *
+ * @param enable true to follow the ESP-NOW commands, false to stay on the base profile
+ */
+void wifi_manager_set_auto_low_latency(bool enable);
+
+/**
+ * @brief Get the radio profile statistics
+ *
+ * @param[out] stats Filled with the statistics
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t wifi_manager_get_radio_stats(wifi_manager_radio_stats_t *stats);
+
+/**
+ * @brief Print the active radio profile and the time spent in each one
+ */
+void wifi_manager_print_radio_stats(void);
+
+/**
+ * @brief Name of a radio profile
+ *
+ * @param profile Radio profile
+ * @return Static string ("?" if out of range)
+ */
+const char *wifi_manager_radio_profile_name(wifi_radio_profile_t profile);
+
+/**
+ * @brief Get the disconnect reasons, the RSSI at each link loss and the time to recover
+ *
+ * @param[out] stats Filled with the statistics
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t wifi_manager_get_disconnect_stats(wifi_manager_disconnect_stats_t *stats);
+
+/**
+ * @brief Serialize disconnect statistics in the report layout (see WIFI_MANAGER_DISCONNECT_REPORT_MAX)
+ *
+ * @param[in] stats Statistics
+ * @param[out] buf Output buffer
+ * @param[in] len Size of buf
+ * @return Bytes written; reasons that do not fit are left out, 0 if len is too small for the fixed part
+ */
+size_t wifi_manager_serialize_disconnect_stats(const wifi_manager_disconnect_stats_t *stats, uint8_t *buf, size_t len);
+
+/**
+ * @brief Print the disconnect reasons, RSSI bins and time-to-recover histogram
+ */
+void wifi_manager_print_disconnect_stats(void);
+
+/**
+ * @brief Erase the cached AP from NVS, the next connect scans all channels
+ *
+ * @return ESP_OK on success, NVS error code otherwise
+ */
+esp_err_t wifi_manager_forget_ap(void);
+
 /**
  * @brief Deinitialize WiFi
  *
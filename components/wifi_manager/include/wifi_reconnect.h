@@ -0,0 +1,166 @@
+/******************************************************************************
+ * @file wifi_reconnect.h
+ * @brief Platform independent reconnect scheduler of the WiFi manager
+ *
+ * @details Plain C with no ESP-IDF dependencies, so that the same scheduler runs
+ *          in the firmware (wifi_manager.c feeds it the WiFi events and arms a
+ *          timer for wifi_rc_next_ms()) and in the host simulator
+ *          (host/wifi_reconnect), which drives it from a scripted fake event
+ *          source. Time is always passed in by the caller in milliseconds.
+ *
+ *          After a lost link or a failed attempt the next attempt is scheduled
+ *          with exponential backoff (base_ms * 2^failures, capped at cap_ms) and
+ *          +/- jitter_permille of jitter, so a fleet does not retry in lockstep.
+ *          It never gives up. An attempt that falls due while ESP-NOW traffic
+ *          was seen within priority_window_ms is deferred until the window
+ *          closes, so a moving rover never loses radio time to STA scans.
+ *
+ ******************************************************************************/
+
+#ifndef WIFI_RECONNECT_H
+#define WIFI_RECONNECT_H
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Default schedule: first retry after ~250 ms, doubling up to 30 s, +/-20 % jitter,
+ * attempts held back for 2 s after the last ESP-NOW command */
+#define WIFI_RC_DEFAULT_CONFIG() \
+    { .base_ms = 250, .cap_ms = 30000, .jitter_permille = 200, .priority_window_ms = 2000 }
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Scheduler state
+ */
+typedef enum
+{
+    WIFI_RC_IDLE = 0,       /* Not started */
+    WIFI_RC_CONNECTING,     /* Attempt issued, waiting for connected / disconnected */
+    WIFI_RC_CONNECTED,      /* Associated and got an IP */
+    WIFI_RC_BACKOFF,        /* Waiting for next_ms */
+    WIFI_RC_DEFERRED,       /* Attempt due but held back by the ESP-NOW priority window */
+} wifi_rc_state_t;
+
+/**
+ * @brief Scheduler parameters
+ */
+typedef struct
+{
+    uint32_t base_ms;               /* Delay before the first retry */
+    uint32_t cap_ms;                /* Longest delay between attempts */
+    uint16_t jitter_permille;       /* Random +/- spread of each delay */
+    uint32_t priority_window_ms;    /* Attempts wait this long after the last ESP-NOW activity, 0 = never */
+} wifi_rc_config_t;
+
+/**
+ * @brief Scheduler counters
+ */
+typedef struct
+{
+    uint32_t attempts;              /* Connect attempts issued */
+    uint32_t failures;              /* Attempts that ended without a connection */
+    uint32_t connects;              /* Successful connections */
+    uint32_t link_losses;           /* Disconnects of an established connection */
+    uint32_t deferred;              /* Times a due attempt was held back by the priority window */
+    uint32_t last_outage_ms;        /* Link loss (or start) to connected, of the last connection */
+    uint32_t max_outage_ms;
+} wifi_rc_stats_t;
+
+/**
+ * @brief Scheduler instance
+ */
+typedef struct
+{
+    wifi_rc_config_t config;
+    wifi_rc_state_t  state;
+    uint32_t         consecutive_failures;  /* Failed attempts since the last connection */
+    uint32_t         next_ms;               /* Time of the next attempt (BACKOFF / DEFERRED) */
+    uint32_t         down_since_ms;         /* Start of the current outage */
+    uint32_t         rng;                   /* xorshift32 state of the jitter */
+    wifi_rc_stats_t  stats;
+} wifi_rc_t;
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+
+/**
+ * @brief Initialize a scheduler
+ *
+ * @param[out] rc Scheduler
+ * @param[in] config Parameters (cap_ms is raised to base_ms if lower)
+ * @param[in] seed Jitter seed, any value
+ */
+void wifi_rc_init(wifi_rc_t *rc, const wifi_rc_config_t *config, uint32_t seed);
+
+/**
+ * @brief The driver started: the first attempt is due at once
+ *
+ * @param[in,out] rc Scheduler
+ * @param[in] now_ms Current time
+ */
+void wifi_rc_start(wifi_rc_t *rc, uint32_t now_ms);
+
+/**
+ * @brief The station connected (got an IP)
+ *
+ * @param[in,out] rc Scheduler
+ * @param[in] now_ms Current time
+ */
+void wifi_rc_on_connected(wifi_rc_t *rc, uint32_t now_ms);
+
+/**
+ * @brief The station disconnected: an established link was lost or an attempt failed
+ *
+ * @param[in,out] rc Scheduler
+ * @param[in] now_ms Current time
+ *
+ * @return Delay until the next attempt in ms
+ */
+uint32_t wifi_rc_on_disconnected(wifi_rc_t *rc, uint32_t now_ms);
+
+/**
+ * @brief Decide whether to start an attempt now
+ *
+ * @details Call when the timer armed for wifi_rc_next_ms() fires (calling it
+ *          earlier is harmless). Returns true exactly once per scheduled attempt;
+ *          the caller then connects and the state becomes WIFI_RC_CONNECTING.
+ *
+ * @param[in,out] rc Scheduler
+ * @param[in] now_ms Current time
+ * @param[in] last_activity_ms Time of the last ESP-NOW command, 0 if none yet
+ *
+ * @return true if the caller must start a connect attempt now
+ */
+bool wifi_rc_poll(wifi_rc_t *rc, uint32_t now_ms, uint32_t last_activity_ms);
+
+/**
+ * @brief Time at which wifi_rc_poll() has to be called next
+ *
+ * @param[in] rc Scheduler
+ * @param[out] next_ms Time of the next attempt
+ *
+ * @return false if nothing is scheduled (idle, connecting or connected)
+ */
+bool wifi_rc_next_ms(const wifi_rc_t *rc, uint32_t *next_ms);
+
+/**
+ * @brief Name of a state
+ *
+ * @param[in] state Scheduler state
+ *
+ * @return Static string
+ */
+const char *wifi_rc_state_name(wifi_rc_state_t state);
+
+#endif /* WIFI_RECONNECT_H */
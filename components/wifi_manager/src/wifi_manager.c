@@ -5,6 +5,7 @@
 /* C Standard Libraries */
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 
 /* ESP-IDF includes */
 #include "freertos/FreeRTOS.h"
@@ -14,44 +15,171 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include "esp_wifi_types.h"
+#include "nvs.h"
 #include <lwip/ip_addr.h>
 
 /* Project includes */
 #include "wifi_manager.h"
+#include "wifi_reconnect.h"
+#include "flight_recorder.h"
+#include "trace.h"
 #include "WiFi_Credentials.h" // WiFi credentials (not committed to the repo, you must provide it locally)
 
 /*******************************************************************************/
 /*                                 MACROS                                      */
 /*******************************************************************************/
+
+/* Consecutive failed attempts after which WIFI_FAIL_BIT is set (retrying goes on with backoff) */
 #define WIFI_MAXIMUM_RETRY 5
 
 /* Event group bits for WiFi connection status */
 #define WIFI_CONNECTED_BIT BIT0 // We have connected to the AP specified in the WiFi credentials
 #define WIFI_FAIL_BIT      BIT1 // We have failed to connect to the AP after max retries
 
+/* NVS location of the last good AP (wifi_ap_cache_t) */
+#define WIFI_AP_CACHE_NAMESPACE "wifi_mgr"
+#define WIFI_AP_CACHE_KEY       "ap_cache"
+#define WIFI_AP_CACHE_VERSION   1
+
+/* NVS keys (same namespace) of the operating mode and the ESP-NOW-only channel */
+#define WIFI_MODE_KEY           "mode"
+#define WIFI_CHANNEL_KEY        "channel"
+
 static const char *TAG = "wifi_manager";
 
 /*******************************************************************************/
-/*                            GLOBAL VARIABLES                                 */
+/*                                DATA TYPES                                   */
 /*******************************************************************************/
 
-/* WiFi event group for connection state management */
-EventGroupHandle_t WiFi_EventGroup = NULL;
+/**
+ * @brief Last AP the station got an IP from, as stored in NVS
+ */
+typedef struct
+{
+    uint8_t  version;           /* WIFI_AP_CACHE_VERSION */
+    uint8_t  channel;           /* Primary channel of the AP */
+    uint8_t  authmode;          /* wifi_auth_mode_t the AP used */
+    uint8_t  bssid[6];
+    uint32_t ssid_hash;         /* FNV-1a of WIFI_SSID, a changed SSID invalidates the entry */
+} wifi_ap_cache_t;
+
+/**
+ * @brief Driver settings of a radio profile
+ */
+typedef struct
+{
+    const char     *name;
+    wifi_ps_type_t  ps;                 /* Modem sleep mode (forced to WIFI_PS_NONE in ESP-NOW-only mode) */
+    uint8_t         listen_interval;    /* Beacons between wake-ups under WIFI_PS_MAX_MODEM, set at association */
+    int8_t          max_tx_power;       /* esp_wifi_set_max_tx_power() units of 0.25 dBm */
+} wifi_radio_profile_cfg_t;
 
-/* Buffer to store the current IP address in STA mode (e.g., "192.168.1.100") */
-char STA_IP_Addr_String[16] = "0.0.0.0";
+/**
+ * @brief Connect-time histogram, written by the event task only
+ */
+typedef struct
+{
+    _Atomic uint32_t count;
+    _Atomic uint32_t min_ms;
+    _Atomic uint32_t max_ms;
+    _Atomic uint32_t buckets[WIFI_MANAGER_CONNECT_BUCKETS];
+} wifi_connect_hist_state_t;
 
 /*******************************************************************************/
 /*                            STATIC VARIABLES                                 */
 /*******************************************************************************/
 
-/* Retry counter for WiFi connection attempts */
-static int s_retry_num = 0;
+/* Event group for connection state management, only waited on by wifi_manager_wait_connected() */
+static EventGroupHandle_t s_event_group = NULL;
+
+/* Connectivity snapshot published through a seqlock: s_state_seq is odd while a writer is updating s_state.
+ * Writers (event task, channel poll timer) serialize on s_state_lock, readers never take it. */
+static wifi_manager_state_t s_state;
+static _Atomic uint32_t s_state_seq;
+static portMUX_TYPE s_state_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_ever_connected = false;
 
 /* Callback configuration */
 static wifi_manager_callbacks_t s_callbacks = {0};
 
+/* Storage of s_event_group: allocated at link time, no heap use */
+static StaticEventGroup_t s_event_group_storage;
+
+/* Time esp_wifi_start() was called (us since boot), the connect time is logged against it */
+static int64_t s_start_us = 0;
+
+/* Operating mode and fixed channel read from NVS at start */
+static wifi_manager_mode_t s_mode = WIFI_MANAGER_MODE_STA;
+static uint8_t s_fixed_channel = WIFI_MANAGER_DEFAULT_CHANNEL;
+
+/* Mode waiting to be stored by the timer: mode << 8 | channel, the latest request wins */
+static _Atomic uint16_t s_mode_request;
+static esp_timer_handle_t s_mode_timer = NULL;
+
+/* Last good AP loaded from / saved to NVS, valid if s_cache_valid */
+static wifi_ap_cache_t s_cache;
+static bool s_cache_valid = false;
+
+/* Path of the attempt in progress, when it began (us since boot) and whether the station is connected */
+static wifi_connect_path_t s_path = WIFI_CONNECT_PATH_SCAN;
+static int64_t s_attempt_us = 0;
+static bool s_connected = false;
+
+/* Channel the radio was last seen on (0 = unknown), channel of a scheduled switch, and the timers driving both */
+static _Atomic uint8_t s_channel;
+static uint8_t s_switch_channel = 0;
+static esp_timer_handle_t s_poll_timer = NULL;
+static esp_timer_handle_t s_switch_timer = NULL;
+
+/* Reconnect scheduler (shared by the event task and the esp_timer task), the timer of its next
+ * attempt, the path that attempt takes and the time of the last ESP-NOW command (ms since boot) */
+static wifi_rc_t s_rc;
+static portMUX_TYPE s_rc_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_rc_timer = NULL;
+static wifi_connect_path_t s_next_path = WIFI_CONNECT_PATH_SCAN;
+static _Atomic uint32_t s_activity_ms;
+
+/* Radio profiles, indexed by wifi_radio_profile_t */
+static const wifi_radio_profile_cfg_t s_radio_profiles[WIFI_RADIO_PROFILE_COUNT] =
+{
+    [WIFI_RADIO_PROFILE_LOW_LATENCY] = { "low-latency", WIFI_PS_NONE,      1,  80 },   /* 20 dBm */
+    [WIFI_RADIO_PROFILE_BALANCED]    = { "balanced",    WIFI_PS_MIN_MODEM, 3,  68 },   /* 17 dBm */
+    [WIFI_RADIO_PROFILE_LOW_POWER]   = { "low-power",   WIFI_PS_MAX_MODEM, 10, 52 },   /* 13 dBm */
+};
+
+/* Base and active radio profile; the timer applies every change, the pending flag coalesces requests for it.
+ * Residency is accounted by the timer task, s_profile_lock guards it against readers. */
+static _Atomic uint8_t s_profile_base = WIFI_MANAGER_RADIO_PROFILE;
+static _Atomic uint8_t s_profile_active = WIFI_MANAGER_RADIO_PROFILE;
+static _Atomic bool s_auto_low_latency = WIFI_MANAGER_AUTO_LOW_LATENCY;
+static _Atomic bool s_profile_pending;
+static esp_timer_handle_t s_profile_timer = NULL;
+static portMUX_TYPE s_profile_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_profile_since_ms = 0;
+static uint32_t s_profile_switches = 0;
+static uint32_t s_profile_residency_ms[WIFI_RADIO_PROFILE_COUNT];
+
+/* Listen interval of the STA config last handed to the driver */
+static uint16_t s_config_listen_interval = 0;
+
+/* Time-to-connect per path and directed connects that had to fall back to a scan */
+static wifi_connect_hist_state_t s_connect_hist[WIFI_CONNECT_PATH_COUNT];
+
+/* Disconnect analytics, written by the event task only: reason slots (reason set once, before its count),
+ * RSSI at link loss, time from a link loss (s_loss_us, 0 if none pending) to the next IP address */
+static _Atomic uint32_t s_disconnects;
+static _Atomic uint32_t s_link_losses;
+static _Atomic uint32_t s_reason_overflow;
+static _Atomic uint16_t s_reason_code[WIFI_MANAGER_DISCONNECT_REASONS];
+static _Atomic uint32_t s_reason_count[WIFI_MANAGER_DISCONNECT_REASONS];
+static _Atomic uint32_t s_rssi_bins[WIFI_MANAGER_RSSI_BINS];
+static wifi_connect_hist_state_t s_recover_hist;
+static int64_t s_loss_us = 0;
+static _Atomic uint32_t s_cache_fallbacks;
+
 /*******************************************************************************/
 /*                        STATIC FUNCTION DECLARATIONS                         */
 /*******************************************************************************/
@@ -87,6 +215,178 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
  */
 static void ip_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 
+/**
+ * @brief FNV-1a hash of a string
+ *
+ * @param str NUL-terminated string
+ * @return 32-bit hash
+ */
+static uint32_t wifi_manager_hash(const char *str);
+
+/**
+ * @brief Load the operating mode and the ESP-NOW-only channel from NVS into s_mode, s_fixed_channel
+ *
+ * @details Missing or invalid entries select WIFI_MANAGER_MODE_STA and WIFI_MANAGER_DEFAULT_CHANNEL.
+ */
+static void wifi_manager_mode_load(void);
+
+/**
+ * @brief esp_timer callback: store the mode requested with wifi_manager_request_mode()
+ */
+static void wifi_manager_mode_timer_cb(void *arg);
+
+/**
+ * @brief Start the driver for WIFI_MANAGER_MODE_ESPNOW_ONLY: no association, radio pinned to s_fixed_channel
+ *
+ * @return ESP_OK on success, error code of the failing driver call otherwise
+ */
+static esp_err_t wifi_manager_start_espnow_only(void);
+
+/**
+ * @brief Load the last good AP from NVS into s_cache
+ *
+ * @return true if an entry for WIFI_SSID was found
+ */
+static bool wifi_manager_cache_load(void);
+
+/**
+ * @brief Save the AP the station is connected to into NVS if it differs from s_cache
+ */
+static void wifi_manager_cache_update(void);
+
+/**
+ * @brief Build the STA config for a connect path
+ *
+ * @details WIFI_CONNECT_PATH_CACHED pins BSSID, channel and authmode of s_cache so
+ *          the driver probes one channel only; WIFI_CONNECT_PATH_SCAN scans all
+ *          channels for WIFI_SSID.
+ *
+ * @param path Connect path
+ * @param wifi_config Filled with the STA config
+ */
+static void wifi_manager_build_config(wifi_connect_path_t path, wifi_config_t *wifi_config);
+
+/**
+ * @brief Apply the config of a path and call esp_wifi_connect()
+ *
+ * @details If the driver rejects the call, the attempt is counted as failed
+ *          and the next one scheduled, since no disconnect event will come.
+ *
+ * @param path Connect path
+ * @param new_attempt true to restart the time-to-connect measurement
+ */
+static void wifi_manager_connect(wifi_connect_path_t path, bool new_attempt);
+
+/**
+ * @brief Start an update of s_state: take the writer lock and make s_state_seq odd
+ *
+ * @details Only plain stores to the returned state until wifi_manager_state_end().
+ *
+ * @return s_state, to be modified in place
+ */
+static wifi_manager_state_t *wifi_manager_state_begin(void);
+
+/**
+ * @brief Publish the update: make s_state_seq even again and release the writer lock
+ */
+static void wifi_manager_state_end(void);
+
+/**
+ * @brief Record the channel the radio is on, report a change to on_channel_change
+ *
+ * @details Called from the event task and the esp_timer task; the exchange makes
+ *          sure each change is reported once.
+ *
+ * @param channel Current primary channel
+ */
+static void wifi_manager_channel_seen(uint8_t channel);
+
+/**
+ * @brief esp_timer callback: check the channel while it is meaningful (associated or ESP-NOW only)
+ */
+static void wifi_manager_poll_timer_cb(void *arg);
+
+/**
+ * @brief esp_timer callback: perform the switch scheduled by wifi_manager_switch_channel()
+ */
+static void wifi_manager_switch_timer_cb(void *arg);
+
+/**
+ * @brief Create the channel timers and start the periodic check
+ *
+ * @return ESP_OK on success, esp_timer error code otherwise
+ */
+static esp_err_t wifi_manager_channel_watch_start(void);
+
+/**
+ * @brief Milliseconds since boot, the time base of the reconnect scheduler
+ */
+static inline uint32_t wifi_manager_now_ms(void);
+
+/**
+ * @brief esp_timer callback: start the scheduled attempt on s_next_path, or re-arm if it was deferred
+ */
+static void wifi_manager_reconnect_timer_cb(void *arg);
+
+/**
+ * @brief Arm s_rc_timer for the next attempt of the scheduler, if one is scheduled
+ */
+static void wifi_manager_reconnect_arm(void);
+
+/**
+ * @brief Set power save mode and TX power of a profile and account the time spent in the previous one
+ *
+ * @param profile Radio profile
+ * @param now_ms Current time
+ */
+static void wifi_manager_profile_apply(wifi_radio_profile_t profile, uint32_t now_ms);
+
+/**
+ * @brief Have wifi_manager_profile_timer_cb() run now (once, however often it is called)
+ */
+static void wifi_manager_profile_kick(void);
+
+/**
+ * @brief esp_timer callback: apply low latency while commands arrive, the base profile otherwise
+ */
+static void wifi_manager_profile_timer_cb(void *arg);
+
+/**
+ * @brief Create the profile timer and apply the base profile
+ *
+ * @return ESP_OK on success, esp_timer or driver error code otherwise
+ */
+static esp_err_t wifi_manager_profile_start(void);
+
+/**
+ * @brief Add a sample to a millisecond histogram
+ *
+ * @param h Histogram (time-to-connect of a path or time to recover)
+ * @param ms Sample
+ */
+static void wifi_manager_hist_record(wifi_connect_hist_state_t *h, uint32_t ms);
+
+/**
+ * @brief Copy a millisecond histogram out of its atomics
+ */
+static void wifi_manager_hist_read(const wifi_connect_hist_state_t *h, wifi_manager_connect_hist_t *out);
+
+/**
+ * @brief Format the non-empty buckets of a histogram as " <upper:count" pairs
+ *
+ * @return Characters written
+ */
+static int wifi_manager_hist_format(const wifi_manager_connect_hist_t *h, char *line, size_t size);
+
+/**
+ * @brief Count a disconnect: reason slot, and for a link loss the RSSI bin and the start of the recovery time
+ *
+ * @param reason wifi_err_reason_t reported by the driver
+ * @param rssi RSSI reported by the driver
+ * @param link_lost true if the station was connected
+ */
+static void wifi_manager_disconnect_record(uint16_t reason, int8_t rssi, bool link_lost);
+
 /*******************************************************************************/
 /*                        STATIC FUNCTION DEFINITIONS                          */
 /*******************************************************************************/
@@ -95,22 +395,44 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
 {
     /* Suppress unused parameter warnings */
     (void)arg;
-    (void)event_data;
 
+    TRACE_INSTANT(TRACE_EV_WIFI_EVENT, event_id);
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) 
     {
         /* Clear connected bit on start attempt */
-        if (WiFi_EventGroup != NULL) 
+        if (s_event_group != NULL) 
+        {
+            xEventGroupClearBits(s_event_group, WIFI_CONNECTED_BIT);
+        }
+        if (s_mode == WIFI_MANAGER_MODE_ESPNOW_ONLY)
         {
-            xEventGroupClearBits(WiFi_EventGroup, WIFI_CONNECTED_BIT);
+            /* No AP: the radio stays on the fixed channel, nothing ever scans */
+            return;
         }
+
         /* Connect only after the WIFI_EVENT_STA_START event is received, which indicates
-         * that the WiFi driver is ready to connect to an Access Point (AP). */
-        esp_wifi_connect();
-        ESP_LOGI(TAG, "WIFI_EVENT_STA_START: Connecting...");
+         * that the WiFi driver is ready to connect to an Access Point (AP).
+         * The config set before esp_wifi_start() already targets the cached AP if there is one.
+         * The scheduler lets the attempt go at once unless ESP-NOW commands are arriving. */
+        s_next_path = s_cache_valid ? WIFI_CONNECT_PATH_CACHED : WIFI_CONNECT_PATH_SCAN;
+        portENTER_CRITICAL(&s_rc_lock);
+        wifi_rc_start(&s_rc, wifi_manager_now_ms());
+        portEXIT_CRITICAL(&s_rc_lock);
+        ESP_LOGI(TAG, "WIFI_EVENT_STA_START: Connecting (%s)...", (s_next_path == WIFI_CONNECT_PATH_CACHED) ? "cached AP" : "scan");
+        wifi_manager_reconnect_timer_cb(NULL);
     } 
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) 
+    {
+        /* The AP may sit on another channel than the one ESP-NOW has been using so far */
+        const wifi_event_sta_connected_t *connected = (const wifi_event_sta_connected_t *)event_data;
+        wifi_manager_channel_seen(connected->channel);
+    }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) 
     {
+        /* Keep the disconnect in the black-box history */
+        const wifi_event_sta_disconnected_t *disconnected = (const wifi_event_sta_disconnected_t *)event_data;
+        flight_recorder_link(FR_LINK_WIFI_DISCONNECTED, disconnected->reason, disconnected->rssi);
+
         /* Invoke user disconnect callback if registered */
         if (s_callbacks.on_disconnect) 
         {
@@ -123,26 +445,53 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
         }
 
         /* Clear connected bit on disconnect */
-        if (WiFi_EventGroup != NULL) 
+        if (s_event_group != NULL) 
+        {
+            xEventGroupClearBits(s_event_group, WIFI_CONNECTED_BIT);
+        }
+        wifi_manager_state_t *state = wifi_manager_state_begin();
+        state->link = WIFI_LINK_CONNECTING;
+        state->ip = 0;
+        state->rssi = 0;
+        state->last_disconnect_reason = disconnected->reason;
+        wifi_manager_state_end();
+
+        /* A lost link is reconnected to the cached AP first, a failed directed connect falls back to a full scan */
+        bool link_lost = s_connected;
+        s_connected = false;
+        wifi_manager_disconnect_record(disconnected->reason, disconnected->rssi, link_lost);
+        if (link_lost && s_cache_valid)
+        {
+            s_next_path = WIFI_CONNECT_PATH_CACHED;
+            ESP_LOGI(TAG, "Link lost (reason %d), reconnecting to the cached AP", disconnected->reason);
+        }
+        else if (!link_lost && s_path == WIFI_CONNECT_PATH_CACHED)
         {
-            xEventGroupClearBits(WiFi_EventGroup, WIFI_CONNECTED_BIT);
+            atomic_fetch_add_explicit(&s_cache_fallbacks, 1, memory_order_relaxed);
+            s_next_path = WIFI_CONNECT_PATH_SCAN;
+            ESP_LOGW(TAG, "Cached AP not reachable (reason %d), falling back to a full scan", disconnected->reason);
         }
-        /* In case of disconnection, attempt to connect again for maximum of WIFI_MAXIMUM_RETRY times */
-        if (s_retry_num < WIFI_MAXIMUM_RETRY) 
+        else
         {
-            esp_wifi_connect();
+            s_next_path = s_path;
+        }
+
+        /* The attempt is not issued from here: the scheduler spaces retries with jittered exponential backoff */
+        portENTER_CRITICAL(&s_rc_lock);
+        uint32_t delay_ms = wifi_rc_on_disconnected(&s_rc, wifi_manager_now_ms());
+        uint32_t failures = s_rc.consecutive_failures;
+        portEXIT_CRITICAL(&s_rc_lock);
+        wifi_manager_reconnect_arm();
+        ESP_LOGI(TAG, "Retry connection to the AP in %lu ms (%lu failed)", (unsigned long)delay_ms, (unsigned long)failures);
 
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retry connection to the AP (%d/%d)", s_retry_num, WIFI_MAXIMUM_RETRY);
-        } 
-        else 
+        /* Report the failure once, but keep retrying: the AP may come back at any time */
+        if (failures == WIFI_MAXIMUM_RETRY) 
         {
-            /* After all retires failed, set the event group bit to indicate failure */
-            if (WiFi_EventGroup != NULL) 
+            if (s_event_group != NULL) 
             {
-                xEventGroupSetBits(WiFi_EventGroup, WIFI_FAIL_BIT);
+                xEventGroupSetBits(s_event_group, WIFI_FAIL_BIT);
             }
-            ESP_LOGE(TAG, "Connect to the AP failed after %d retries", WIFI_MAXIMUM_RETRY);
+            ESP_LOGE(TAG, "Connect to the AP failed after %d retries, retrying with backoff", WIFI_MAXIMUM_RETRY);
 
             /* Invoke status display callback if registered */
             if (s_callbacks.on_status_update) 
@@ -163,95 +512,193 @@ static void ip_event_handler(void* arg, esp_event_base_t event_base, int32_t eve
         /* Cast event_data to the appropriate type */
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
 
-        /* Log the obtained IP address */
-        ESP_LOGI(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
+        /* Log the obtained IP address, the connect time and the channel the AP put us on */
+        uint8_t primary_channel = 0;
+        wifi_second_chan_t secondary_channel = WIFI_SECOND_CHAN_NONE;
+        (void)esp_wifi_get_channel(&primary_channel, &secondary_channel);
+        ESP_LOGI(TAG, "Connected to AP SSID:%s, got IP:" IPSTR " on channel %d, %lu ms after WiFi start",
+                 WIFI_SSID, IP2STR(&event->ip_info.ip), primary_channel,
+                 (unsigned long)((esp_timer_get_time() - s_start_us) / 1000));
+
+        flight_recorder_link(FR_LINK_WIFI_GOT_IP, event->ip_info.ip.addr, 0);
+        TRACE_INSTANT(TRACE_EV_WIFI_GOT_IP, event->ip_info.ip.addr);
 
-        /* Reset retry counter on successful connection */
-        s_retry_num = 0;
+        /* Reset the backoff on successful connection, time it and remember the AP for the next connect */
+        portENTER_CRITICAL(&s_rc_lock);
+        wifi_rc_on_connected(&s_rc, wifi_manager_now_ms());
+        portEXIT_CRITICAL(&s_rc_lock);
+        s_connected = true;
+        int64_t now_us = esp_timer_get_time();
+        wifi_manager_hist_record(&s_connect_hist[s_path], (uint32_t)((now_us - s_attempt_us) / 1000));
+        if (s_loss_us != 0)
+        {
+            wifi_manager_hist_record(&s_recover_hist, (uint32_t)((now_us - s_loss_us) / 1000));
+            s_loss_us = 0;
+        }
+        wifi_manager_cache_update();
 
-        /* Convert IP address to string format and store it in STA_IP_Addr_String */
-        snprintf(STA_IP_Addr_String, sizeof(STA_IP_Addr_String), IPSTR, IP2STR(&event->ip_info.ip));
+        /* Publish the address */
+        wifi_manager_state_t *state = wifi_manager_state_begin();
+        state->link = WIFI_LINK_CONNECTED;
+        state->ip = event->ip_info.ip.addr;
+        state->reconnects += s_ever_connected ? 1u : 0u;
+        wifi_manager_state_end();
+        s_ever_connected = true;
 
         /* Set the WiFi event group bit to indicate successful connection and clear the fail bit */
-        if (WiFi_EventGroup != NULL) 
+        if (s_event_group != NULL) 
         {
-            xEventGroupClearBits(WiFi_EventGroup, WIFI_FAIL_BIT); // Clear potential previous failure
-            xEventGroupSetBits(WiFi_EventGroup, WIFI_CONNECTED_BIT);
+            xEventGroupClearBits(s_event_group, WIFI_FAIL_BIT); // Clear potential previous failure
+            xEventGroupSetBits(s_event_group, WIFI_CONNECTED_BIT);
         }
         
         /* Invoke status display callback if registered */
         if (s_callbacks.on_status_update) 
         {
             char detail_buf[20];
-            snprintf(detail_buf, sizeof(detail_buf), "IP:%s", STA_IP_Addr_String);
+            snprintf(detail_buf, sizeof(detail_buf), "IP:" IPSTR, IP2STR(&event->ip_info.ip));
             s_callbacks.on_status_update("WiFi Connected", detail_buf);
         }
     } /* add handling of other IP event cases if needed */
 }
 
-/*******************************************************************************/
-/*                        GLOBAL FUNCTION DEFINITIONS                          */
-/*******************************************************************************/
+static uint32_t wifi_manager_hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str)
+    {
+        hash = (hash ^ (uint8_t)*str++) * 16777619u;
+    }
+    return hash;
+}
 
-esp_err_t wifi_manager_init(const wifi_manager_callbacks_t *callbacks)
+static void wifi_manager_mode_load(void)
 {
-    ESP_LOGI(TAG, "Initializing WiFi...");
+    s_mode = WIFI_MANAGER_MODE_STA;
+    s_fixed_channel = WIFI_MANAGER_DEFAULT_CHANNEL;
 
-    /* Store callbacks if provided */
-    if (callbacks != NULL) 
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_AP_CACHE_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
     {
-        memcpy(&s_callbacks, callbacks, sizeof(wifi_manager_callbacks_t));
-    } 
-    else 
+        return;
+    }
+
+    uint8_t mode = WIFI_MANAGER_MODE_STA;
+    uint8_t channel = WIFI_MANAGER_DEFAULT_CHANNEL;
+    if (nvs_get_u8(nvs, WIFI_MODE_KEY, &mode) == ESP_OK && mode < WIFI_MANAGER_MODE_COUNT)
     {
-        memset(&s_callbacks, 0, sizeof(wifi_manager_callbacks_t));
+        s_mode = (wifi_manager_mode_t)mode;
     }
+    if (nvs_get_u8(nvs, WIFI_CHANNEL_KEY, &channel) == ESP_OK && channel >= 1 && channel <= 13)
+    {
+        s_fixed_channel = channel;
+    }
+    nvs_close(nvs);
+}
 
-    /* Initialize the WiFi event group which will be used to signal connection status */
-    WiFi_EventGroup = xEventGroupCreate();
-    if (WiFi_EventGroup == NULL) 
+static void wifi_manager_mode_timer_cb(void *arg)
+{
+    (void)arg;
+
+    uint16_t request = atomic_load_explicit(&s_mode_request, memory_order_relaxed);
+    esp_err_t ret = wifi_manager_set_mode((wifi_manager_mode_t)(request >> 8), (uint8_t)request);
+    if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "Failed to create WiFi event group");
-        return ESP_FAIL;
+        ESP_LOGE(TAG, "Storing the requested mode failed: %s", esp_err_to_name(ret));
     }
+}
 
-    /* Get the default WiFi initialization config and use it to initialize the WiFi driver */
-    /* The esp_wifi_init() function initializes the WiFi driver with the provided configuration.
-     * The default configuration is used here, which is suitable for most applications.
-     * It can be customized if needed by modifying the wifi_init_config_t structure.
-     **/  
-    wifi_init_config_t wifi_cfg = WIFI_INIT_CONFIG_DEFAULT();
-    esp_err_t wifi_init_err = esp_wifi_init(&wifi_cfg);
-    if (wifi_init_err != ESP_OK)
+static esp_err_t wifi_manager_start_espnow_only(void)
+{
+    /* STA interface without a config: the driver runs (ESP-NOW needs it) but never associates or scans */
+    ESP_RETURN_ON_ERROR(esp_wifi_set_mode(WIFI_MODE_STA), TAG, "WiFi set mode failed");
+    s_start_us = esp_timer_get_time();
+    ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "esp_wifi_start failed");
+
+    /* No modem sleep whatever the profile: there is no AP beacon to sleep against */
+    ESP_RETURN_ON_ERROR(wifi_manager_profile_start(), TAG, "radio profile start failed");
+    ESP_RETURN_ON_ERROR(esp_wifi_set_channel(s_fixed_channel, WIFI_SECOND_CHAN_NONE), TAG, "esp_wifi_set_channel failed");
+
+    ESP_RETURN_ON_ERROR(wifi_manager_channel_watch_start(), TAG, "channel watch start failed");
+
+    ESP_LOGI(TAG, "WiFi started in ESP-NOW only mode on channel %d", s_fixed_channel);
+    if (s_callbacks.on_status_update)
     {
-        ESP_LOGE(TAG, "WiFi init failed: %s", esp_err_to_name(wifi_init_err));
-        return wifi_init_err;
+        char detail_buf[20];
+        snprintf(detail_buf, sizeof(detail_buf), "Channel %d", s_fixed_channel);
+        s_callbacks.on_status_update("ESP-NOW only", detail_buf);
     }
+    return ESP_OK;
+}
 
-    /* #01 - Register the event handlers for WiFi and IP events */
-    /* The event handlers are registered to handle specific events related to WiFi and IP.
-     * The wifi_event_handler() function handles WiFi events (e.g., connection, disconnection),
-     * while the ip_event_handler() function handles IP events (e.g., obtaining an IP address).
-     * The event handlers are registered with the default event loop created earlier.
-     **/
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_RETURN_ON_ERROR(esp_event_handler_instance_register(WIFI_EVENT,
-                                                            ESP_EVENT_ANY_ID,    // Any event related to WiFi
-                                                            &wifi_event_handler, // Function to handle the registered event
-                                                            NULL,                // No argument passed to the handler
-                                                            &instance_any_id), TAG, "Register WIFI_EVENT failed");
-    ESP_RETURN_ON_ERROR(esp_event_handler_instance_register(IP_EVENT,
-                                                            IP_EVENT_STA_GOT_IP, // Event when the station gets an IP address
-                                                            &ip_event_handler,   // Function to handle the registered event
-                                                            NULL,                // No argument passed to the handler
-                                                            &instance_got_ip), TAG, "Register IP_EVENT failed");
+static bool wifi_manager_cache_load(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_AP_CACHE_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+
+    size_t len = sizeof(s_cache);
+    esp_err_t ret = nvs_get_blob(nvs, WIFI_AP_CACHE_KEY, &s_cache, &len);
+    nvs_close(nvs);
+
+    return ret == ESP_OK && len == sizeof(s_cache) && s_cache.version == WIFI_AP_CACHE_VERSION &&
+           s_cache.ssid_hash == wifi_manager_hash(WIFI_SSID) && s_cache.channel >= 1 && s_cache.channel <= 14;
+}
+
+static void wifi_manager_cache_update(void)
+{
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK)
+    {
+        return;
+    }
+
+    wifi_ap_cache_t entry =
+    {
+        .version = WIFI_AP_CACHE_VERSION,
+        .channel = ap_info.primary,
+        .authmode = (uint8_t)ap_info.authmode,
+        .ssid_hash = wifi_manager_hash(WIFI_SSID),
+    };
+    memcpy(entry.bssid, ap_info.bssid, sizeof(entry.bssid));
+    if (s_cache_valid && memcmp(&entry, &s_cache, sizeof(entry)) == 0)
+    {
+        return;
+    }
+
+    /* Only written when the AP changed, so NVS sees one write per AP move, not one per connect */
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(WIFI_AP_CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_set_blob(nvs, WIFI_AP_CACHE_KEY, &entry, sizeof(entry));
+        if (ret == ESP_OK)
+        {
+            ret = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to cache the AP in NVS: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    s_cache = entry;
+    s_cache_valid = true;
+    ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %d",
+             entry.bssid[0], entry.bssid[1], entry.bssid[2],
+             entry.bssid[3], entry.bssid[4], entry.bssid[5], entry.channel);
+}
 
-    /* #02 - Define the WiFi STA mode configuration */
-    /* This config is different from the wifi_init_config_t used before, which is for the driver initialization. 
+static void wifi_manager_build_config(wifi_connect_path_t path, wifi_config_t *wifi_config)
+{
+    /* This config is different from the wifi_init_config_t used for the driver initialization.
      * This one is specifically for configuring the parameters of either STA or AP mode (STA+AP mode is also possible).
      **/
-    wifi_config_t wifi_config = 
+    *wifi_config = (wifi_config_t)
     {
         .sta = {
             .ssid = WIFI_SSID,
@@ -259,57 +706,512 @@ esp_err_t wifi_manager_init(const wifi_manager_callbacks_t *callbacks)
             /* Authmode threshold defaults to WPA2 PSK. */
             .threshold.authmode = WIFI_AUTH_WPA2_PSK, // Or adjust as needed (WIFI_AUTH_WPA_WPA2_PSK, etc.)
             .sae_pwe_h2e = WPA3_SAE_PWE_BOTH, // Enable WPA3 support if needed
+            /* Only used under WIFI_PS_MAX_MODEM, fixed at association */
+            .listen_interval = s_radio_profiles[atomic_load_explicit(&s_profile_base, memory_order_relaxed)].listen_interval,
         },
     };
 
-    esp_err_t wifi_mode_err = esp_wifi_set_mode(WIFI_MODE_STA);
-    if (wifi_mode_err != ESP_OK)
+    if (path == WIFI_CONNECT_PATH_CACHED && s_cache_valid)
     {
-        ESP_LOGE(TAG, "WiFi set mode failed: %s", esp_err_to_name(wifi_mode_err));
-        return wifi_mode_err;
+        /* Directed connect: probe the one channel of the known BSSID instead of sweeping all of them */
+        wifi_config->sta.scan_method = WIFI_FAST_SCAN;
+        wifi_config->sta.bssid_set = true;
+        memcpy(wifi_config->sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        wifi_config->sta.channel = s_cache.channel;
+        wifi_config->sta.threshold.authmode = (wifi_auth_mode_t)s_cache.authmode;
     }
+    else
+    {
+        wifi_config->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+}
 
-    /* #03 - Configure and connect (WiFi driver already initialized) */
-    ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &wifi_config), TAG, "esp_wifi_set_config failed");
-
-    ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "esp_wifi_start failed");
+static void wifi_manager_connect(wifi_connect_path_t path, bool new_attempt)
+{
+    wifi_radio_profile_t base = (wifi_radio_profile_t)atomic_load_explicit(&s_profile_base, memory_order_relaxed);
+    if (path != s_path || s_config_listen_interval != s_radio_profiles[base].listen_interval)
+    {
+        wifi_config_t wifi_config;
+        wifi_manager_build_config(path, &wifi_config);
+        esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_wifi_set_config failed: %s", esp_err_to_name(ret));
+        }
+        s_path = path;
+        s_config_listen_interval = wifi_config.sta.listen_interval;
+    }
+    if (new_attempt)
+    {
+        s_attempt_us = esp_timer_get_time();
+    }
+    esp_err_t ret = esp_wifi_connect();
+    if (ret != ESP_OK)
+    {
+        /* No disconnect event follows a rejected call: count it as a failed attempt, as the event would */
+        portENTER_CRITICAL(&s_rc_lock);
+        uint32_t delay_ms = wifi_rc_on_disconnected(&s_rc, wifi_manager_now_ms());
+        portEXIT_CRITICAL(&s_rc_lock);
+        wifi_manager_reconnect_arm();
+        ESP_LOGW(TAG, "esp_wifi_connect failed: %s, retry in %lu ms", esp_err_to_name(ret), (unsigned long)delay_ms);
+    }
+}
 
-    /* #08 - Connection should now be triggered by the wifi_event_handler via esp_wifi_connect() once the WIFI_EVENT_STA_START
-     * event is received. The connection process will be handled in the event handler.
-     * The handler will also set the bits in the WiFi_EventGroup to indicate success or failure.
-     **/
-    ESP_LOGI(TAG, "WiFi initialized in STA mode, attempting to connect to SSID: %s", WIFI_SSID);
+static wifi_manager_state_t *wifi_manager_state_begin(void)
+{
+    portENTER_CRITICAL(&s_state_lock);
+    atomic_store_explicit(&s_state_seq, atomic_load_explicit(&s_state_seq, memory_order_relaxed) + 1u,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return &s_state;
+}
+
+static void wifi_manager_state_end(void)
+{
+    atomic_store_explicit(&s_state_seq, atomic_load_explicit(&s_state_seq, memory_order_relaxed) + 1u,
+                          memory_order_release);
+    portEXIT_CRITICAL(&s_state_lock);
+}
+
+static void wifi_manager_channel_seen(uint8_t channel)
+{
+    if (channel == 0)
+    {
+        return;
+    }
+    wifi_manager_state_begin()->channel = channel;
+    wifi_manager_state_end();
+
+    uint8_t old_channel = atomic_exchange_explicit(&s_channel, channel, memory_order_relaxed);
+    if (old_channel != 0 && old_channel != channel)
+    {
+        ESP_LOGW(TAG, "Channel changed %d -> %d", old_channel, channel);
+        if (s_callbacks.on_channel_change)
+        {
+            s_callbacks.on_channel_change(channel, old_channel);
+        }
+    }
+}
+
+static void wifi_manager_poll_timer_cb(void *arg)
+{
+    (void)arg;
+
+    /* While scanning or connecting the driver hops channels, only the associated / pinned channel counts */
+    bool associated = (s_event_group != NULL) && (xEventGroupGetBits(s_event_group) & WIFI_CONNECTED_BIT);
+    if (s_mode != WIFI_MANAGER_MODE_ESPNOW_ONLY && !associated)
+    {
+        return;
+    }
+
+    uint8_t primary = 0;
+    wifi_second_chan_t secondary = WIFI_SECOND_CHAN_NONE;
+    if (esp_wifi_get_channel(&primary, &secondary) == ESP_OK)
+    {
+        wifi_manager_channel_seen(primary);
+    }
+
+    wifi_ap_record_t ap;
+    if (associated && esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+    {
+        wifi_manager_state_begin()->rssi = ap.rssi;
+        wifi_manager_state_end();
+    }
+}
+
+static void wifi_manager_switch_timer_cb(void *arg)
+{
+    (void)arg;
+
+    esp_err_t ret = esp_wifi_set_channel(s_switch_channel, WIFI_SECOND_CHAN_NONE);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_wifi_set_channel(%d) failed: %s", s_switch_channel, esp_err_to_name(ret));
+        return;
+    }
+    s_fixed_channel = s_switch_channel;
+    wifi_manager_poll_timer_cb(NULL);
+}
+
+static esp_err_t wifi_manager_channel_watch_start(void)
+{
+    uint8_t primary = 0;
+    wifi_second_chan_t secondary = WIFI_SECOND_CHAN_NONE;
+    if (esp_wifi_get_channel(&primary, &secondary) == ESP_OK)
+    {
+        atomic_store_explicit(&s_channel, primary, memory_order_relaxed);
+        wifi_manager_state_begin()->channel = primary;
+        wifi_manager_state_end();
+    }
+
+    const esp_timer_create_args_t poll_args = { .callback = wifi_manager_poll_timer_cb, .name = "wifi_ch_poll" };
+    const esp_timer_create_args_t switch_args = { .callback = wifi_manager_switch_timer_cb, .name = "wifi_ch_switch" };
+    /* Created once, a start after wifi_manager_deinit() only restarts the poll */
+    if (s_poll_timer == NULL)
+    {
+        ESP_RETURN_ON_ERROR(esp_timer_create(&poll_args, &s_poll_timer), TAG, "channel poll timer create failed");
+    }
+    if (s_switch_timer == NULL)
+    {
+        ESP_RETURN_ON_ERROR(esp_timer_create(&switch_args, &s_switch_timer), TAG, "channel switch timer create failed");
+    }
+    return esp_timer_start_periodic(s_poll_timer, (uint64_t)WIFI_MANAGER_CHANNEL_POLL_MS * 1000u);
+}
+
+static inline uint32_t wifi_manager_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void wifi_manager_reconnect_timer_cb(void *arg)
+{
+    (void)arg;
+
+    portENTER_CRITICAL(&s_rc_lock);
+    bool due = wifi_rc_poll(&s_rc, wifi_manager_now_ms(), atomic_load_explicit(&s_activity_ms, memory_order_relaxed));
+    portEXIT_CRITICAL(&s_rc_lock);
+
+    if (due)
+    {
+        wifi_manager_connect(s_next_path, true);
+    }
+    else
+    {
+        /* Deferred by the ESP-NOW priority window (or called early): wait for the new deadline */
+        wifi_manager_reconnect_arm();
+    }
+}
+
+static void wifi_manager_reconnect_arm(void)
+{
+    uint32_t next_ms = 0;
+    portENTER_CRITICAL(&s_rc_lock);
+    bool scheduled = wifi_rc_next_ms(&s_rc, &next_ms);
+    portEXIT_CRITICAL(&s_rc_lock);
+    if (!scheduled || s_rc_timer == NULL)
+    {
+        return;
+    }
+
+    int32_t delay_ms = (int32_t)(next_ms - wifi_manager_now_ms());
+    (void)esp_timer_stop(s_rc_timer);
+    (void)esp_timer_start_once(s_rc_timer, (uint64_t)((delay_ms > 0) ? delay_ms : 1) * 1000u);
+}
+
+static void wifi_manager_profile_apply(wifi_radio_profile_t profile, uint32_t now_ms)
+{
+    const wifi_radio_profile_cfg_t *cfg = &s_radio_profiles[profile];
+
+    /* Without an AP there is no beacon to sleep against: modem sleep would only delay ESP-NOW frames */
+    wifi_ps_type_t ps = (s_mode == WIFI_MANAGER_MODE_ESPNOW_ONLY) ? WIFI_PS_NONE : cfg->ps;
+    esp_err_t ret = esp_wifi_set_ps(ps);
+    if (ret == ESP_OK)
+    {
+        ret = esp_wifi_set_max_tx_power(cfg->max_tx_power);
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Radio profile %s failed: %s", cfg->name, esp_err_to_name(ret));
+        return;
+    }
+
+    wifi_radio_profile_t old = (wifi_radio_profile_t)atomic_load_explicit(&s_profile_active, memory_order_relaxed);
+    portENTER_CRITICAL(&s_profile_lock);
+    s_profile_residency_ms[old] += now_ms - s_profile_since_ms;
+    s_profile_since_ms = now_ms;
+    s_profile_switches++;
+    atomic_store_explicit(&s_profile_active, (uint8_t)profile, memory_order_relaxed);
+    portEXIT_CRITICAL(&s_profile_lock);
+    ESP_LOGI(TAG, "Radio profile %s -> %s", s_radio_profiles[old].name, cfg->name);
+}
+
+static void wifi_manager_profile_kick(void)
+{
+    if (s_profile_timer == NULL || atomic_exchange_explicit(&s_profile_pending, true, memory_order_relaxed))
+    {
+        return;
+    }
+    (void)esp_timer_stop(s_profile_timer);
+    (void)esp_timer_start_once(s_profile_timer, 0);
+}
+
+static void wifi_manager_profile_timer_cb(void *arg)
+{
+    (void)arg;
+    atomic_store_explicit(&s_profile_pending, false, memory_order_relaxed);
+
+    uint32_t now_ms = wifi_manager_now_ms();
+    uint32_t last_ms = atomic_load_explicit(&s_activity_ms, memory_order_relaxed);
+    bool driving = atomic_load_explicit(&s_auto_low_latency, memory_order_relaxed) && last_ms != 0 &&
+                   (int32_t)(now_ms - last_ms) < WIFI_MANAGER_LOW_LATENCY_HOLD_MS;
+    wifi_radio_profile_t target = driving ? WIFI_RADIO_PROFILE_LOW_LATENCY :
+                                  (wifi_radio_profile_t)atomic_load_explicit(&s_profile_base, memory_order_relaxed);
+
+    if (target != (wifi_radio_profile_t)atomic_load_explicit(&s_profile_active, memory_order_relaxed))
+    {
+        wifi_manager_profile_apply(target, now_ms);
+    }
+    if (driving)
+    {
+        /* Check again when the hold after the last command runs out */
+        uint32_t remaining_ms = last_ms + WIFI_MANAGER_LOW_LATENCY_HOLD_MS - now_ms;
+        (void)esp_timer_start_once(s_profile_timer, (uint64_t)remaining_ms * 1000u);
+    }
+}
+
+static esp_err_t wifi_manager_profile_start(void)
+{
+    if (s_profile_timer == NULL)
+    {
+        const esp_timer_create_args_t args = { .callback = wifi_manager_profile_timer_cb, .name = "wifi_profile" };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&args, &s_profile_timer), TAG, "profile timer create failed");
+    }
+
+    wifi_radio_profile_t base = (wifi_radio_profile_t)atomic_load_explicit(&s_profile_base, memory_order_relaxed);
+    const wifi_radio_profile_cfg_t *cfg = &s_radio_profiles[base];
+    ESP_RETURN_ON_ERROR(esp_wifi_set_ps((s_mode == WIFI_MANAGER_MODE_ESPNOW_ONLY) ? WIFI_PS_NONE : cfg->ps),
+                        TAG, "esp_wifi_set_ps failed");
+    ESP_RETURN_ON_ERROR(esp_wifi_set_max_tx_power(cfg->max_tx_power), TAG, "esp_wifi_set_max_tx_power failed");
+    atomic_store_explicit(&s_profile_active, (uint8_t)base, memory_order_relaxed);
+    s_profile_since_ms = wifi_manager_now_ms();
+    ESP_LOGI(TAG, "Radio profile %s%s", cfg->name,
+             atomic_load_explicit(&s_auto_low_latency, memory_order_relaxed) ? ", low latency while driven" : "");
+    return ESP_OK;
+}
+
+static void wifi_manager_hist_record(wifi_connect_hist_state_t *h, uint32_t ms)
+{
+    uint32_t bucket = (ms != 0) ? (31u - (uint32_t)__builtin_clz(ms)) : 0;
+    if (bucket >= WIFI_MANAGER_CONNECT_BUCKETS)
+    {
+        bucket = WIFI_MANAGER_CONNECT_BUCKETS - 1;
+    }
+
+    uint32_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (count == 0 || ms < atomic_load_explicit(&h->min_ms, memory_order_relaxed))
+    {
+        atomic_store_explicit(&h->min_ms, ms, memory_order_relaxed);
+    }
+    if (ms > atomic_load_explicit(&h->max_ms, memory_order_relaxed))
+    {
+        atomic_store_explicit(&h->max_ms, ms, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&h->buckets[bucket], 1, memory_order_relaxed);
+    atomic_store_explicit(&h->count, count + 1, memory_order_relaxed);
+}
+
+static void wifi_manager_hist_read(const wifi_connect_hist_state_t *h, wifi_manager_connect_hist_t *out)
+{
+    out->count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    out->min_ms = (out->count != 0) ? atomic_load_explicit(&h->min_ms, memory_order_relaxed) : UINT32_MAX;
+    out->max_ms = atomic_load_explicit(&h->max_ms, memory_order_relaxed);
+    for (int b = 0; b < WIFI_MANAGER_CONNECT_BUCKETS; b++)
+    {
+        out->buckets[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+    }
+}
+
+static int wifi_manager_hist_format(const wifi_manager_connect_hist_t *h, char *line, size_t size)
+{
+    int pos = 0;
+    line[0] = '\0';
+    for (int b = 0; b < WIFI_MANAGER_CONNECT_BUCKETS && pos < (int)size; b++)
+    {
+        if (h->buckets[b] != 0)
+        {
+            pos += snprintf(&line[pos], size - pos, " <%lu:%lu",
+                            (unsigned long)(2ul << b), (unsigned long)h->buckets[b]);
+        }
+    }
+    return pos;
+}
+
+static void wifi_manager_disconnect_record(uint16_t reason, int8_t rssi, bool link_lost)
+{
+    atomic_fetch_add_explicit(&s_disconnects, 1, memory_order_relaxed);
+
+    /* Slot of this reason, or the first free one (slots fill in order and are never freed) */
+    int slot = 0;
+    while (slot < WIFI_MANAGER_DISCONNECT_REASONS &&
+           atomic_load_explicit(&s_reason_count[slot], memory_order_relaxed) != 0 &&
+           atomic_load_explicit(&s_reason_code[slot], memory_order_relaxed) != reason)
+    {
+        slot++;
+    }
+    if (slot == WIFI_MANAGER_DISCONNECT_REASONS)
+    {
+        atomic_fetch_add_explicit(&s_reason_overflow, 1, memory_order_relaxed);
+    }
+    else
+    {
+        atomic_store_explicit(&s_reason_code[slot], reason, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s_reason_count[slot], 1, memory_order_release);
+    }
+
+    if (!link_lost)
+    {
+        return;
+    }
+    atomic_fetch_add_explicit(&s_link_losses, 1, memory_order_relaxed);
+    int bin = (rssi >= -50) ? 0 : (-50 - rssi + 9) / 10;
+    if (bin >= WIFI_MANAGER_RSSI_BINS)
+    {
+        bin = WIFI_MANAGER_RSSI_BINS - 1;
+    }
+    atomic_fetch_add_explicit(&s_rssi_bins[bin], 1, memory_order_relaxed);
+    s_loss_us = esp_timer_get_time();
+}
+
+/*******************************************************************************/
+/*                        GLOBAL FUNCTION DEFINITIONS                          */
+/*******************************************************************************/
+
+esp_err_t wifi_manager_start(const wifi_manager_callbacks_t *callbacks)
+{
+    ESP_LOGI(TAG, "Initializing WiFi...");
+
+    /* Store callbacks if provided */
+    if (callbacks != NULL) 
+    {
+        memcpy(&s_callbacks, callbacks, sizeof(wifi_manager_callbacks_t));
+    } 
+    else 
+    {
+        memset(&s_callbacks, 0, sizeof(wifi_manager_callbacks_t));
+    }
+
+    /* Initialize the WiFi event group which will be used to signal connection status */
+    s_event_group = xEventGroupCreateStatic(&s_event_group_storage);
+    if (s_event_group == NULL) 
+    {
+        ESP_LOGE(TAG, "Failed to create WiFi event group");
+        return ESP_FAIL;
+    }
+
+    /* Get the default WiFi initialization config and use it to initialize the WiFi driver */
+    /* The esp_wifi_init() function initializes the WiFi driver with the provided configuration.
+     * The default configuration is used here, which is suitable for most applications.
+     * It can be customized if needed by modifying the wifi_init_config_t structure.
+     **/  
+    wifi_init_config_t wifi_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_err_t wifi_init_err = esp_wifi_init(&wifi_cfg);
+    if (wifi_init_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "WiFi init failed: %s", esp_err_to_name(wifi_init_err));
+        return wifi_init_err;
+    }
+
+    /* #01 - Register the event handlers for WiFi and IP events */
+    /* The event handlers are registered to handle specific events related to WiFi and IP.
+     * The wifi_event_handler() function handles WiFi events (e.g., connection, disconnection),
+     * while the ip_event_handler() function handles IP events (e.g., obtaining an IP address).
+     * The event handlers are registered with the default event loop created earlier.
+     **/
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    ESP_RETURN_ON_ERROR(esp_event_handler_instance_register(WIFI_EVENT,
+                                                            ESP_EVENT_ANY_ID,    // Any event related to WiFi
+                                                            &wifi_event_handler, // Function to handle the registered event
+                                                            NULL,                // No argument passed to the handler
+                                                            &instance_any_id), TAG, "Register WIFI_EVENT failed");
+    ESP_RETURN_ON_ERROR(esp_event_handler_instance_register(IP_EVENT,
+                                                            IP_EVENT_STA_GOT_IP, // Event when the station gets an IP address
+                                                            &ip_event_handler,   // Function to handle the registered event
+                                                            NULL,                // No argument passed to the handler
+                                                            &instance_got_ip), TAG, "Register IP_EVENT failed");
+
+    /* #02 - Define the WiFi STA mode configuration: the cached AP if NVS has one, a full scan otherwise */
+    wifi_manager_mode_load();
+    if (s_mode_timer == NULL)
+    {
+        const esp_timer_create_args_t mode_args = { .callback = wifi_manager_mode_timer_cb, .name = "wifi_mode_store" };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&mode_args, &s_mode_timer), TAG, "mode timer create failed");
+    }
+    wifi_manager_state_begin()->link = (s_mode == WIFI_MANAGER_MODE_ESPNOW_ONLY) ? WIFI_LINK_ESPNOW_ONLY : WIFI_LINK_CONNECTING;
+    wifi_manager_state_end();
+    if (s_mode == WIFI_MANAGER_MODE_ESPNOW_ONLY)
+    {
+        return wifi_manager_start_espnow_only();
+    }
+    s_cache_valid = wifi_manager_cache_load();
+    s_path = s_cache_valid ? WIFI_CONNECT_PATH_CACHED : WIFI_CONNECT_PATH_SCAN;
+    s_connected = false;
+    wifi_config_t wifi_config;
+    wifi_manager_build_config(s_path, &wifi_config);
+
+    /* Reconnect scheduler, jitter seeded per device so a fleet does not retry in lockstep */
+    wifi_rc_config_t rc_config = WIFI_RC_DEFAULT_CONFIG();
+    rc_config.priority_window_ms = WIFI_MANAGER_SCAN_HOLD_MS;
+    wifi_rc_init(&s_rc, &rc_config, esp_random());
+    if (s_rc_timer == NULL)
+    {
+        const esp_timer_create_args_t rc_args = { .callback = wifi_manager_reconnect_timer_cb, .name = "wifi_reconnect" };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&rc_args, &s_rc_timer), TAG, "reconnect timer create failed");
+    }
+
+    esp_err_t wifi_mode_err = esp_wifi_set_mode(WIFI_MODE_STA);
+    if (wifi_mode_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "WiFi set mode failed: %s", esp_err_to_name(wifi_mode_err));
+        return wifi_mode_err;
+    }
+
+    /* #03 - Configure and connect (WiFi driver already initialized) */
+    ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &wifi_config), TAG, "esp_wifi_set_config failed");
+    s_config_listen_interval = wifi_config.sta.listen_interval;
+
+    s_start_us = esp_timer_get_time();
+    ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "esp_wifi_start failed");
+    ESP_RETURN_ON_ERROR(wifi_manager_profile_start(), TAG, "radio profile start failed");
+    ESP_RETURN_ON_ERROR(wifi_manager_channel_watch_start(), TAG, "channel watch start failed");
+
+    /* #08 - Connection should now be triggered by the wifi_event_handler via esp_wifi_connect() once the WIFI_EVENT_STA_START
+     * event is received. The connection process will be handled in the event handler.
+     * The handler will also set the bits in s_event_group and publish s_state to report success or failure.
+     **/
+    ESP_LOGI(TAG, "WiFi initialized in STA mode, attempting to connect to SSID: %s", WIFI_SSID);
+
+    /* #04 - Return at once: ESP-NOW can be brought up on the running driver right away, the
+     * connection outcome is reported through the callbacks, wifi_manager_get_state() and wifi_manager_wait_connected().
+     **/
+    return ESP_OK;
+}
+
+esp_err_t wifi_manager_init(const wifi_manager_callbacks_t *callbacks)
+{
+    ESP_RETURN_ON_ERROR(wifi_manager_start(callbacks), TAG, "WiFi start failed");
+    if (s_mode == WIFI_MANAGER_MODE_ESPNOW_ONLY)
+    {
+        return ESP_OK;
+    }
+
+    /* Wait for the connection to complete or fail */
+    return wifi_manager_wait_connected(portMAX_DELAY);
+}
+
+esp_err_t wifi_manager_wait_connected(TickType_t timeout)
+{
+    if (s_event_group == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_mode == WIFI_MANAGER_MODE_ESPNOW_ONLY)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
 
-    /* #04 - Wait for the connection to complete or fail */
     /* The xEventGroupWaitBits() function blocks the calling task until one of the specified bits is set in the event group.
      * In this case, it waits for either the WIFI_CONNECTED_BIT or WIFI_FAIL_BIT to be set.
-     * The pdFALSE flag indicates that the bits should not be cleared on exit, and portMAX_DELAY means wait indefinitely.
+     * The pdFALSE flag indicates that the bits should not be cleared on exit.
      **/
-    EventBits_t bits = xEventGroupWaitBits(WiFi_EventGroup,
+    EventBits_t bits = xEventGroupWaitBits(s_event_group,
                                             WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
                                             pdFALSE,        // Don't clear bits on exit
                                             pdFALSE,        // Wait for EITHER bit
-                                            portMAX_DELAY); // Wait indefinitely
+                                            timeout);
 
     if (bits & WIFI_CONNECTED_BIT) 
     {
-        ESP_LOGI(TAG, "Connected to AP SSID:%s", WIFI_SSID);
-        
-        /* Get and print the WiFi channel */
-        uint8_t primary_channel = 0;
-        wifi_second_chan_t secondary_channel = WIFI_SECOND_CHAN_NONE;
-        esp_err_t channel_err = wifi_manager_get_channel(&primary_channel, &secondary_channel);
-        
-        if (channel_err == ESP_OK) 
-        {
-            ESP_LOGI(TAG, "WiFi Channel: %d", primary_channel);
-            
-            if (secondary_channel != WIFI_SECOND_CHAN_NONE) 
-            {
-                ESP_LOGI(TAG, "Secondary Channel: %d (HT40 mode)", secondary_channel);
-            }
-        }
-        
         return ESP_OK;
     } 
     else if (bits & WIFI_FAIL_BIT) 
@@ -319,21 +1221,423 @@ esp_err_t wifi_manager_init(const wifi_manager_callbacks_t *callbacks)
     } 
     else 
     {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-        return ESP_FAIL;
+        return ESP_ERR_TIMEOUT;
     }
 }
 
 esp_err_t wifi_manager_deinit(void)
 {
-    if (WiFi_EventGroup != NULL)
+    if (s_rc_timer != NULL)
+    {
+        (void)esp_timer_stop(s_rc_timer);
+    }
+    if (s_profile_timer != NULL)
+    {
+        (void)esp_timer_stop(s_profile_timer);
+    }
+    /* The channel poll would keep querying a stopped driver, a pending switch would set its channel */
+    if (s_poll_timer != NULL)
+    {
+        (void)esp_timer_stop(s_poll_timer);
+    }
+    if (s_switch_timer != NULL)
     {
-        vEventGroupDelete(WiFi_EventGroup);
-        WiFi_EventGroup = NULL;
+        (void)esp_timer_stop(s_switch_timer);
     }
+    if (s_event_group != NULL)
+    {
+        vEventGroupDelete(s_event_group);
+        s_event_group = NULL;
+    }
+    wifi_manager_state_t *state = wifi_manager_state_begin();
+    state->link = WIFI_LINK_DOWN;
+    state->ip = 0;
+    state->rssi = 0;
+    wifi_manager_state_end();
     return esp_wifi_stop();
 }
 
+esp_err_t wifi_manager_get_state(wifi_manager_state_t *state)
+{
+    if (state == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Copy until no writer was active before or during the copy */
+    uint32_t seq;
+    do
+    {
+        seq = atomic_load_explicit(&s_state_seq, memory_order_acquire);
+        *state = *(volatile const wifi_manager_state_t *)&s_state;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1u) != 0 || seq != atomic_load_explicit(&s_state_seq, memory_order_relaxed));
+    return ESP_OK;
+}
+
+wifi_manager_mode_t wifi_manager_get_mode(void)
+{
+    return s_mode;
+}
+
+esp_err_t wifi_manager_set_mode(wifi_manager_mode_t mode, uint8_t channel)
+{
+    if (mode >= WIFI_MANAGER_MODE_COUNT || channel < 1 || channel > 13)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(WIFI_AP_CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_set_u8(nvs, WIFI_MODE_KEY, (uint8_t)mode);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_set_u8(nvs, WIFI_CHANNEL_KEY, channel);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (ret == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Mode %s (channel %d) stored, effective after reboot",
+                 (mode == WIFI_MANAGER_MODE_ESPNOW_ONLY) ? "ESP-NOW only" : "STA", channel);
+    }
+    return ret;
+}
+
+esp_err_t wifi_manager_request_mode(wifi_manager_mode_t mode, uint8_t channel)
+{
+    if (mode >= WIFI_MANAGER_MODE_COUNT || channel < 1 || channel > 13)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_mode_timer == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    atomic_store_explicit(&s_mode_request, (uint16_t)(((uint16_t)mode << 8) | channel), memory_order_relaxed);
+    (void)esp_timer_stop(s_mode_timer);
+    return esp_timer_start_once(s_mode_timer, 0);
+}
+
+esp_err_t wifi_manager_switch_channel(uint8_t channel)
+{
+    if (channel < 1 || channel > 13)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_mode != WIFI_MANAGER_MODE_ESPNOW_ONLY || s_switch_timer == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t old_channel = atomic_load_explicit(&s_channel, memory_order_relaxed);
+    if (channel == old_channel)
+    {
+        return ESP_OK;
+    }
+
+    /* Tell the peers while they can still hear us, switch once the notice had time to go out */
+    if (s_callbacks.on_channel_leaving)
+    {
+        s_callbacks.on_channel_leaving(channel, old_channel);
+    }
+    s_switch_channel = channel;
+    (void)esp_timer_stop(s_switch_timer);
+    return esp_timer_start_once(s_switch_timer, (uint64_t)WIFI_MANAGER_CHANNEL_LEAVE_MS * 1000u);
+}
+
+esp_err_t wifi_manager_get_connect_stats(wifi_manager_connect_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int p = 0; p < WIFI_CONNECT_PATH_COUNT; p++)
+    {
+        wifi_manager_hist_read(&s_connect_hist[p], &stats->paths[p]);
+    }
+    stats->cache_fallbacks = atomic_load_explicit(&s_cache_fallbacks, memory_order_relaxed);
+    stats->cache_valid = s_cache_valid;
+    return ESP_OK;
+}
+
+void wifi_manager_note_espnow_activity(void)
+{
+    uint32_t now_ms = wifi_manager_now_ms();
+    atomic_store_explicit(&s_activity_ms, (now_ms != 0) ? now_ms : 1, memory_order_relaxed);
+
+    /* Only the first command of a drive costs more than the two loads: it gets the radio into low latency */
+    if (atomic_load_explicit(&s_auto_low_latency, memory_order_relaxed) &&
+        atomic_load_explicit(&s_profile_active, memory_order_relaxed) != WIFI_RADIO_PROFILE_LOW_LATENCY)
+    {
+        wifi_manager_profile_kick();
+    }
+}
+
+esp_err_t wifi_manager_set_radio_profile(wifi_radio_profile_t profile)
+{
+    if (profile >= WIFI_RADIO_PROFILE_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_profile_timer == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    atomic_store_explicit(&s_profile_base, (uint8_t)profile, memory_order_relaxed);
+    wifi_manager_profile_kick();
+    return ESP_OK;
+}
+
+wifi_radio_profile_t wifi_manager_get_radio_profile(void)
+{
+    return (wifi_radio_profile_t)atomic_load_explicit(&s_profile_active, memory_order_relaxed);
+}
+
+void wifi_manager_set_auto_low_latency(bool enable)
+{
+    atomic_store_explicit(&s_auto_low_latency, enable, memory_order_relaxed);
+    wifi_manager_profile_kick();
+}
+
+esp_err_t wifi_manager_get_radio_stats(wifi_manager_radio_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t now_ms = wifi_manager_now_ms();
+    stats->base = (wifi_radio_profile_t)atomic_load_explicit(&s_profile_base, memory_order_relaxed);
+    stats->auto_low_latency = atomic_load_explicit(&s_auto_low_latency, memory_order_relaxed);
+    portENTER_CRITICAL(&s_profile_lock);
+    stats->active = (wifi_radio_profile_t)atomic_load_explicit(&s_profile_active, memory_order_relaxed);
+    stats->switches = s_profile_switches;
+    memcpy(stats->residency_ms, s_profile_residency_ms, sizeof(stats->residency_ms));
+    if (s_profile_timer != NULL)
+    {
+        stats->residency_ms[stats->active] += now_ms - s_profile_since_ms;
+    }
+    portEXIT_CRITICAL(&s_profile_lock);
+    return ESP_OK;
+}
+
+void wifi_manager_print_radio_stats(void)
+{
+    wifi_manager_radio_stats_t stats;
+    (void)wifi_manager_get_radio_stats(&stats);
+    ESP_LOGI(TAG, "Radio profile %s (base %s, auto low latency %s), %lu switches, time in low-latency %lu balanced %lu low-power %lu ms",
+             wifi_manager_radio_profile_name(stats.active), wifi_manager_radio_profile_name(stats.base),
+             stats.auto_low_latency ? "on" : "off", (unsigned long)stats.switches,
+             (unsigned long)stats.residency_ms[WIFI_RADIO_PROFILE_LOW_LATENCY],
+             (unsigned long)stats.residency_ms[WIFI_RADIO_PROFILE_BALANCED],
+             (unsigned long)stats.residency_ms[WIFI_RADIO_PROFILE_LOW_POWER]);
+}
+
+const char *wifi_manager_radio_profile_name(wifi_radio_profile_t profile)
+{
+    return (profile < WIFI_RADIO_PROFILE_COUNT) ? s_radio_profiles[profile].name : "?";
+}
+
+esp_err_t wifi_manager_get_reconnect_stats(wifi_manager_reconnect_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t now_ms = wifi_manager_now_ms();
+    uint32_t next_ms = 0;
+    portENTER_CRITICAL(&s_rc_lock);
+    bool scheduled = wifi_rc_next_ms(&s_rc, &next_ms);
+    stats->state = s_rc.state;
+    stats->consecutive_failures = s_rc.consecutive_failures;
+    stats->counters = s_rc.stats;
+    portEXIT_CRITICAL(&s_rc_lock);
+
+    int32_t next_in_ms = (int32_t)(next_ms - now_ms);
+    stats->next_attempt_in_ms = (scheduled && next_in_ms > 0) ? (uint32_t)next_in_ms : 0;
+    return ESP_OK;
+}
+
+void wifi_manager_print_connect_stats(void)
+{
+    static const char *const path_names[WIFI_CONNECT_PATH_COUNT] = { "cached", "scan" };
+    wifi_manager_connect_stats_t stats;
+    char line[8 * WIFI_MANAGER_CONNECT_BUCKETS];
+
+    (void)wifi_manager_get_connect_stats(&stats);
+    ESP_LOGI(TAG, "Connect times (ms, log2 buckets), AP cached: %s, fallbacks to scan: %lu",
+             stats.cache_valid ? "yes" : "no", (unsigned long)stats.cache_fallbacks);
+    for (int p = 0; p < WIFI_CONNECT_PATH_COUNT; p++)
+    {
+        const wifi_manager_connect_hist_t *h = &stats.paths[p];
+        if (h->count == 0)
+        {
+            continue;
+        }
+
+        (void)wifi_manager_hist_format(h, line, sizeof(line));
+        ESP_LOGI(TAG, "  %-6s n=%lu min %lu max %lu |%s", path_names[p], (unsigned long)h->count,
+                 (unsigned long)h->min_ms, (unsigned long)h->max_ms, line);
+    }
+
+    wifi_manager_reconnect_stats_t rc;
+    (void)wifi_manager_get_reconnect_stats(&rc);
+    if (rc.state != WIFI_RC_IDLE)
+    {
+        ESP_LOGI(TAG, "Reconnect: %s (next in %lu ms, %lu failed), attempts %lu failures %lu losses %lu deferred %lu, outage last %lu max %lu ms",
+                 wifi_rc_state_name(rc.state), (unsigned long)rc.next_attempt_in_ms, (unsigned long)rc.consecutive_failures,
+                 (unsigned long)rc.counters.attempts, (unsigned long)rc.counters.failures,
+                 (unsigned long)rc.counters.link_losses, (unsigned long)rc.counters.deferred,
+                 (unsigned long)rc.counters.last_outage_ms, (unsigned long)rc.counters.max_outage_ms);
+    }
+}
+
+esp_err_t wifi_manager_get_disconnect_stats(wifi_manager_disconnect_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->disconnects = atomic_load_explicit(&s_disconnects, memory_order_relaxed);
+    stats->link_losses = atomic_load_explicit(&s_link_losses, memory_order_relaxed);
+    stats->reason_overflow = atomic_load_explicit(&s_reason_overflow, memory_order_relaxed);
+    for (int r = 0; r < WIFI_MANAGER_DISCONNECT_REASONS; r++)
+    {
+        /* The count is published after the reason, a non-zero count always comes with its reason */
+        stats->reasons[r].count = atomic_load_explicit(&s_reason_count[r], memory_order_acquire);
+        stats->reasons[r].reason = atomic_load_explicit(&s_reason_code[r], memory_order_relaxed);
+    }
+    for (int b = 0; b < WIFI_MANAGER_RSSI_BINS; b++)
+    {
+        stats->rssi_bins[b] = atomic_load_explicit(&s_rssi_bins[b], memory_order_relaxed);
+    }
+    wifi_manager_hist_read(&s_recover_hist, &stats->recover);
+    return ESP_OK;
+}
+
+size_t wifi_manager_serialize_disconnect_stats(const wifi_manager_disconnect_stats_t *stats, uint8_t *buf, size_t len)
+{
+    const size_t fixed = WIFI_MANAGER_DISCONNECT_REPORT_MAX - 6 * WIFI_MANAGER_DISCONNECT_REASONS;
+    if (stats == NULL || buf == NULL || len < fixed)
+    {
+        return 0;
+    }
+
+    /* #01 - Counters, RSSI bins and recovery histogram, all u32 */
+    uint32_t words[3 + WIFI_MANAGER_RSSI_BINS + 3 + WIFI_MANAGER_CONNECT_BUCKETS];
+    uint32_t n = 0;
+    words[n++] = stats->disconnects;
+    words[n++] = stats->link_losses;
+    words[n++] = stats->reason_overflow;
+    for (int b = 0; b < WIFI_MANAGER_RSSI_BINS; b++)
+    {
+        words[n++] = stats->rssi_bins[b];
+    }
+    words[n++] = stats->recover.count;
+    words[n++] = stats->recover.min_ms;
+    words[n++] = stats->recover.max_ms;
+    for (int b = 0; b < WIFI_MANAGER_CONNECT_BUCKETS; b++)
+    {
+        words[n++] = stats->recover.buckets[b];
+    }
+
+    uint8_t *p = buf;
+    for (uint32_t w = 0; w < n; w++)
+    {
+        *p++ = (uint8_t)(words[w]);
+        *p++ = (uint8_t)(words[w] >> 8);
+        *p++ = (uint8_t)(words[w] >> 16);
+        *p++ = (uint8_t)(words[w] >> 24);
+    }
+
+    /* #02 - Used reason slots, as many as fit */
+    uint8_t *count_byte = p++;
+    *count_byte = 0;
+    for (int r = 0; r < WIFI_MANAGER_DISCONNECT_REASONS; r++)
+    {
+        const wifi_manager_reason_count_t *rc = &stats->reasons[r];
+        if (rc->count == 0 || (size_t)(p - buf) + 6 > len)
+        {
+            continue;
+        }
+        *p++ = (uint8_t)(rc->reason);
+        *p++ = (uint8_t)(rc->reason >> 8);
+        *p++ = (uint8_t)(rc->count);
+        *p++ = (uint8_t)(rc->count >> 8);
+        *p++ = (uint8_t)(rc->count >> 16);
+        *p++ = (uint8_t)(rc->count >> 24);
+        (*count_byte)++;
+    }
+    return (size_t)(p - buf);
+}
+
+void wifi_manager_print_disconnect_stats(void)
+{
+    wifi_manager_disconnect_stats_t stats;
+    char line[8 * WIFI_MANAGER_CONNECT_BUCKETS];
+
+    (void)wifi_manager_get_disconnect_stats(&stats);
+    if (stats.disconnects == 0)
+    {
+        return;
+    }
+
+    int pos = 0;
+    line[0] = '\0';
+    for (int r = 0; r < WIFI_MANAGER_DISCONNECT_REASONS && pos < (int)sizeof(line); r++)
+    {
+        if (stats.reasons[r].count != 0)
+        {
+            pos += snprintf(&line[pos], sizeof(line) - pos, " %u:%lu",
+                            stats.reasons[r].reason, (unsigned long)stats.reasons[r].count);
+        }
+    }
+    ESP_LOGI(TAG, "Disconnects %lu (link losses %lu), reason:count%s%s", (unsigned long)stats.disconnects,
+             (unsigned long)stats.link_losses, line, (stats.reason_overflow != 0) ? " +other" : "");
+    ESP_LOGI(TAG, "  RSSI at loss >=-50:%lu -60:%lu -70:%lu -80:%lu -90:%lu <-90:%lu",
+             (unsigned long)stats.rssi_bins[0], (unsigned long)stats.rssi_bins[1], (unsigned long)stats.rssi_bins[2],
+             (unsigned long)stats.rssi_bins[3], (unsigned long)stats.rssi_bins[4], (unsigned long)stats.rssi_bins[5]);
+    if (stats.recover.count != 0)
+    {
+        (void)wifi_manager_hist_format(&stats.recover, line, sizeof(line));
+        ESP_LOGI(TAG, "  Time to recover (ms) n=%lu min %lu max %lu |%s", (unsigned long)stats.recover.count,
+                 (unsigned long)stats.recover.min_ms, (unsigned long)stats.recover.max_ms, line);
+    }
+}
+
+esp_err_t wifi_manager_forget_ap(void)
+{
+    s_cache_valid = false;
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(WIFI_AP_CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    ret = nvs_erase_key(nvs, WIFI_AP_CACHE_KEY);
+    if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ret = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return ret;
+}
+
 esp_err_t wifi_manager_get_channel(uint8_t *primary_channel, wifi_second_chan_t *secondary_channel)
 {
     /* Get the current WiFi channel from the driver */
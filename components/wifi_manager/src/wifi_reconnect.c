@@ -0,0 +1,194 @@
+/******************************************************************************
+ * @file wifi_reconnect.c
+ * @brief Platform independent reconnect scheduler of the WiFi manager
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <string.h>
+#include "wifi_reconnect.h"
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Next value of the xorshift32 generator
+ */
+static uint32_t wifi_rc_rand(wifi_rc_t *rc);
+
+/**
+ * @brief Backoff delay after the given number of consecutive failures, jittered and capped
+ */
+static uint32_t wifi_rc_delay(wifi_rc_t *rc, uint32_t failures);
+
+/**
+ * @brief true if time a is at or after time b (wrap-safe)
+ */
+static inline bool wifi_rc_reached(uint32_t a, uint32_t b);
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+void wifi_rc_init(wifi_rc_t *rc, const wifi_rc_config_t *config, uint32_t seed)
+{
+    memset(rc, 0, sizeof(*rc));
+    rc->config = *config;
+    if (rc->config.base_ms == 0)
+    {
+        rc->config.base_ms = 1;
+    }
+    if (rc->config.cap_ms < rc->config.base_ms)
+    {
+        rc->config.cap_ms = rc->config.base_ms;
+    }
+    if (rc->config.jitter_permille > 1000)
+    {
+        rc->config.jitter_permille = 1000;
+    }
+    rc->rng = (seed != 0) ? seed : 0x9E3779B9u;
+    rc->state = WIFI_RC_IDLE;
+}
+
+void wifi_rc_start(wifi_rc_t *rc, uint32_t now_ms)
+{
+    rc->state = WIFI_RC_BACKOFF;
+    rc->next_ms = now_ms;
+    rc->down_since_ms = now_ms;
+    rc->consecutive_failures = 0;
+}
+
+void wifi_rc_on_connected(wifi_rc_t *rc, uint32_t now_ms)
+{
+    uint32_t outage_ms = now_ms - rc->down_since_ms;
+    rc->stats.connects++;
+    rc->stats.last_outage_ms = outage_ms;
+    if (outage_ms > rc->stats.max_outage_ms)
+    {
+        rc->stats.max_outage_ms = outage_ms;
+    }
+    rc->consecutive_failures = 0;
+    rc->state = WIFI_RC_CONNECTED;
+}
+
+uint32_t wifi_rc_on_disconnected(wifi_rc_t *rc, uint32_t now_ms)
+{
+    if (rc->state == WIFI_RC_CONNECTED)
+    {
+        /* Link lost: the outage starts now, the first retry comes after base_ms */
+        rc->stats.link_losses++;
+        rc->down_since_ms = now_ms;
+        rc->consecutive_failures = 0;
+    }
+    else if (rc->state == WIFI_RC_CONNECTING)
+    {
+        rc->stats.failures++;
+        rc->consecutive_failures++;
+    }
+    else
+    {
+        /* Spurious event while already waiting: keep the current schedule */
+        return wifi_rc_reached(now_ms, rc->next_ms) ? 0 : rc->next_ms - now_ms;
+    }
+
+    uint32_t delay_ms = wifi_rc_delay(rc, rc->consecutive_failures);
+    rc->next_ms = now_ms + delay_ms;
+    rc->state = WIFI_RC_BACKOFF;
+    return delay_ms;
+}
+
+bool wifi_rc_poll(wifi_rc_t *rc, uint32_t now_ms, uint32_t last_activity_ms)
+{
+    if ((rc->state != WIFI_RC_BACKOFF && rc->state != WIFI_RC_DEFERRED) || !wifi_rc_reached(now_ms, rc->next_ms))
+    {
+        return false;
+    }
+
+    /* ESP-NOW has priority while commands arrive: wait until the window after the last one has closed */
+    if (rc->config.priority_window_ms != 0 && last_activity_ms != 0)
+    {
+        uint32_t window_end = last_activity_ms + rc->config.priority_window_ms;
+        if (!wifi_rc_reached(now_ms, window_end))
+        {
+            if (rc->state != WIFI_RC_DEFERRED)
+            {
+                rc->stats.deferred++;
+            }
+            rc->state = WIFI_RC_DEFERRED;
+            rc->next_ms = window_end;
+            return false;
+        }
+    }
+
+    rc->stats.attempts++;
+    rc->state = WIFI_RC_CONNECTING;
+    return true;
+}
+
+bool wifi_rc_next_ms(const wifi_rc_t *rc, uint32_t *next_ms)
+{
+    if (rc->state != WIFI_RC_BACKOFF && rc->state != WIFI_RC_DEFERRED)
+    {
+        return false;
+    }
+    *next_ms = rc->next_ms;
+    return true;
+}
+
+const char *wifi_rc_state_name(wifi_rc_state_t state)
+{
+    switch (state)
+    {
+        case WIFI_RC_IDLE:       return "idle";
+        case WIFI_RC_CONNECTING: return "connecting";
+        case WIFI_RC_CONNECTED:  return "connected";
+        case WIFI_RC_BACKOFF:    return "backoff";
+        case WIFI_RC_DEFERRED:   return "deferred";
+        default:                 return "?";
+    }
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static uint32_t wifi_rc_rand(wifi_rc_t *rc)
+{
+    uint32_t x = rc->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rc->rng = x;
+    return x;
+}
+
+static uint32_t wifi_rc_delay(wifi_rc_t *rc, uint32_t failures)
+{
+    /* base * 2^failures, stopping at the cap before the shift can overflow */
+    uint32_t delay_ms = rc->config.base_ms;
+    for (uint32_t i = 0; i < failures && delay_ms < rc->config.cap_ms; i++)
+    {
+        delay_ms = (delay_ms > rc->config.cap_ms / 2) ? rc->config.cap_ms : delay_ms * 2;
+    }
+    if (delay_ms > rc->config.cap_ms)
+    {
+        delay_ms = rc->config.cap_ms;
+    }
+
+    /* Scale by 1000 +/- jitter_permille, keep the result within the cap */
+    uint32_t span = 2u * rc->config.jitter_permille + 1u;
+    uint32_t factor = 1000u - rc->config.jitter_permille + (wifi_rc_rand(rc) % span);
+    uint64_t jittered = ((uint64_t)delay_ms * factor) / 1000u;
+    if (jittered > rc->config.cap_ms)
+    {
+        jittered = rc->config.cap_ms;
+    }
+    return (jittered != 0) ? (uint32_t)jittered : 1u;
+}
+
+static inline bool wifi_rc_reached(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) >= 0;
+}
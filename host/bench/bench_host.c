@@ -0,0 +1,244 @@
+/******************************************************************************
+ * @file bench_host.c
+ * @brief Host micro-benchmark runner for the shared hot-path kernels
+ *
+ * @details Runs every kernel from bench_kernels.h in a calibrated loop and
+ *          reports nanoseconds per operation. Each kernel is measured
+ *          BENCH_REPEATS times and the median is reported, which is stable
+ *          enough to compare against a stored baseline with
+ *          tools/bench_compare.py.
+ *
+ *          Usage: bench_host [--filter SUBSTRING] [--min-time-ms MS] [--json FILE]
+ *
+ *          A human readable table goes to stdout; --json additionally writes
+ *          the machine readable results.
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "bench_kernels.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Number of timed runs per kernel; the median is reported */
+#define BENCH_REPEATS 7
+
+/* Default minimum duration of one timed run */
+#define BENCH_DEFAULT_MIN_TIME_MS 50
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Loop around one kernel: runs it n times and returns the folded results
+ */
+typedef uint32_t (*bench_loop_fn_t)(bench_state_t *st, uint32_t n);
+
+/**
+ * @brief One benchmark case
+ */
+typedef struct
+{
+    const char      *name;
+    bench_loop_fn_t loop;
+} bench_case_t;
+
+/**
+ * @brief Result of one benchmark case
+ */
+typedef struct
+{
+    const char *name;
+    double      ns_per_op;      /* Median over BENCH_REPEATS runs */
+    double      ns_per_op_min;  /* Fastest run */
+    uint32_t    iterations;     /* Iterations per run */
+} bench_result_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Monotonic time in nanoseconds
+ */
+static uint64_t bench_now_ns(void);
+
+/**
+ * @brief Measure one case
+ *
+ * @param[in] bc Case to run
+ * @param[in] min_time_ns Minimum duration of one timed run
+ * @param[out] result Filled with the measurement
+ */
+static void bench_run_case(const bench_case_t *bc, uint64_t min_time_ns, bench_result_t *result);
+
+/**
+ * @brief qsort comparator for doubles
+ */
+static int bench_cmp_double(const void *a, const void *b);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static bench_state_t s_state;
+
+/* Results are folded into this so the compiler has to keep every kernel */
+static volatile uint32_t s_sink;
+
+/* One loop function per kernel */
+#define BENCH_DEFINE_LOOP(name)                                         \
+    static uint32_t bench_loop_##name(bench_state_t *st, uint32_t n)    \
+    {                                                                   \
+        uint32_t acc = 0;                                               \
+        for (uint32_t i = 0; i < n; i++)                                \
+        {                                                               \
+            acc += bench_kernel_##name(st, i);                          \
+        }                                                               \
+        return acc;                                                     \
+    }
+BENCH_KERNELS(BENCH_DEFINE_LOOP)
+#undef BENCH_DEFINE_LOOP
+
+#define BENCH_CASE_ENTRY(name) { #name, bench_loop_##name },
+static const bench_case_t s_cases[] =
+{
+    BENCH_KERNELS(BENCH_CASE_ENTRY)
+};
+#undef BENCH_CASE_ENTRY
+
+#define BENCH_NUM_CASES (sizeof(s_cases) / sizeof(s_cases[0]))
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL;
+    const char *json_path = NULL;
+    uint64_t min_time_ms = BENCH_DEFAULT_MIN_TIME_MS;
+
+    static const struct option options[] =
+    {
+        { "filter",      required_argument, NULL, 'f' },
+        { "min-time-ms", required_argument, NULL, 't' },
+        { "json",        required_argument, NULL, 'j' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'f': filter = optarg; break;
+            case 't': min_time_ms = strtoull(optarg, NULL, 0); break;
+            case 'j': json_path = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [--filter SUBSTRING] [--min-time-ms MS] [--json FILE]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    bench_result_t results[BENCH_NUM_CASES];
+    size_t num_results = 0;
+
+    printf("%-28s %12s %12s %12s\n", "kernel", "ns/op", "min ns/op", "iterations");
+    for (size_t i = 0; i < BENCH_NUM_CASES; i++)
+    {
+        if (filter != NULL && strstr(s_cases[i].name, filter) == NULL)
+        {
+            continue;
+        }
+
+        bench_result_t *r = &results[num_results++];
+        bench_run_case(&s_cases[i], min_time_ms * 1000000u, r);
+        printf("%-28s %12.2f %12.2f %12u\n", r->name, r->ns_per_op, r->ns_per_op_min, r->iterations);
+    }
+
+    if (json_path == NULL)
+    {
+        return 0;
+    }
+
+    FILE *f = fopen(json_path, "w");
+    if (f == NULL)
+    {
+        perror(json_path);
+        return 1;
+    }
+    fprintf(f, "{\n  \"format\": \"wave_rover_bench\",\n  \"version\": 1,\n  \"platform\": \"host\",\n  \"unit\": \"ns\",\n  \"results\": [\n");
+    for (size_t i = 0; i < num_results; i++)
+    {
+        fprintf(f, "    {\"name\": \"%s\", \"value\": %.3f, \"min\": %.3f, \"iterations\": %u}%s\n",
+                results[i].name, results[i].ns_per_op, results[i].ns_per_op_min, results[i].iterations,
+                (i + 1 < num_results) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return 0;
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_run_case(const bench_case_t *bc, uint64_t min_time_ns, bench_result_t *result)
+{
+    double samples[BENCH_REPEATS];
+
+    /* #01 - Fresh state for every case so kernels don't see each other's leftovers */
+    bench_state_init(&s_state);
+
+    /* #02 - Calibrate: grow the iteration count until one run takes min_time_ns */
+    uint32_t n = 1;
+    while (true)
+    {
+        uint64_t start = bench_now_ns();
+        s_sink += bc->loop(&s_state, n);
+        uint64_t elapsed = bench_now_ns() - start;
+        if (elapsed >= min_time_ns || n >= (UINT32_MAX / 2u))
+        {
+            break;
+        }
+        n *= 2u;
+    }
+
+    /* #03 - Timed runs */
+    for (int rep = 0; rep < BENCH_REPEATS; rep++)
+    {
+        uint64_t start = bench_now_ns();
+        s_sink += bc->loop(&s_state, n);
+        uint64_t elapsed = bench_now_ns() - start;
+        samples[rep] = (double)elapsed / (double)n;
+    }
+
+    qsort(samples, BENCH_REPEATS, sizeof(samples[0]), bench_cmp_double);
+    result->name = bc->name;
+    result->ns_per_op = samples[BENCH_REPEATS / 2];
+    result->ns_per_op_min = samples[0];
+    result->iterations = n;
+}
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
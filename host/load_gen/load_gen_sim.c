@@ -0,0 +1,257 @@
+/******************************************************************************
+ * @file load_gen_sim.c
+ * @brief Host simulator for the multi-peer ESP-NOW traffic generator
+ *
+ * @details Feeds the firmware's peer scheduler (load_gen_core) into a model of
+ *          the receive path: a bounded FIFO drained by a single consumer with a
+ *          per-frame cost of service_us + len * ns_per_byte. This mirrors the
+ *          firmware load generator, where the injector task drains a queue of
+ *          LOAD_GEN_QUEUE_DEPTH frames. Calibrate the cost model with the numbers
+ *          from a firmware run (env:seeed_xiao_esp32c6_loadgen), then use the
+ *          simulator to predict where the receive path saturates.
+ *
+ *          Usage: load_gen_sim [--peers N] [--rate HZ] [--large-pct P]
+ *                              [--small-len B] [--large-len B] [--duration-ms MS]
+ *                              [--seed S] [--queue-depth D] [--service-us US]
+ *                              [--ns-per-byte NS] [--sweep]
+ *
+ *          Prints one JSON object per run (a JSON array with --sweep, which
+ *          repeats the run for 1..N peers).
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "load_gen_core.h"
+
+/*******************************************************************************/
+/*                                  MACROS                                     */
+/*******************************************************************************/
+
+/* Queue capacity the simulator can model */
+#define SIM_MAX_QUEUE_DEPTH 1024
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Cost model of the consumer draining the queue
+ */
+typedef struct
+{
+    uint32_t queue_depth;   /* Capacity of the receive queue */
+    uint32_t service_us;    /* Fixed cost per frame (dispatch, callback, logging) */
+    uint32_t ns_per_byte;   /* Additional cost per payload byte */
+} sim_model_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Run one simulation
+ *
+ * @param[in] cfg Traffic shape
+ * @param[in] model Receive path model
+ * @param[out] report Result of the run
+ */
+static void sim_run(const lg_config_t *cfg, const sim_model_t *model, lg_report_t *report);
+
+/**
+ * @brief Print one run as a JSON object
+ *
+ * @param[in] cfg Traffic shape
+ * @param[in] report Result of the run
+ */
+static void sim_print_json(const lg_config_t *cfg, const lg_report_t *report);
+
+/*******************************************************************************/
+/*                             STATIC VARIABLES                                */
+/*******************************************************************************/
+static lg_sched_t s_sched;
+static lg_hist_t s_hist;
+
+/* Service start times of the frames currently held in the queue (ring buffer) */
+static uint64_t s_queue_start_us[SIM_MAX_QUEUE_DEPTH];
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    lg_config_t cfg =
+    {
+        .num_peers = 20,
+        .rate_hz = 50,
+        .large_frame_pct = 10,
+        .small_len = 16,
+        .large_len = 200,
+        .duration_ms = 30000,
+        .seed = 1
+    };
+    sim_model_t model =
+    {
+        .queue_depth = 32,
+        .service_us = 40,
+        .ns_per_byte = 8
+    };
+    int sweep = 0;
+
+    static const struct option options[] =
+    {
+        { "peers",       required_argument, NULL, 'n' },
+        { "rate",        required_argument, NULL, 'r' },
+        { "large-pct",   required_argument, NULL, 'p' },
+        { "small-len",   required_argument, NULL, 's' },
+        { "large-len",   required_argument, NULL, 'l' },
+        { "duration-ms", required_argument, NULL, 'd' },
+        { "seed",        required_argument, NULL, 'S' },
+        { "queue-depth", required_argument, NULL, 'q' },
+        { "service-us",  required_argument, NULL, 'c' },
+        { "ns-per-byte", required_argument, NULL, 'b' },
+        { "sweep",       no_argument,       NULL, 'w' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        unsigned long value = (optarg != NULL) ? strtoul(optarg, NULL, 0) : 0;
+        switch (opt)
+        {
+            case 'n': cfg.num_peers = (uint8_t)value; break;
+            case 'r': cfg.rate_hz = (uint16_t)value; break;
+            case 'p': cfg.large_frame_pct = (uint8_t)value; break;
+            case 's': cfg.small_len = (uint8_t)value; break;
+            case 'l': cfg.large_len = (uint8_t)value; break;
+            case 'd': cfg.duration_ms = (uint32_t)value; break;
+            case 'S': cfg.seed = (uint32_t)value; break;
+            case 'q': model.queue_depth = (uint32_t)value; break;
+            case 'c': model.service_us = (uint32_t)value; break;
+            case 'b': model.ns_per_byte = (uint32_t)value; break;
+            case 'w': sweep = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [--peers N] [--rate HZ] [--large-pct P] [--small-len B] [--large-len B]\n"
+                                "       [--duration-ms MS] [--seed S] [--queue-depth D] [--service-us US]\n"
+                                "       [--ns-per-byte NS] [--sweep]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (model.queue_depth == 0 || model.queue_depth > SIM_MAX_QUEUE_DEPTH)
+    {
+        fprintf(stderr, "queue depth must be 1..%d\n", SIM_MAX_QUEUE_DEPTH);
+        return 2;
+    }
+    if (cfg.num_peers == 0 || cfg.num_peers > LG_MAX_PEERS)
+    {
+        fprintf(stderr, "peers must be 1..%d\n", LG_MAX_PEERS);
+        return 2;
+    }
+
+    lg_report_t report;
+    if (!sweep)
+    {
+        sim_run(&cfg, &model, &report);
+        sim_print_json(&cfg, &report);
+        printf("\n");
+        return 0;
+    }
+
+    /* Sweep: same traffic shape for 1..num_peers peers */
+    uint8_t max_peers = cfg.num_peers;
+    printf("[\n");
+    for (uint8_t n = 1; n <= max_peers; n++)
+    {
+        cfg.num_peers = n;
+        sim_run(&cfg, &model, &report);
+        sim_print_json(&cfg, &report);
+        printf("%s\n", (n < max_peers) ? "," : "");
+    }
+    printf("]\n");
+    return 0;
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void sim_run(const lg_config_t *cfg, const sim_model_t *model, lg_report_t *report)
+{
+    lg_frame_t frame;
+    uint32_t head = 0;          /* Oldest queued frame */
+    uint32_t count = 0;         /* Frames still waiting for the consumer */
+    uint64_t consumer_free_us = 0;
+    uint64_t last_done_us = 0;
+
+    memset(report, 0, sizeof(*report));
+    report->queue_depth = model->queue_depth;
+    lg_hist_reset(&s_hist);
+    lg_sched_init(&s_sched, cfg, 0);
+
+    /* Frames come out of the scheduler in due-time order, so a single pass is enough */
+    while (lg_sched_next(&s_sched, UINT64_MAX, &frame))
+    {
+        uint64_t now_us = frame.due_us;
+        report->frames_offered++;
+
+        /* #01 - Everything the consumer has picked up by now has left the queue */
+        while (count > 0 && s_queue_start_us[head] < now_us)
+        {
+            head = (head + 1u) % model->queue_depth;
+            count--;
+        }
+
+        /* #02 - Full queue: the frame is lost, just like xQueueSend(..., 0) failing */
+        if (count >= model->queue_depth)
+        {
+            report->frames_dropped++;
+            continue;
+        }
+
+        /* #03 - Queue the frame and work out when the consumer gets to it */
+        uint64_t start_us = (consumer_free_us > now_us) ? consumer_free_us : now_us;
+        uint64_t done_us = start_us + model->service_us + ((uint64_t)frame.len * model->ns_per_byte) / 1000u;
+        consumer_free_us = done_us;
+
+        s_queue_start_us[(head + count) % model->queue_depth] = start_us;
+        count++;
+        if (count > report->queue_hwm)
+        {
+            report->queue_hwm = count;
+        }
+
+        lg_hist_record(&s_hist, (uint32_t)(done_us - now_us));
+        report->frames_delivered++;
+        report->bytes_delivered += frame.len;
+        last_done_us = done_us;
+    }
+
+    /* The run lasts until the configured end or until the backlog has drained */
+    uint64_t end_us = (uint64_t)cfg->duration_ms * 1000u;
+    report->duration_us = (uint32_t)((last_done_us > end_us) ? last_done_us : end_us);
+    lg_report_fill_latency(&s_hist, report);
+}
+
+static void sim_print_json(const lg_config_t *cfg, const lg_report_t *report)
+{
+    uint64_t duration_ms = report->duration_us / 1000u;
+    uint64_t fps = (duration_ms != 0) ? (uint64_t)report->frames_delivered * 1000u / duration_ms : 0;
+
+    printf("{\"peers\": %u, \"rate_hz\": %u, \"large_pct\": %u, \"duration_us\": %u, "
+           "\"offered\": %u, \"delivered\": %u, \"dropped\": %u, \"bytes\": %u, \"frames_per_s\": %llu, "
+           "\"queue_hwm\": %u, \"queue_depth\": %u, "
+           "\"latency_us\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u, \"avg\": %u}}",
+           cfg->num_peers, cfg->rate_hz, cfg->large_frame_pct, report->duration_us,
+           report->frames_offered, report->frames_delivered, report->frames_dropped,
+           report->bytes_delivered, (unsigned long long)fps,
+           report->queue_hwm, report->queue_depth,
+           report->latency_p50_us, report->latency_p90_us, report->latency_p99_us,
+           report->latency_max_us, report->latency_avg_us);
+}
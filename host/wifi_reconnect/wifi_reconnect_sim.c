@@ -0,0 +1,264 @@
+/******************************************************************************
+ * @file wifi_reconnect_sim.c
+ * @brief Host simulator for the WiFi reconnect scheduler
+ *
+ * @details Drives the firmware's scheduler (wifi_reconnect) from a scripted fake
+ *          event source instead of the WiFi driver: the AP disappears at
+ *          --ap-down-at for --ap-outage-ms, every attempt takes --connect-ms
+ *          and succeeds only while the AP is up, and ESP-NOW commands arrive
+ *          every --cmd-period-ms between --drive-from and --drive-to (the rover
+ *          being driven). Time advances in 1 ms steps.
+ *
+ *          Usage: wifi_reconnect_sim [--duration-ms MS] [--ap-down-at MS]
+ *                                    [--ap-outage-ms MS] [--connect-ms MS]
+ *                                    [--drive-from MS] [--drive-to MS]
+ *                                    [--cmd-period-ms MS] [--base-ms MS]
+ *                                    [--cap-ms MS] [--jitter PERMILLE]
+ *                                    [--window-ms MS] [--seed S] [--trace]
+ *
+ *          Prints one JSON object with the scheduler counters and the
+ *          reconnect delay after the AP came back; --trace prints every event
+ *          to stderr. Exits with 1 if an invariant is broken: an attempt inside
+ *          the priority window, a delay above the cap, two attempts in flight,
+ *          or no reconnect after the outage.
+ *
+ ******************************************************************************/
+
+/*******************************************************************************/
+/*                                 INCLUDES                                    */
+/*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include "wifi_reconnect.h"
+
+/*******************************************************************************/
+/*                                DATA TYPES                                   */
+/*******************************************************************************/
+
+/**
+ * @brief Script of the fake event source
+ */
+typedef struct
+{
+    uint32_t duration_ms;       /* Length of the run */
+    uint32_t ap_down_at_ms;     /* The AP disappears here ... */
+    uint32_t ap_outage_ms;      /* ... for this long */
+    uint32_t connect_ms;        /* Time from esp_wifi_connect() to connected / disconnected */
+    uint32_t drive_from_ms;     /* ESP-NOW commands arrive from here ... */
+    uint32_t drive_to_ms;       /* ... until here */
+    uint32_t cmd_period_ms;     /* Command period while driving, 0 = no commands */
+    bool     trace;             /* Print every event to stderr */
+} sim_script_t;
+
+/**
+ * @brief Result of a run
+ */
+typedef struct
+{
+    uint32_t max_delay_ms;          /* Longest scheduled delay */
+    uint32_t attempts_in_window;    /* Attempts started inside the priority window (must be 0) */
+    uint32_t overlapping;           /* Attempts started while one was in flight (must be 0) */
+    uint32_t recovered_after_ms;    /* AP back to connected, UINT32_MAX if never */
+} sim_result_t;
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DECLARATIONS                            */
+/*******************************************************************************/
+/**
+ * @brief Run the script against a scheduler
+ *
+ * @param[in] script Fake event source
+ * @param[in,out] rc Initialized scheduler
+ * @param[out] result Checks of the run
+ */
+static void sim_run(const sim_script_t *script, wifi_rc_t *rc, sim_result_t *result);
+
+/**
+ * @brief true if the AP is reachable at the given time
+ */
+static bool sim_ap_up(const sim_script_t *script, uint32_t now_ms);
+
+/*******************************************************************************/
+/*                     GLOBAL FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    sim_script_t script =
+    {
+        .duration_ms = 180000,
+        .ap_down_at_ms = 10000,
+        .ap_outage_ms = 60000,
+        .connect_ms = 1500,
+        .drive_from_ms = 65000,
+        .drive_to_ms = 80000,
+        .cmd_period_ms = 50,
+        .trace = false
+    };
+    wifi_rc_config_t config = WIFI_RC_DEFAULT_CONFIG();
+    uint32_t seed = 1;
+
+    static const struct option options[] =
+    {
+        { "duration-ms",   required_argument, NULL, 'd' },
+        { "ap-down-at",    required_argument, NULL, 'a' },
+        { "ap-outage-ms",  required_argument, NULL, 'o' },
+        { "connect-ms",    required_argument, NULL, 'c' },
+        { "drive-from",    required_argument, NULL, 'f' },
+        { "drive-to",      required_argument, NULL, 't' },
+        { "cmd-period-ms", required_argument, NULL, 'p' },
+        { "base-ms",       required_argument, NULL, 'b' },
+        { "cap-ms",        required_argument, NULL, 'C' },
+        { "jitter",        required_argument, NULL, 'j' },
+        { "window-ms",     required_argument, NULL, 'w' },
+        { "seed",          required_argument, NULL, 'S' },
+        { "trace",         no_argument,       NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        unsigned long value = (optarg != NULL) ? strtoul(optarg, NULL, 0) : 0;
+        switch (opt)
+        {
+            case 'd': script.duration_ms = (uint32_t)value; break;
+            case 'a': script.ap_down_at_ms = (uint32_t)value; break;
+            case 'o': script.ap_outage_ms = (uint32_t)value; break;
+            case 'c': script.connect_ms = (uint32_t)value; break;
+            case 'f': script.drive_from_ms = (uint32_t)value; break;
+            case 't': script.drive_to_ms = (uint32_t)value; break;
+            case 'p': script.cmd_period_ms = (uint32_t)value; break;
+            case 'b': config.base_ms = (uint32_t)value; break;
+            case 'C': config.cap_ms = (uint32_t)value; break;
+            case 'j': config.jitter_permille = (uint16_t)value; break;
+            case 'w': config.priority_window_ms = (uint32_t)value; break;
+            case 'S': seed = (uint32_t)value; break;
+            case 'T': script.trace = true; break;
+            default:
+                fprintf(stderr, "usage: %s [--duration-ms MS] [--ap-down-at MS] [--ap-outage-ms MS] [--connect-ms MS]\n"
+                                "       [--drive-from MS] [--drive-to MS] [--cmd-period-ms MS] [--base-ms MS]\n"
+                                "       [--cap-ms MS] [--jitter PERMILLE] [--window-ms MS] [--seed S] [--trace]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (script.connect_ms == 0)
+    {
+        fprintf(stderr, "connect time must be at least 1 ms\n");
+        return 2;
+    }
+
+    wifi_rc_t rc;
+    sim_result_t result;
+    wifi_rc_init(&rc, &config, seed);
+    sim_run(&script, &rc, &result);
+
+    bool ok = (result.attempts_in_window == 0) && (result.overlapping == 0) &&
+              (result.max_delay_ms <= rc.config.cap_ms) && (result.recovered_after_ms != UINT32_MAX);
+    printf("{\"base_ms\": %u, \"cap_ms\": %u, \"jitter_permille\": %u, \"window_ms\": %u, "
+           "\"attempts\": %u, \"failures\": %u, \"connects\": %u, \"link_losses\": %u, \"deferred\": %u, "
+           "\"last_outage_ms\": %u, \"max_outage_ms\": %u, \"max_delay_ms\": %u, "
+           "\"recovered_after_ms\": %d, \"attempts_in_window\": %u, \"overlapping\": %u, \"ok\": %s}\n",
+           rc.config.base_ms, rc.config.cap_ms, rc.config.jitter_permille, rc.config.priority_window_ms,
+           rc.stats.attempts, rc.stats.failures, rc.stats.connects, rc.stats.link_losses, rc.stats.deferred,
+           rc.stats.last_outage_ms, rc.stats.max_outage_ms, result.max_delay_ms,
+           (result.recovered_after_ms == UINT32_MAX) ? -1 : (int)result.recovered_after_ms,
+           result.attempts_in_window, result.overlapping, ok ? "true" : "false");
+    return ok ? 0 : 1;
+}
+
+/*******************************************************************************/
+/*                     STATIC FUNCTION DEFINITIONS                             */
+/*******************************************************************************/
+
+static void sim_run(const sim_script_t *script, wifi_rc_t *rc, sim_result_t *result)
+{
+    uint32_t ap_up_at_ms = script->ap_down_at_ms + script->ap_outage_ms;
+    uint32_t last_cmd_ms = 0;
+    uint32_t attempt_done_ms = 0;   /* End of the attempt in flight, 0 if none */
+    bool connected = false;
+
+    result->max_delay_ms = 0;
+    result->attempts_in_window = 0;
+    result->overlapping = 0;
+    result->recovered_after_ms = UINT32_MAX;
+
+    /* Time starts at 1: 0 means "no ESP-NOW activity yet" to the scheduler */
+    wifi_rc_start(rc, 1);
+    for (uint32_t now_ms = 1; now_ms <= script->duration_ms; now_ms++)
+    {
+        /* #01 - ESP-NOW commands while the rover is driven */
+        if (script->cmd_period_ms != 0 && now_ms >= script->drive_from_ms && now_ms < script->drive_to_ms &&
+            (now_ms - script->drive_from_ms) % script->cmd_period_ms == 0)
+        {
+            last_cmd_ms = now_ms;
+        }
+
+        /* #02 - The AP going away drops an established link at once */
+        if (connected && !sim_ap_up(script, now_ms))
+        {
+            connected = false;
+            uint32_t delay_ms = wifi_rc_on_disconnected(rc, now_ms);
+            result->max_delay_ms = (delay_ms > result->max_delay_ms) ? delay_ms : result->max_delay_ms;
+            if (script->trace)
+            {
+                fprintf(stderr, "%8u link lost, retry in %u ms\n", now_ms, delay_ms);
+            }
+        }
+
+        /* #03 - The attempt in flight completes */
+        if (attempt_done_ms != 0 && now_ms >= attempt_done_ms)
+        {
+            attempt_done_ms = 0;
+            if (sim_ap_up(script, now_ms))
+            {
+                connected = true;
+                wifi_rc_on_connected(rc, now_ms);
+                if (now_ms >= ap_up_at_ms && result->recovered_after_ms == UINT32_MAX)
+                {
+                    result->recovered_after_ms = now_ms - ap_up_at_ms;
+                }
+                if (script->trace)
+                {
+                    fprintf(stderr, "%8u connected (outage %u ms)\n", now_ms, rc->stats.last_outage_ms);
+                }
+            }
+            else
+            {
+                uint32_t delay_ms = wifi_rc_on_disconnected(rc, now_ms);
+                result->max_delay_ms = (delay_ms > result->max_delay_ms) ? delay_ms : result->max_delay_ms;
+                if (script->trace)
+                {
+                    fprintf(stderr, "%8u attempt failed (%u in a row), retry in %u ms\n",
+                            now_ms, rc->consecutive_failures, delay_ms);
+                }
+            }
+        }
+
+        /* #04 - The firmware timer fires at the scheduled time, polling every tick is equivalent */
+        if (wifi_rc_poll(rc, now_ms, last_cmd_ms))
+        {
+            if (attempt_done_ms != 0 || connected)
+            {
+                result->overlapping++;
+            }
+            if (last_cmd_ms != 0 && rc->config.priority_window_ms != 0 &&
+                now_ms - last_cmd_ms < rc->config.priority_window_ms)
+            {
+                result->attempts_in_window++;
+            }
+            attempt_done_ms = now_ms + script->connect_ms;
+            if (script->trace)
+            {
+                fprintf(stderr, "%8u attempt %u\n", now_ms, rc->stats.attempts);
+            }
+        }
+    }
+}
+
+static bool sim_ap_up(const sim_script_t *script, uint32_t now_ms)
+{
+    return now_ms < script->ap_down_at_ms || now_ms >= script->ap_down_at_ms + script->ap_outage_ms;
+}
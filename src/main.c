@@ -9,6 +9,7 @@
 /*******************************************************************************/
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -16,19 +17,50 @@
 #include "esp_netif.h"
 #include "esp_event.h"
 #include "nvs_flash.h"
+#include "sdkconfig.h"
 #include "esp_now_comm.h"
 #include "esp_now_comm_callbacks.h"
 #include "wifi_manager.h"
+#include "load_gen.h"
+#include "bench_target.h"
+#include "latency_probe.h"
+#include "deferred_log.h"
+#include "flight_recorder.h"
+#include "trace.h"
+#include "sys_monitor.h"
+#include "prof.h"
+#include "heap_monitor.h"
+#include "esp_now_comm_protocol.h"
+#include "esp_now_comm_diag.h"
+#include "esp_now_comm_echo.h"
+#include "esp_now_comm_pairing.h"
+#include "esp_now_comm_lease.h"
 
 /*******************************************************************************/
 /*                                  MACROS                                     */
 /*******************************************************************************/
 #define TAG "MAIN"
 
+/* Diagnostics config topic: entries per page and longest key */
+#define DIAG_CONFIG_PER_PAGE 8
+#define DIAG_CONFIG_KEY_MAX  23
+
+_Static_assert(DIAG_CONFIG_PER_PAGE * (1 + DIAG_CONFIG_KEY_MAX + 4) <= ESP_NOW_DIAG_PAGE_MAX,
+               "A page of config entries must fit one diagnostics reply");
+
 /*******************************************************************************/
 /*                                DATA TYPES                                   */
 /*******************************************************************************/
 
+/**
+ * @brief One value reported by the diagnostics config topic
+ */
+typedef struct
+{
+    const char *key;
+    int32_t value;
+} diag_config_entry_t;
+
 /*******************************************************************************/
 /*                     GLOBAL FUNCTION DECLARATIONS                            */
 /*******************************************************************************/
@@ -56,6 +88,73 @@
  */
 static esp_err_t initialize_components(void);
 
+/**
+ * @brief Deferred log sink: send a record frame to all ESP-NOW peers
+ *
+ * @param[in] frame Record frame built by the deferred logger
+ * @param[in] len Frame length
+ *
+ * @return Result of esp_now_comm_send()
+ */
+static esp_err_t dlog_sink_espnow(const uint8_t *frame, size_t len);
+
+/**
+ * @brief System monitor sink: send a report to all ESP-NOW peers as telemetry
+ *
+ * @param[in] report Report built by the system monitor
+ * @param[in] len Report length
+ *
+ * @return Result of esp_now_comm_send()
+ */
+static esp_err_t sys_monitor_sink_espnow(const uint8_t *report, size_t len);
+
+/**
+ * @brief WiFi manager channel callbacks: announce a planned switch / move the peers after a change
+ *
+ * @param[in] new_channel Channel the radio is / will be on
+ * @param[in] old_channel Channel it leaves
+ */
+static void wifi_channel_leaving(uint8_t new_channel, uint8_t old_channel);
+static void wifi_channel_changed(uint8_t new_channel, uint8_t old_channel);
+
+/**
+ * @brief Send a diagnostics payload to all ESP-NOW peers, prefixed with its message ID
+ *
+ * @param[in] msg_id Message ID from esp_now_comm_protocol.h
+ * @param[in] payload Message payload
+ * @param[in] len Payload length
+ *
+ * @return
+ *      - ESP_ERR_INVALID_SIZE if the message does not fit one frame
+ *      - Result of esp_now_comm_send() otherwise
+ */
+static esp_err_t send_diag_to_peers(uint8_t msg_id, const uint8_t *payload, size_t len);
+
+/**
+ * @brief Diagnostics providers (see esp_now_comm_diag_provider_t)
+ *
+ * @details histograms: one latency_probe_serialize() stage per page;
+ *          tasks: the last sys_monitor_serialize() report;
+ *          config: entries of u8 key length, key, i32 value;
+ *          events: flight_recorder_dump_page() pages;
+ *          profile: u16 cpu_mhz, then prof_serialize() sites;
+ *          wifi: wifi_manager_serialize_disconnect_stats() report.
+ */
+static esp_err_t diag_provide_histograms(uint16_t page, uint8_t *buf, size_t len,
+                                         size_t *out_len, uint16_t *page_count);
+static esp_err_t diag_provide_tasks(uint16_t page, uint8_t *buf, size_t len,
+                                    size_t *out_len, uint16_t *page_count);
+static esp_err_t diag_provide_config(uint16_t page, uint8_t *buf, size_t len,
+                                     size_t *out_len, uint16_t *page_count);
+static esp_err_t diag_provide_events(uint16_t page, uint8_t *buf, size_t len,
+                                     size_t *out_len, uint16_t *page_count);
+static esp_err_t diag_provide_wifi(uint16_t page, uint8_t *buf, size_t len,
+                                   size_t *out_len, uint16_t *page_count);
+#if PROF_ENABLED
+static esp_err_t diag_provide_profile(uint16_t page, uint8_t *buf, size_t len,
+                                      size_t *out_len, uint16_t *page_count);
+#endif
+
 /*******************************************************************************/
 /*                             STATIC VARIABLES                                */
 /*******************************************************************************/
@@ -66,6 +165,13 @@ static esp_err_t initialize_components(void);
 
 void app_main(void)
 {
+#if BENCH_APP
+    /* Benchmark build: time the hot-path kernels on the bare target, no radio, no driver */
+    (void)bench_target_run();
+    deferred_log_measure_cost(200);
+    return;
+#endif
+
     /* Initialize all system components */
     esp_err_t ret = initialize_components();
     if (ret != ESP_OK) 
@@ -74,12 +180,68 @@ void app_main(void)
         return;
     }
 
-    /* Main application loop */
+    /* Steady state from here on: every further heap allocation is accounted, hot-path ones are flagged */
+    (void)heap_monitor_start();
+
+#if LOAD_GEN_ENABLED
+    /* Soak/scaling build: drive the receive path with simulated peers */
+    lg_config_t load_gen_config = LOAD_GEN_DEFAULT_CONFIG();
+    ret = load_gen_start(&load_gen_config);
+    if (ret != ESP_OK) 
+    {
+        ESP_LOGE(TAG, "Failed to start load generator: %s", esp_err_to_name(ret));
+    }
+#endif
+
+    /* Main application loop: system monitor and periodic diagnostics */
+    static sys_monitor_snapshot_t sys_snapshot;
+    bool flight_recorder_dumped = false;
     while (true) 
     {
-        /* Log a periodic message to indicate device is operational */
-        ESP_LOGI(TAG, "Main function, checking in...");
-        vTaskDelay(pdMS_TO_TICKS(10000));
+        /* Print the black-box history once after it froze on a fault */
+        if (flight_recorder_is_frozen() && !flight_recorder_dumped) 
+        {
+            flight_recorder_dump_console();
+            flight_recorder_dumped = true;
+        }
+        else if (!flight_recorder_is_frozen()) 
+        {
+            flight_recorder_dumped = false;
+        }
+
+        TRACE_BEGIN(TRACE_EV_MAIN_LOOP);
+        /* Sample task CPU, stacks, heap and ISR load; warns on its own and publishes to the peers */
+        (void)sys_monitor_sample(&sys_snapshot);
+        sys_monitor_print(&sys_snapshot);
+        (void)heap_monitor_sample(NULL);
+        heap_monitor_print();
+        esp_now_comm_print_stats();
+        wifi_manager_print_connect_stats();
+        wifi_manager_print_disconnect_stats();
+        wifi_manager_print_radio_stats();
+        esp_now_comm_echo_print();
+        esp_now_comm_pairing_print();
+        esp_now_comm_lease_print();
+        deferred_log_print_stats();
+#if LATENCY_PROBE_ENABLED
+        latency_probe_print();
+#endif
+#if LOAD_GEN_ENABLED
+        if (load_gen_is_running()) 
+        {
+            load_gen_print_report();
+        }
+#endif
+        TRACE_END(TRACE_EV_MAIN_LOOP);
+#if TRACE_ENABLED
+        /* Trace build: print the timeline of the last period for tools/trace_to_chrome.py */
+        trace_dump_console();
+#endif
+#if PROF_ENABLED
+        /* Profiling build: cycles per site over the last period */
+        prof_dump_console(true);
+#endif
+        vTaskDelay(pdMS_TO_TICKS(SYS_MONITOR_PERIOD_MS));
     }
 }
 
@@ -89,6 +251,23 @@ void app_main(void)
 
 static esp_err_t initialize_components(void)
 {
+    /******************************* Flight Recorder *******************************/
+    /* First, so that the boot and everything after it is on record (or the previous crash is kept) */
+    (void)flight_recorder_init();
+
+    /******************************* Deferred Logger *******************************/
+    /* Started first so that the hot paths of the components below can log right away */
+    esp_err_t dlog_err = deferred_log_init();
+    if (dlog_err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Deferred logger initialization failed: %s", esp_err_to_name(dlog_err));
+    }
+    deferred_log_set_sink(dlog_sink_espnow);
+    sys_monitor_set_sink(sys_monitor_sink_espnow);
+#if DEFERRED_LOG_SHIP
+    deferred_log_set_output(DEFERRED_LOG_OUTPUT_CONSOLE | DEFERRED_LOG_OUTPUT_SINK);
+#endif
+
     /******************************* NVS Flash *******************************/
     ESP_LOGI(TAG, "Initializing NVS Flash...");
     esp_err_t nvs_err = nvs_flash_init();
@@ -151,7 +330,18 @@ static esp_err_t initialize_components(void)
 
     /******************************* WiFi Initialization *******************************/
     ESP_LOGI(TAG, "Initializing WiFi...");
-    esp_err_t wifi_err = wifi_manager_init(NULL);
+    /* ESP-NOW peers follow the radio when the AP (or a test) moves it to another channel */
+    const wifi_manager_callbacks_t wifi_callbacks =
+    {
+        .on_channel_leaving = wifi_channel_leaving,
+        .on_channel_change = wifi_channel_changed,
+    };
+#if WIFI_MANAGER_BLOCKING_INIT
+    esp_err_t wifi_err = wifi_manager_init(&wifi_callbacks);
+#else
+    /* Returns once the driver runs: ESP-NOW comes up now, the AP connection completes in the background */
+    esp_err_t wifi_err = wifi_manager_start(&wifi_callbacks);
+#endif
     if (wifi_err != ESP_OK)
     {
         ESP_LOGI(TAG, "WiFi initialization failed: %s", esp_err_to_name(wifi_err)); // Log the error but continue execution
@@ -188,18 +378,232 @@ static esp_err_t initialize_components(void)
     esp_wifi_get_channel(&primary_ch, &secondary_ch);
     ESP_LOGI(TAG, "Device operating on WiFi channel: %d", primary_ch);
 
-    /* Add the MAC address of the wave_rover_driver device as ESP-NOW peer */
-    uint8_t wave_rover_driver_mac[] = {0xD8, 0x13, 0x2A, 0x2F, 0x3C, 0xE4};
-    ESP_LOGI(TAG, "Adding wave_rover_driver peer...");
-    ret = esp_now_comm_add_peer(wave_rover_driver_mac);
+    /* Controllers paired before are registered from NVS right away; new ones pair through a broadcast beacon */
+    ret = esp_now_comm_pairing_init();
     if (ret != ESP_OK) 
     {
-        ESP_LOGE(TAG, "Failed to add peer: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to start pairing: %s", esp_err_to_name(ret));
         return ret;
     }
-    ESP_LOGI(TAG, "Controller peer added successfully");
+
+    /* Link round-trip benchmark: requests every ESP_NOW_COMM_ECHO_INTERVAL_MS (echo build), answers always */
+    ret = esp_now_comm_echo_start(ESP_NOW_COMM_ECHO_INTERVAL_MS);
+    if (ret != ESP_OK) 
+    {
+        ESP_LOGE(TAG, "Failed to start echo requests: %s", esp_err_to_name(ret));
+    }
+
+    /************************ Remote Diagnostics ***********************/
+    ret = esp_now_comm_diag_init();
+    if (ret != ESP_OK) 
+    {
+        ESP_LOGE(TAG, "Failed to start diagnostics service: %s", esp_err_to_name(ret));
+    }
+    (void)esp_now_comm_diag_register(ESP_NOW_DIAG_TOPIC_HISTOGRAMS, diag_provide_histograms);
+    (void)esp_now_comm_diag_register(ESP_NOW_DIAG_TOPIC_TASKS, diag_provide_tasks);
+    (void)esp_now_comm_diag_register(ESP_NOW_DIAG_TOPIC_CONFIG, diag_provide_config);
+    (void)esp_now_comm_diag_register(ESP_NOW_DIAG_TOPIC_EVENTS, diag_provide_events);
+    (void)esp_now_comm_diag_register(ESP_NOW_DIAG_TOPIC_WIFI, diag_provide_wifi);
+#if PROF_ENABLED
+    (void)esp_now_comm_diag_register(ESP_NOW_DIAG_TOPIC_PROFILE, diag_provide_profile);
+#endif
     
     ESP_LOGI(TAG, "All components initialized successfully");
     return ESP_OK;
 }
 
+static esp_err_t dlog_sink_espnow(const uint8_t *frame, size_t len)
+{
+    return send_diag_to_peers(ESP_NOW_MSG_DLOG_RECORDS, frame, len);
+}
+
+static esp_err_t sys_monitor_sink_espnow(const uint8_t *report, size_t len)
+{
+    return send_diag_to_peers(ESP_NOW_MSG_SYSMON_REPORT, report, len);
+}
+
+static void wifi_channel_leaving(uint8_t new_channel, uint8_t old_channel)
+{
+    (void)esp_now_comm_notify_channel(new_channel, old_channel);
+}
+
+static void wifi_channel_changed(uint8_t new_channel, uint8_t old_channel)
+{
+    (void)esp_now_comm_resync_channel(new_channel, old_channel);
+}
+
+static esp_err_t send_diag_to_peers(uint8_t msg_id, const uint8_t *payload, size_t len)
+{
+    uint8_t frame[ESP_NOW_COMM_PAYLOAD_SIZE];
+    if (len + 1 > sizeof(frame))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    frame[0] = msg_id;
+    memcpy(&frame[1], payload, len);
+    return esp_now_comm_send(NULL, frame, (int)(len + 1));
+}
+
+static esp_err_t diag_provide_histograms(uint16_t page, uint8_t *buf, size_t len,
+                                         size_t *out_len, uint16_t *page_count)
+{
+    /* The reference stage has no histogram of its own */
+    *page_count = LATENCY_STAGE_COUNT - 1;
+    if (page >= *page_count)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *out_len = latency_probe_serialize((latency_stage_t)(LATENCY_STAGE_RECV_CB + 1 + page), buf, len);
+    return (*out_len != 0) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t diag_provide_tasks(uint16_t page, uint8_t *buf, size_t len,
+                                    size_t *out_len, uint16_t *page_count)
+{
+    static sys_monitor_snapshot_t snapshot;
+
+    *page_count = 1;
+    if (page != 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret = sys_monitor_get_last(&snapshot);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    *out_len = sys_monitor_serialize(&snapshot, buf, len);
+    return ESP_OK;
+}
+
+static esp_err_t diag_provide_config(uint16_t page, uint8_t *buf, size_t len,
+                                     size_t *out_len, uint16_t *page_count)
+{
+    wifi_manager_state_t wifi;
+    (void)wifi_manager_get_state(&wifi);
+    wifi_manager_radio_stats_t radio;
+    (void)wifi_manager_get_radio_stats(&radio);
+    esp_now_comm_pairing_stats_t pairing;
+    (void)esp_now_comm_pairing_get_stats(&pairing);
+
+    const diag_config_entry_t entries[] =
+    {
+        { "wifi.channel",           wifi.channel },
+        { "wifi.link",              wifi.link },
+        { "wifi.rssi",              wifi.rssi },
+        { "wifi.reconnects",        (int32_t)wifi.reconnects },
+        { "wifi.disconnect_reason", wifi.last_disconnect_reason },
+        { "espnow.max_peers",       ESP_NOW_COMM_MAX_PEERS },
+        { "espnow.logical_peers",   ESP_NOW_COMM_MAX_LOGICAL_PEERS },
+        { "espnow.payload_size",    ESP_NOW_COMM_PAYLOAD_SIZE },
+        { "build.latency_probe",    LATENCY_PROBE_ENABLED },
+        { "build.trace",            TRACE_ENABLED },
+        { "build.prof",             PROF_ENABLED },
+        { "build.load_gen",         LOAD_GEN_ENABLED },
+        { "dlog.ship",              DEFERRED_LOG_SHIP },
+        { "sysmon.period_ms",       SYS_MONITOR_PERIOD_MS },
+        { "sysmon.warn_stack",      SYS_MONITOR_WARN_STACK_BYTES },
+        { "sysmon.warn_heap",       SYS_MONITOR_WARN_HEAP_BYTES },
+        { "sysmon.warn_cpu_pm",     SYS_MONITOR_WARN_CPU_PERMILLE },
+        { "sysmon.warn_isr_pm",     SYS_MONITOR_WARN_ISR_PERMILLE },
+        { "fr.records",             FLIGHT_RECORDER_RECORDS },
+        { "boot.wifi_blocking",     WIFI_MANAGER_BLOCKING_INIT },
+        { "wifi.mode",              wifi_manager_get_mode() },
+        { "wifi.profile",           radio.base },
+        { "wifi.auto_low_latency",  radio.auto_low_latency },
+        { "espnow.echo_ms",         ESP_NOW_COMM_ECHO_INTERVAL_MS },
+        { "pair.count",             pairing.paired },
+        { "pair.restored",          pairing.restored },
+        { "pair.restore_ms",        (int32_t)pairing.restore_ms },
+        { "pair.paired_ms",         (int32_t)pairing.paired_ms },
+        { "pair.first_cmd_ms",      (int32_t)pairing.first_cmd_ms },
+        { "pair.first_cmd_cached",  pairing.first_cmd_cached },
+        { "lease.enforce",          ESP_NOW_COMM_LEASE_ENFORCE },
+        { "lease.implicit",         ESP_NOW_COMM_LEASE_IMPLICIT },
+        { "lease.default_ms",       ESP_NOW_COMM_LEASE_DEFAULT_MS },
+        { "lease.max_ms",           ESP_NOW_COMM_LEASE_MAX_MS },
+    };
+    const size_t count = sizeof(entries) / sizeof(entries[0]);
+
+    *page_count = (uint16_t)((count + DIAG_CONFIG_PER_PAGE - 1) / DIAG_CONFIG_PER_PAGE);
+    if (page >= *page_count)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t *p = buf;
+    for (size_t i = page * DIAG_CONFIG_PER_PAGE; i < count && i < (page + 1u) * DIAG_CONFIG_PER_PAGE; i++)
+    {
+        size_t key_len = strnlen(entries[i].key, DIAG_CONFIG_KEY_MAX);
+        if ((size_t)(p - buf) + 1 + key_len + 4 > len)
+        {
+            break;
+        }
+        *p++ = (uint8_t)key_len;
+        memcpy(p, entries[i].key, key_len);
+        p += key_len;
+        uint32_t value = (uint32_t)entries[i].value;
+        *p++ = (uint8_t)value;
+        *p++ = (uint8_t)(value >> 8);
+        *p++ = (uint8_t)(value >> 16);
+        *p++ = (uint8_t)(value >> 24);
+    }
+    *out_len = (size_t)(p - buf);
+    return ESP_OK;
+}
+
+static esp_err_t diag_provide_events(uint16_t page, uint8_t *buf, size_t len,
+                                     size_t *out_len, uint16_t *page_count)
+{
+    flight_recorder_status_t status;
+    (void)flight_recorder_get_status(&status);
+
+    /* Pages are cut to the reply size, which holds fewer records than a FLIGHT_REC_PAGE frame */
+    const uint32_t per_page = (len - FLIGHT_RECORDER_PAGE_HEADER) / sizeof(fr_record_t);
+    uint32_t pages = (status.total + per_page - 1) / per_page;
+    *page_count = (uint16_t)((pages != 0) ? pages : 1);
+    if (page >= *page_count)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *out_len = flight_recorder_dump_page(page * per_page, buf, len);
+    return (*out_len != 0) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t diag_provide_wifi(uint16_t page, uint8_t *buf, size_t len,
+                                   size_t *out_len, uint16_t *page_count)
+{
+    wifi_manager_disconnect_stats_t stats;
+
+    *page_count = 1;
+    if (page != 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    (void)wifi_manager_get_disconnect_stats(&stats);
+    *out_len = wifi_manager_serialize_disconnect_stats(&stats, buf, len);
+    return (*out_len != 0) ? ESP_OK : ESP_FAIL;
+}
+
+#if PROF_ENABLED
+static esp_err_t diag_provide_profile(uint16_t page, uint8_t *buf, size_t len,
+                                      size_t *out_len, uint16_t *page_count)
+{
+    const size_t per_page = (len - 2) / PROF_SERIALIZED_SITE;
+    *page_count = (uint16_t)((PROF_SITE_COUNT + per_page - 1) / per_page);
+    if (page >= *page_count)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    buf[0] = (uint8_t)CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    buf[1] = (uint8_t)(CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ >> 8);
+    *out_len = 2 + prof_serialize((prof_site_t)(page * per_page), &buf[2], len - 2);
+    return ESP_OK;
+}
+#endif
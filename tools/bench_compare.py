@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""Compare benchmark results against a stored baseline.
+
+Both files use the JSON format written by host/bench/bench_host (--json):
+
+    {"format": "wave_rover_bench", "version": 1, "platform": "host", "unit": "ns",
+     "results": [{"name": "hist_record", "value": 1.23, ...}, ...]}
+
+A kernel counts as regressed when it is slower than the baseline by more than
+--threshold percent. Kernels that only exist on one side are listed but never
+fail the comparison.
+
+Exit status: 0 if nothing regressed, 1 if at least one kernel regressed,
+2 on usage or input errors.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load_results(path):
+    """Load a results file and return (metadata, {name: value})."""
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            doc = json.load(f)
+    except (OSError, ValueError) as err:
+        sys.exit("error: cannot read %s: %s" % (path, err))
+    if doc.get("format") != "wave_rover_bench":
+        sys.exit("error: %s is not a wave_rover_bench results file" % path)
+    return doc, {r["name"]: float(r["value"]) for r in doc.get("results", [])}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", help="stored baseline results (JSON)")
+    parser.add_argument("current", help="fresh results (JSON)")
+    parser.add_argument("--threshold", type=float, default=15.0,
+                        help="allowed slowdown in percent before a kernel counts as regressed (default: 15)")
+    args = parser.parse_args()
+
+    base_doc, base = load_results(args.baseline)
+    cur_doc, cur = load_results(args.current)
+    if base_doc.get("unit") != cur_doc.get("unit"):
+        sys.exit("error: unit mismatch (%s vs %s)" % (base_doc.get("unit"), cur_doc.get("unit")))
+    unit = cur_doc.get("unit", "")
+
+    regressions = 0
+    print("%-28s %12s %12s %9s" % ("kernel", "baseline", "current", "change"))
+    for name in list(base) + [n for n in cur if n not in base]:
+        if name not in cur:
+            print("%-28s %12.2f %12s %9s" % (name, base[name], "-", "missing"))
+            continue
+        if name not in base:
+            print("%-28s %12s %12.2f %9s" % (name, "-", cur[name], "new"))
+            continue
+        change = (cur[name] - base[name]) / base[name] * 100.0 if base[name] > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-28s %12.2f %12.2f %+8.1f%%%s" % (name, base[name], cur[name], change, flag))
+
+    print("unit: %s, threshold: %.1f%%, regressions: %d" % (unit, args.threshold, regressions))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
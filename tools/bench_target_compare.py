@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Compare an on-target benchmark report with the host baseline.
+
+Reads the console log of the benchmark firmware (env:seeed_xiao_esp32c6_bench),
+which contains lines like
+
+    BENCH_BEGIN,cpu_mhz=160,iterations=1000,repeats=7
+    BENCH,hist_record,flash,41.37,212
+    BENCH,hist_record,iram,38.02,96
+    BENCH_END
+
+and prints, per kernel, the host time next to the target time in both
+placements (cycles and ns), the target/host ratio and the flash penalty
+(flash/iram) for warm and cold calls.
+
+Optionally writes the target results in the common wave_rover_bench JSON format
+(unit ns, one entry per kernel@placement) so that tools/bench_compare.py can
+track on-target regressions against a stored target baseline as well.
+
+Usage:
+    pio device monitor -e seeed_xiao_esp32c6_bench | tee bench_target.log
+    tools/bench_target_compare.py bench_target.log [--host host/bench/baseline_host.json] [--json out.json]
+"""
+
+import argparse
+import json
+import os
+import sys
+
+DEFAULT_HOST_BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                     "..", "host", "bench", "baseline_host.json")
+
+
+def parse_report(path):
+    """Return (header dict, {kernel: {placement: (cycles_per_op, cold_cycles)}}, kernel order)."""
+    header = None
+    results = {}
+    order = []
+    try:
+        with open(path, "r", encoding="utf-8", errors="replace") as f:
+            lines = f.readlines()
+    except OSError as err:
+        sys.exit("error: cannot read %s: %s" % (path, err))
+
+    for raw in lines:
+        # Serial monitors may prefix lines with timestamps; the record starts at the tag
+        line = raw.strip()
+        pos = line.find("BENCH")
+        if pos < 0:
+            continue
+        fields = line[pos:].split(",")
+        tag = fields[0]
+        if tag == "BENCH_BEGIN":
+            header = dict(f.split("=", 1) for f in fields[1:] if "=" in f)
+            results = {}
+            order = []
+        elif tag == "BENCH" and header is not None and len(fields) == 5:
+            name, placement = fields[1], fields[2]
+            try:
+                per_op, cold = float(fields[3]), int(fields[4])
+            except ValueError:
+                continue
+            if name not in results:
+                results[name] = {}
+                order.append(name)
+            results[name][placement] = (per_op, cold)
+        elif tag == "BENCH_END" and header is not None:
+            # Use the last complete report in the log
+            return header, results, order
+
+    sys.exit("error: no complete BENCH_BEGIN..BENCH_END report in %s" % path)
+
+
+def load_host(path):
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            doc = json.load(f)
+    except (OSError, ValueError) as err:
+        sys.exit("error: cannot read %s: %s" % (path, err))
+    if doc.get("format") != "wave_rover_bench" or doc.get("unit") != "ns":
+        sys.exit("error: %s is not a host wave_rover_bench results file" % path)
+    return {r["name"]: float(r["value"]) for r in doc.get("results", [])}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("report", help="console log containing the target benchmark report")
+    parser.add_argument("--host", default=DEFAULT_HOST_BASELINE,
+                        help="host results JSON (default: host/bench/baseline_host.json)")
+    parser.add_argument("--json", help="also write the target results as wave_rover_bench JSON")
+    args = parser.parse_args()
+
+    header, results, order = parse_report(args.report)
+    host = load_host(args.host)
+    mhz = float(header.get("cpu_mhz", "160"))
+
+    print("target: %g MHz, %s iterations x %s repeats" %
+          (mhz, header.get("iterations", "?"), header.get("repeats", "?")))
+    print("%-24s %10s | %10s %10s | %10s %10s | %9s %10s %9s" %
+          ("kernel", "host ns", "iram cyc", "iram ns", "flash cyc", "flash ns",
+           "iram/host", "flash/iram", "cold f/i"))
+
+    json_results = []
+    for name in order:
+        iram = results[name].get("iram")
+        flash = results[name].get("flash")
+        host_ns = host.get(name)
+
+        iram_ns = iram[0] * 1000.0 / mhz if iram else None
+        flash_ns = flash[0] * 1000.0 / mhz if flash else None
+
+        def fmt(value, spec="%10.2f"):
+            return spec % value if value is not None else "%10s" % "-"
+
+        ratio_host = "%8.1fx" % (iram_ns / host_ns) if (iram_ns and host_ns) else "%9s" % "-"
+        ratio_flash = "%9.2fx" % (flash[0] / iram[0]) if (iram and flash and iram[0] > 0) else "%10s" % "-"
+        ratio_cold = "%8.2fx" % (float(flash[1]) / iram[1]) if (iram and flash and iram[1] > 0) else "%9s" % "-"
+
+        print("%-24s %s | %s %s | %s %s | %s %s %s" %
+              (name, fmt(host_ns), fmt(iram[0] if iram else None), fmt(iram_ns),
+               fmt(flash[0] if flash else None), fmt(flash_ns), ratio_host, ratio_flash, ratio_cold))
+
+        for placement, value in (("iram", iram), ("flash", flash)):
+            if value is not None:
+                json_results.append({"name": "%s@%s" % (name, placement),
+                                     "value": round(value[0] * 1000.0 / mhz, 3),
+                                     "cycles": value[0],
+                                     "cold_cycles": value[1]})
+
+    missing = [n for n in host if n not in results]
+    if missing:
+        print("not run on target: %s" % ", ".join(missing))
+
+    if args.json:
+        doc = {"format": "wave_rover_bench", "version": 1, "platform": "esp32c6",
+               "unit": "ns", "cpu_mhz": mhz, "results": json_results}
+        with open(args.json, "w", encoding="utf-8") as f:
+            json.dump(doc, f, indent=2)
+            f.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""Query the rover's remote diagnostics service and render the replies.
+
+The controller relays frames between the host and the rover (see espnow_frames.py
+for the capture format). Build a query, send it from the controller, then feed
+the controller capture back to this script:
+
+    tools/diag_cli.py query counters              # all pages -> "d7 01 01 ff ff"
+    tools/diag_cli.py query events --page 3 --id 7
+    tools/diag_cli.py render controller.log
+    pio device monitor | tools/diag_cli.py render -
+
+Topics: index, counters, histograms, tasks, config, events, profile, wifi (see esp_now_comm_diag.h).
+Replies are grouped by rover, request id and topic; missing pages are reported.
+"""
+
+import argparse
+import struct
+import sys
+
+from espnow_frames import iter_frames, u16
+import flight_recorder_decode
+import latency_probe_decode
+import sys_monitor_decode
+
+MSG_DIAG_QUERY = 0xD7
+MSG_DIAG_REPLY = 0xD8
+REPLY_HEADER_LEN = 7
+PAGE_ALL = 0xFFFF
+
+TOPICS = ["index", "counters", "histograms", "tasks", "config", "events", "profile", "wifi"]
+STATUS = ["ok", "unknown topic", "bad page", "error"]
+
+TOTALS = struct.Struct("<12Ibb")
+TOTALS_FIELDS = ["now_ms", "rx_frames", "rx_bytes", "rx_dropped", "rx_unknown", "tx_frames", "tx_bytes",
+                 "tx_success", "tx_fail", "tx_queue_full", "tx_errors", "last_rx_ms", "last_rssi",
+                 "last_noise_floor"]
+PEER = struct.Struct("<6s8Ibb")
+PROF_SITE = struct.Struct("<B15s3IQ")
+
+# wifi_manager_serialize_disconnect_stats(): counters, RSSI bins, recovery histogram, then the reason slots
+RSSI_BINS = [">=-50", "-60", "-70", "-80", "-90", "<-90"]
+CONNECT_BUCKETS = 16
+WIFI_FIXED = struct.Struct("<%dI" % (3 + len(RSSI_BINS) + 3 + CONNECT_BUCKETS))
+WIFI_REASON = struct.Struct("<HI")
+# wifi_err_reason_t values seen in practice (esp_wifi_types.h)
+WIFI_REASONS = {
+    1: "unspecified", 2: "auth_expire", 3: "auth_leave", 4: "disassoc_inactivity", 5: "assoc_toomany",
+    6: "class2_frame", 7: "class3_frame", 8: "assoc_leave", 15: "4way_handshake_timeout",
+    16: "group_key_update_timeout", 23: "802_1x_auth_failed", 34: "missing_acks",
+    200: "beacon_timeout", 201: "no_ap_found", 202: "auth_fail", 203: "assoc_fail", 204: "handshake_timeout",
+    205: "connection_fail", 206: "ap_tsf_reset", 207: "roaming", 208: "assoc_comeback_too_long",
+    209: "sa_query_timeout", 210: "no_ap_compatible_security", 211: "no_ap_authmode_threshold",
+    212: "no_ap_rssi_threshold",
+}
+
+
+def topic_name(topic):
+    return TOPICS[topic] if topic < len(TOPICS) else "topic%d" % topic
+
+
+def render_index(pages):
+    print("    topics: %s" % ", ".join(topic_name(t) for t in pages.get(0, b"")))
+
+
+def render_counters(pages):
+    now_ms = None
+    for page in sorted(pages):
+        data = pages[page]
+        if page == 0 and len(data) >= TOTALS.size:
+            totals = dict(zip(TOTALS_FIELDS, TOTALS.unpack_from(data)))
+            now_ms = totals["now_ms"]
+            for key in TOTALS_FIELDS[1:]:
+                print("    %-18s %d" % (key, totals[key]))
+            continue
+        for off in range(0, len(data) - PEER.size + 1, PEER.size):
+            mac, rxf, rxb, rxd, txf, txb, txs, txe, seen, rssi, _ = PEER.unpack_from(data, off)
+            age = "%d ms ago" % (now_ms - seen) if seen and now_ms is not None else ("never" if not seen else "?")
+            print("    %s rx %d/%d B (dropped %d) tx %d/%d B ack %d fail %d rssi %d seen %s" % (
+                ":".join("%02x" % b for b in mac), rxf, rxb, rxd, txf, txb, txs, txe, rssi, age))
+
+
+def render_histograms(pages):
+    for page in sorted(pages):
+        r = latency_probe_decode.decode(pages[page])
+        if not r:
+            continue
+        to_us = lambda cycles: cycles / float(r["mhz"])
+        if r["count"] == 0:
+            print("    %-14s %8d" % (r["stage"], 0))
+            continue
+        print("    %-14s %8d  p50 %8.1f us  p99 %8.1f us  max %8.1f us" % (
+            r["stage"], r["count"], to_us(latency_probe_decode.percentile(r, 50)),
+            to_us(latency_probe_decode.percentile(r, 99)), to_us(r["max"])))
+
+
+def render_tasks(pages):
+    r = sys_monitor_decode.decode(pages.get(0, b""))
+    if not r:
+        print("    no sample yet")
+        return
+    print("    up %ds cpu %.1f%% isr ~%.1f%% heap free %d min %d%s" % (
+        r["uptime_s"], r["cpu_permille"] / 10.0, r["isr_permille"] / 10.0, r["heap_free"],
+        r["heap_min_free"], "  WARN: " + ",".join(r["warnings"]) if r["warnings"] else ""))
+    for name, cpu, stack in r["tasks"]:
+        print("    %-8s cpu %5.1f%%  stack free min %5d" % (name, cpu / 10.0, stack))
+
+
+def render_config(pages):
+    for page in sorted(pages):
+        data, off = pages[page], 0
+        while off < len(data):
+            n = data[off]
+            if off + 1 + n + 4 > len(data):
+                break
+            key = data[off + 1:off + 1 + n].decode("ascii", errors="replace")
+            value = struct.unpack_from("<i", data, off + 1 + n)[0]
+            print("    %-22s %d" % (key, value))
+            off += 1 + n + 4
+
+
+def render_events(pages):
+    header = None
+    for page in sorted(pages):
+        data = pages[page]
+        if len(data) < flight_recorder_decode.PAGE_HEADER_LEN:
+            continue
+        if header is None:
+            header = (data[0], data[1], u16(data, 2))
+            print("    fault=%s frozen=%s recovered=%s total=%d" % (
+                flight_recorder_decode.name(flight_recorder_decode.FAULTS, header[0]),
+                bool(header[1] & 1), bool(header[1] & 2), header[2]))
+        for i in range(data[6]):
+            off = flight_recorder_decode.PAGE_HEADER_LEN + i * flight_recorder_decode.RECORD.size
+            if off + flight_recorder_decode.RECORD.size > len(data):
+                break
+            ts, seq, rtype, a0, a1, a2 = flight_recorder_decode.RECORD.unpack_from(data, off)
+            print("    %10d us #%-5d %s" % (ts, seq, flight_recorder_decode.describe(rtype, a0, a1, a2)))
+
+
+def render_profile(pages):
+    print("    %-15s %10s %10s %10s %10s" % ("site", "count", "min us", "avg us", "max us"))
+    for page in sorted(pages):
+        data = pages[page]
+        if len(data) < 2:
+            continue
+        mhz = float(u16(data, 0) or 160)
+        for off in range(2, len(data) - PROF_SITE.size + 1, PROF_SITE.size):
+            _, name, count, lo, hi, total = PROF_SITE.unpack_from(data, off)
+            name = name.split(b"\0", 1)[0].decode("ascii", errors="replace")
+            if count == 0:
+                print("    %-15s %10d" % (name, 0))
+                continue
+            print("    %-15s %10d %10.2f %10.2f %10.2f" % (name, count, lo / mhz, total / count / mhz, hi / mhz))
+
+
+def render_wifi(pages):
+    data = pages.get(0, b"")
+    if len(data) < WIFI_FIXED.size + 1:
+        print("    short report")
+        return
+    words = WIFI_FIXED.unpack_from(data)
+    disconnects, losses, overflow = words[0:3]
+    bins = words[3:3 + len(RSSI_BINS)]
+    count, lo, hi = words[3 + len(RSSI_BINS):6 + len(RSSI_BINS)]
+    buckets = words[6 + len(RSSI_BINS):]
+    print("    disconnects %d, link losses %d" % (disconnects, losses))
+    off = WIFI_FIXED.size + 1
+    for _ in range(data[WIFI_FIXED.size]):
+        if off + WIFI_REASON.size > len(data):
+            break
+        reason, n = WIFI_REASON.unpack_from(data, off)
+        print("    reason %3d %-26s %d" % (reason, WIFI_REASONS.get(reason, "?"), n))
+        off += WIFI_REASON.size
+    if overflow:
+        print("    other reasons              %d" % overflow)
+    print("    rssi at loss: %s" % "  ".join("%s:%d" % (name, n) for name, n in zip(RSSI_BINS, bins)))
+    if count:
+        print("    time to recover: n=%d min %d ms max %d ms |%s" % (count, lo, hi, "".join(
+            " <%d:%d" % (2 << b, n) for b, n in enumerate(buckets) if n)))
+
+
+RENDERERS = [render_index, render_counters, render_histograms, render_tasks, render_config, render_events,
+             render_profile, render_wifi]
+
+
+def cmd_query(args):
+    topic = TOPICS.index(args.topic) if args.topic in TOPICS else int(args.topic, 0)
+    page = PAGE_ALL if args.page == "all" else int(args.page, 0)
+    frame = bytes([MSG_DIAG_QUERY, args.id & 0xFF, topic, page & 0xFF, page >> 8])
+    print(" ".join("%02x" % b for b in frame))
+    return 0
+
+
+def cmd_render(args):
+    stream = sys.stdin if args.log == "-" else open(args.log, "r", encoding="utf-8", errors="replace")
+    replies = {}
+    for mac, frame in iter_frames(stream):
+        if len(frame) < 1 + REPLY_HEADER_LEN or frame[0] != MSG_DIAG_REPLY:
+            continue
+        req_id, topic, status, page, page_count = frame[1], frame[2], frame[3], u16(frame, 4), u16(frame, 6)
+        reply = replies.setdefault((mac, req_id, topic), {"pages": {}, "page_count": 0, "errors": []})
+        reply["page_count"] = page_count
+        if status == 0:
+            reply["pages"][page] = frame[1 + REPLY_HEADER_LEN:]
+        else:
+            reply["errors"].append((page, STATUS[status] if status < len(STATUS) else str(status)))
+
+    if not replies:
+        sys.exit("no diagnostics replies found")
+
+    for (mac, req_id, topic), reply in replies.items():
+        missing = [p for p in range(reply["page_count"]) if p not in reply["pages"]]
+        print("%s request %d %s: %d/%d pages%s" % (
+            mac or "?", req_id, topic_name(topic), len(reply["pages"]), reply["page_count"],
+            ", missing %s" % missing if missing and not reply["errors"] else ""))
+        for page, error in reply["errors"]:
+            print("    page %d: %s" % (page, error))
+        if topic < len(RENDERERS) and reply["pages"]:
+            RENDERERS[topic](reply["pages"])
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    query = sub.add_parser("query", help="print the query frame to send from the controller")
+    query.add_argument("topic", help="topic name or number")
+    query.add_argument("--page", default="all", help="page number or 'all' (default)")
+    query.add_argument("--id", type=int, default=1, help="request id echoed in the replies")
+    query.set_defaults(func=cmd_query)
+    render = sub.add_parser("render", help="render the replies found in a controller capture")
+    render.add_argument("log", help="controller console capture, '-' for stdin")
+    render.set_defaults(func=cmd_render)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Decode deferred log records shipped over ESP-NOW (ESP_NOW_MSG_DLOG_RECORDS frames).
+
+Build the rover with -DDEFERRED_LOG_SHIP=1, capture the controller console (see
+espnow_frames.py for the expected line format) and feed it to this script:
+
+    tools/dlog_decode.py controller.log
+    pio device monitor | tools/dlog_decode.py -
+
+Message formats are read from components/deferred_log/Include/deferred_log_fmt.h,
+so decode with the same revision of the tree the rover was built from.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+from espnow_frames import iter_frames, u16, u32
+
+MSG_DLOG_RECORDS = 0xD2
+RECORD_HEADER_LEN = 8
+FMT_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "components",
+                          "deferred_log", "Include", "deferred_log_fmt.h")
+_FMT_ENTRY = re.compile(r'^\s*X\(\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+
+
+def load_formats(path):
+    """Return [(id name, tag, format)] in ID order."""
+    formats = []
+    with open(path, "r", encoding="utf-8") as header:
+        for line in header:
+            m = _FMT_ENTRY.match(line)
+            if m:
+                formats.append((m.group(1), m.group(2), m.group(3).encode().decode("unicode_escape")))
+    return formats
+
+
+def decode(payload):
+    """Yield (timestamp_us, fmt_id, producer, args) for every record of one payload."""
+    if not payload:
+        return
+    count, off = payload[0], 1
+    for _ in range(count):
+        if off + RECORD_HEADER_LEN > len(payload):
+            return
+        ts, fmt_id, producer, nargs = u32(payload, off), u16(payload, off + 4), payload[off + 6], payload[off + 7]
+        off += RECORD_HEADER_LEN
+        if off + 4 * nargs > len(payload):
+            return
+        args = [u32(payload, off + 4 * i) for i in range(nargs)]
+        off += 4 * nargs
+        yield ts, fmt_id, producer, args
+
+
+def render(formats, fmt_id, args):
+    if fmt_id >= len(formats):
+        return "?", "unknown format %d args=%s" % (fmt_id, args)
+    _, tag, fmt = formats[fmt_id]
+    needed = len(re.findall(r"%[^%]", fmt.replace("%%", "")))
+    padded = (args + [0] * needed)[:needed]
+    try:
+        return tag, fmt % tuple(padded)
+    except (TypeError, ValueError):
+        return tag, "%s args=%s" % (fmt, args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="controller console capture, '-' for stdin")
+    parser.add_argument("--formats", default=FMT_HEADER, help="path of deferred_log_fmt.h")
+    args = parser.parse_args()
+
+    formats = load_formats(args.formats)
+    stream = sys.stdin if args.log == "-" else open(args.log, "r", encoding="utf-8", errors="replace")
+    records = 0
+    for mac, frame in iter_frames(stream):
+        if not frame or frame[0] != MSG_DLOG_RECORDS:
+            continue
+        for ts, fmt_id, producer, rec_args in decode(frame[1:]):
+            tag, text = render(formats, fmt_id, rec_args)
+            print("%-17s %10.3f ms  [%d] %s: %s" % (mac or "?", ts / 1000.0, producer, tag, text))
+            records += 1
+
+    if records == 0:
+        sys.exit("no deferred log records found")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
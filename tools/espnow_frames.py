@@ -0,0 +1,36 @@
+"""Helpers for host tools that consume ESP-NOW frames captured by a controller.
+
+The host cannot talk ESP-NOW itself. The tools therefore read the console of a
+controller (or any ESP32 acting as a serial bridge) that prints every received
+frame on its own line as
+
+    RX <aa:bb:cc:dd:ee:ff> <payload as hex>
+
+Anything else on the console is ignored. Lines with only a hex payload are
+accepted as well, with an unknown source MAC.
+"""
+
+import re
+
+_RX_LINE = re.compile(r"RX\s+([0-9A-Fa-f]{2}(?::[0-9A-Fa-f]{2}){5})\s+([0-9A-Fa-f]+)\s*$")
+_HEX_LINE = re.compile(r"^\s*([0-9A-Fa-f]{2}(?:\s*[0-9A-Fa-f]{2})*)\s*$")
+
+
+def iter_frames(stream):
+    """Yield (mac, payload bytes) for every frame found in a text stream."""
+    for line in stream:
+        m = _RX_LINE.search(line)
+        if m:
+            yield m.group(1).lower(), bytes.fromhex(m.group(2))
+            continue
+        m = _HEX_LINE.match(line)
+        if m:
+            yield None, bytes.fromhex(re.sub(r"\s+", "", m.group(1)))
+
+
+def u16(buf, off):
+    return buf[off] | (buf[off + 1] << 8)
+
+
+def u32(buf, off):
+    return buf[off] | (buf[off + 1] << 8) | (buf[off + 2] << 16) | (buf[off + 3] << 24)
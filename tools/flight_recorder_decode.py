@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Decode flight recorder dumps.
+
+Two sources are accepted, also mixed in one capture:
+- the rover console: flight_recorder_dump_console() prints every page as "FR <hex>"
+  (done automatically once the recorder freezes, and at boot after a watchdog/panic reset);
+- a controller capture (see espnow_frames.py) of ESP_NOW_MSG_FLIGHT_REC_PAGE replies to
+  ESP_NOW_MSG_FLIGHT_REC_QUERY (0xD3 followed by the u16 number of the first record).
+
+    tools/flight_recorder_decode.py rover.log
+    pio device monitor | tools/flight_recorder_decode.py -
+
+Prints the records oldest first, with times relative to the last record.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+from espnow_frames import iter_frames, u16
+
+MSG_FLIGHT_REC_PAGE = 0xD4
+PAGE_HEADER_LEN = 7
+RECORD = struct.Struct("<IHBBII")
+_CONSOLE_LINE = re.compile(r"FR\s+([0-9A-Fa-f]+)\s*$")
+
+FAULTS = ["none", "failsafe", "overcurrent", "watchdog", "panic", "manual"]
+LINK_EVENTS = ["wifi_disconnected", "wifi_got_ip", "espnow_send_fail", "channel_change", "lease_change"]
+
+
+def s16(v):
+    return v - 0x10000 if v & 0x8000 else v
+
+
+def s32(v):
+    return v - 0x100000000 if v & 0x80000000 else v
+
+
+def name(table, index):
+    return table[index] if index < len(table) else str(index)
+
+
+def describe(rtype, a0, a1, a2):
+    if rtype == 1:
+        return "BOOT     reset_reason=%d" % a0
+    if rtype == 2:
+        return "CMD_RX   msg=0x%02x len=%d from=..:%02x:%02x payload=%08x" % (
+            a0, a1 & 0xFFFF, (a1 >> 16) & 0xFF, a1 >> 24, a2)
+    if rtype == 3:
+        return "CONTROL  mode=%d setpoint=%d/%d output=%d/%d" % (
+            a0, s16(a1 & 0xFFFF), s16(a1 >> 16), s16(a2 & 0xFFFF), s16(a2 >> 16))
+    if rtype == 4:
+        return "CURRENT  left=%d mA right=%d mA" % (a1, a2)
+    if rtype == 5:
+        event = name(LINK_EVENTS, a0)
+        if a0 == 1:
+            detail = "ip=%d.%d.%d.%d" % (a1 & 0xFF, (a1 >> 8) & 0xFF, (a1 >> 16) & 0xFF, a1 >> 24)
+        elif a0 == 3:
+            detail = "channel=%d->%d" % ((a1 >> 8) & 0xFF, a1 & 0xFF)
+        else:
+            detail = "detail=%d" % a1 if a0 == 0 else "peer=..:%08x" % a1
+        return "LINK     %s %s rssi=%d" % (event, detail, s32(a2))
+    if rtype == 6:
+        return "FAULT    %s arg1=%d arg2=%d" % (name(FAULTS, a0), a1, a2)
+    return "type=%d arg0=%d arg1=%d arg2=%d" % (rtype, a0, a1, a2)
+
+
+def iter_pages(stream):
+    """Yield page payloads from console lines and controller captures."""
+    lines = list(stream)
+    for line in lines:
+        m = _CONSOLE_LINE.search(line)
+        if m:
+            yield bytes.fromhex(m.group(1))
+    for _, frame in iter_frames(iter(lines)):
+        if frame and frame[0] == MSG_FLIGHT_REC_PAGE:
+            yield frame[1:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="console or controller capture, '-' for stdin")
+    args = parser.parse_args()
+
+    stream = sys.stdin if args.log == "-" else open(args.log, "r", encoding="utf-8", errors="replace")
+    records, fault, flags, total = {}, 0, 0, 0
+    for page in iter_pages(stream):
+        if len(page) < PAGE_HEADER_LEN:
+            continue
+        fault, flags, total, start, count = page[0], page[1], u16(page, 2), u16(page, 4), page[6]
+        for i in range(count):
+            off = PAGE_HEADER_LEN + i * RECORD.size
+            if off + RECORD.size > len(page):
+                break
+            ts, seq, rtype, a0, a1, a2 = RECORD.unpack_from(page, off)
+            records[seq] = (ts, rtype, a0, a1, a2)
+
+    if not records:
+        sys.exit("no flight recorder pages found")
+
+    # Sequence numbers are 16 bit and the ring is much shorter: the oldest record follows the
+    # largest gap between consecutive sequence numbers
+    seqs = sorted(records)
+    gaps = [((seqs[(i + 1) % len(seqs)] - seqs[i]) % 0x10000, i) for i in range(len(seqs))]
+    first = (max(gaps)[1] + 1) % len(seqs) if len(seqs) > 1 else 0
+    ordered = [records[seq] for seq in seqs[first:] + seqs[:first]]
+    last = ordered[-1][0]
+    print("fault=%s frozen=%s recovered=%s records=%d/%d" % (
+        name(FAULTS, fault), bool(flags & 1), bool(flags & 2), len(ordered), total))
+    for ts, rtype, a0, a1, a2 in ordered:
+        delta = s32((ts - last) & 0xFFFFFFFF)
+        print("%10.3f ms  %s" % (delta / 1000.0, describe(rtype, a0, a1, a2)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Decode latency histogram reports (ESP_NOW_MSG_LATENCY_REPORT frames).
+
+Send ESP_NOW_MSG_LATENCY_QUERY (a single 0xD0 byte) from the controller, capture
+the controller console (see espnow_frames.py for the expected line format) and
+feed it to this script:
+
+    tools/latency_probe_decode.py controller.log
+    pio device monitor | tools/latency_probe_decode.py -
+
+Prints, per stage, the number of frames and percentiles of the time elapsed since
+the frame entered the rover's ESP-NOW receive callback.
+"""
+
+import argparse
+import sys
+
+from espnow_frames import iter_frames, u16, u32
+
+MSG_LATENCY_REPORT = 0xD1
+STAGES = ["recv_cb", "enqueue", "dispatch", "decode", "control_pickup", "pwm_update"]
+HEADER_LEN = 16
+
+
+def decode(payload):
+    """Decode one report payload (without the message byte)."""
+    if len(payload) < HEADER_LEN:
+        return None
+    stage, nbuckets, mhz = payload[0], payload[1], u16(payload, 2)
+    if len(payload) < HEADER_LEN + 2 * nbuckets:
+        return None
+    buckets = [u16(payload, HEADER_LEN + 2 * i) for i in range(nbuckets)]
+    return {"stage": STAGES[stage] if stage < len(STAGES) else str(stage), "mhz": mhz or 160,
+            "count": u32(payload, 4), "min": u32(payload, 8), "max": u32(payload, 12),
+            "buckets": buckets}
+
+
+def percentile(report, pct):
+    """Upper bound (cycles) of the log2 bucket holding the percentile."""
+    total = sum(report["buckets"])
+    if total == 0:
+        return 0
+    rank = max(1, (total * pct + 99) // 100)
+    seen = 0
+    for i, n in enumerate(report["buckets"]):
+        seen += n
+        if seen >= rank:
+            return min((1 << (i + 1)) - 1, report["max"])
+    return report["max"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="controller console capture, '-' for stdin")
+    args = parser.parse_args()
+
+    stream = sys.stdin if args.log == "-" else open(args.log, "r", encoding="utf-8", errors="replace")
+    reports = {}
+    for mac, frame in iter_frames(stream):
+        if frame and frame[0] == MSG_LATENCY_REPORT:
+            report = decode(frame[1:])
+            if report:
+                reports[(mac, report["stage"])] = report
+
+    if not reports:
+        sys.exit("no latency reports found")
+
+    print("%-17s %-14s %8s %10s %10s %10s %10s %10s" %
+          ("rover", "stage", "count", "p50 us", "p90 us", "p99 us", "min us", "max us"))
+    for (mac, stage), r in reports.items():
+        to_us = lambda cycles: cycles / float(r["mhz"])
+        if r["count"] == 0:
+            print("%-17s %-14s %8d %10s" % (mac or "?", stage, 0, "-"))
+            continue
+        print("%-17s %-14s %8d %10.1f %10.1f %10.1f %10.1f %10.1f" %
+              (mac or "?", stage, r["count"], to_us(percentile(r, 50)), to_us(percentile(r, 90)),
+               to_us(percentile(r, 99)), to_us(r["min"]), to_us(r["max"])))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
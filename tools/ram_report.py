@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Report static RAM use per component from the linker map file.
+
+All component state, task stacks, queues and event groups are allocated at
+link time, so the map file accounts for them. Build any env and run:
+
+    tools/ram_report.py .pio/build/seeed_xiao_esp32c6/firmware.map
+    tools/ram_report.py firmware.map --all        # ESP-IDF components as well
+
+Prints, per component archive, the bytes in .data, .bss and .noinit (RTC/no-init
+RAM such as the flight recorder) and the code placed in IRAM, which also occupies
+SRAM on the ESP32-C6. Objects that do not come from an archive are listed as
+"(objects)".
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import defaultdict
+
+# Input section line of a GNU ld map: " .bss.s_ring  0x40800000  0x400  path/libfoo.a(foo.c.obj)".
+# Long section names put the address/size/object on the following line.
+_SECTION = re.compile(r"^\s(\.[^\s]+|COMMON)(?:\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)\s+(.+))?$")
+_CONTINUATION = re.compile(r"^\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)\s+(.+)$")
+_ARCHIVE = re.compile(r"([^/\\]+)\.a\((.+)\)$")
+
+# Firmware components (components/ and the application in src/)
+PROJECT = {"libbench", "libdeferred_log", "libesp_now_comm", "libflight_recorder", "libheap_monitor",
+           "liblatency_probe", "libload_gen", "libprof", "libsys_monitor", "libtrace", "libwifi_manager",
+           "libsrc", "libmain"}
+
+KINDS = ["data", "bss", "noinit", "iram"]
+
+
+def classify(section):
+    """Map an input section name to a RAM kind, None for flash-only sections."""
+    if section.startswith((".noinit", ".rtc_noinit", ".rtc.bss")):
+        return "noinit"
+    if section.startswith((".bss", ".sbss", ".dram1.bss", "COMMON")):
+        return "bss"
+    if section.startswith((".data", ".sdata", ".dram1", ".rtc.data")):
+        return "data"
+    if section.startswith((".iram1", ".iram", ".text.iram")):
+        return "iram"
+    return None
+
+
+def parse(path):
+    usage = defaultdict(lambda: dict.fromkeys(KINDS, 0))
+    pending = None
+    in_discarded = False
+    with open(path, "r", encoding="utf-8", errors="replace") as f:
+        for line in f:
+            if line.startswith("Discarded input sections"):
+                in_discarded = True
+                continue
+            if line.startswith("Memory Configuration"):
+                in_discarded = False
+                continue
+            if in_discarded:
+                continue
+
+            size, obj = None, None
+            m = _SECTION.match(line.rstrip("\n"))
+            if m:
+                if m.group(2) is None:
+                    pending = m.group(1)
+                    continue
+                section, size, obj = m.group(1), int(m.group(3), 16), m.group(4)
+            elif pending:
+                c = _CONTINUATION.match(line.rstrip("\n"))
+                section, pending = pending, None
+                if not c:
+                    continue
+                size, obj = int(c.group(2), 16), c.group(3)
+            else:
+                continue
+
+            kind = classify(section)
+            if kind is None or size == 0:
+                continue
+            a = _ARCHIVE.search(obj.strip())
+            name = a.group(1) if a else "(objects)"
+            usage[name][kind] += size
+    return usage
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map file of a firmware build")
+    parser.add_argument("--all", action="store_true", help="list ESP-IDF components too")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.map):
+        sys.exit("map file not found: %s" % args.map)
+    usage = parse(args.map)
+    if not usage:
+        sys.exit("no RAM sections found in %s" % args.map)
+
+    rows = [(name, u) for name, u in usage.items() if args.all or name in PROJECT]
+    rows.sort(key=lambda r: -sum(r[1].values()))
+    print("%-24s %8s %8s %8s %8s %8s" % ("component", "data", "bss", "noinit", "iram", "total"))
+    totals = dict.fromkeys(KINDS, 0)
+    for name, u in rows:
+        for k in KINDS:
+            totals[k] += u[k]
+        print("%-24s %8d %8d %8d %8d %8d" % (name[3:] if name.startswith("lib") else name,
+                                              u["data"], u["bss"], u["noinit"], u["iram"], sum(u.values())))
+    print("%-24s %8d %8d %8d %8d %8d" % ("total", totals["data"], totals["bss"], totals["noinit"],
+                                          totals["iram"], sum(totals.values())))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
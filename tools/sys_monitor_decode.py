@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Decode system monitor telemetry (ESP_NOW_MSG_SYSMON_REPORT frames).
+
+The rover sends one report to all peers every SYS_MONITOR_PERIOD_MS. Capture the
+controller console (see espnow_frames.py for the expected line format) and feed
+it to this script:
+
+    tools/sys_monitor_decode.py controller.log
+    pio device monitor | tools/sys_monitor_decode.py -
+
+Prints every report: uptime, CPU and ISR load, heap, warnings and per-task
+CPU share and stack high-water mark.
+"""
+
+import argparse
+import sys
+
+from espnow_frames import iter_frames, u16, u32
+
+MSG_SYSMON_REPORT = 0xD6
+HEADER_LEN = 16
+TASK_LEN = 12
+WARNINGS = ["stack", "heap", "cpu", "isr"]
+
+
+def decode(payload):
+    """Decode one report payload (without the message byte)."""
+    if len(payload) < HEADER_LEN:
+        return None
+    report = {"uptime_s": u32(payload, 0), "heap_free": u32(payload, 4), "heap_min_free": u32(payload, 8),
+              "cpu_permille": u16(payload, 12), "isr_permille": payload[14] * 4,
+              "warnings": [w for i, w in enumerate(WARNINGS) if payload[15] & (1 << i)], "tasks": []}
+    for off in range(HEADER_LEN, len(payload) - TASK_LEN + 1, TASK_LEN):
+        name = payload[off:off + 8].split(b"\0", 1)[0].decode("ascii", errors="replace")
+        report["tasks"].append((name, u16(payload, off + 8), u16(payload, off + 10)))
+    return report
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="controller console capture, '-' for stdin")
+    args = parser.parse_args()
+
+    stream = sys.stdin if args.log == "-" else open(args.log, "r", encoding="utf-8", errors="replace")
+    reports = 0
+    for mac, frame in iter_frames(stream):
+        if not frame or frame[0] != MSG_SYSMON_REPORT:
+            continue
+        r = decode(frame[1:])
+        if not r:
+            continue
+        reports += 1
+        print("%s up %ds cpu %.1f%% isr ~%.1f%% heap free %d min %d%s" % (
+            mac or "?", r["uptime_s"], r["cpu_permille"] / 10.0, r["isr_permille"] / 10.0,
+            r["heap_free"], r["heap_min_free"],
+            "  WARN: " + ",".join(r["warnings"]) if r["warnings"] else ""))
+        for name, cpu, stack in r["tasks"]:
+            print("    %-8s cpu %5.1f%%  stack free min %5d" % (name, cpu / 10.0, stack))
+
+    if reports == 0:
+        sys.exit("no system monitor reports found")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Convert trace dumps from the rover console to Chrome trace JSON.
+
+Flash the trace build (pio run -e seeed_xiao_esp32c6_trace -t upload), capture the
+console and convert it:
+
+    pio device monitor -e seeed_xiao_esp32c6_trace | tee trace.log
+    tools/trace_to_chrome.py trace.log -o trace.json
+
+Open trace.json in chrome://tracing or https://ui.perfetto.dev. Every dump
+(TRACE_DUMP_BEGIN .. TRACE_DUMP_END) becomes one process, so consecutive windows
+can be told apart. Event names are read from components/trace/Include/trace.h.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+RECORD = struct.Struct("<IHBBI")
+TID_OTHER, TID_ISR = 0xFE, 0xFF
+TRACE_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "components",
+                            "trace", "Include", "trace.h")
+_EVENT_ENTRY = re.compile(r'^\s*X\(\s*(\w+)\s*,\s*"([^"]*)"\s*,\s*"([^"]*)"\s*\)')
+_BEGIN = re.compile(r"TRACE_DUMP_BEGIN,cpu_mhz=(\d+)")
+_TASK = re.compile(r"TRACE_TASK,(\d+),(.*?)\s*$")
+_DATA = re.compile(r"TRACE,([0-9A-Fa-f]+)\s*$")
+
+
+def load_events(path):
+    """Return [(name, category)] in ID order."""
+    events = []
+    with open(path, "r", encoding="utf-8") as header:
+        for line in header:
+            m = _EVENT_ENTRY.match(line)
+            if m:
+                events.append((m.group(2), m.group(3)))
+    return events
+
+
+def iter_dumps(stream):
+    """Yield (cpu_mhz, {tid: name}, [records]) for every complete dump."""
+    dump = None
+    for line in stream:
+        m = _BEGIN.search(line)
+        if m:
+            dump = (int(m.group(1)), {}, bytearray())
+            continue
+        if dump is None:
+            continue
+        m = _TASK.search(line)
+        if m:
+            dump[1][int(m.group(1))] = m.group(2)
+            continue
+        m = _DATA.search(line)
+        if m:
+            dump[2].extend(bytes.fromhex(m.group(1)))
+            continue
+        if "TRACE_DUMP_END" in line:
+            data = dump[2]
+            records = [RECORD.unpack_from(data, off) for off in range(0, len(data) - RECORD.size + 1, RECORD.size)]
+            yield dump[0], dump[1], records
+            dump = None
+
+
+def convert(dumps, events):
+    out = []
+    for pid, (mhz, tasks, records) in enumerate(dumps):
+        out.append({"ph": "M", "name": "process_name", "pid": pid, "tid": 0,
+                    "args": {"name": "dump %d" % pid}})
+        names = dict(tasks)
+        names[TID_OTHER], names[TID_ISR] = "other tasks", "ISR"
+        for tid, tname in names.items():
+            out.append({"ph": "M", "name": "thread_name", "pid": pid, "tid": tid, "args": {"name": tname}})
+
+        # The 32-bit cycle counter wraps every few seconds; records are in order, so unwrap as we go
+        base, last, ts0 = 0, None, None
+        for cycles, event, phase, tid, arg in records:
+            if last is not None and cycles < last and last - cycles > 0x80000000:
+                base += 1 << 32
+            last = cycles
+            abs_cycles = base + cycles
+            ts0 = abs_cycles if ts0 is None else ts0
+            name, cat = events[event] if event < len(events) else ("event_%d" % event, "?")
+            entry = {"name": name, "cat": cat, "ph": chr(phase), "pid": pid, "tid": tid,
+                     "ts": (abs_cycles - ts0) / float(mhz)}
+            if chr(phase) == "i":
+                entry["s"] = "t"
+                entry["args"] = {"arg": arg}
+            out.append(entry)
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", help="console capture, '-' for stdin")
+    parser.add_argument("-o", "--output", default="-", help="output JSON file (default: stdout)")
+    parser.add_argument("--events", default=TRACE_HEADER, help="path of trace.h")
+    args = parser.parse_args()
+
+    events = load_events(args.events)
+    stream = sys.stdin if args.log == "-" else open(args.log, "r", encoding="utf-8", errors="replace")
+    dumps = list(iter_dumps(stream))
+    if not dumps:
+        sys.exit("no trace dumps found")
+
+    trace = convert(dumps, events)
+    if args.output == "-":
+        json.dump(trace, sys.stdout)
+        sys.stdout.write("\n")
+    else:
+        with open(args.output, "w", encoding="utf-8") as out:
+            json.dump(trace, out)
+        print("%d dumps, %d events -> %s" % (len(dumps), len(trace["traceEvents"]), args.output), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())